@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "capture_arena.h"
+
+#ifndef MAP_POPULATE
+#define MAP_POPULATE 0
+#endif
+
+#define ARENA_ALIGN(x)	(((x) + 63) & ~((size_t) 63))	// keeps every buffer on its own cache lines
+
+int capture_arena_reserve (capture_arena *a, unsigned long num_of_words, unsigned int samples_per_echo) {
+	struct timespec t0, t1;
+	size_t words_size, samples_size, avr_size, size;
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t k;
+	void *base;
+
+	a->reserves++;
+	if (a->base != NULL && num_of_words <= a->max_words && samples_per_echo <= a->max_avr) {
+		return 1;
+	}
+
+	// never shrink: the next measurement of the session most likely has the same size
+	if (num_of_words < a->max_words)
+		num_of_words = a->max_words;
+	if (samples_per_echo < a->max_avr)
+		samples_per_echo = a->max_avr;
+
+	words_size = ARENA_ALIGN(num_of_words * sizeof(uint32_t));
+	samples_size = ARENA_ALIGN(num_of_words * 2 * sizeof(uint16_t));
+	avr_size = ARENA_ALIGN(samples_per_echo * sizeof(unsigned int));
+	size = (words_size + samples_size + avr_size + page - 1) / page * page;
+	if (size == 0)
+		size = page;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	capture_arena_free(a);
+	base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (base == MAP_FAILED) {
+		printf("ERROR: cannot map %lu bytes for the capture arena\n", (unsigned long) size);
+		return 0;
+	}
+	a->locked = (mlock(base, size) == 0); // needs root or a big enough RLIMIT_MEMLOCK, otherwise the pages are only pre-faulted
+	for (k = 0; k < size; k += page) { // touch every page in case MAP_POPULATE is not available
+		((volatile char *) base)[k] = 0;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	a->base = base;
+	a->size = size;
+	a->words = (uint32_t *) base;
+	a->max_words = num_of_words;
+	a->samples = (uint16_t *) ((char *) base + words_size);
+	a->max_samples = num_of_words * 2;
+	a->avr_data = (unsigned int *) ((char *) base + words_size + samples_size);
+	a->max_avr = samples_per_echo;
+
+	a->maps++;
+	a->map_ns += (uint64_t) (t1.tv_sec - t0.tv_sec) * 1000000000ULL + (t1.tv_nsec - t0.tv_nsec);
+	if (size > a->peak_size)
+		a->peak_size = size;
+	return 1;
+}
+
+void capture_arena_free (capture_arena *a) {
+	if (a->base == NULL) {
+		return;
+	}
+	if (a->locked)
+		munlock(a->base, a->size);
+	munmap(a->base, a->size);
+	a->base = NULL;
+	a->size = 0;
+	a->words = NULL;
+	a->max_words = 0;
+	a->samples = NULL;
+	a->max_samples = 0;
+	a->avr_data = NULL;
+	a->max_avr = 0;
+	a->locked = 0;
+}
+
+int capture_arena_relock (capture_arena *a) {
+	if (a->base != NULL && a->locked) {
+		a->locked = (mlock(a->base, a->size) == 0);
+	}
+	return a->locked;
+}
+
+void capture_arena_print_stat (const capture_arena *a) {
+	printf("capture arena: %lu KiB (peak %lu KiB, %s), %lu words, %u echo points, %lu reserves, %lu maps in %.3f ms, %lu dropped words\n",
+			(unsigned long) (a->size >> 10), (unsigned long) (a->peak_size >> 10), a->locked ? "locked" : "not locked",
+			a->max_words, a->max_avr, a->reserves, a->maps, (double) a->map_ns * 1e-6, a->dropped_words);
+}
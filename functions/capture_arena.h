@@ -0,0 +1,48 @@
+// Capture arena: the buffers of one scan (packed fifo words, 16-bit samples and the echo sum) in a single
+// mapping sized from the measurement instead of fixed worst-case globals. The mapping is locked and
+// pre-faulted when it is created, so the first scan does not pay for page faults, and it is reused as long
+// as the next scans fit. capture_arena_reserve is cheap when nothing has to grow, so it can be called
+// before every scan.
+
+#ifndef CAPTURE_ARENA_H_
+#define CAPTURE_ARENA_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct {
+	void *base;					// the mapping
+	size_t size;				// in bytes
+	uint32_t *words;			// packed fifo words
+	unsigned long max_words;
+	uint16_t *samples;			// unpacked samples, 2 per fifo word
+	unsigned long max_samples;
+	unsigned int *avr_data;		// echo sum
+	unsigned int max_avr;
+	int locked;					// mlock succeeded
+	// statistics
+	size_t peak_size;			// the largest mapping so far, in bytes
+	unsigned long reserves;		// calls of capture_arena_reserve
+	unsigned long maps;			// of which (re)created the mapping
+	uint64_t map_ns;			// time spent mapping, locking and pre-faulting
+	unsigned long dropped_words;	// words beyond max_words given to capture_arena_put
+} capture_arena;
+
+// make room for num_of_words fifo words (and their samples) and samples_per_echo sums. The content is
+// not kept when the mapping grows. Returns 0 if the memory cannot be mapped
+int capture_arena_reserve (capture_arena *a, unsigned long num_of_words, unsigned int samples_per_echo);
+void capture_arena_free (capture_arena *a);
+// lock a mapping that was locked again, after munlockall (rt_profile_leave) dropped it. Returns a->locked
+int capture_arena_relock (capture_arena *a);
+void capture_arena_print_stat (const capture_arena *a);
+
+// store fifo word k, the words that do not fit are read from the fifo anyway (and only counted)
+static inline void capture_arena_put (capture_arena *a, unsigned long k, uint32_t word) {
+	if (k < a->max_words) {
+		a->words[k] = word;
+	} else {
+		a->dropped_words++;
+	}
+}
+
+#endif
@@ -92,6 +92,18 @@ void cpmg_param_calculator_ltc1746 (
 	*(output+INIT_DELAY_ADC_OFFST) = init_adc_delay_int;
 }
 
+double cpmg_echo_centre_ltc1746 (
+	double adc_sampling_freq,	// adc sampling frequency
+	double shift_sampling_us,	// the same shift as given to cpmg_param_calculator_ltc1746
+	double pulse2_us,			// the length of cpmg 180 deg pulse
+	double echotime_us,			// the length between one echo to the other
+	unsigned int init_adc_delay	// output[INIT_DELAY_ADC_OFFST] of cpmg_param_calculator_ltc1746
+){
+	// cpmg_param_calculator_ltc1746 starts the capture total_sample/2 samples before the echo, which is expected at
+	// echotime_us/2 after the 180 deg pulse (plus the shift). The rounding of the delay moves the echo away from the middle
+	return ((echotime_us/2) - pulse2_us + shift_sampling_us)*adc_sampling_freq - (double)init_adc_delay;
+}
+
 void cpmg_param_calculator_manual (
 	unsigned int * output,		// cpmg parameter output
 	double nmr_fsm_clkfreq,		// nmr fsm operating frequency (in MHz)
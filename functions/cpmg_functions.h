@@ -28,6 +28,16 @@ void cpmg_param_calculator_ltc1746 (
 	unsigned int total_sample	// the total adc samples captured in one echo
 );
 
+// the position of the echo centre in the adc capture window (in samples, from the first sample) for the init_adc_delay computed
+// by cpmg_param_calculator_ltc1746. It is total_sample/2 apart from the rounding of init_adc_delay
+double cpmg_echo_centre_ltc1746 (
+	double adc_sampling_freq,	// adc sampling frequency
+	double shift_sampling_us,	// the same shift as given to cpmg_param_calculator_ltc1746
+	double pulse2_us,			// the length of cpmg 180 deg pulse
+	double echotime_us,			// the length between one echo to the other
+	unsigned int init_adc_delay	// output[INIT_DELAY_ADC_OFFST] of cpmg_param_calculator_ltc1746
+);
+
 void cpmg_param_calculator_manual (
 	unsigned int * output,		// cpmg parameter output
 	double nmr_fsm_clkfreq,		// nmr fsm operating frequency (in MHz)
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpmg_sweep.h"
+#include "cpmg_functions.h"
+
+int cpmg_sweep_init (cpmg_sweep *sw) {
+	memset(sw, 0, sizeof(cpmg_sweep));
+	sw->pt = malloc(CPMG_SWEEP_INIT_POINTS * sizeof(cpmg_sweep_point));
+	if (sw->pt == NULL) {
+		printf("ERROR: no memory for the sweep\n");
+		return 0;
+	}
+	sw->cap = CPMG_SWEEP_INIT_POINTS;
+	return 1;
+}
+
+void cpmg_sweep_free (cpmg_sweep *sw) {
+	free(sw->pt);
+	memset(sw, 0, sizeof(cpmg_sweep));
+}
+
+int cpmg_sweep_add (cpmg_sweep *sw, const cpmg_sweep_point *p) {
+	cpmg_sweep_point *pt;
+
+	if (sw->num == sw->cap) {
+		pt = realloc(sw->pt, 2 * sw->cap * sizeof(cpmg_sweep_point));
+		if (pt == NULL) {
+			printf("ERROR: no memory for %u sweep points\n", 2 * sw->cap);
+			return 0;
+		}
+		sw->pt = pt;
+		sw->cap *= 2;
+	}
+	pt = &sw->pt[sw->num];
+	*pt = *p;
+	pt->index = sw->num;
+	pt->done = 0;
+	pt->pll_programmed = 0;
+	pt->run_ms = 0;
+	pt->min_ms = 0;
+	sw->num++;
+	return 1;
+}
+
+int cpmg_sweep_grid (cpmg_sweep *sw, const cpmg_sweep_point *base, const double *freq, unsigned int n_freq,
+		const double *pulse1_us, unsigned int n_pulse1, const double *pulse2_us, unsigned int n_pulse2,
+		const double *echo_spacing_us, unsigned int n_echo_spacing) {
+	cpmg_sweep_point p = *base;
+	unsigned int f, p1, p2, e;
+
+	for (f = 0; f < (freq != NULL && n_freq > 0 ? n_freq : 1); f++) {
+		for (p1 = 0; p1 < (pulse1_us != NULL && n_pulse1 > 0 ? n_pulse1 : 1); p1++) {
+			for (p2 = 0; p2 < (pulse2_us != NULL && n_pulse2 > 0 ? n_pulse2 : 1); p2++) {
+				for (e = 0; e < (echo_spacing_us != NULL && n_echo_spacing > 0 ? n_echo_spacing : 1); e++) {
+					p.cpmg_freq = freq != NULL && n_freq > 0 ? freq[f] : base->cpmg_freq;
+					p.pulse1_us = pulse1_us != NULL && n_pulse1 > 0 ? pulse1_us[p1] : base->pulse1_us;
+					p.pulse2_us = pulse2_us != NULL && n_pulse2 > 0 ? pulse2_us[p2] : base->pulse2_us;
+					p.echo_spacing_us = echo_spacing_us != NULL && n_echo_spacing > 0 ? echo_spacing_us[e]
+							: base->echo_spacing_us;
+					if (!cpmg_sweep_add(sw, &p)) {
+						return 0;
+					}
+				}
+			}
+		}
+	}
+	return 1;
+}
+
+int cpmg_sweep_load (cpmg_sweep *sw, const char *path) {
+	FILE *f = fopen(path, "r");
+	char line[256];
+	cpmg_sweep_point p;
+	unsigned int line_num = 0;
+	int n = 0, fields;
+
+	if (f == NULL) {
+		printf("ERROR: cannot read the sweep points from %s\n", path);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f) != NULL) {
+		line_num++;
+		if (strchr(line, '#') != NULL) {
+			*strchr(line, '#') = 0;
+		}
+		memset(&p, 0, sizeof(p));
+		fields = sscanf(line, "%lf %lf %lf %lf %u %u %lf", &p.cpmg_freq, &p.pulse1_us, &p.pulse2_us,
+				&p.echo_spacing_us, &p.samples_per_echo, &p.echoes_per_scan, &p.init_adc_delay_compensation);
+		if (fields <= 0) { // an empty line or a comment
+			continue;
+		}
+		if (fields < 6) {
+			printf("WARNING: %s:%u has %d of the 6 parameters, the line is skipped\n", path, line_num, fields);
+			continue;
+		}
+		if (!cpmg_sweep_add(sw, &p)) {
+			break;
+		}
+		n++;
+	}
+	fclose(f);
+	return n;
+}
+
+// exact, as the nmr_pll_cache keys: a tolerance is not transitive and would break the qsort order
+static int same_clock (const cpmg_sweep_point *a, const cpmg_sweep_point *b) {
+	return a->cpmg_freq == b->cpmg_freq;
+}
+
+static int cmp_point (const void *a, const void *b) {
+	const cpmg_sweep_point *x = (const cpmg_sweep_point *) a;
+	const cpmg_sweep_point *y = (const cpmg_sweep_point *) b;
+
+	if (!same_clock(x, y)) {
+		return x->cpmg_freq < y->cpmg_freq ? -1 : 1;
+	}
+	return (x->index > y->index) - (x->index < y->index); // stable: the order given within one clock
+}
+
+unsigned int cpmg_sweep_clock_changes (const cpmg_sweep *sw) {
+	unsigned int k, changes = 0;
+
+	for (k = 1; k < sw->num; k++) {
+		changes += !same_clock(&sw->pt[k - 1], &sw->pt[k]);
+	}
+	return changes;
+}
+
+void cpmg_sweep_order (cpmg_sweep *sw) {
+	sw->clock_changes_given = cpmg_sweep_clock_changes(sw);
+	qsort(sw->pt, sw->num, sizeof(cpmg_sweep_point), cmp_point);
+}
+
+double cpmg_sweep_seq_us (const cpmg_sweep_point *p) {
+	double nmr_fsm_clkfreq = 16 * p->cpmg_freq;
+	unsigned int cpmg_param[5];
+
+	cpmg_param_calculator_ltc1746(cpmg_param, nmr_fsm_clkfreq, p->cpmg_freq, 4 * p->cpmg_freq,
+			p->init_adc_delay_compensation, p->pulse1_us, p->pulse2_us, p->echo_spacing_us, p->samples_per_echo);
+	return ((double) cpmg_param[PULSE1_OFFST] + cpmg_param[DELAY1_OFFST]
+			+ (double) p->echoes_per_scan * ((double) cpmg_param[PULSE2_OFFST] + cpmg_param[DELAY2_OFFST]))
+			/ nmr_fsm_clkfreq;
+}
+
+int cpmg_sweep_write_report (const cpmg_sweep *sw, const char *path) {
+	const cpmg_sweep_point *p;
+	FILE *f = fopen(path, "w");
+	unsigned int k;
+
+	if (f == NULL) {
+		printf("ERROR: cannot write %s\n", path);
+		return 0;
+	}
+	fprintf(f, "index,cpmg_freq,pulse1_us,pulse2_us,echo_spacing_us,samples_per_echo,echoes_per_scan,"
+			"init_adc_delay_compensation,done,pll_programmed,run_ms,min_ms,overhead_ms\n");
+	for (k = 0; k < sw->num; k++) {
+		p = &sw->pt[k];
+		fprintf(f, "%u,%.6f,%.3f,%.3f,%.3f,%u,%u,%.3f,%d,%d,%.3f,%.3f,%.3f\n", p->index, p->cpmg_freq,
+				p->pulse1_us, p->pulse2_us, p->echo_spacing_us, p->samples_per_echo, p->echoes_per_scan,
+				p->init_adc_delay_compensation, p->done, p->pll_programmed, p->run_ms, p->min_ms,
+				p->run_ms - p->min_ms);
+	}
+	fclose(f);
+	return 1;
+}
+
+void cpmg_sweep_print (const cpmg_sweep *sw) {
+	double run_ms = 0, min_ms = 0;
+	unsigned int k, programmed = 0, done = 0;
+
+	for (k = 0; k < sw->num; k++) {
+		run_ms += sw->pt[k].run_ms;
+		min_ms += sw->pt[k].min_ms;
+		programmed += sw->pt[k].pll_programmed;
+		done += sw->pt[k].done;
+	}
+	printf("cpmg sweep: %u/%u points in %.3f s (the sequences alone: %.3f s, %.1f ms set up per point), "
+			"pll reprogrammed %u times (%u clock changes in the order given)\n", done, sw->num, run_ms * 1e-3,
+			min_ms * 1e-3, done > 0 ? (run_ms - min_ms) / done : 0, programmed, sw->clock_changes_given);
+}
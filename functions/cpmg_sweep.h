@@ -0,0 +1,57 @@
+// CPMG parameter sweep: a list of CPMG_Sequence parameter tuples (read from a file, built as a grid, or added one by
+// one) that is measured in one process and into one session folder, instead of starting cpmg_iterate once per point.
+// cpmg_sweep_order puts the points with the same nmr fsm clock (16 * cpmg_freq) next to each other, in ascending
+// frequency and otherwise in the order given, so the nmr system PLL is reprogrammed once per frequency instead of at
+// every change of frequency in the list.
+// Every point keeps its measured time next to its physics-limited minimum: the sequences from the programmed counts
+// plus the scan spacing (or the scan period), so the report shows what the set up of every point costs.
+
+#ifndef CPMG_SWEEP_H_
+#define CPMG_SWEEP_H_
+
+#include <stdint.h>
+
+#define CPMG_SWEEP_INIT_POINTS	64
+
+typedef struct {
+	// the parameters, as for CPMG_Sequence
+	double cpmg_freq;
+	double pulse1_us;
+	double pulse2_us;
+	double echo_spacing_us;
+	unsigned int samples_per_echo;
+	unsigned int echoes_per_scan;
+	double init_adc_delay_compensation;
+	unsigned int index;				// the position in the list as given, the data folder of the point is named by it
+	// the result
+	int done;						// CPMG_measure ran the scans (0: skipped or aborted)
+	int pll_programmed;				// the nmr system PLL was reprogrammed for this point
+	double run_ms;					// the whole point: set up, scans, files
+	double min_ms;					// the sequences and the scan spacing only
+} cpmg_sweep_point;
+
+typedef struct {
+	cpmg_sweep_point *pt;
+	unsigned int num;
+	unsigned int cap;
+	unsigned int clock_changes_given;	// nmr fsm clock changes in the order given, set by cpmg_sweep_order
+} cpmg_sweep;
+
+int cpmg_sweep_init (cpmg_sweep *sw);	// returns 0 without memory
+void cpmg_sweep_free (cpmg_sweep *sw);
+int cpmg_sweep_add (cpmg_sweep *sw, const cpmg_sweep_point *p);	// the parameters of p, returns 0 without memory
+// every combination of the values given (n = 0 or a NULL list keeps the value of base), cpmg_freq varying slowest
+int cpmg_sweep_grid (cpmg_sweep *sw, const cpmg_sweep_point *base, const double *freq, unsigned int n_freq,
+		const double *pulse1_us, unsigned int n_pulse1, const double *pulse2_us, unsigned int n_pulse2,
+		const double *echo_spacing_us, unsigned int n_echo_spacing);
+// one point per line: cpmg_freq pulse1_us pulse2_us echo_spacing_us samples_per_echo echoes_per_scan
+// [init_adc_delay_compensation], '#' starts a comment. Returns the points read, -1 if the file cannot be read
+int cpmg_sweep_load (cpmg_sweep *sw, const char *path);
+void cpmg_sweep_order (cpmg_sweep *sw);
+unsigned int cpmg_sweep_clock_changes (const cpmg_sweep *sw);	// in the current order
+// the length of one sequence of p in us, from the counts the FPGA is programmed with
+double cpmg_sweep_seq_us (const cpmg_sweep_point *p);
+int cpmg_sweep_write_report (const cpmg_sweep *sw, const char *path);	// one CSV line per point, in the order measured
+void cpmg_sweep_print (const cpmg_sweep *sw);
+
+#endif
@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "dac_update.h"
+#include "avalon_spi.h"
+#include "sim_bus.h"
+
+#define DAC_FRAME_REG_MSK	(0x07<<19)
+#define DAC_FRAME_ADDR_MSK	(0x07<<16)
+
+static uint64_t dac_update_now_ns () {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+// the register ofst (in words) of the SPI core
+static volatile uint32_t * spi_reg (void *spi, uint32_t ofst) {
+	return (volatile uint32_t *) spi + ofst;
+}
+
+uint32_t dac_ad5722r_frame (uint32_t dac_addr, double volt, double full_scale) {
+	long code = lround(volt / full_scale * (1 << (DAC_AD5722R_BITS - 1)));
+
+	if (code > (1 << (DAC_AD5722R_BITS - 1)) - 1) {
+		code = (1 << (DAC_AD5722R_BITS - 1)) - 1;
+	}
+	if (code < -(1 << (DAC_AD5722R_BITS - 1))) {
+		code = -(1 << (DAC_AD5722R_BITS - 1));
+	}
+	return WR_DAC | DAC_REG | (dac_addr & DAC_FRAME_ADDR_MSK)
+			| (((uint32_t) code & ((1 << DAC_AD5722R_BITS) - 1)) << (16 - DAC_AD5722R_BITS));
+}
+
+double dac_ad5722r_volt (uint32_t frame, double full_scale) {
+	int32_t code = (int32_t) ((frame & 0xFFFF) >> (16 - DAC_AD5722R_BITS));
+
+	if (code & (1 << (DAC_AD5722R_BITS - 1))) {
+		code -= 1 << DAC_AD5722R_BITS;
+	}
+	return code * full_scale / (1 << (DAC_AD5722R_BITS - 1));
+}
+
+void dac_update_init (dac_update *d, void *spi, double full_scale) {
+	memset(d, 0, sizeof(dac_update));
+	d->spi = spi;
+	d->full_scale = full_scale;
+}
+
+int dac_update_stage_frame (dac_update *d, uint32_t frame) {
+	unsigned int k;
+
+	if ((frame & DAC_FRAME_REG_MSK) == DAC_REG) {
+		for (k = 0; k < d->num; k++) {
+			if ((d->frame[k] & (DAC_FRAME_REG_MSK | DAC_FRAME_ADDR_MSK)) == (frame & (DAC_FRAME_REG_MSK
+					| DAC_FRAME_ADDR_MSK))) {
+				d->frame[k] = frame;
+				return 1;
+			}
+		}
+	}
+	if (d->num == DAC_UPDATE_MAX_FRAMES) {
+		return 0;
+	}
+	d->frame[d->num++] = frame;
+	return 1;
+}
+
+int dac_update_stage (dac_update *d, uint32_t dac_addr, double volt) {
+	return dac_update_stage_frame(d, dac_ad5722r_frame(dac_addr, volt, d->full_scale));
+}
+
+// poll the SPI status until bit is set
+static int dac_update_poll (dac_update *d, uint32_t bit) {
+	unsigned long n;
+
+	for (n = 1; n <= DAC_SPI_POLL_MAX; n++) {
+		if (bus_read_word(spi_reg(d->spi, SPI_STATUS_offst)) & (1 << bit)) {
+			d->stat.polls += n;
+			return 1;
+		}
+	}
+	d->stat.polls += n - 1;
+	d->stat.timeouts++;
+	return 0;
+}
+
+int dac_update_shift (dac_update *d) {
+	uint64_t t_start, ns;
+	unsigned int k;
+	int ok = 1;
+
+	if (d->num == 0) {
+		return 1;
+	}
+	t_start = dac_update_now_ns();
+	for (k = 0; k < d->num && ok; k++) {
+		ok = dac_update_poll(d, status_TRDY_bit);
+		if (ok) {
+			bus_write_word(spi_reg(d->spi, SPI_TXDATA_offst), d->frame[k]);
+		}
+	}
+	if (ok) {
+		ok = dac_update_poll(d, status_TMT_bit);
+	}
+	if (!ok) {
+		printf("ERROR: the dac spi core did not take %u frames\n", d->num);
+	}
+	ns = dac_update_now_ns() - t_start;
+	d->stat.commits++;
+	d->stat.frames += k;
+	d->stat.total_ns += ns;
+	d->stat.last_ns = ns;
+	if (ns > d->stat.max_ns) {
+		d->stat.max_ns = ns;
+	}
+	d->num = 0;
+	return ok;
+}
+
+void dac_update_print (const dac_update *d) {
+	const dac_update_stat *s = &d->stat;
+
+	printf("dac: %lu updates of %.1f frames, %.1f us shifting per update (max %.1f us), %.1f status reads per "
+			"update, %lu timeouts\n", s->commits, s->commits > 0 ? (double) s->frames / s->commits : 0,
+			s->commits > 0 ? s->total_ns * 1e-3 / s->commits : 0, s->max_ns * 1e-3,
+			s->commits > 0 ? (double) s->polls / s->commits : 0, s->timeouts);
+}
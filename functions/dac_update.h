@@ -0,0 +1,49 @@
+// Coalesced AD5722R updates through the Avalon SPI core: the channels to change are staged as 24 bit frames and
+// shifted out back to back, TXDATA written as soon as TRDY says the holding register is free (the next frame waits
+// while the previous one shifts) and TMT polled once after the last one, without sleeping. The caller holds LDAC high
+// around dac_update_shift and releases it once, so every channel staged changes its output on the same edge and the
+// analog settling is waited for once per update instead of once per channel.
+// A frame is R/W (bit 23), the register (bits 21-19), the channel (bits 18-16) and the data (bits 15-0); the 12 bit
+// codes are two's complement for the bipolar ranges, left aligned in the data.
+
+#ifndef DAC_UPDATE_H_
+#define DAC_UPDATE_H_
+
+#include <stdint.h>
+#include "dac_ad5722r_driver.h"
+
+#define DAC_AD5722R_BITS		12
+#define DAC_UPDATE_MAX_FRAMES	4
+#define DAC_SPI_POLL_MAX		100000		// reads of the SPI status before a frame is given up (a frame is a few hundred)
+
+typedef struct {
+	unsigned long commits;			// dac_update_shift calls with frames
+	unsigned long frames;
+	unsigned long polls;			// SPI status reads
+	unsigned long timeouts;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint64_t last_ns;
+} dac_update_stat;
+
+typedef struct {
+	void *spi;						// the base of the SPI core
+	double full_scale;				// V, the output range is +-full_scale
+	uint32_t frame[DAC_UPDATE_MAX_FRAMES];
+	unsigned int num;
+	dac_update_stat stat;
+} dac_update;
+
+// the DAC register frame putting the channel dac_addr (DAC_A, DAC_B or DAC_AB) at volt, clamped to the range
+uint32_t dac_ad5722r_frame (uint32_t dac_addr, double volt, double full_scale);
+double dac_ad5722r_volt (uint32_t frame, double full_scale);	// the voltage a DAC register frame asks for
+void dac_update_init (dac_update *d, void *spi, double full_scale);
+// stage a frame; a DAC register frame replaces the one staged for the same channel. Returns 0 when full
+int dac_update_stage_frame (dac_update *d, uint32_t frame);
+int dac_update_stage (dac_update *d, uint32_t dac_addr, double volt);
+// shift the staged frames out back to back and wait for the last one to leave. Returns 0 on a timeout, the frames
+// are unstaged anyway
+int dac_update_shift (dac_update *d);
+void dac_update_print (const dac_update *d);
+
+#endif
@@ -0,0 +1,350 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "ddc.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define DDC_NEON
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#define DDC_SSE2
+#include <emmintrin.h>
+#endif
+
+int32_t ddc_dot (const int16_t *a, const int16_t *b, unsigned int n) {
+	unsigned int k = 0;
+	int32_t sum = 0;
+
+#if defined(DDC_NEON)
+	int32x4_t acc = vdupq_n_s32(0);
+	int16x8_t va, vb;
+	int32x2_t s2;
+
+	for (; k + 8 <= n; k += 8) {
+		va = vld1q_s16(a + k);
+		vb = vld1q_s16(b + k);
+		acc = vmlal_s16(acc, vget_low_s16(va), vget_low_s16(vb));
+		acc = vmlal_s16(acc, vget_high_s16(va), vget_high_s16(vb));
+	}
+	s2 = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+	sum = vget_lane_s32(vpadd_s32(s2, s2), 0);
+#elif defined(DDC_SSE2)
+	__m128i acc = _mm_setzero_si128();
+	int32_t lanes[4];
+
+	for (; k + 8 <= n; k += 8) {
+		acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_loadu_si128((const __m128i *) (a + k)),
+				_mm_loadu_si128((const __m128i *) (b + k))));
+	}
+	_mm_storeu_si128((__m128i *) lanes, acc);
+	sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+
+	for (; k < n; k++) {
+		sum += (int32_t) a[k] * b[k];
+	}
+	return sum;
+}
+
+static inline int16_t ddc_sat16 (int32_t x) {
+	return x > 32767 ? 32767 : (x < -32768 ? -32768 : (int16_t) x);
+}
+
+// y[m] = (sum h[k] * x[m*decim + k]) >> shift, rounded
+static void ddc_fir_decim (const int16_t *x, unsigned int out_len, const int16_t *h, unsigned int len,
+		unsigned int decim, unsigned int shift, int16_t *y) {
+	int32_t round = shift ? (1 << (shift - 1)) : 0;
+	unsigned int m;
+
+	for (m = 0; m < out_len; m++) {
+		y[m] = ddc_sat16((ddc_dot(x + (unsigned long) m * decim, h, len) + round) >> shift);
+	}
+}
+
+static unsigned int ddc_valid_len (unsigned int in_len, unsigned int taps, unsigned int decim) {
+	return in_len >= taps ? (in_len - taps) / decim + 1 : 0;
+}
+
+void ddc_default_config (ddc_config *cfg, unsigned int cic_decim, unsigned int fir_decim) {
+	memset(cfg, 0, sizeof(ddc_config));
+	cfg->cic_order = 3;
+	cfg->cic_decim = cic_decim;
+	cfg->fir_decim = fir_decim;
+	if (fir_decim > 1) { // pass band up to 80% of the output Nyquist frequency
+		cfg->fir_len = 31;
+		ddc_design_lowpass(cfg->fir_taps, cfg->fir_len, 0.4 / fir_decim);
+	}
+}
+
+int ddc_init (ddc *d, const ddc_config *cfg, unsigned int samples_per_echo, unsigned int echoes_per_scan) {
+	int32_t *poly;
+	int32_t *next;
+	unsigned int len, n, k, r;
+	double gain_log2;
+	long fir_abs = 0;
+
+	memset(d, 0, sizeof(ddc));
+	d->cfg = *cfg;
+	d->in_len = samples_per_echo;
+
+	if (cfg->cic_decim < 1 || cfg->fir_decim < 1 || cfg->fir_len > DDC_MAX_FIR_TAPS
+			|| (cfg->cic_decim > 1 && (cfg->cic_order < 1 || cfg->cic_order > 6))) {
+		printf("ERROR: ddc configuration not valid\n");
+		return 0;
+	}
+	gain_log2 = cfg->cic_decim > 1 ? cfg->cic_order * log2(cfg->cic_decim) : 0;
+	if (gain_log2 > DDC_MAX_CIC_GAIN_LOG2) {
+		printf("ERROR: ddc CIC gain %u^%u is too big\n", cfg->cic_decim, cfg->cic_order);
+		return 0;
+	}
+	for (k = 0; k < cfg->fir_len; k++) {
+		fir_abs += abs(cfg->fir_taps[k]);
+	}
+	if (fir_abs >= (1L << 18)) { // the CIC output is within +-2^13, so the sum stays within 31 bit
+		printf("ERROR: ddc FIR taps are too big\n");
+		return 0;
+	}
+
+	// the CIC impulse response: boxcar(R) convolved cic_order times, integer and symmetric
+	if (cfg->cic_decim > 1) {
+		d->cic_len = cfg->cic_order * (cfg->cic_decim - 1) + 1;
+		poly = (int32_t *) calloc(d->cic_len, sizeof(int32_t));
+		next = (int32_t *) calloc(d->cic_len, sizeof(int32_t));
+		d->cic_taps = (int16_t *) malloc(d->cic_len * sizeof(int16_t));
+		if (poly == NULL || next == NULL || d->cic_taps == NULL) {
+			free(poly);
+			free(next);
+			ddc_free(d);
+			return 0;
+		}
+		poly[0] = 1;
+		len = 1;
+		for (n = 0; n < cfg->cic_order; n++) {
+			memset(next, 0, d->cic_len * sizeof(int32_t));
+			for (k = 0; k < len; k++)
+				for (r = 0; r < cfg->cic_decim; r++)
+					next[k + r] += poly[k];
+			len += cfg->cic_decim - 1;
+			memcpy(poly, next, d->cic_len * sizeof(int32_t));
+		}
+		for (k = 0; k < d->cic_len; k++) {
+			if (poly[k] > 32767) {
+				printf("ERROR: ddc CIC tap %d does not fit into 16 bit\n", poly[k]);
+				free(poly);
+				free(next);
+				ddc_free(d);
+				return 0;
+			}
+			d->cic_taps[k] = (int16_t) poly[k];
+		}
+		free(poly);
+		free(next);
+		d->cic_shift = (unsigned int) ceil(gain_log2 - 1e-9);
+		d->out1_len = ddc_valid_len(samples_per_echo, d->cic_len, cfg->cic_decim);
+	} else {
+		d->out1_len = samples_per_echo;
+	}
+	d->out_len = cfg->fir_len > 0 ? ddc_valid_len(d->out1_len, cfg->fir_len, cfg->fir_decim) : d->out1_len;
+
+	d->mix_i = (int16_t *) malloc((samples_per_echo + 1) * sizeof(int16_t));
+	d->mix_q = (int16_t *) malloc((samples_per_echo + 1) * sizeof(int16_t));
+	d->stage1_i = (int16_t *) malloc((d->out1_len + 1) * sizeof(int16_t));
+	d->stage1_q = (int16_t *) malloc((d->out1_len + 1) * sizeof(int16_t));
+	d->echoes_per_scan = echoes_per_scan;
+	d->iq = (int16_t *) malloc(((unsigned long) echoes_per_scan * d->out_len + 1) * 2 * sizeof(int16_t));
+	if (d->mix_i == NULL || d->mix_q == NULL || d->stage1_i == NULL || d->stage1_q == NULL || d->iq == NULL) {
+		printf("ERROR: cannot allocate the ddc buffers\n");
+		ddc_free(d);
+		return 0;
+	}
+	return 1;
+}
+
+void ddc_free (ddc *d) {
+	free(d->cic_taps);
+	free(d->mix_i);
+	free(d->mix_q);
+	free(d->stage1_i);
+	free(d->stage1_q);
+	free(d->iq);
+	d->cic_taps = NULL;
+	d->mix_i = NULL;
+	d->mix_q = NULL;
+	d->stage1_i = NULL;
+	d->stage1_q = NULL;
+	d->iq = NULL;
+	d->in_len = 0;
+	d->out_len = 0;
+}
+
+// multiply by 1, -j, -1, j: I = x0, 0, -x2, 0, ... and Q = 0, -x1, 0, x3, ...
+static void ddc_mix (const uint16_t *samples, unsigned int n, int16_t *mix_i, int16_t *mix_q) {
+	unsigned int k = 0;
+
+#if defined(DDC_NEON)
+	const int16x8_t mid = vdupq_n_s16(DDC_ADC_MIDSCALE);
+	const int16_t ci[8] = { 1, 0, -1, 0, 1, 0, -1, 0 };
+	const int16_t cq[8] = { 0, -1, 0, 1, 0, -1, 0, 1 };
+	const int16x8_t vci = vld1q_s16(ci);
+	const int16x8_t vcq = vld1q_s16(cq);
+	int16x8_t x;
+
+	for (; k + 8 <= n; k += 8) {
+		x = vsubq_s16(vreinterpretq_s16_u16(vld1q_u16(samples + k)), mid);
+		vst1q_s16(mix_i + k, vmulq_s16(x, vci));
+		vst1q_s16(mix_q + k, vmulq_s16(x, vcq));
+	}
+#elif defined(DDC_SSE2)
+	const __m128i mid = _mm_set1_epi16(DDC_ADC_MIDSCALE);
+	const __m128i ci = _mm_setr_epi16(1, 0, -1, 0, 1, 0, -1, 0);
+	const __m128i cq = _mm_setr_epi16(0, -1, 0, 1, 0, -1, 0, 1);
+	__m128i x;
+
+	for (; k + 8 <= n; k += 8) {
+		x = _mm_sub_epi16(_mm_loadu_si128((const __m128i *) (samples + k)), mid);
+		_mm_storeu_si128((__m128i *) (mix_i + k), _mm_mullo_epi16(x, ci));
+		_mm_storeu_si128((__m128i *) (mix_q + k), _mm_mullo_epi16(x, cq));
+	}
+#endif
+
+	for (; k < n; k++) {
+		int16_t x1 = (int16_t) (samples[k] - DDC_ADC_MIDSCALE);
+		switch (k & 3) {
+		case 0: mix_i[k] = x1; mix_q[k] = 0; break;
+		case 1: mix_i[k] = 0; mix_q[k] = -x1; break;
+		case 2: mix_i[k] = -x1; mix_q[k] = 0; break;
+		default: mix_i[k] = 0; mix_q[k] = x1; break;
+		}
+	}
+}
+
+void ddc_run (ddc *d, const uint16_t *samples, unsigned long num_of_echoes, int16_t *iq) {
+	const int16_t *s1_i, *s1_q;
+	unsigned long e;
+	unsigned int m;
+	int16_t *out_i = d->stage1_i;	// reused for the final outputs before they are interleaved
+	int16_t *out_q = d->stage1_q;
+
+	for (e = 0; e < num_of_echoes; e++) {
+		ddc_mix(samples + e * d->in_len, d->in_len, d->mix_i, d->mix_q);
+
+		if (d->cic_taps != NULL) {
+			ddc_fir_decim(d->mix_i, d->out1_len, d->cic_taps, d->cic_len, d->cfg.cic_decim, d->cic_shift, d->stage1_i);
+			ddc_fir_decim(d->mix_q, d->out1_len, d->cic_taps, d->cic_len, d->cfg.cic_decim, d->cic_shift, d->stage1_q);
+			s1_i = d->stage1_i;
+			s1_q = d->stage1_q;
+		} else {
+			s1_i = d->mix_i;
+			s1_q = d->mix_q;
+		}
+
+		if (d->cfg.fir_len > 0) { // the outputs are fewer than the inputs, so they can be written over the mix buffers
+			ddc_fir_decim(s1_i, d->out_len, d->cfg.fir_taps, d->cfg.fir_len, d->cfg.fir_decim, 15, d->mix_i);
+			ddc_fir_decim(s1_q, d->out_len, d->cfg.fir_taps, d->cfg.fir_len, d->cfg.fir_decim, 15, d->mix_q);
+			out_i = d->mix_i;
+			out_q = d->mix_q;
+		} else {
+			out_i = (int16_t *) s1_i;
+			out_q = (int16_t *) s1_q;
+		}
+
+		for (m = 0; m < d->out_len; m++) {
+			iq[(e * d->out_len + m) * 2] = out_i[m];
+			iq[(e * d->out_len + m) * 2 + 1] = out_q[m];
+		}
+	}
+}
+
+double ddc_gain (const ddc *d) {
+	double gain = 1;
+
+	if (d->cic_taps != NULL) {
+		gain = pow(d->cfg.cic_decim, d->cfg.cic_order) / ldexp(1, d->cic_shift);
+	}
+	return gain;
+}
+
+void ddc_reference (const ddc *d, const uint16_t *samples, double *iq) {
+	const double c_i[4] = { 1, 0, -1, 0 };
+	const double c_q[4] = { 0, -1, 0, 1 };
+	double *mix_i = (double *) malloc(d->in_len * sizeof(double));
+	double *mix_q = (double *) malloc(d->in_len * sizeof(double));
+	double *s1_i = (double *) malloc((d->out1_len + 1) * sizeof(double));
+	double *s1_q = (double *) malloc((d->out1_len + 1) * sizeof(double));
+	double cic_gain = d->cic_taps != NULL ? pow(d->cfg.cic_decim, d->cfg.cic_order) : 1;
+	double acc_i, acc_q;
+	unsigned int k, m;
+
+	for (k = 0; k < d->in_len; k++) {
+		mix_i[k] = ((double) samples[k] - DDC_ADC_MIDSCALE) * c_i[k & 3];
+		mix_q[k] = ((double) samples[k] - DDC_ADC_MIDSCALE) * c_q[k & 3];
+	}
+	for (m = 0; m < d->out1_len; m++) {
+		if (d->cic_taps == NULL) {
+			s1_i[m] = mix_i[m];
+			s1_q[m] = mix_q[m];
+			continue;
+		}
+		acc_i = 0;
+		acc_q = 0;
+		for (k = 0; k < d->cic_len; k++) {
+			acc_i += d->cic_taps[k] * mix_i[m * d->cfg.cic_decim + k];
+			acc_q += d->cic_taps[k] * mix_q[m * d->cfg.cic_decim + k];
+		}
+		s1_i[m] = acc_i / cic_gain;
+		s1_q[m] = acc_q / cic_gain;
+	}
+	for (m = 0; m < d->out_len; m++) {
+		if (d->cfg.fir_len == 0) {
+			iq[m * 2] = s1_i[m];
+			iq[m * 2 + 1] = s1_q[m];
+			continue;
+		}
+		acc_i = 0;
+		acc_q = 0;
+		for (k = 0; k < d->cfg.fir_len; k++) {
+			acc_i += d->cfg.fir_taps[k] / 32768.0 * s1_i[m * d->cfg.fir_decim + k];
+			acc_q += d->cfg.fir_taps[k] / 32768.0 * s1_q[m * d->cfg.fir_decim + k];
+		}
+		iq[m * 2] = acc_i;
+		iq[m * 2 + 1] = acc_q;
+	}
+	free(mix_i);
+	free(mix_q);
+	free(s1_i);
+	free(s1_q);
+}
+
+void ddc_design_lowpass (int16_t *taps, unsigned int len, double cutoff) {
+	double h[DDC_MAX_FIR_TAPS];
+	double sum = 0, x;
+	long isum = 0;
+	unsigned int k;
+
+	if (len == 0 || len > DDC_MAX_FIR_TAPS) {
+		return;
+	}
+	for (k = 0; k < len; k++) {
+		x = k - (len - 1) / 2.0;
+		h[k] = (x == 0 ? 2 * cutoff : sin(2 * M_PI * cutoff * x) / (M_PI * x));
+		if (len > 1)
+			h[k] *= 0.54 - 0.46 * cos(2 * M_PI * k / (len - 1));
+		sum += h[k];
+	}
+	for (k = 0; k < len; k++) {
+		taps[k] = (int16_t) lround(h[k] / sum * 32768);
+		isum += taps[k];
+	}
+	taps[(len - 1) / 2] += (int16_t) (32768 - isum); // exactly unity at DC after rounding
+}
+
+const char * ddc_impl () {
+#if defined(DDC_NEON)
+	return "neon";
+#elif defined(DDC_SSE2)
+	return "sse2";
+#else
+	return "scalar";
+#endif
+}
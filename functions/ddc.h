@@ -0,0 +1,60 @@
+// Digital downconversion of the ADC samples to complex baseband.
+// The ADC runs at exactly 4 * cpmg_freq, so the local oscillator e^(-j*pi/2*n) is the sequence
+// 1, -j, -1, j: I takes the even samples with alternating sign and Q the odd ones, no multiplier is needed.
+// The I and Q streams are then decimated by a CIC filter of order cic_order and rate cic_decim (run as
+// its equivalent integer FIR, so the stages share one multiply-accumulate kernel) followed by an optional
+// Q15 FIR of rate fir_decim. The echoes are separate acquisition windows, so every echo is filtered on
+// its own and only the outputs that are fully inside the window are produced.
+// The dot products use NEON when compiled with -mfpu=neon, SSE2 on x86, plain C otherwise.
+
+#ifndef DDC_H_
+#define DDC_H_
+
+#include <stdint.h>
+
+#define DDC_ADC_MIDSCALE	8192	// the ADC code of 0 V
+#define DDC_MAX_FIR_TAPS	128
+#define DDC_MAX_CIC_GAIN_LOG2	18	// cic_decim^cic_order must stay below 2^18 so the 32-bit sums cannot overflow
+
+typedef struct {
+	unsigned int cic_order;			// 1 to 6
+	unsigned int cic_decim;			// 1 skips the CIC
+	unsigned int fir_decim;			// decimation of the FIR stage
+	unsigned int fir_len;			// 0 skips the FIR
+	int16_t fir_taps[DDC_MAX_FIR_TAPS];	// Q15, sum about 32768 for unity gain
+} ddc_config;
+
+typedef struct {
+	ddc_config cfg;
+	unsigned int in_len;			// samples per echo
+	int16_t *cic_taps;				// the CIC as FIR: boxcar(cic_decim) convolved cic_order times
+	unsigned int cic_len;
+	unsigned int cic_shift;			// the CIC output is scaled down by 2^cic_shift
+	unsigned int out1_len;			// CIC outputs per echo
+	unsigned int out_len;			// I/Q outputs per echo
+	int16_t *mix_i;					// work buffers
+	int16_t *mix_q;
+	int16_t *stage1_i;
+	int16_t *stage1_q;
+	unsigned int echoes_per_scan;
+	int16_t *iq;					// the output of a whole scan, echoes_per_scan * out_len I/Q pairs
+} ddc;
+
+// CIC of order 3 and rate cic_decim followed by a 31 tap lowpass of rate fir_decim (no FIR if fir_decim is 1)
+void ddc_default_config (ddc_config *cfg, unsigned int cic_decim, unsigned int fir_decim);
+// set up the filter chain for scans of echoes_per_scan echoes of samples_per_echo samples. Returns 0 if the configuration is not valid
+int ddc_init (ddc *d, const ddc_config *cfg, unsigned int samples_per_echo, unsigned int echoes_per_scan);
+void ddc_free (ddc *d);
+// downconvert and decimate num_of_echoes echoes of in_len samples to out_len interleaved I/Q pairs each (iq can be d->iq)
+void ddc_run (ddc *d, const uint16_t *samples, unsigned long num_of_echoes, int16_t *iq);
+// the gain of the integer chain relative to ddc_reference
+double ddc_gain (const ddc *d);
+// the same chain of one echo in double precision, without rounding or scaling (for the accuracy test)
+void ddc_reference (const ddc *d, const uint16_t *samples, double *iq);
+// Hamming windowed sinc lowpass in Q15 with unity DC gain, cutoff relative to the FIR input rate (0 to 0.5)
+void ddc_design_lowpass (int16_t *taps, unsigned int len, double cutoff);
+// sum of a[k] * b[k] in 32 bit, the caller makes sure it cannot overflow (also used by echo_integ.h)
+int32_t ddc_dot (const int16_t *a, const int16_t *b, unsigned int n);
+const char * ddc_impl ();	// the name of the dot product path
+
+#endif
@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+#include "dma_capture.h"
+#include "avalon_dma.h"
+#include "sim_bus.h"
+
+void dma_capture_init (dma_capture *dma, volatile unsigned int *dma_addr) {
+	dma->dma_addr = dma_addr;
+	dma->length = 0;
+	dma->status = 0;
+	dma->busy = 0;
+	dma->polls = 0;
+}
+
+void dma_capture_start (dma_capture *dma, uint32_t read_addr, uint32_t write_addr, uint32_t num_of_words) {
+	bus_write_word(dma->dma_addr+DMA_CONTROL_OFST,	DMA_CTRL_SWRST_MSK);	// write twice to do software reset
+	bus_write_word(dma->dma_addr+DMA_CONTROL_OFST,	DMA_CTRL_SWRST_MSK);	// software resetted
+	bus_write_word(dma->dma_addr+DMA_STATUS_OFST,	0x0);					// clear the DONE bit
+	bus_write_word(dma->dma_addr+DMA_READADDR_OFST,	read_addr);				// set DMA read address
+	bus_write_word(dma->dma_addr+DMA_WRITEADDR_OFST,	write_addr);			// set DMA write address
+	bus_write_word(dma->dma_addr+DMA_LENGTH_OFST,	num_of_words*4);		// set transfer length (in byte, so multiply by 4 to get word-addressing)
+	bus_write_word(dma->dma_addr+DMA_CONTROL_OFST,	(DMA_CTRL_WORD_MSK|DMA_CTRL_LEEN_MSK|DMA_CTRL_RCON_MSK)); // set settings for transfer
+	bus_write_word(dma->dma_addr+DMA_CONTROL_OFST,	(DMA_CTRL_WORD_MSK|DMA_CTRL_LEEN_MSK|DMA_CTRL_RCON_MSK|DMA_CTRL_GO_MSK)); // set settings & also enable transfer
+
+	dma->length = num_of_words*4;
+	dma->busy = 1;
+	dma->polls = 0;
+}
+
+int dma_capture_poll (dma_capture *dma) {
+	if (!dma->busy) {
+		return DMA_CAPTURE_DONE;
+	}
+	dma->status = bus_read_word(dma->dma_addr+DMA_STATUS_OFST);
+	dma->polls++;
+	if ((dma->status & DMA_STAT_DONE_MSK) && !(dma->status & DMA_STAT_BUSY_MSK)) { // 'DONE' bit is '1' and 'BUSY' bit is '0'
+		bus_write_word(dma->dma_addr+DMA_CONTROL_OFST, (DMA_CTRL_WORD_MSK|DMA_CTRL_LEEN_MSK|DMA_CTRL_RCON_MSK)); // deassert GO while idle
+		bus_write_word(dma->dma_addr+DMA_STATUS_OFST, 0x0); // clear the DONE bit
+		dma->busy = 0;
+		return DMA_CAPTURE_DONE;
+	}
+	return DMA_CAPTURE_BUSY;
+}
+
+int dma_capture_wait (dma_capture *dma, long timeout_us) {
+	struct timespec t_start, t_now;
+
+	clock_gettime(CLOCK_MONOTONIC, &t_start);
+	while (dma_capture_poll(dma) == DMA_CAPTURE_BUSY) {
+		if (timeout_us >= 0) {
+			clock_gettime(CLOCK_MONOTONIC, &t_now);
+			if ((t_now.tv_sec - t_start.tv_sec) * 1000000L + (t_now.tv_nsec - t_start.tv_nsec) / 1000L > timeout_us) {
+				return DMA_CAPTURE_TIMEOUT;
+			}
+		}
+		usleep(10); // wait time to prevent overloading the DMA bus arbitration request
+	}
+	return DMA_CAPTURE_DONE;
+}
+
+void dma_capture_print_status (dma_capture *dma) {
+	printf("\tstatus reg: 0x%x (%lu polls)\n", dma->status, dma->polls);
+	if (!(dma->status & DMA_STAT_DONE_MSK)) {
+		printf("\tDMA transaction is not done.\n");
+	}
+	if (dma->status & DMA_STAT_BUSY_MSK) {
+		printf("\tDMA is busy.\n");
+	}
+	if (dma->status & DMA_STAT_REOP_MSK) {
+		printf("\tDMA transaction completed due to end-of-packet on read side.\n");
+	}
+	if (dma->status & DMA_STAT_WEOP_MSK) {
+		printf("\tDMA transaction completed due to end-of-packet on write side.\n");
+	}
+	if (dma->status & DMA_STAT_LEN_MSK) {
+		printf("\tDMA transaction completed due to length-register decrements to 0.\n");
+	}
+}
@@ -0,0 +1,34 @@
+// Asynchronous FIFO to SDRAM capture with the avalon DMA (register map in avalon_dma.h).
+// dma_capture_start programs the transfer and returns immediately, so the CPU can process the
+// previous scan while the next one is transferred. Completion is checked with dma_capture_poll
+// or waited for with dma_capture_wait.
+
+#ifndef DMA_CAPTURE_H_
+#define DMA_CAPTURE_H_
+
+#include <stdint.h>
+
+#define DMA_CAPTURE_BUSY		0
+#define DMA_CAPTURE_DONE		1
+#define DMA_CAPTURE_TIMEOUT		-1
+
+typedef struct {
+	volatile unsigned int *dma_addr;	// DMA control/status registers
+	uint32_t length;					// length of the current transfer in bytes
+	uint32_t status;					// the last status register value
+	int busy;							// a transfer is started and not yet completed
+	unsigned long polls;				// status polls of the current transfer
+} dma_capture;
+
+void dma_capture_init (dma_capture *dma, volatile unsigned int *dma_addr);
+void dma_capture_start (
+	dma_capture *dma,
+	uint32_t read_addr,		// source address seen by the DMA read master (the fifo data port, read from a constant address)
+	uint32_t write_addr,	// destination address seen by the DMA write master
+	uint32_t num_of_words	// the amount of 32-bit words to transfer
+);
+int dma_capture_poll (dma_capture *dma);						// DMA_CAPTURE_DONE or DMA_CAPTURE_BUSY
+int dma_capture_wait (dma_capture *dma, long timeout_us);		// DMA_CAPTURE_DONE or DMA_CAPTURE_TIMEOUT. Negative timeout waits forever
+void dma_capture_print_status (dma_capture *dma);
+
+#endif
@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <string.h>
+#include "dma_emulator.h"
+#include "avalon_dma.h"
+#include "sim_bus.h"
+
+void dma_emu_init (dma_emu *emu, double rate) {
+	memset(emu, 0, sizeof(dma_emu));
+	emu->rate = rate;
+}
+
+int dma_emu_map_window (dma_emu *emu, uint32_t base, uint32_t span, void *host) {
+	if (emu->num_of_window >= DMA_EMU_MAX_WINDOW) {
+		printf("ERROR: dma_emu window table is full\n");
+		return 0;
+	}
+	emu->window[emu->num_of_window].base = base;
+	emu->window[emu->num_of_window].span = span;
+	emu->window[emu->num_of_window].host = (char *) host;
+	emu->num_of_window++;
+	return 1;
+}
+
+static void * dma_emu_host (dma_emu *emu, uint32_t addr);
+
+// the fifo offers a word to the DMA
+static int dma_emu_sink (void *ctx, uint32_t word) {
+	dma_emu *emu = (dma_emu *) ctx;
+	void *dst;
+
+	if (!(emu->control & DMA_CTRL_GO_MSK) || !(emu->status & DMA_STAT_BUSY_MSK) || emu->length == 0) {
+		return 0;
+	}
+	dst = dma_emu_host(emu, emu->writeaddress);
+	if (dst == NULL) {
+		return 0;
+	}
+	bus_write_word(dst, word);
+	if (!(emu->control & DMA_CTRL_WCON_MSK))
+		emu->writeaddress += 4;
+	emu->length -= 4;
+	emu->moved++;
+	if (emu->length == 0 && (emu->control & DMA_CTRL_LEEN_MSK)) {
+		emu->status &= ~DMA_STAT_BUSY_MSK;
+		emu->status |= DMA_STAT_DONE_MSK | DMA_STAT_LEN_MSK;
+	}
+	return 1;
+}
+
+void dma_emu_set_source_fifo (dma_emu *emu, fifo_emu *fifo) {
+	emu->src_fifo = fifo;
+	fifo_emu_set_sink(fifo, dma_emu_sink, emu);
+}
+
+static void * dma_emu_host (dma_emu *emu, uint32_t addr) {
+	unsigned int k;
+
+	for (k = 0; k < emu->num_of_window; k++) {
+		if (addr >= emu->window[k].base && addr - emu->window[k].base < emu->window[k].span) {
+			return emu->window[k].host + (addr - emu->window[k].base);
+		}
+	}
+	emu->bad_addr++;
+	return NULL;
+}
+
+// move the words the DMA could have moved since GO
+static void dma_emu_advance (dma_emu *emu) {
+	struct timespec now;
+	uint64_t budget;
+	uint64_t n;
+	void *src;
+	void *dst;
+
+	if (!(emu->control & DMA_CTRL_GO_MSK) || !(emu->status & DMA_STAT_BUSY_MSK)) {
+		return;
+	}
+
+	if (emu->src_fifo != NULL) {
+		fifo_emu_update(emu->src_fifo); // the fifo hands its words to dma_emu_sink
+		return;
+	}
+
+	n = emu->length >> 2;
+	if (emu->rate > 0) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		budget = (uint64_t) (((double) (now.tv_sec - emu->t_go.tv_sec)
+				+ (double) (now.tv_nsec - emu->t_go.tv_nsec) * 1e-9) * emu->rate);
+		budget = budget > emu->moved ? budget - emu->moved : 0;
+		if (n > budget)
+			n = budget;
+	}
+
+	for (; n > 0; n--) {
+		src = dma_emu_host(emu, emu->readaddress);
+		dst = dma_emu_host(emu, emu->writeaddress);
+		if (src == NULL || dst == NULL) {
+			break;
+		}
+		bus_write_word(dst, bus_read_word(src));
+		if (!(emu->control & DMA_CTRL_RCON_MSK))
+			emu->readaddress += 4;
+		if (!(emu->control & DMA_CTRL_WCON_MSK))
+			emu->writeaddress += 4;
+		emu->length -= 4;
+		emu->moved++;
+	}
+
+	if (emu->length == 0 && (emu->control & DMA_CTRL_LEEN_MSK)) {
+		emu->status &= ~DMA_STAT_BUSY_MSK;
+		emu->status |= DMA_STAT_DONE_MSK | DMA_STAT_LEN_MSK;
+	}
+}
+
+static uint32_t dma_emu_rd (void *ctx, uint32_t ofst) {
+	dma_emu *emu = (dma_emu *) ctx;
+
+	switch (ofst >> 2) {
+		case DMA_STATUS_OFST:		dma_emu_advance(emu); return emu->status;
+		case DMA_READADDR_OFST:		return emu->readaddress;
+		case DMA_WRITEADDR_OFST:	return emu->writeaddress;
+		case DMA_LENGTH_OFST:		return emu->length;
+		case DMA_CONTROL_OFST:		return emu->control;
+		default:					return 0;
+	}
+}
+
+static void dma_emu_wr (void *ctx, uint32_t ofst, uint32_t val) {
+	dma_emu *emu = (dma_emu *) ctx;
+
+	if ((ofst >> 2) != DMA_CONTROL_OFST) {
+		emu->swrst_cnt = 0;
+	}
+	switch (ofst >> 2) {
+		case DMA_STATUS_OFST:		emu->status &= ~(DMA_STAT_DONE_MSK | DMA_STAT_REOP_MSK | DMA_STAT_WEOP_MSK | DMA_STAT_LEN_MSK); break; // any write clears DONE
+		case DMA_READADDR_OFST:		emu->readaddress = val; break;
+		case DMA_WRITEADDR_OFST:	emu->writeaddress = val; break;
+		case DMA_LENGTH_OFST:		emu->length = val; break;
+		case DMA_CONTROL_OFST:
+			if (val & DMA_CTRL_SWRST_MSK) {
+				if (++emu->swrst_cnt == 2) {
+					emu->status = 0;
+					emu->control = 0;
+					emu->length = 0;
+					emu->swrst_cnt = 0;
+				}
+				break;
+			}
+			emu->swrst_cnt = 0;
+			if ((val & DMA_CTRL_GO_MSK) && !(emu->control & DMA_CTRL_GO_MSK) && emu->length > 0) {
+				emu->status |= DMA_STAT_BUSY_MSK;
+				emu->moved = 0;
+				clock_gettime(CLOCK_MONOTONIC, &emu->t_go);
+			}
+			emu->control = val;
+			if (emu->src_fifo != NULL) {
+				fifo_emu_update(emu->src_fifo); // take what is already waiting in the fifo
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+void dma_emu_attach (dma_emu *emu, void *dma_addr) {
+	sim_bus_map(dma_addr, 32, dma_emu_rd, dma_emu_wr, emu);
+}
@@ -0,0 +1,44 @@
+// Register-level model of the avalon DMA (avalon_dma.h) on the sim_bus.
+// With an emulated fifo as the source, the DMA takes every word the moment the fifo produces it
+// (the fifo read slave stalls the DMA while it is empty), so the fifo does not overflow while the
+// CPU is busy with something else. Other sources are copied whenever the status register is polled,
+// limited by a configurable bandwidth. DMA master addresses are translated to host pointers through
+// windows registered with dma_emu_map_window.
+
+#ifndef DMA_EMULATOR_H_
+#define DMA_EMULATOR_H_
+
+#include <stdint.h>
+#include <time.h>
+#include "fifo_emulator.h"
+
+#define DMA_EMU_MAX_WINDOW	4
+
+typedef struct {
+	uint32_t base;	// base address seen by the DMA masters
+	uint32_t span;
+	char *host;		// the corresponding host address
+} dma_emu_window;
+
+typedef struct {
+	uint32_t status;
+	uint32_t readaddress;
+	uint32_t writeaddress;
+	uint32_t length;
+	uint32_t control;
+	uint32_t swrst_cnt;			// the DMA resets on the second consecutive SWRST write
+	double rate;				// bandwidth in words per second, 0 is unlimited
+	uint64_t moved;				// words moved in the current transfer
+	struct timespec t_go;
+	fifo_emu *src_fifo;			// the emulated fifo behind the read address, NULL if the source is memory
+	dma_emu_window window[DMA_EMU_MAX_WINDOW];
+	unsigned int num_of_window;
+	unsigned long bad_addr;		// accesses outside of every window
+} dma_emu;
+
+void dma_emu_init (dma_emu *emu, double rate);
+int dma_emu_map_window (dma_emu *emu, uint32_t base, uint32_t span, void *host);
+void dma_emu_set_source_fifo (dma_emu *emu, fifo_emu *fifo);
+void dma_emu_attach (dma_emu *emu, void *dma_addr);
+
+#endif
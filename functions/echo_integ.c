@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "ddc.h"
+#include "echo_integ.h"
+
+static const int osc_i[4] = { 1, 0, -1, 0 }; // e^(-j*pi/2*k), as in ddc.c
+static const int osc_q[4] = { 0, -1, 0, 1 };
+
+// the weight of window sample k (0 to len-1), not normalized
+static double echo_integ_weight (const echo_integ *ei, unsigned int k) {
+	double x;
+
+	switch (ei->cfg.window) {
+	case ECHO_INTEG_HANN:
+		return 0.5 - 0.5 * cos(2 * M_PI * (k + 1) / (ei->len + 1));
+	case ECHO_INTEG_GAUSS:
+		x = (k - (ei->len - 1) / 2.0) / (ei->len / 6.0);
+		return exp(-0.5 * x * x);
+	case ECHO_INTEG_CUSTOM:
+		return ei->cfg.custom[k];
+	default:
+		return 1;
+	}
+}
+
+int echo_integ_init (echo_integ *ei, const echo_integ_config *cfg, unsigned int samples_per_echo,
+		unsigned int echoes_per_scan, double centre) {
+	double w_sum = 0, w_abs_sum = 0;
+	double start;
+	unsigned int k, clamped = 0;
+	long q, q_sum = 0;
+
+	memset(ei, 0, sizeof(echo_integ));
+	ei->cfg = *cfg;
+
+	if (cfg->window > ECHO_INTEG_CUSTOM || samples_per_echo == 0
+			|| (cfg->window == ECHO_INTEG_CUSTOM && (cfg->custom == NULL || cfg->custom_len == 0))) {
+		printf("ERROR: echo integration window not valid\n");
+		return 0;
+	}
+	ei->len = cfg->window == ECHO_INTEG_CUSTOM ? cfg->custom_len : cfg->width;
+	if (ei->len == 0 || ei->len > samples_per_echo) {
+		if (cfg->window == ECHO_INTEG_CUSTOM) {
+			printf("ERROR: %u custom weights do not fit into an echo of %u samples\n", ei->len, samples_per_echo);
+			return 0;
+		}
+		ei->len = samples_per_echo;
+	}
+	ei->centre = centre + cfg->centre_shift;
+	start = floor(ei->centre - ei->len / 2.0 + 0.5);
+	if (start < 0 || start + ei->len > samples_per_echo) {
+		if (ei->len < samples_per_echo) { // a window over the whole echo cannot be centred
+			printf("WARNING: the integration window (%u samples at %.1f) is outside of the echo and is moved inside\n",
+					ei->len, start);
+		}
+		start = start < 0 ? 0 : samples_per_echo - ei->len;
+	}
+	ei->start = (unsigned int) start;
+
+	for (k = 0; k < ei->len; k++) {
+		w_sum += echo_integ_weight(ei, k);
+		w_abs_sum += fabs(echo_integ_weight(ei, k));
+	}
+	if (w_sum <= 0) {
+		printf("ERROR: the integration weights do not sum up to a positive value\n");
+		return 0;
+	}
+
+	ei->samples_per_echo = samples_per_echo;
+	ei->echoes_per_scan = echoes_per_scan;
+	ei->w_i = (int16_t *) malloc(ei->len * sizeof(int16_t));
+	ei->w_q = (int16_t *) malloc(ei->len * sizeof(int16_t));
+	ei->iq = (int32_t *) malloc(((unsigned long) echoes_per_scan + 1) * 2 * sizeof(int32_t));
+	if (ei->w_i == NULL || ei->w_q == NULL || ei->iq == NULL) {
+		printf("ERROR: cannot allocate the echo integration buffers\n");
+		echo_integ_free(ei);
+		return 0;
+	}
+
+	// the oscillator phase counts from the first sample of the echo, the same for every echo as the capture starts on the same phase.
+	// Normalized on the sum of |w|: with negative lobes the sum of w is smaller and would let the dot product overflow
+	for (k = 0; k < ei->len; k++) {
+		q = lround(echo_integ_weight(ei, k) / w_abs_sum * ECHO_INTEG_WEIGHT_SUM);
+		if (q > 32767 || q < -32767) {
+			q = q > 0 ? 32767 : -32767;
+			clamped++;
+		}
+		q_sum += q;
+		ei->w_i[k] = (int16_t) (q * osc_i[(ei->start + k) & 3]);
+		ei->w_q[k] = (int16_t) (q * osc_q[(ei->start + k) & 3]);
+		ei->bias_i += DDC_ADC_MIDSCALE * ei->w_i[k];
+		ei->bias_q += DDC_ADC_MIDSCALE * ei->w_q[k];
+	}
+	if (clamped > 0) {
+		printf("WARNING: %u integration weights are clamped to 16 bit, the window is distorted\n", clamped);
+	}
+	if (q_sum <= 0) {
+		printf("ERROR: the integration weights are too small to be quantized\n");
+		echo_integ_free(ei);
+		return 0;
+	}
+	// a cosine of amplitude A puts A/2 into the weighted mean of the mixed samples
+	ei->scale = 2.0 * (1 << ECHO_INTEG_FRAC_BITS) / q_sum;
+	return 1;
+}
+
+void echo_integ_free (echo_integ *ei) {
+	free(ei->w_i);
+	free(ei->w_q);
+	free(ei->iq);
+	ei->w_i = NULL;
+	ei->w_q = NULL;
+	ei->iq = NULL;
+	ei->samples_per_echo = 0;
+}
+
+void echo_integ_run (const echo_integ *ei, const uint16_t *samples, unsigned long num_of_echoes, int32_t *iq) {
+	const int16_t *window;
+	unsigned long e;
+
+	for (e = 0; e < num_of_echoes; e++) {
+		window = (const int16_t *) samples + e * ei->samples_per_echo + ei->start; // 14-bit samples, the same as int16_t
+		iq[e * 2] = (int32_t) lround((ddc_dot(window, ei->w_i, ei->len) - ei->bias_i) * ei->scale);
+		iq[e * 2 + 1] = (int32_t) lround((ddc_dot(window, ei->w_q, ei->len) - ei->bias_q) * ei->scale);
+	}
+}
+
+void echo_integ_reference (const echo_integ *ei, const uint16_t *samples, double *iq) {
+	double w_sum = 0, acc_i = 0, acc_q = 0, w, x;
+	unsigned int k, n;
+
+	for (k = 0; k < ei->len; k++) {
+		n = ei->start + k;
+		w = echo_integ_weight(ei, k);
+		x = (double) samples[n] - DDC_ADC_MIDSCALE;
+		w_sum += w;
+		acc_i += w * x * osc_i[n & 3];
+		acc_q += w * x * osc_q[n & 3];
+	}
+	iq[0] = 2 * acc_i / w_sum * (1 << ECHO_INTEG_FRAC_BITS);
+	iq[1] = 2 * acc_q / w_sum * (1 << ECHO_INTEG_FRAC_BITS);
+}
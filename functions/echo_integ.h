@@ -0,0 +1,56 @@
+// Echo integration: one complex amplitude per echo instead of all the samples of the echo.
+// Every echo is weighted with a window placed on the echo centre (cpmg_echo_centre_ltc1746) and demodulated with
+// the same fs/4 oscillator as ddc.h, so a scan reduces to an echoes_per_scan long I/Q decay vector.
+// The window is a box, a Hann window, a Gaussian (the matched filter of a Gaussian echo) or given by the caller,
+// e.g. the envelope of a measured echo for a matched filter. The weights times the oscillator are quantized to
+// 16 bit once, so every echo is two integer dot products (ddc_dot, NEON or SSE2).
+// The outputs are the echo amplitude in units of 2^-ECHO_INTEG_FRAC_BITS ADC LSB: a cosine of amplitude A in phase
+// with the oscillator gives I = A * 2^ECHO_INTEG_FRAC_BITS and Q = 0.
+
+#ifndef ECHO_INTEG_H_
+#define ECHO_INTEG_H_
+
+#include <stdint.h>
+
+// window
+#define ECHO_INTEG_BOX		0
+#define ECHO_INTEG_HANN		1
+#define ECHO_INTEG_GAUSS	2	// sigma is 1/6 of the width
+#define ECHO_INTEG_CUSTOM	3	// the weights in custom
+
+#define ECHO_INTEG_FRAC_BITS	4
+#define ECHO_INTEG_WEIGHT_SUM	65536	// the |quantized weights| sum up to about this, so a dot product of 14-bit samples stays below 2^31
+
+typedef struct {
+	unsigned int window;		// ECHO_INTEG_BOX, _HANN, _GAUSS or _CUSTOM
+	unsigned int width;			// samples, 0 or more than samples_per_echo takes the whole echo (ignored for ECHO_INTEG_CUSTOM)
+	double centre_shift;		// samples, moves the window away from the computed echo centre
+	const double *custom;		// ECHO_INTEG_CUSTOM: custom_len weights, centred on the echo
+	unsigned int custom_len;
+} echo_integ_config;
+
+typedef struct {
+	echo_integ_config cfg;
+	unsigned int samples_per_echo;
+	unsigned int echoes_per_scan;
+	double centre;				// the echo centre used for the window, in samples from the start of the echo
+	unsigned int start;			// the first sample of the window
+	unsigned int len;			// the samples in the window
+	int16_t *w_i;				// quantized weights times the oscillator
+	int16_t *w_q;
+	int32_t bias_i;				// the midscale part of the dot products
+	int32_t bias_q;
+	double scale;				// from the dot product to the output unit
+	int32_t *iq;				// the output of a whole scan, echoes_per_scan I/Q pairs
+} echo_integ;
+
+// set up the window for echoes of samples_per_echo samples with their centre at centre. Returns 0 if it is not valid
+int echo_integ_init (echo_integ *ei, const echo_integ_config *cfg, unsigned int samples_per_echo,
+		unsigned int echoes_per_scan, double centre);
+void echo_integ_free (echo_integ *ei);
+// integrate num_of_echoes echoes of samples_per_echo samples to one I/Q pair each (iq can be ei->iq)
+void echo_integ_run (const echo_integ *ei, const uint16_t *samples, unsigned long num_of_echoes, int32_t *iq);
+// one echo with the unquantized weights in double precision, in the output unit (for the accuracy test)
+void echo_integ_reference (const echo_integ *ei, const uint16_t *samples, double *iq);
+
+#endif
@@ -0,0 +1,138 @@
+#include <stddef.h>
+#include "echo_unpack.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define ECHO_UNPACK_NEON
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#define ECHO_UNPACK_SSE2
+#include <emmintrin.h>
+#else
+#define ECHO_UNPACK_SCALAR
+#endif
+
+void echo_unpack_sum_scalar (const uint32_t *fifo_words, unsigned long num_of_words,
+		unsigned int samples_per_echo, uint16_t *samples, unsigned int *avr_data) {
+	unsigned long num_of_echoes = ((unsigned long) num_of_words * 2) / samples_per_echo;
+	unsigned long echo = 0;
+	unsigned long w;
+	unsigned int pos = 0; // sample position within the echo
+	unsigned int sample;
+	uint32_t fifo_word;
+
+	for (w = 0; w < num_of_words; w++) {
+		fifo_word = fifo_words[w];
+
+		sample = fifo_word & ADC_SAMPLE_MASK;
+		if (samples != NULL)
+			samples[w * 2] = sample;
+		if (echo < num_of_echoes)
+			avr_data[pos] += sample;
+		if (++pos == samples_per_echo) {
+			pos = 0;
+			echo++;
+		}
+
+		sample = (fifo_word >> 16) & ADC_SAMPLE_MASK;
+		if (samples != NULL)
+			samples[w * 2 + 1] = sample;
+		if (echo < num_of_echoes)
+			avr_data[pos] += sample;
+		if (++pos == samples_per_echo) {
+			pos = 0;
+			echo++;
+		}
+	}
+}
+
+#ifndef ECHO_UNPACK_SCALAR
+// one echo: the n samples from sample first on, masked, stored to dst (if not NULL) and added to avr_data
+static void echo_sum_vect (const uint32_t *fifo_words, unsigned long first, unsigned int n, uint16_t *dst,
+		unsigned int *avr_data) {
+	const uint32_t *src;
+	unsigned int k = 0;
+
+	if (n > 0 && (first & 1)) { // the echo starts in the upper half of a word
+		avr_data[0] += fifo_sample_at(fifo_words, first);
+		if (dst != NULL)
+			dst[0] = fifo_sample_at(fifo_words, first);
+		k = 1;
+	}
+	src = fifo_words + ((first + k) >> 1); // word aligned from sample k on: 8 samples are 4 words
+
+#if defined(ECHO_UNPACK_NEON)
+	const uint32x4_t mask = vdupq_n_u32(ADC_SAMPLE_MASK);
+	uint32x4_t w, lo, hi;
+	uint32x4x2_t acc;
+	uint16x4x2_t s;
+
+	for (; k + 8 <= n; k += 8, src += 4) {
+		w = vld1q_u32(src);
+		lo = vandq_u32(w, mask);				// samples k, k+2, k+4, k+6
+		hi = vandq_u32(vshrq_n_u32(w, 16), mask);	// samples k+1, k+3, k+5, k+7
+		if (dst != NULL) {
+			s.val[0] = vmovn_u32(lo);
+			s.val[1] = vmovn_u32(hi);
+			vst2_u16(dst + k, s);				// interleaved back into sample order
+		}
+		acc = vld2q_u32(avr_data + k);
+		acc.val[0] = vaddq_u32(acc.val[0], lo);
+		acc.val[1] = vaddq_u32(acc.val[1], hi);
+		vst2q_u32(avr_data + k, acc);
+	}
+#elif defined(ECHO_UNPACK_SSE2)
+	const __m128i mask = _mm_set1_epi32(ADC_SAMPLE_MASK);
+	__m128i w, lo, hi, s0, s1;
+
+	for (; k + 8 <= n; k += 8, src += 4) {
+		w = _mm_loadu_si128((const __m128i *) src);
+		lo = _mm_and_si128(w, mask);						// samples k, k+2, k+4, k+6
+		hi = _mm_and_si128(_mm_srli_epi32(w, 16), mask);	// samples k+1, k+3, k+5, k+7
+		s0 = _mm_unpacklo_epi32(lo, hi);					// samples k to k+3
+		s1 = _mm_unpackhi_epi32(lo, hi);					// samples k+4 to k+7
+		if (dst != NULL)
+			_mm_storeu_si128((__m128i *) (dst + k), _mm_packs_epi32(s0, s1)); // 14 bit, no saturation
+		_mm_storeu_si128((__m128i *) (avr_data + k), _mm_add_epi32(_mm_loadu_si128((const __m128i *) (avr_data + k)), s0));
+		_mm_storeu_si128((__m128i *) (avr_data + k + 4), _mm_add_epi32(_mm_loadu_si128((const __m128i *) (avr_data + k + 4)), s1));
+	}
+#endif
+
+	for (; k < n; k++) { // the samples that do not fill a whole vector
+		if (dst != NULL)
+			dst[k] = fifo_sample_at(fifo_words, first + k);
+		avr_data[k] += fifo_sample_at(fifo_words, first + k);
+	}
+}
+#endif
+
+void echo_unpack_sum (const uint32_t *fifo_words, unsigned long num_of_words,
+		unsigned int samples_per_echo, uint16_t *samples, unsigned int *avr_data) {
+#ifdef ECHO_UNPACK_SCALAR
+	echo_unpack_sum_scalar(fifo_words, num_of_words, samples_per_echo, samples, avr_data);
+#else
+	unsigned long num_of_samples = (unsigned long) num_of_words * 2;
+	unsigned long num_of_echoes = num_of_samples / samples_per_echo;
+	unsigned long e;
+	unsigned long k;
+
+	for (e = 0; e < num_of_echoes; e++) {
+		echo_sum_vect(fifo_words, e * samples_per_echo, samples_per_echo,
+				samples != NULL ? samples + e * samples_per_echo : NULL, avr_data);
+	}
+	if (samples != NULL) { // partial echo at the end
+		for (k = num_of_echoes * samples_per_echo; k < num_of_samples; k++) {
+			samples[k] = fifo_sample_at(fifo_words, k);
+		}
+	}
+#endif
+}
+
+const char * echo_unpack_impl () {
+#if defined(ECHO_UNPACK_NEON)
+	return "neon";
+#elif defined(ECHO_UNPACK_SSE2)
+	return "sse2";
+#else
+	return "scalar";
+#endif
+}
@@ -0,0 +1,34 @@
+// Unpacking of the ADC FIFO words and echo averaging in a single sweep.
+// Every 32-bit fifo word holds 2 samples (lower half first), each with 14 significant bits. The vector
+// paths load 4 words at a time and take the even samples with a mask and the odd ones with a shift and a
+// mask, then interleave them back into sample order for the stores and the echo sum; the words are only
+// read as uint32_t, so neither the byte order nor the aliasing rules matter. An echo starting in the upper
+// half of a word takes its first sample alone.
+// The NEON path is used when compiled with -mfpu=neon, the SSE2 path on x86, the scalar one otherwise.
+
+#ifndef ECHO_UNPACK_H_
+#define ECHO_UNPACK_H_
+
+#include <stdint.h>
+
+#define ADC_SAMPLE_MASK		0x3FFF	// 14 significant bit
+#define fifo_sample_at(fifo_words, k)	(((fifo_words)[(k) >> 1] >> (((k) & 1) * 16)) & ADC_SAMPLE_MASK)	// sample k of the packed words
+
+// unpack num_of_words fifo words to samples (can be NULL if only the average is needed) and add echo
+// sample k to avr_data[k]. avr_data is not cleared, so it can accumulate several scans.
+// A partial echo at the end is unpacked but not summed
+void echo_unpack_sum (
+	const uint32_t *fifo_words,		// packed fifo words
+	unsigned long num_of_words,		// the amount of fifo words (2 samples per word)
+	unsigned int samples_per_echo,
+	uint16_t *samples,				// the unpacked samples (2*num_of_words), NULL to skip
+	unsigned int *avr_data			// the echo sum (samples_per_echo)
+);
+
+// the plain C version of echo_unpack_sum, also the reference for the vector paths
+void echo_unpack_sum_scalar (const uint32_t *fifo_words, unsigned long num_of_words,
+		unsigned int samples_per_echo, uint16_t *samples, unsigned int *avr_data);
+
+const char * echo_unpack_impl ();	// the name of the path used by echo_unpack_sum
+
+#endif
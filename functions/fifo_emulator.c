@@ -0,0 +1,268 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "fifo_emulator.h"
+#include "sim_bus.h"
+#include "general.h"
+#include "AlteraIP/altera_avalon_fifo_regs.h"
+
+uint32_t fifo_emu_ramp (void *ctx, uint64_t word_idx) {
+	return (uint32_t) (((word_idx * 2) & 0x3FFF) | (((word_idx * 2 + 1) & 0x3FFF) << 16));
+}
+
+int fifo_emu_echo_shape (const fifo_emu_echo_sig *sig, unsigned int pos) {
+	int a = sig->amplitude;
+	int x = (int) (2 * (uint64_t) pos * sig->amplitude / sig->samples_per_echo) - a;
+
+	return a - (x < 0 ? -x : x);
+}
+
+uint32_t fifo_emu_echo (void *ctx, uint64_t word_idx) {
+	const fifo_emu_echo_sig *sig = (const fifo_emu_echo_sig *) ctx;
+	uint32_t word = 0;
+	int shape;
+	int k;
+
+	for (k = 0; k < 2; k++) {
+		shape = fifo_emu_echo_shape(sig, (unsigned int) ((word_idx * 2 + k) % sig->samples_per_echo));
+		word |= (uint32_t) ((sig->offset + (sig->negate ? -shape : shape)) & 0x3FFF) << (16 * k);
+	}
+	return word;
+}
+
+int fifo_emu_init (fifo_emu *emu, uint32_t depth, double rate) {
+	memset(emu, 0, sizeof(fifo_emu));
+	emu->mem = (uint32_t *) malloc(depth * sizeof(uint32_t));
+	if (emu->mem == NULL) {
+		printf("ERROR: fifo_emu cannot allocate %u words\n", depth);
+		return 0;
+	}
+	emu->depth = depth;
+	emu->rate = rate;
+	emu->almostfull = depth;
+	emu->gen = fifo_emu_ramp;
+	return 1;
+}
+
+void fifo_emu_free (fifo_emu *emu) {
+	free(emu->mem);
+	emu->mem = NULL;
+}
+
+void fifo_emu_set_gen (fifo_emu *emu, fifo_emu_gen_fn gen, void *gen_ctx) {
+	emu->gen = gen;
+	emu->gen_ctx = gen_ctx;
+}
+
+void fifo_emu_set_sink (fifo_emu *emu, fifo_emu_sink_fn sink, void *sink_ctx) {
+	emu->sink = sink;
+	emu->sink_ctx = sink_ctx;
+}
+
+void fifo_emu_set_step (fifo_emu *emu, double step) {
+	emu->step = step;
+}
+
+void fifo_emu_reset (fifo_emu *emu) {
+	emu->level = 0;
+	emu->rd_ptr = 0;
+	emu->wr_ptr = 0;
+	emu->event = 0;
+	emu->running = 0;
+}
+
+void fifo_emu_start (fifo_emu *emu, uint64_t total_words) {
+	emu->total_words = total_words;
+	emu->produced = 0;
+	emu->consumed = 0;
+	emu->dropped = 0;
+	emu->underflow = 0;
+	emu->ticks = 0;
+	emu->running = 1;
+	clock_gettime(CLOCK_MONOTONIC, &emu->t_start);
+}
+
+void fifo_emu_update (fifo_emu *emu) {
+	struct timespec now;
+	uint64_t target;
+	uint32_t word;
+
+	// a DMA drains the fifo as fast as the words arrive, so hand it what is queued first
+	while (emu->sink != NULL && emu->level > 0 && emu->sink(emu->sink_ctx, emu->mem[emu->rd_ptr])) {
+		emu->rd_ptr = (emu->rd_ptr + 1) % emu->depth;
+		emu->level--;
+		emu->consumed++;
+	}
+
+	if (!emu->running) {
+		return;
+	}
+	if (emu->step > 0) {
+		emu->ticks++;
+		target = (uint64_t) (emu->ticks * emu->step);
+	} else {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		target = (uint64_t) (((double) (now.tv_sec - emu->t_start.tv_sec)
+				+ (double) (now.tv_nsec - emu->t_start.tv_nsec) * 1e-9) * emu->rate);
+	}
+	if (target >= emu->total_words) {
+		target = emu->total_words;
+		emu->running = 0;
+	}
+
+	for (; emu->produced < target; emu->produced++) {
+		word = emu->gen(emu->gen_ctx, emu->produced);
+		if (emu->level == 0 && emu->sink != NULL && emu->sink(emu->sink_ctx, word)) {
+			emu->consumed++;
+			continue;
+		}
+		if (emu->level == emu->depth) {
+			emu->dropped++;
+			emu->event |= ALTERA_AVALON_FIFO_EVENT_OVF_MSK;
+			continue;
+		}
+		emu->mem[emu->wr_ptr] = word;
+		emu->wr_ptr = (emu->wr_ptr + 1) % emu->depth;
+		emu->level++;
+	}
+	if (emu->level == emu->depth) {
+		emu->event |= ALTERA_AVALON_FIFO_EVENT_F_MSK;
+	}
+	if (emu->level >= emu->almostfull) {
+		emu->event |= ALTERA_AVALON_FIFO_EVENT_AF_MSK;
+	}
+}
+
+int fifo_emu_running (fifo_emu *emu) {
+	fifo_emu_update(emu);
+	return emu->running;
+}
+
+static uint32_t fifo_emu_status (fifo_emu *emu) {
+	uint32_t status = 0;
+
+	if (emu->level == emu->depth)
+		status |= ALTERA_AVALON_FIFO_STATUS_F_MSK;
+	if (emu->level == 0)
+		status |= ALTERA_AVALON_FIFO_STATUS_E_MSK;
+	if (emu->level >= emu->almostfull)
+		status |= ALTERA_AVALON_FIFO_STATUS_AF_MSK;
+	if (emu->level <= emu->almostempty)
+		status |= ALTERA_AVALON_FIFO_STATUS_AE_MSK;
+	return status | (emu->event & (ALTERA_AVALON_FIFO_STATUS_OVF_MSK | ALTERA_AVALON_FIFO_STATUS_UDF_MSK));
+}
+
+static uint32_t fifo_emu_data_rd (void *ctx, uint32_t ofst) {
+	fifo_emu *emu = (fifo_emu *) ctx;
+	uint32_t data;
+
+	if (ofst != ALTERA_AVALON_FIFO_DATA_REG * 4) {
+		return 0;	// other info
+	}
+	fifo_emu_update(emu);
+	if (emu->level == 0) {
+		emu->underflow++;
+		emu->event |= ALTERA_AVALON_FIFO_EVENT_UDF_MSK;
+		return 0;
+	}
+	data = emu->mem[emu->rd_ptr];
+	emu->rd_ptr = (emu->rd_ptr + 1) % emu->depth;
+	emu->level--;
+	emu->consumed++;
+	if (emu->level == 0) {
+		emu->event |= ALTERA_AVALON_FIFO_EVENT_E_MSK;
+	}
+	return data;
+}
+
+static uint32_t fifo_emu_csr_rd (void *ctx, uint32_t ofst) {
+	fifo_emu *emu = (fifo_emu *) ctx;
+
+	fifo_emu_update(emu);
+	switch (ofst >> 2) {
+		case ALTERA_AVALON_FIFO_LEVEL_REG:			return emu->level;
+		case ALTERA_AVALON_FIFO_STATUS_REG:			return fifo_emu_status(emu);
+		case ALTERA_AVALON_FIFO_EVENT_REG:			return emu->event;
+		case ALTERA_AVALON_FIFO_IENABLE_REG:		return emu->ienable;
+		case ALTERA_AVALON_FIFO_ALMOSTFULL_REG:		return emu->almostfull;
+		case ALTERA_AVALON_FIFO_ALMOSTEMPTY_REG:	return emu->almostempty;
+		default:									return 0;
+	}
+}
+
+static void fifo_emu_csr_wr (void *ctx, uint32_t ofst, uint32_t val) {
+	fifo_emu *emu = (fifo_emu *) ctx;
+
+	switch (ofst >> 2) {
+		case ALTERA_AVALON_FIFO_EVENT_REG:			emu->event &= ~val; break;	// write 1 to clear
+		case ALTERA_AVALON_FIFO_IENABLE_REG:		emu->ienable = val; break;
+		case ALTERA_AVALON_FIFO_ALMOSTFULL_REG:		emu->almostfull = val; break;
+		case ALTERA_AVALON_FIFO_ALMOSTEMPTY_REG:	emu->almostempty = val; break;
+		default:									break;
+	}
+}
+
+static uint32_t fifo_emu_ctrl_in_rd (void *ctx, uint32_t ofst) {
+	return fifo_emu_running((fifo_emu *) ctx) ? (0x01 << NMR_SEQ_run_ofst) : 0;
+}
+
+void fifo_emu_attach (fifo_emu *emu, void *data_addr, void *csr_addr, void *ctrl_in_addr) {
+	sim_bus_map(data_addr, 8, fifo_emu_data_rd, NULL, emu);
+	sim_bus_map(csr_addr, 32, fifo_emu_csr_rd, fifo_emu_csr_wr, emu);
+	if (ctrl_in_addr != NULL) {
+		sim_bus_map(ctrl_in_addr, 16, fifo_emu_ctrl_in_rd, NULL, emu);
+	}
+}
+
+static void *fifo_emu_irq_thread (void *arg) {
+	fifo_emu_irq *irq = (fifo_emu_irq *) arg;
+	fifo_emu *emu = irq->emu;
+	struct timespec now, tick = { 0, FIFO_EMU_IRQ_TICK_US * 1000 };
+	uint64_t produced, level, one = 1;
+	int raised = 0;
+
+	while (!irq->stop) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		produced = (uint64_t) (((double) (now.tv_sec - emu->t_start.tv_sec)
+				+ (double) (now.tv_nsec - emu->t_start.tv_nsec) * 1e-9) * emu->rate);
+		if (produced > emu->total_words) {
+			produced = emu->total_words;
+		}
+		level = produced - __atomic_load_n(&emu->consumed, __ATOMIC_RELAXED);
+		level -= __atomic_load_n(&emu->dropped, __ATOMIC_RELAXED);
+		if ((int64_t) level < emu->almostfull) {
+			raised = 0;
+		} else if (!raised && (emu->ienable & ALTERA_AVALON_FIFO_IENABLE_AF_MSK)) {
+			if (write(irq->fd, &one, sizeof(one)) == sizeof(one)) {
+				irq->irqs++;
+			}
+			raised = 1;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, 0, &tick, NULL);
+	}
+	return NULL;
+}
+
+int fifo_emu_irq_start (fifo_emu_irq *irq, fifo_emu *emu) {
+	memset(irq, 0, sizeof(fifo_emu_irq));
+	irq->emu = emu;
+	irq->fd = eventfd(0, 0);
+	if (irq->fd < 0) {
+		printf("ERROR: fifo_emu_irq cannot create the eventfd\n");
+		return 0;
+	}
+	if (pthread_create(&irq->thread, NULL, fifo_emu_irq_thread, irq) != 0) {
+		printf("ERROR: fifo_emu_irq cannot start its thread\n");
+		close(irq->fd);
+		return 0;
+	}
+	return 1;
+}
+
+void fifo_emu_irq_stop (fifo_emu_irq *irq) {
+	irq->stop = 1;
+	pthread_join(irq->thread, NULL);
+	close(irq->fd);
+}
@@ -0,0 +1,88 @@
+// Emulated ADC FIFO (altera_avalon_fifo with avalon-mm read slave and csr, as in adc_fifo_mem).
+// The fifo is filled at a configurable rate from the moment fifo_emu_start is called, until
+// total_words are produced. The rate is in words per second of the wall clock, or with fifo_emu_set_step in words per
+// access to the fifo (data port, csr or ctrl_in): the fill then only advances with the reader, so a run does not
+// depend on the scheduler and gives the same result every time. Words that do not fit into the fifo are dropped and flagged with the
+// overflow event, the same way the ADC data is lost when the HPS drains the fifo too late.
+// The data port, the csr and optionally the ctrl_in register (NMR_SEQ_run bit) are attached to the sim_bus.
+// fifo_emu_irq adds the fifo interrupt as a fake UIO device (an eventfd) for fifo_event.
+
+#ifndef FIFO_EMULATOR_H_
+#define FIFO_EMULATOR_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+typedef uint32_t (*fifo_emu_gen_fn) (void *ctx, uint64_t word_idx); // generates the fifo word with index word_idx (counted from the start)
+typedef int (*fifo_emu_sink_fn) (void *ctx, uint32_t word); // a master draining the fifo on its own (DMA). Returns 0 when it does not take the word
+
+typedef struct {
+	uint32_t depth;				// fifo depth in words
+	double rate;				// fill rate in words per second
+	double step;				// words per access to the fifo, 0: the fill follows the wall clock
+	uint64_t ticks;				// accesses since fifo_emu_start, the clock of the fill with step
+	uint64_t total_words;		// the amount of words produced by one run
+	uint64_t produced;			// words produced so far (including the dropped ones)
+	uint64_t consumed;			// words read out through the data port
+	uint64_t dropped;			// words lost because the fifo was full
+	uint32_t level;				// current fill level
+	uint32_t *mem;				// fifo storage
+	uint32_t rd_ptr;
+	uint32_t wr_ptr;
+	uint32_t event;				// sticky event register
+	uint32_t ienable;
+	uint32_t almostfull;
+	uint32_t almostempty;
+	unsigned long underflow;	// reads from an empty fifo (crashes the real FPGA)
+	int running;
+	struct timespec t_start;
+	fifo_emu_gen_fn gen;
+	void *gen_ctx;
+	fifo_emu_sink_fn sink;
+	void *sink_ctx;
+} fifo_emu;
+
+int fifo_emu_init (fifo_emu *emu, uint32_t depth, double rate);
+void fifo_emu_free (fifo_emu *emu);
+void fifo_emu_set_gen (fifo_emu *emu, fifo_emu_gen_fn gen, void *gen_ctx);
+void fifo_emu_set_sink (fifo_emu *emu, fifo_emu_sink_fn sink, void *sink_ctx);
+void fifo_emu_set_step (fifo_emu *emu, double step);	// step words per access to the fifo instead of rate
+void fifo_emu_update (fifo_emu *emu);	// bring the fifo up to date with the wall clock, or one access further
+void fifo_emu_start (fifo_emu *emu, uint64_t total_words);
+void fifo_emu_reset (fifo_emu *emu);
+int fifo_emu_running (fifo_emu *emu);	// 1 while words are still being produced
+void fifo_emu_attach (fifo_emu *emu, void *data_addr, void *csr_addr, void *ctrl_in_addr); // ctrl_in_addr can be NULL
+uint32_t fifo_emu_ramp (void *ctx, uint64_t word_idx);	// default generator: sample n has the value n & 0x3FFF
+
+// phase cycled echo generator (ctx is a fifo_emu_echo_sig): every echo is a triangle of the given amplitude
+// around offset, mirrored when negate is set (the excitation phase shifted by 180 degrees)
+typedef struct {
+	unsigned int samples_per_echo;
+	uint16_t offset;			// the ADC mid scale
+	uint16_t amplitude;			// offset +- amplitude must stay within 14 bit
+	int negate;
+} fifo_emu_echo_sig;
+
+uint32_t fifo_emu_echo (void *ctx, uint64_t word_idx);
+int fifo_emu_echo_shape (const fifo_emu_echo_sig *sig, unsigned int pos);	// the echo without offset and sign at position pos
+
+// the almost-full interrupt of the fifo on an eventfd, raised by a thread that looks at the fifo every
+// FIFO_EMU_IRQ_TICK_US. The emulator state belongs to the thread reading the bus, so the thread does not update it but
+// estimates the level from the fill rate and the words read. The interrupt is raised once when the level reaches
+// almostfull with IENABLE_AF set, and again only after the level went below it, as the UIO driver keeps the line
+// masked until the fifo is served
+#define FIFO_EMU_IRQ_TICK_US	50
+
+typedef struct {
+	fifo_emu *emu;
+	int fd;						// the eventfd, hand it to fifo_event_attach_fd
+	volatile int stop;
+	unsigned long irqs;			// interrupts raised
+	pthread_t thread;
+} fifo_emu_irq;
+
+int fifo_emu_irq_start (fifo_emu_irq *irq, fifo_emu *emu);	// after fifo_emu_start
+void fifo_emu_irq_stop (fifo_emu_irq *irq);
+
+#endif
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include "AlteraIP/altera_avalon_fifo_regs.h"
+#include "fifo_event.h"
+#include "sim_bus.h"
+
+void fifo_event_init_poll (fifo_event *ev, volatile unsigned int *csr) {
+	memset(ev, 0, sizeof(fifo_event));
+	ev->backend = FIFO_EVENT_POLL;
+	ev->fd = -1;
+	ev->csr = csr;
+}
+
+int fifo_event_open_uio (fifo_event *ev, const char *path) {
+	int fd = open(path, O_RDWR);
+
+	if (fd < 0) {
+		printf("WARNING: cannot open the fifo interrupt %s (%s), the fifo is polled\n", path, strerror(errno));
+		return 0;
+	}
+	fifo_event_attach_fd(ev, fd, FIFO_EVENT_FD_UIO);
+	ev->own_fd = 1;
+	return 1;
+}
+
+void fifo_event_attach_fd (fifo_event *ev, int fd, int fd_type) {
+	ev->backend = FIFO_EVENT_UIO;
+	ev->fd = fd;
+	ev->fd_type = fd_type;
+	ev->own_fd = 0;
+}
+
+void fifo_event_close (fifo_event *ev) {
+	if (ev->backend == FIFO_EVENT_UIO) {
+		bus_write_word(ev->csr + ALTERA_AVALON_FIFO_IENABLE_REG, 0);
+	}
+	if (ev->own_fd) {
+		close(ev->fd);
+	}
+	ev->backend = FIFO_EVENT_POLL;
+	ev->fd = -1;
+	ev->own_fd = 0;
+}
+
+// take the pending interrupt and enable the line again
+static void fifo_event_ack (fifo_event *ev) {
+	uint32_t count;
+	uint64_t counter;
+	struct pollfd pfd = { ev->fd, POLLIN, 0 };
+
+	if (ev->fd_type == FIFO_EVENT_FD_EVENTFD) {
+		if (poll(&pfd, 1, 0) > 0 && read(ev->fd, &counter, sizeof(counter)) == sizeof(counter)) {
+			ev->irqs++;
+		}
+		return;
+	}
+	if (poll(&pfd, 1, 0) > 0 && read(ev->fd, &count, sizeof(count)) == sizeof(count)) {
+		ev->irqs++;
+	}
+	count = 1;
+	if (write(ev->fd, &count, sizeof(count)) != sizeof(count)) {
+		printf("WARNING: the fifo interrupt cannot be enabled again (%s)\n", strerror(errno));
+	}
+}
+
+void fifo_event_arm (fifo_event *ev, uint32_t almostfull) {
+	bus_write_word(ev->csr + ALTERA_AVALON_FIFO_ALMOSTFULL_REG, almostfull);
+	bus_write_word(ev->csr + ALTERA_AVALON_FIFO_EVENT_REG, ALTERA_AVALON_FIFO_EVENT_ALL); // clear the sticky events
+	if (ev->backend == FIFO_EVENT_UIO) {
+		bus_write_word(ev->csr + ALTERA_AVALON_FIFO_IENABLE_REG, FIFO_EVENT_IENABLE);
+		fifo_event_ack(ev);
+	}
+}
+
+int fifo_event_wait (fifo_event *ev, long timeout_us) {
+	struct pollfd pfd = { ev->fd, POLLIN, 0 };
+
+	ev->waits++;
+	if (ev->backend == FIFO_EVENT_POLL) {
+		return (bus_read_word(ev->csr + ALTERA_AVALON_FIFO_STATUS_REG) & ALTERA_AVALON_FIFO_STATUS_AF_MSK) != 0;
+	}
+
+	// the events that woke us up last time, then the line, then the level: nothing can slip through
+	bus_write_word(ev->csr + ALTERA_AVALON_FIFO_EVENT_REG, FIFO_EVENT_IENABLE);
+	fifo_event_ack(ev);
+	if (bus_read_word(ev->csr + ALTERA_AVALON_FIFO_STATUS_REG) & ALTERA_AVALON_FIFO_STATUS_AF_MSK) {
+		ev->ready++;
+		return 1;
+	}
+	if (poll(&pfd, 1, (int) ((timeout_us + 999) / 1000)) <= 0) {
+		ev->timeouts++;
+	}
+	return (bus_read_word(ev->csr + ALTERA_AVALON_FIFO_STATUS_REG) & ALTERA_AVALON_FIFO_STATUS_AF_MSK) != 0;
+}
+
+void fifo_event_print_stat (const fifo_event *ev) {
+	printf("fifo events (%s): %lu waits, %lu ready at once, %lu interrupts, %lu timeouts\n",
+			ev->backend == FIFO_EVENT_UIO ? (ev->fd_type == FIFO_EVENT_FD_UIO ? "uio" : "eventfd") : "polling",
+			ev->waits, ev->ready, ev->irqs, ev->timeouts);
+}
@@ -0,0 +1,50 @@
+// Fifo events: waiting for the ADC fifo to fill up, either by polling its csr or by blocking on the fifo interrupt.
+// Both backends have the same interface, so fifo_stream_drain does not know which one it runs on.
+// FIFO_EVENT_POLL reads the status once per fifo_event_wait and returns at once, the drain spins as it always did.
+// FIFO_EVENT_UIO enables the almost-full and empty events in IENABLE and sleeps in poll() on the UIO device of the fifo
+// interrupt (uio_pdrv_genirq: a read returns the interrupt count, writing 1 enables the line again), so the cpu is
+// free while the fifo fills up. The events are sticky and are cleared before the line is enabled again, and the level
+// is checked once more before sleeping, so an event that came in between is not lost. The wait is bounded by a
+// timeout, as the end of the sequence has no interrupt and is still seen on NMR_SEQ_run.
+// The interrupt can also come from an eventfd (FIFO_EVENT_FD_EVENTFD: an 8 byte counter, no unmasking), which is
+// how the emulated fifo raises it (fifo_emu_irq).
+
+#ifndef FIFO_EVENT_H_
+#define FIFO_EVENT_H_
+
+#include <stdint.h>
+#include "trace_ring.h"
+
+#define FIFO_EVENT_POLL			0
+#define FIFO_EVENT_UIO			1
+
+#define FIFO_EVENT_FD_UIO		0	// a UIO device
+#define FIFO_EVENT_FD_EVENTFD	1	// an eventfd standing in for it
+
+#define FIFO_EVENT_IENABLE		(ALTERA_AVALON_FIFO_IENABLE_AF_MSK | ALTERA_AVALON_FIFO_IENABLE_E_MSK)
+
+typedef struct {
+	int backend;					// FIFO_EVENT_POLL or FIFO_EVENT_UIO
+	int fd;							// the interrupt, -1 with FIFO_EVENT_POLL
+	int fd_type;					// FIFO_EVENT_FD_UIO or FIFO_EVENT_FD_EVENTFD
+	int own_fd;						// fifo_event_close closes fd
+	volatile unsigned int *csr;		// fifo csr
+	trace_ring *trace;				// the fifo levels seen by the drain and the end of the sequence, can be NULL
+	// statistics
+	unsigned long waits;
+	unsigned long ready;			// waits that found the fifo above almost-full before sleeping
+	unsigned long irqs;				// wakeups by the interrupt
+	unsigned long timeouts;
+} fifo_event;
+
+void fifo_event_init_poll (fifo_event *ev, volatile unsigned int *csr);
+// the UIO device at path (e.g. /dev/uio0), returns 0 and stays on polling if it cannot be opened
+int fifo_event_open_uio (fifo_event *ev, const char *path);
+void fifo_event_attach_fd (fifo_event *ev, int fd, int fd_type);	// use fd as the interrupt, it is not closed by fifo_event_close
+void fifo_event_close (fifo_event *ev);	// back to polling
+void fifo_event_arm (fifo_event *ev, uint32_t almostfull);	// set the threshold and clear the events, before the sequence starts
+// wait until the fifo is almost full, at most timeout_us with FIFO_EVENT_UIO. Returns 1 if it is
+int fifo_event_wait (fifo_event *ev, long timeout_us);
+void fifo_event_print_stat (const fifo_event *ev);
+
+#endif
@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "fifo_stream.h"
+#include "sim_bus.h"
+#include "general.h"
+#include "AlteraIP/altera_avalon_fifo_regs.h"
+
+int fifo_ring_init (fifo_ring *ring, size_t size) {
+	size_t n = 1;
+
+	while (n < size) {
+		n <<= 1;
+	}
+	memset(ring, 0, sizeof(fifo_ring));
+	ring->buf = (uint32_t *) malloc(n * sizeof(uint32_t));
+	if (ring->buf == NULL) {
+		printf("ERROR: fifo_ring cannot allocate %lu words\n", (unsigned long) n);
+		return 0;
+	}
+	ring->size = n;
+	return 1;
+}
+
+void fifo_ring_free (fifo_ring *ring) {
+	free(ring->buf);
+	memset(ring, 0, sizeof(fifo_ring));
+}
+
+void fifo_ring_clear (fifo_ring *ring) {
+	ring->head = 0;
+	ring->tail = 0;
+}
+
+size_t fifo_ring_level (fifo_ring *ring) {
+	return ring->head - ring->tail;
+}
+
+int fifo_ring_reserve (fifo_ring *ring, size_t n) {
+	size_t level = fifo_ring_level(ring);
+	size_t new_size = ring->size;
+	uint32_t *new_buf;
+	size_t k;
+
+	if (level + n <= ring->size) {
+		return 1;
+	}
+	while (new_size < level + n) {
+		new_size <<= 1;
+	}
+	new_buf = (uint32_t *) malloc(new_size * sizeof(uint32_t));
+	if (new_buf == NULL) {
+		printf("ERROR: fifo_ring cannot grow to %lu words\n", (unsigned long) new_size);
+		return 0;
+	}
+	for (k = 0; k < level; k++) { // linearize the old content
+		new_buf[k] = fifo_ring_at(ring, k);
+	}
+	free(ring->buf);
+	ring->buf = new_buf;
+	ring->size = new_size;
+	ring->tail = 0;
+	ring->head = level;
+	return 1;
+}
+
+size_t fifo_ring_pop (fifo_ring *ring, uint32_t *dst, size_t n) {
+	size_t level = fifo_ring_level(ring);
+	size_t k;
+
+	if (n > level) {
+		n = level;
+	}
+	for (k = 0; k < n; k++) {
+		dst[k] = fifo_ring_at(ring, k);
+	}
+	ring->tail += n;
+	return n;
+}
+
+long fifo_stream_drain (fifo_ring *ring, void *fifo_data_addr,
+		fifo_event *ev, void *ctrl_in_addr,
+		unsigned long expected_words, uint32_t almostfull,
+		fifo_stream_stat *stat) {
+	fifo_stream_stat st;
+	uint32_t fifo_mem_level;
+	uint32_t k;
+	uint8_t running = 1;
+
+	memset(&st, 0, sizeof(st));
+
+	// grow the ring for the whole scan up front, so no allocation happens while the fifo is filling up
+	if (!fifo_ring_reserve(ring, expected_words)) {
+		return 0;
+	}
+
+	fifo_event_arm(ev, almostfull);
+
+	while (st.words < expected_words) {
+		if (running) {
+			if (!fifo_event_wait(ev, FIFO_STREAM_TICK_US)) {
+				st.polls++;
+				if (!(bus_read_word(ctrl_in_addr) & (0x01 << NMR_SEQ_run_ofst))) {
+					running = 0;
+					trace_event(ev->trace, TRACE_FSM_DONE, 1);
+					usleep(300); // let the last samples of the acquisition window reach the fifo
+				}
+				continue;
+			}
+		}
+
+		fifo_mem_level = bus_read_word(ev->csr + ALTERA_AVALON_FIFO_LEVEL_REG);
+		if (fifo_mem_level == 0) {
+			if (!running) {
+				break; // sequence is done and the fifo is empty
+			}
+			continue;
+		}
+		trace_event(ev->trace, TRACE_FIFO_LEVEL, fifo_mem_level);
+		if (fifo_mem_level > st.max_level) {
+			st.max_level = fifo_mem_level;
+		}
+		if (fifo_mem_level > expected_words - st.words) { // never read more than ordered
+			fifo_mem_level = expected_words - st.words;
+		}
+		for (k = 0; k < fifo_mem_level; k++) {
+			ring->buf[ring->head & (ring->size - 1)] = bus_read_word(fifo_data_addr);
+			ring->head++;
+		}
+		st.words += fifo_mem_level;
+		st.bursts++;
+	}
+
+	if (bus_read_word(ev->csr + ALTERA_AVALON_FIFO_EVENT_REG) & ALTERA_AVALON_FIFO_EVENT_OVF_MSK) {
+		st.overflow = 1;
+	}
+	if (fifo_ring_level(ring) > ring->peak) {
+		ring->peak = fifo_ring_level(ring);
+	}
+	if (stat != NULL) {
+		*stat = st;
+	}
+	return (long) st.words;
+}
@@ -0,0 +1,55 @@
+// Streaming readout of the ADC FIFO.
+// Instead of waiting for the NMR sequence to finish and reading the fifo afterwards, the fifo is drained
+// in bursts while the sequence is still running. The almost-full threshold of the fifo csr paces the bursts:
+// nothing is read until the fifo reaches the threshold, then the whole fill level is read at once.
+// The data goes into a ring buffer that grows on demand, so the length of the echo train is limited by
+// the RAM instead of by the fifo depth or a static array.
+// The drain waits for the threshold through a fifo_event, by polling the csr or by sleeping on the fifo interrupt.
+
+#ifndef FIFO_STREAM_H_
+#define FIFO_STREAM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "fifo_event.h"
+
+#define FIFO_RING_INIT_SIZE		(1<<16)	// initial ring size in words
+#define FIFO_STREAM_TICK_US		1000	// the longest sleep on the fifo interrupt, the end of the sequence is seen this late
+
+typedef struct {
+	uint32_t *buf;
+	size_t size;	// capacity in words, always a power of 2
+	size_t head;	// write index, only increments
+	size_t tail;	// read index, only increments
+	size_t peak;	// the highest fill level of the ring
+} fifo_ring;
+
+typedef struct {
+	unsigned long words;	// words drained
+	unsigned long bursts;	// burst reads
+	unsigned long polls;	// waits that found the fifo below the threshold
+	uint32_t max_level;		// the highest fifo level seen. Close to the fifo depth means the drain was late
+	uint32_t overflow;		// the fifo overflowed, so data was lost
+} fifo_stream_stat;
+
+int fifo_ring_init (fifo_ring *ring, size_t size);
+void fifo_ring_free (fifo_ring *ring);
+void fifo_ring_clear (fifo_ring *ring);
+int fifo_ring_reserve (fifo_ring *ring, size_t n);	// make room for n more words, growing the ring if needed
+size_t fifo_ring_level (fifo_ring *ring);
+size_t fifo_ring_pop (fifo_ring *ring, uint32_t *dst, size_t n);
+#define fifo_ring_at(ring, idx)		((ring)->buf[((ring)->tail + (idx)) & ((ring)->size - 1)])	// idx-th word from the read index
+
+// drain the fifo while the sequence runs, until expected_words are read or the sequence stops and the fifo is empty.
+// Returns the number of words put into the ring.
+long fifo_stream_drain (
+	fifo_ring *ring,
+	void *fifo_data_addr,					// fifo data port
+	fifo_event *ev,							// the fifo csr and how to wait on it
+	void *ctrl_in_addr,						// control input with the NMR_SEQ_run status
+	unsigned long expected_words,			// the amount of words ordered (samples / 2)
+	uint32_t almostfull,					// burst threshold in words
+	fifo_stream_stat *stat					// can be NULL
+);
+
+#endif
@@ -82,3 +82,17 @@
 #define SIG_S11_PATH	1
 
 #define SEL_ADC1746		1
+
+// ADC data readout mode
+#define READ_FIFO_AFTER_SEQ		0	// wait for the sequence to finish, then read the fifo (limited by the fifo depth)
+#define READ_FIFO_STREAM		1	// drain the fifo while the sequence is running (limited by the RAM)
+#define READ_DMA				2	// the DMA moves the fifo to the SDRAM while the sequence is running (needs DMA_FIFO_BASE and SDRAM_BASE in the FPGA design)
+
+// raw data file format
+#define DATA_FILE_TEXT	0	// one sample per line
+#define DATA_FILE_BIN	1	// binary scan file (scan_file.h)
+
+// processing of the ADC samples before they are written
+#define ADC_DSP_RAW		0	// the samples as they come from the ADC
+#define ADC_DSP_DDC		1	// downconverted to I/Q and decimated (ddc.h)
+#define ADC_DSP_INTEG	2	// one I/Q amplitude per echo (echo_integ.h)
@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+#include "hw_wait.h"
+#include "sim_bus.h"
+
+static hw_wait_site *hw_wait_sites = NULL;
+
+static uint64_t hw_wait_now_ns () {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static void hw_wait_sleep_ns (uint64_t ns) {
+	struct timespec t;
+
+	t.tv_sec = ns / 1000000000;
+	t.tv_nsec = ns % 1000000000;
+	clock_nanosleep(CLOCK_MONOTONIC, 0, &t, NULL);
+}
+
+static void hw_wait_record (hw_wait_site *site, uint64_t ns) {
+	unsigned int bin = 0;
+	uint64_t us = ns / 1000;
+
+	while (us > 0 && bin < HW_WAIT_HIST_BINS - 1) {
+		us >>= 1;
+		bin++;
+	}
+	site->hist[bin]++;
+	site->total_ns += ns;
+	if (ns > site->max_ns) {
+		site->max_ns = ns;
+	}
+}
+
+uint32_t hw_wait_reg (hw_wait_site *site, void *addr, uint32_t mask, uint32_t value, uint64_t timeout_ns) {
+	uint64_t t_start, t_now, t_sleep, sleep_ns = HW_WAIT_SLEEP_MIN_NS;
+	uint32_t polls = 0;
+
+	if (!site->registered) {
+		site->next = hw_wait_sites;
+		hw_wait_sites = site;
+		site->registered = 1;
+	}
+	site->waits++;
+
+	t_start = hw_wait_now_ns();
+	for (;;) {
+		polls++;
+		if ((bus_read_word(addr) & mask) == value) {
+			break;
+		}
+		t_now = hw_wait_now_ns() - t_start;
+		if (t_now >= timeout_ns) {
+			// one more look, a sleep can end just past the deadline
+			polls++;
+			if ((bus_read_word(addr) & mask) == value) {
+				break;
+			}
+			site->polls += polls;
+			site->timeouts++;
+			return 0;
+		}
+		if (t_now < HW_WAIT_SPIN_NS) {
+			continue;
+		}
+		if (t_now < HW_WAIT_YIELD_NS) {
+			sched_yield();
+			site->yields++;
+			continue;
+		}
+		t_sleep = sleep_ns < timeout_ns - t_now ? sleep_ns : timeout_ns - t_now;
+		hw_wait_sleep_ns(t_sleep);
+		t_sleep = hw_wait_now_ns() - t_start - t_now - t_sleep; // the wakeup latency
+		if ((int64_t) t_sleep > 0 && t_sleep > site->max_late_ns) {
+			site->max_late_ns = t_sleep;
+		}
+		site->sleeps++;
+		if (sleep_ns < HW_WAIT_SLEEP_MAX_NS) {
+			sleep_ns <<= 1;
+		}
+	}
+	hw_wait_record(site, hw_wait_now_ns() - t_start);
+	site->polls += polls;
+	return polls;
+}
+
+void hw_wait_clear (hw_wait_site *site) {
+	hw_wait_site *next = site->next;
+	int registered = site->registered;
+	const char *name = site->name;
+
+	memset(site, 0, sizeof(hw_wait_site));
+	site->name = name;
+	site->next = next;
+	site->registered = registered;
+}
+
+void hw_wait_print (const hw_wait_site *site) {
+	unsigned long done = site->waits - site->timeouts;
+	unsigned int bin;
+
+	printf("%s: %lu waits, %lu timeouts, mean %.1f us, max %.1f us, %.1f polls/wait, %lu yields, %lu sleeps (wakeup latency up to %.1f us)\n",
+			site->name, site->waits, site->timeouts, done ? site->total_ns * 1e-3 / done : 0,
+			site->max_ns * 1e-3, site->waits ? (double) site->polls / site->waits : 0, site->yields, site->sleeps,
+			site->max_late_ns * 1e-3);
+	for (bin = 0; bin < HW_WAIT_HIST_BINS; bin++) {
+		if (site->hist[bin] == 0) {
+			continue;
+		}
+		if (bin == 0) {
+			printf("\t      < 1 us : %lu\n", site->hist[bin]);
+		} else if (bin == HW_WAIT_HIST_BINS - 1) {
+			printf("\t>= %8u us : %lu\n", 1u << (bin - 1), site->hist[bin]);
+		} else {
+			printf("\t< %9u us : %lu\n", 1u << bin, site->hist[bin]);
+		}
+	}
+}
+
+void hw_wait_print_all () {
+	const hw_wait_site *site;
+
+	for (site = hw_wait_sites; site != NULL; site = site->next) {
+		hw_wait_print(site);
+	}
+}
@@ -0,0 +1,43 @@
+// Bounded waits for a bit pattern in an FPGA register, in place of the bare spin loops on the status bits.
+// The register is read through bus_read_word with an adaptive back-off: back to back for HW_WAIT_SPIN_NS (the PLL
+// STATUS and lock bits come within microseconds), then giving the cpu away with sched_yield until HW_WAIT_YIELD_NS,
+// then sleeping with clock_nanosleep, the sleep doubling from HW_WAIT_SLEEP_MIN_NS up to HW_WAIT_SLEEP_MAX_NS but
+// never past the deadline. A sequence of a second thus costs about a thousand wake-ups instead of a whole core.
+// Every wait site counts its waits, timeouts and back-off steps and keeps a log2 histogram of the wait times. A site
+// registers itself on its first wait, so hw_wait_print_all reports every site that was used.
+
+#ifndef HW_WAIT_H_
+#define HW_WAIT_H_
+
+#include <stdint.h>
+
+#define HW_WAIT_SPIN_NS			20000		// poll back to back up to this
+#define HW_WAIT_YIELD_NS		1000000		// then sched_yield between the polls up to this
+#define HW_WAIT_SLEEP_MIN_NS	20000		// then sleep, starting with this
+#define HW_WAIT_SLEEP_MAX_NS	1000000
+#define HW_WAIT_HIST_BINS		24			// bin 0: below 1 us, bin k: 2^(k-1) to 2^k us, the last one takes the rest
+
+typedef struct hw_wait_site {
+	const char *name;
+	unsigned long waits;
+	unsigned long timeouts;
+	unsigned long polls;			// register reads
+	unsigned long yields;
+	unsigned long sleeps;
+	uint64_t total_ns;				// time spent in the waits that did not time out
+	uint64_t max_ns;
+	uint64_t max_late_ns;			// the longest a sleep overran its request: the wakeup latency
+	unsigned long hist[HW_WAIT_HIST_BINS];
+	struct hw_wait_site *next;		// the registered sites
+	int registered;
+} hw_wait_site;
+
+#define HW_WAIT_SITE_INIT(site_name)	{ site_name, 0, 0, 0, 0, 0, 0, 0, 0, { 0 }, NULL, 0 }
+
+// wait until (*addr & mask) == value, at most timeout_ns. Returns the register reads, 0 on a timeout
+uint32_t hw_wait_reg (hw_wait_site *site, void *addr, uint32_t mask, uint32_t value, uint64_t timeout_ns);
+void hw_wait_clear (hw_wait_site *site);	// the statistics, the site stays registered
+void hw_wait_print (const hw_wait_site *site);
+void hw_wait_print_all ();
+
+#endif
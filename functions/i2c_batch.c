@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "i2c_batch.h"
+#include "hw_wait.h"
+#include "sim_bus.h"
+
+static hw_wait_site i2c_batch_fifo_site = HW_WAIT_SITE_INIT("i2c command fifo");
+static hw_wait_site i2c_batch_idle_site = HW_WAIT_SITE_INIT("i2c core idle");
+
+static uint64_t i2c_batch_now_ns () {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+// the register ofst (in words) of core
+static volatile uint32_t * i2c_reg (void *core, uint32_t ofst) {
+	return (volatile uint32_t *) core + ofst;
+}
+
+void i2c_core_init (void *core, double clk_hz, double bus_hz) {
+	uint32_t half = (uint32_t) (clk_hz / bus_hz / 2 + 0.5);
+
+	bus_write_word(i2c_reg(core, CTRL_OFST), 0);	// disabled: the fifos are flushed
+	bus_write_word(i2c_reg(core, ISER_OFST), 0);	// polled
+	bus_write_word(i2c_reg(core, ISR_OFST), NACK_DET_MSK | ARBLOST_DET_MSK | RX_OVER_MSK);
+	bus_write_word(i2c_reg(core, SCL_LOW_OFST), half & SCL_LOW_MSK);
+	bus_write_word(i2c_reg(core, SCL_HIGH_OFST), half & HIGH_LOW_MSK);
+	bus_write_word(i2c_reg(core, SDA_HOLD_OFST), (half / 2) & SDA_HOLD_MSK);
+	bus_write_word(i2c_reg(core, CTRL_OFST), (bus_hz > 100000 ? BUS_SPEED_MSK : 0) | CORE_EN_MSK);
+}
+
+void i2c_batch_init (i2c_batch *b) {
+	memset(b, 0, sizeof(i2c_batch));
+}
+
+int i2c_batch_add_core (i2c_batch *b, void *core, uint32_t fifo_depth) {
+	i2c_batch_queue *q;
+
+	if (b->num_of_cores == I2C_BATCH_MAX_CORES) {
+		printf("ERROR: an i2c batch takes %d cores at most\n", I2C_BATCH_MAX_CORES);
+		return 0;
+	}
+	q = &b->q[b->num_of_cores++];
+	q->core = core;
+	q->fifo_depth = fifo_depth < I2C_FIFO_DEPTH ? fifo_depth : I2C_FIFO_DEPTH;
+	q->num = 0;
+	return 1;
+}
+
+static i2c_batch_queue * i2c_batch_queue_of (i2c_batch *b, void *core) {
+	unsigned int k;
+
+	for (k = 0; k < b->num_of_cores; k++) {
+		if (b->q[k].core == core) {
+			return &b->q[k];
+		}
+	}
+	return NULL;
+}
+
+int i2c_batch_write (i2c_batch *b, void *core, uint8_t dev_addr, uint8_t reg, const uint8_t *data,
+		unsigned int len) {
+	i2c_batch_queue *q = i2c_batch_queue_of(b, core);
+	unsigned int k;
+
+	if (q == NULL || q->num + len + 2 > I2C_FIFO_DEPTH) {
+		return 0;
+	}
+	q->cmd[q->num++] = (1 << STA_SHFT) | ((dev_addr & 0x7F) << AD_SHFT) | (WR_I2C << RW_D_SHFT);
+	q->cmd[q->num++] = (len == 0 ? 1 << STO_SHFT : 0) | reg;
+	for (k = 0; k < len; k++) {
+		q->cmd[q->num++] = (k == len - 1 ? 1 << STO_SHFT : 0) | (data[k] & I2C_DATA_MSK);
+	}
+	b->transactions++;
+	return 1;
+}
+
+int i2c_batch_commit (i2c_batch *b) {
+	uint64_t t_start = i2c_batch_now_ns(), ns;
+	i2c_batch_queue *q;
+	uint32_t isr;
+	unsigned int k;
+	int pending, ok = 1;
+
+	if (b->transactions == 0) {
+		return 1;
+	}
+	// the fifos are empty after every commit. The cores are filled in turns, so that they all run while the longer
+	// queues wait for room
+	for (k = 0; k < b->num_of_cores; k++) {
+		b->q[k].sent = 0;
+		b->q[k].room = b->q[k].fifo_depth;
+	}
+	do {
+		pending = 0;
+		for (k = 0; k < b->num_of_cores; k++) {
+			q = &b->q[k];
+			while (q->sent < q->num) {
+				if (q->room == 0) {
+					q->room = q->fifo_depth
+							- (bus_read_word(i2c_reg(q->core, TFR_CMD_FIFO_LVL_OFST)) & TFR_CMD_FIFO_LVL_MSK);
+					if (q->room == 0) {
+						break;
+					}
+				}
+				bus_write_word(i2c_reg(q->core, TFR_CMD_OFST), q->cmd[q->sent++]);
+				q->room--;
+			}
+			pending |= q->sent < q->num;
+		}
+	} while (pending && i2c_batch_now_ns() - t_start < I2C_BATCH_TIMEOUT_NS);
+
+	b->isr = 0;
+	for (k = 0; k < b->num_of_cores; k++) {
+		q = &b->q[k];
+		if (q->num == 0) {
+			continue;
+		}
+		b->stat.cmds += q->sent;
+		if (q->sent < q->num
+				|| hw_wait_reg(&i2c_batch_fifo_site, (void *) i2c_reg(q->core, TFR_CMD_FIFO_LVL_OFST),
+						TFR_CMD_FIFO_LVL_MSK, 0, I2C_BATCH_TIMEOUT_NS) == 0
+				|| hw_wait_reg(&i2c_batch_idle_site, (void *) i2c_reg(q->core, STATUS_OFST), CORE_STATUS_MSK, 0,
+						I2C_BATCH_TIMEOUT_NS) == 0) {
+			printf("ERROR: the i2c core at %p did not finish a batch of %u commands\n", q->core, q->num);
+			b->stat.timeouts++;
+			bus_write_word(i2c_reg(q->core, CTRL_OFST), 0);	// flush what is left
+			bus_write_word(i2c_reg(q->core, CTRL_OFST), CORE_EN_MSK);
+			ok = 0;
+		}
+		isr = bus_read_word(i2c_reg(q->core, ISR_OFST)) & (NACK_DET_MSK | ARBLOST_DET_MSK);
+		if (isr != 0) {
+			bus_write_word(i2c_reg(q->core, ISR_OFST), isr); // write 1 to clear
+			b->stat.nacks += (isr & NACK_DET_MSK) != 0;
+			b->stat.arblosts += (isr & ARBLOST_DET_MSK) != 0;
+			b->isr |= isr;
+			ok = 0;
+		}
+		q->num = 0;
+	}
+
+	ns = i2c_batch_now_ns() - t_start;
+	b->stat.batches++;
+	b->stat.transactions += b->transactions;
+	b->stat.total_ns += ns;
+	b->stat.last_ns = ns;
+	if (ns > b->stat.max_ns) {
+		b->stat.max_ns = ns;
+	}
+	b->transactions = 0;
+	return ok;
+}
+
+void i2c_batch_begin (i2c_batch *b) {
+	b->open++;
+}
+
+int i2c_batch_end (i2c_batch *b) {
+	if (b->open > 0 && --b->open > 0) {
+		return 1;
+	}
+	return i2c_batch_commit(b);
+}
+
+void i2c_batch_print (const i2c_batch *b) {
+	const i2c_batch_stat *s = &b->stat;
+
+	printf("i2c: %lu batches of %.1f transactions (%.1f commands), %.1f us per batch (max %.1f us), "
+			"%lu nack, %lu arbitration lost, %lu timeouts\n", s->batches,
+			s->batches > 0 ? (double) s->transactions / s->batches : 0,
+			s->batches > 0 ? (double) s->cmds / s->batches : 0,
+			s->batches > 0 ? s->total_ns * 1e-3 / s->batches : 0, s->max_ns * 1e-3, s->nacks, s->arblosts,
+			s->timeouts);
+}
+
+void i2c_batch_clear_stat (i2c_batch *b) {
+	memset(&b->stat, 0, sizeof(i2c_batch_stat));
+}
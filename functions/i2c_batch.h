@@ -0,0 +1,65 @@
+// Batched I2C register writes through the Avalon I2C cores: the writes of a batch are queued as TFR_CMD words per
+// core, pushed into the command fifos of all the cores back to back (in turns when a batch is longer than a fifo, the
+// fill level only read once the free space known is used up), and the batch waits once for the cores to go idle and
+// looks at NACK_DET/ARBLOST_DET once per core at the end, instead of a wait and a status check per register.
+// The cores of one batch run in parallel, and the registers of a device written with one transaction (the
+// auto-increment of the register pointer) cost one address byte and one pointer byte for all of them.
+// A batch can be held open (i2c_batch_begin/i2c_batch_end, nested) so that the writes of several calls go out in one
+// burst; with no batch open the caller commits its writes at once. Every commit is timed into i2c_batch_stat.
+
+#ifndef I2C_BATCH_H_
+#define I2C_BATCH_H_
+
+#include <stdint.h>
+#include "avalon_i2c.h"
+
+#define I2C_BATCH_MAX_CORES		2
+#define I2C_BATCH_TIMEOUT_NS	100000000	// a full command fifo at 100 kHz takes 23 ms
+
+typedef struct {
+	unsigned long batches;
+	unsigned long transactions;		// the device transactions (start to stop)
+	unsigned long cmds;				// TFR_CMD words
+	unsigned long nacks;			// batches with a NACK, counted per core
+	unsigned long arblosts;
+	unsigned long timeouts;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint64_t last_ns;
+} i2c_batch_stat;
+
+typedef struct {
+	void *core;						// the base of the I2C core
+	uint32_t fifo_depth;			// the depth of its command fifo
+	uint16_t cmd[I2C_FIFO_DEPTH];
+	unsigned int num;
+	unsigned int sent;				// pushed into the fifo
+	uint32_t room;					// free words in the fifo, as last known
+} i2c_batch_queue;
+
+typedef struct {
+	i2c_batch_queue q[I2C_BATCH_MAX_CORES];
+	unsigned int num_of_cores;
+	unsigned int transactions;		// queued
+	unsigned int open;				// i2c_batch_begin nesting
+	uint32_t isr;					// NACK_DET and ARBLOST_DET of the cores at the last commit
+	i2c_batch_stat stat;
+} i2c_batch;
+
+// set up a core: disabled, the interrupt status cleared, scl at bus_hz from the core clock clk_hz, enabled
+void i2c_core_init (void *core, double clk_hz, double bus_hz);
+void i2c_batch_init (i2c_batch *b);
+int i2c_batch_add_core (i2c_batch *b, void *core, uint32_t fifo_depth);	// returns 0 with too many cores
+// queue one write transaction: start, the 7 bit device address, reg, the len data bytes, stop.
+// Returns 0 when the queue of core cannot take it (commit first) or for a core not added
+int i2c_batch_write (i2c_batch *b, void *core, uint8_t dev_addr, uint8_t reg, const uint8_t *data,
+		unsigned int len);
+// push the queued commands, wait for the cores to finish, check the status once per core. The queue is empty after.
+// Returns 0 on a NACK, a lost arbitration or a timeout
+int i2c_batch_commit (i2c_batch *b);
+void i2c_batch_begin (i2c_batch *b);
+int i2c_batch_end (i2c_batch *b);	// commits when the outermost batch ends (returns 1 otherwise)
+void i2c_batch_print (const i2c_batch *b);
+void i2c_batch_clear_stat (i2c_batch *b);
+
+#endif
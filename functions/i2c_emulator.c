@@ -0,0 +1,192 @@
+#include <string.h>
+#include <time.h>
+#include "i2c_emulator.h"
+#include "tca9555_driver.h"
+#include "sim_bus.h"
+
+#define I2C_EMU_DEFAULT_BUS_HZ	100000
+
+static uint64_t i2c_emu_now_ns () {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+// a byte and its acknowledge
+static uint64_t i2c_emu_byte_ns (const i2c_emu *emu) {
+	if (emu->scl_low + emu->scl_high == 0) {
+		return 9 * 1000000000ULL / I2C_EMU_DEFAULT_BUS_HZ;
+	}
+	return (uint64_t) (9e9 * (emu->scl_low + emu->scl_high) / emu->clk_hz);
+}
+
+void i2c_emu_init (i2c_emu *emu, double clk_hz, uint32_t depth) {
+	memset(emu, 0, sizeof(i2c_emu));
+	emu->clk_hz = clk_hz;
+	emu->depth = depth < I2C_FIFO_DEPTH ? depth : I2C_FIFO_DEPTH;
+}
+
+int i2c_emu_add_dev (i2c_emu *emu, uint8_t addr) {
+	i2c_emu_dev *dev;
+
+	if (emu->num_of_dev == I2C_EMU_MAX_DEV) {
+		return 0;
+	}
+	dev = &emu->dev[emu->num_of_dev++];
+	memset(dev, 0, sizeof(i2c_emu_dev));
+	dev->addr = addr;
+	dev->reg[CNT_REG_OUT_PORT0] = 0xFF;
+	dev->reg[CNT_REG_OUT_PORT1] = 0xFF;
+	dev->reg[CNT_REG_CONF_PORT0] = 0xFF; // inputs
+	dev->reg[CNT_REG_CONF_PORT1] = 0xFF;
+	return 1;
+}
+
+i2c_emu_dev * i2c_emu_dev_at (i2c_emu *emu, uint8_t addr) {
+	unsigned int k;
+
+	for (k = 0; k < emu->num_of_dev; k++) {
+		if (emu->dev[k].addr == addr) {
+			return &emu->dev[k];
+		}
+	}
+	return NULL;
+}
+
+void i2c_emu_lose_arbitration (i2c_emu *emu) {
+	emu->lose_arb = 1;
+}
+
+// one command on the bus
+static void i2c_emu_shift (i2c_emu *emu, uint16_t cmd) {
+	emu->cmds++;
+	if (cmd & (1 << STA_SHFT)) {
+		emu->transactions++;
+		emu->in_tfr = 1;
+		emu->ptr_next = 1;
+		if (emu->lose_arb) {
+			emu->lose_arb = 0;
+			emu->isr |= ARBLOST_DET_MSK;
+			emu->cur = NULL;
+		} else {
+			emu->cur = i2c_emu_dev_at(emu, (cmd >> AD_SHFT) & 0x7F);
+			if (emu->cur == NULL || (cmd & (1 << RW_D_SHFT)) != WR_I2C) { // reads are not modelled
+				emu->isr |= NACK_DET_MSK;
+				emu->cur = NULL;
+			}
+		}
+	} else if (emu->in_tfr && emu->cur != NULL) {
+		if (emu->ptr_next) {
+			emu->ptr = cmd & 0x07;
+			emu->ptr_next = 0;
+		} else {
+			emu->cur->reg[emu->ptr] = cmd & I2C_DATA_MSK;
+			emu->cur->reg_writes++;
+			emu->ptr ^= 1; // the other register of the pair
+		}
+	}
+	if (cmd & (1 << STO_SHFT)) {
+		emu->in_tfr = 0;
+		emu->cur = NULL;
+	}
+}
+
+void i2c_emu_update (i2c_emu *emu) {
+	uint64_t now = i2c_emu_now_ns();
+	uint32_t k, n;
+
+	if (!(emu->ctrl & CORE_EN_MSK)) {
+		return;
+	}
+	// the commands waiting in the fifo are timed from the moment the core runs
+	for (k = 0, n = emu->rd_ptr; k < emu->level; k++, n = (n + 1) % I2C_FIFO_DEPTH) {
+		if (emu->done_ns[n] == 0) {
+			emu->busy_until_ns = (emu->busy_until_ns > now ? emu->busy_until_ns : now) + i2c_emu_byte_ns(emu);
+			emu->done_ns[n] = emu->busy_until_ns;
+		}
+	}
+	while (emu->level > 0 && emu->done_ns[emu->rd_ptr] <= now) {
+		i2c_emu_shift(emu, emu->fifo[emu->rd_ptr]);
+		emu->rd_ptr = (emu->rd_ptr + 1) % I2C_FIFO_DEPTH;
+		emu->level--;
+	}
+}
+
+static uint32_t i2c_emu_rd (void *ctx, uint32_t ofst) {
+	i2c_emu *emu = (i2c_emu *) ctx;
+
+	emu->bus_reads++;
+	i2c_emu_update(emu);
+	switch (ofst >> 2) {
+	case CTRL_OFST:
+		return emu->ctrl;
+	case ISER_OFST:
+		return emu->iser;
+	case ISR_OFST:
+		return emu->isr | (emu->level < emu->depth ? TX_READY_MSK : 0);
+	case STATUS_OFST:
+		return emu->level > 0 || emu->in_tfr ? CORE_STATUS_MSK : 0;
+	case TFR_CMD_FIFO_LVL_OFST:
+		return emu->level;
+	case RX_DATA_FIFO_LVL_OFST:
+		return 0;
+	case SCL_LOW_OFST:
+		return emu->scl_low;
+	case SCL_HIGH_OFST:
+		return emu->scl_high;
+	case SDA_HOLD_OFST:
+		return emu->sda_hold;
+	default:
+		return 0;
+	}
+}
+
+static void i2c_emu_wr (void *ctx, uint32_t ofst, uint32_t val) {
+	i2c_emu *emu = (i2c_emu *) ctx;
+
+	emu->bus_writes++;
+	i2c_emu_update(emu);
+	switch (ofst >> 2) {
+	case TFR_CMD_OFST:
+		if (emu->level == emu->depth) {
+			emu->overflow++;
+			break;
+		}
+		emu->fifo[(emu->rd_ptr + emu->level) % I2C_FIFO_DEPTH] = val & 0x3FF;
+		emu->done_ns[(emu->rd_ptr + emu->level) % I2C_FIFO_DEPTH] = 0;
+		emu->level++;
+		i2c_emu_update(emu);
+		break;
+	case CTRL_OFST:
+		emu->ctrl = val;
+		if (!(val & CORE_EN_MSK)) {
+			emu->level = 0;
+			emu->in_tfr = 0;
+			emu->cur = NULL;
+			emu->busy_until_ns = 0;
+		}
+		break;
+	case ISER_OFST:
+		emu->iser = val;
+		break;
+	case ISR_OFST:
+		emu->isr &= ~(val & (NACK_DET_MSK | ARBLOST_DET_MSK | RX_OVER_MSK));
+		break;
+	case SCL_LOW_OFST:
+		emu->scl_low = val & SCL_LOW_MSK;
+		break;
+	case SCL_HIGH_OFST:
+		emu->scl_high = val & HIGH_LOW_MSK;
+		break;
+	case SDA_HOLD_OFST:
+		emu->sda_hold = val & SDA_HOLD_MSK;
+		break;
+	default:
+		break;
+	}
+}
+
+void i2c_emu_attach (i2c_emu *emu, void *addr) {
+	sim_bus_map(addr, (SDA_HOLD_OFST + 1) * 4, i2c_emu_rd, i2c_emu_wr, emu);
+}
@@ -0,0 +1,59 @@
+// Emulated Avalon I2C core (altera_avalon_i2c in master mode) with TCA9555 expanders on its bus.
+// A command written to TFR_CMD goes into the command fifo and is shifted out one byte time (9 scl periods at the
+// programmed SCL_LOW/SCL_HIGH) after the previous one, on the wall clock, so the fifo level and CORE_STATUS read as
+// on the FPGA. A start to an address with no expander sets NACK_DET and the rest of the transaction up to its stop is
+// dropped; i2c_emu_lose_arbitration makes the next start lose the bus (ARBLOST_DET). NACK_DET and ARBLOST_DET are
+// cleared by writing 1. Clearing CORE_EN flushes the fifo.
+// An expander takes the register pointer and then the data bytes, the pointer toggling within a port pair, as the
+// TCA9555 does. The registers of the core are attached to the sim_bus.
+
+#ifndef I2C_EMULATOR_H_
+#define I2C_EMULATOR_H_
+
+#include <stdint.h>
+#include "avalon_i2c.h"
+
+#define I2C_EMU_MAX_DEV		4
+
+typedef struct {
+	uint8_t addr;
+	uint8_t reg[8];				// the TCA9555 registers
+	unsigned long reg_writes;
+} i2c_emu_dev;
+
+typedef struct {
+	double clk_hz;				// the core clock
+	uint32_t depth;				// of the command fifo, I2C_FIFO_DEPTH at most
+	uint32_t ctrl;
+	uint32_t iser;
+	uint32_t isr;
+	uint32_t scl_low;
+	uint32_t scl_high;
+	uint32_t sda_hold;
+	uint16_t fifo[I2C_FIFO_DEPTH];
+	uint64_t done_ns[I2C_FIFO_DEPTH];	// the time the command is on the bus, 0: not started
+	uint32_t rd_ptr;
+	uint32_t level;
+	uint64_t busy_until_ns;		// the last command started ends then
+	i2c_emu_dev dev[I2C_EMU_MAX_DEV];
+	unsigned int num_of_dev;
+	i2c_emu_dev *cur;			// the addressed expander, NULL outside of a transaction or after a NACK
+	int in_tfr;					// a start was seen, no stop yet
+	int ptr_next;				// the next byte is the register pointer
+	uint8_t ptr;
+	int lose_arb;
+	unsigned long cmds;			// commands shifted out
+	unsigned long transactions;	// starts
+	unsigned long overflow;		// commands written to a full fifo
+	unsigned long bus_reads;
+	unsigned long bus_writes;
+} i2c_emu;
+
+void i2c_emu_init (i2c_emu *emu, double clk_hz, uint32_t depth);
+int i2c_emu_add_dev (i2c_emu *emu, uint8_t addr);	// a TCA9555 at addr (its registers at power up), 0 if full
+i2c_emu_dev * i2c_emu_dev_at (i2c_emu *emu, uint8_t addr);
+void i2c_emu_update (i2c_emu *emu);	// shift out the commands that are due
+void i2c_emu_lose_arbitration (i2c_emu *emu);	// at the next start
+void i2c_emu_attach (i2c_emu *emu, void *addr);
+
+#endif
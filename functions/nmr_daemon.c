@@ -0,0 +1,241 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "nmr_daemon.h"
+
+static volatile sig_atomic_t nmrd_stop = 0;
+
+static void nmrd_on_signal (int sig) {
+	nmrd_stop = 1;
+}
+
+void * nmrd_buf_append (nmrd_buf *b, uint32_t len) {
+	uint32_t capacity = b->capacity ? b->capacity : 4096;
+	void *data;
+
+	if ((uint64_t) b->len + len > NMRD_MAX_PAYLOAD) {
+		return NULL;
+	}
+	while (capacity < b->len + len) {
+		capacity *= 2;
+	}
+	if (capacity != b->capacity || b->data == NULL) {
+		data = realloc(b->data, capacity);
+		if (data == NULL) {
+			return NULL;
+		}
+		b->data = data;
+		b->capacity = capacity;
+	}
+	data = (char *) b->data + b->len;
+	b->len += len;
+	return data;
+}
+
+void nmrd_buf_free (nmrd_buf *b) {
+	free(b->data);
+	b->data = NULL;
+	b->len = 0;
+	b->capacity = 0;
+}
+
+// returns 0 when the connection is closed or broken (or on a signal in the server)
+static int nmrd_read_full (int fd, void *buf, size_t len) {
+	ssize_t n;
+
+	while (len > 0) {
+		n = read(fd, buf, len);
+		if (n < 0 && errno == EINTR && !nmrd_stop) {
+			continue;
+		}
+		if (n <= 0) {
+			return 0;
+		}
+		buf = (char *) buf + n;
+		len -= n;
+	}
+	return 1;
+}
+
+static int nmrd_write_full (int fd, const void *buf, size_t len) {
+	ssize_t n;
+
+	while (len > 0) {
+		n = write(fd, buf, len);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return 0;
+		}
+		buf = (const char *) buf + n;
+		len -= n;
+	}
+	return 1;
+}
+
+static int nmrd_send (int fd, uint16_t cmd, uint16_t status, uint32_t seq, const void *payload, uint32_t len) {
+	nmrd_hdr hdr;
+
+	hdr.magic = NMRD_MAGIC;
+	hdr.cmd = cmd;
+	hdr.status = status;
+	hdr.seq = seq;
+	hdr.len = len;
+	return nmrd_write_full(fd, &hdr, sizeof(hdr)) && (len == 0 || nmrd_write_full(fd, payload, len));
+}
+
+// receive one message into payload. Returns 0 when the connection is gone
+static int nmrd_recv (int fd, nmrd_hdr *hdr, nmrd_buf *payload) {
+	payload->len = 0;
+	if (!nmrd_read_full(fd, hdr, sizeof(nmrd_hdr)) || hdr->magic != NMRD_MAGIC || hdr->len > NMRD_MAX_PAYLOAD) {
+		return 0;
+	}
+	if (hdr->len > 0 && nmrd_buf_append(payload, hdr->len) == NULL) {
+		return 0;
+	}
+	return nmrd_read_full(fd, payload->data, hdr->len);
+}
+
+// the client on fd runs as the user of the daemon (or as root)
+static int nmrd_peer_allowed (int fd) {
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) {
+		return 0;
+	}
+	return cred.uid == geteuid() || cred.uid == 0;
+}
+
+int nmrd_serve (const char *path, nmrd_handler handler, nmrd_stat *stat) {
+	struct sockaddr_un addr;
+	struct sigaction sa;
+	struct timespec t0, t1;
+	nmrd_buf req = { NULL, 0, 0 };
+	nmrd_buf reply = { NULL, 0, 0 };
+	nmrd_hdr hdr;
+	int listen_fd, fd;
+	int status;
+	int quit = 0;
+
+	memset(stat, 0, sizeof(nmrd_stat));
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		printf("ERROR: socket path %s is too long\n", path);
+		return 0;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	// no SA_RESTART, so a signal gets the daemon out of accept() and read()
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = nmrd_on_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN); // a client going away must not kill the daemon
+
+	listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listen_fd < 0) {
+		printf("ERROR: cannot create the socket (%s)\n", strerror(errno));
+		return 0;
+	}
+	unlink(path); // left over by a daemon that was killed
+	// restricted before listen(), so no client can connect while the socket still has the mode of the umask
+	if (bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || chmod(path, NMRD_SOCKET_MODE) < 0
+			|| listen(listen_fd, 4) < 0) {
+		printf("ERROR: cannot listen on %s (%s)\n", path, strerror(errno));
+		close(listen_fd);
+		return 0;
+	}
+
+	nmrd_stop = 0;
+	while (!quit && !nmrd_stop) {
+		fd = accept(listen_fd, NULL, NULL);
+		if (fd < 0) {
+			continue; // EINTR from a signal ends the loop, anything else is retried
+		}
+		if (!nmrd_peer_allowed(fd)) {
+			stat->refused++;
+			close(fd);
+			continue;
+		}
+		stat->clients++;
+		while (!quit && nmrd_recv(fd, &hdr, &req)) {
+			reply.len = 0;
+			stat->requests++;
+			clock_gettime(CLOCK_MONOTONIC, &t0);
+			if (hdr.cmd == NMRD_CMD_PING) {
+				status = NMRD_OK;
+			} else if (hdr.cmd == NMRD_CMD_QUIT) {
+				status = NMRD_OK;
+				quit = 1;
+			} else {
+				status = handler(hdr.cmd, req.data, req.len, &reply);
+			}
+			clock_gettime(CLOCK_MONOTONIC, &t1);
+			stat->busy_ns += (uint64_t) (t1.tv_sec - t0.tv_sec) * 1000000000 + t1.tv_nsec - t0.tv_nsec;
+			if (status != NMRD_OK) {
+				stat->errors++;
+				reply.len = 0;
+			}
+			if (!nmrd_send(fd, hdr.cmd, (uint16_t) status, hdr.seq, reply.data, reply.len)) {
+				break;
+			}
+		}
+		close(fd);
+	}
+
+	close(listen_fd);
+	unlink(path);
+	nmrd_buf_free(&req);
+	nmrd_buf_free(&reply);
+	return 1;
+}
+
+int nmrd_connect (const char *path) {
+	struct sockaddr_un addr;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		return -1;
+	}
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int nmrd_call (int fd, uint16_t cmd, const void *req, uint32_t req_len, nmrd_buf *reply) {
+	static uint32_t seq = 0;
+	nmrd_buf discard = { NULL, 0, 0 };
+	nmrd_hdr hdr;
+	int ok;
+
+	seq++;
+	if (!nmrd_send(fd, cmd, NMRD_OK, seq, req, req_len)) {
+		return -1;
+	}
+	ok = nmrd_recv(fd, &hdr, reply != NULL ? reply : &discard);
+	nmrd_buf_free(&discard);
+	if (!ok || hdr.seq != seq || hdr.cmd != cmd) {
+		return -1;
+	}
+	return hdr.status;
+}
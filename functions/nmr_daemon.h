@@ -0,0 +1,165 @@
+// Acquisition daemon protocol: a long-lived process maps the peripherals once and runs the measurements on request
+// over a Unix-domain stream socket, so the driver does not pay the process start, the mmap and the system init per run.
+// Every message is an nmrd_hdr followed by len bytes of payload. The payloads are the fixed structs below, in the
+// native layout of the HPS (little endian, doubles first so there is no padding). A request is answered with exactly one
+// reply carrying the same cmd and seq, the status and the result payload. One client is served at a time. The socket is
+// only open to the user of the daemon (NMRD_SOCKET_MODE), and a client of another user is dropped (SO_PEERCRED).
+// The measurement commands answer with an nmrd_result naming the data folder; NMRD_CMD_READ_FILE returns a file of
+// that folder, NMRD_CMD_CPMG_MANUAL returns the samples themselves (it does not write files).
+
+#ifndef NMR_DAEMON_H_
+#define NMR_DAEMON_H_
+
+#include <stdint.h>
+
+#define NMRD_SOCKET_PATH		"/tmp/nmr_daemon.sock"
+#define NMRD_MAGIC				0x444D4E31	// "1NMD" in memory
+#define NMRD_MAX_PAYLOAD		(256u<<20)
+#define NMRD_READ_NAME_MAX		48	// longest file name of NMRD_CMD_READ_FILE
+#define NMRD_SOCKET_MODE		0600	// the daemon runs as root for /dev/mem: only clients of its own user may connect
+
+// commands
+#define NMRD_CMD_PING			0	// empty -> empty
+#define NMRD_CMD_QUIT			1	// empty -> empty, the daemon exits after the reply
+#define NMRD_CMD_SET_PARAM		2	// nmrd_param -> empty
+#define NMRD_CMD_INIT			3	// empty -> empty, init_default_system_param again
+#define NMRD_CMD_CPMG			4	// nmrd_cpmg -> nmrd_result (CPMG_iterate)
+#define NMRD_CMD_CPMG_MANUAL	5	// nmrd_cpmg_manual -> uint16_t samples of the scan (as the CPMG Manual main, with EN_PA)
+#define NMRD_CMD_FID			6	// nmrd_fid -> nmrd_result (FID_iterate)
+#define NMRD_CMD_NOISE			7	// nmrd_noise -> nmrd_result (noise_iterate)
+#define NMRD_CMD_TX_SAMPLING	8	// nmrd_tx_sampling -> nmrd_result
+#define NMRD_CMD_READ_FILE		9	// file name (no '/') -> the file in the folder of the last measurement
+
+// status
+#define NMRD_OK					0
+#define NMRD_ERR_PROTO			1	// malformed message or payload of the wrong size
+#define NMRD_ERR_CMD			2	// unknown command
+#define NMRD_ERR_PARAM			3	// parameter out of range
+#define NMRD_ERR_IO				4	// file not found or not readable
+#define NMRD_ERR_HW				5	// the peripheral is not in this FPGA design
+#define NMRD_ERR_ACQ			6	// the amount of data captured did not match, or a pll did not lock
+
+// parameters of NMRD_CMD_SET_PARAM, they stay set for the following measurements
+#define NMRD_PAR_READ_MODE		0	// adc_read_mode
+#define NMRD_PAR_FILE_FORMAT	1	// data_file_format
+#define NMRD_PAR_SCAN_WRITER	2	// scan_writer_en
+#define NMRD_PAR_ACCUM			3	// accum_en, value[1] is accum_checkpoint
+#define NMRD_PAR_ADC_DSP		4	// adc_dsp, value[1] and value[2] as argv[21] and argv[22] of CPMG Iterate
+#define NMRD_PAR_ECHO_INTEG		5	// window, width, centre shift of the echo integration
+#define NMRD_PAR_SCAN_PERIOD	6	// scan_period_us, 0 waits scan_spacing_us in front of every scan
+#define NMRD_PAR_RT_PROFILE		7	// SCHED_FIFO priority (0: off), acquisition core, writer core (rt_profile.h)
+
+typedef struct {
+	uint32_t magic;		// NMRD_MAGIC
+	uint16_t cmd;
+	uint16_t status;	// NMRD_OK in requests
+	uint32_t seq;		// copied into the reply
+	uint32_t len;		// payload bytes
+} nmrd_hdr;
+
+typedef struct {
+	double value[3];
+	uint32_t id;		// NMRD_PAR_
+	uint32_t reserved;
+} nmrd_param;
+
+typedef struct {		// the arguments of CPMG Iterate
+	double cpmg_freq;
+	double pulse1_us;
+	double pulse2_us;
+	double pulse1_dtcl;
+	double pulse2_dtcl;
+	double echo_spacing_us;
+	double init_adc_delay_compensation;
+	uint32_t scan_spacing_us;
+	uint32_t samples_per_echo;
+	uint32_t echoes_per_scan;
+	uint32_t number_of_iteration;
+	uint32_t ph_cycl_en;
+	uint32_t pulse180_t1_int;
+	uint32_t delay180_t1_int;
+	uint32_t reserved;
+} nmrd_cpmg;
+
+typedef struct {
+	double cpmg_freq;
+	double pulse1_us;
+	double pulse2_us;
+	double pulse1_dtcl;
+	double pulse2_dtcl;
+	double delay1_us;
+	double delay2_us;
+	double init_adc_delay_compensation;
+	uint32_t scan_spacing_us;
+	uint32_t samples_per_echo;
+	uint32_t echoes_per_scan;
+	uint32_t ph_cycl_en;
+	uint32_t pulse180_t1_int;
+	uint32_t delay180_t1_int;
+	uint32_t en_pa_delay;		// us between enabling the power amplifier and the sequence
+	uint32_t reserved;
+} nmrd_cpmg_manual;
+
+typedef struct {
+	double cpmg_freq;
+	double pulse2_us;
+	double pulse2_dtcl;
+	uint32_t scan_spacing_us;
+	uint32_t samples_per_echo;
+	uint32_t number_of_iteration;
+	uint32_t reserved;
+} nmrd_fid;
+
+typedef struct {
+	double samp_freq;
+	uint32_t scan_spacing_us;
+	uint32_t samples_per_echo;
+	uint32_t number_of_iteration;
+	uint32_t reserved;
+} nmrd_noise;
+
+typedef struct {
+	double tx_freq;
+	double samp_freq;
+	uint32_t num_of_samples;
+	uint32_t reserved;
+} nmrd_tx_sampling;
+
+typedef struct {
+	char folder[64];	// the data folder, relative to the working directory of the daemon
+	uint64_t run_ns;	// time spent in the measurement
+} nmrd_result;
+
+// the layouts must not depend on the compiler
+typedef char nmrd_size_check[(sizeof(nmrd_hdr) == 16 && sizeof(nmrd_param) == 32 && sizeof(nmrd_cpmg) == 88
+		&& sizeof(nmrd_cpmg_manual) == 96 && sizeof(nmrd_fid) == 40 && sizeof(nmrd_noise) == 24
+		&& sizeof(nmrd_tx_sampling) == 24 && sizeof(nmrd_result) == 72) ? 1 : -1];
+
+typedef struct {		// a growing payload buffer
+	void *data;
+	uint32_t len;
+	uint32_t capacity;
+} nmrd_buf;
+
+void * nmrd_buf_append (nmrd_buf *b, uint32_t len);	// room for len more bytes at the end, NULL if it cannot grow
+void nmrd_buf_free (nmrd_buf *b);
+
+// runs a request: fills reply and returns the status. PING and QUIT are handled by the server
+typedef int (*nmrd_handler) (uint16_t cmd, const void *req, uint32_t req_len, nmrd_buf *reply);
+
+typedef struct {
+	unsigned long clients;
+	unsigned long refused;		// clients of another user, closed without a reply
+	unsigned long requests;
+	unsigned long errors;		// replies with a status other than NMRD_OK
+	uint64_t busy_ns;			// time spent in the handler
+} nmrd_stat;
+
+// serve requests on the socket at path until NMRD_CMD_QUIT, SIGINT or SIGTERM. Returns 0 if the socket cannot be set up
+int nmrd_serve (const char *path, nmrd_handler handler, nmrd_stat *stat);
+// client side: returns the connected socket or -1
+int nmrd_connect (const char *path);
+// send a request and wait for its reply (the payload goes to reply, which can be NULL). Returns the status, -1 on a broken connection
+int nmrd_call (int fd, uint16_t cmd, const void *req, uint32_t req_len, nmrd_buf *reply);
+
+#endif
@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include "nmr_fsm_emulator.h"
+#include "sim_bus.h"
+#include "general.h"
+
+#define REG(addr)	(*(volatile uint32_t *) (addr))
+
+// the fifo fills at the ADC clock (a quarter of the fsm clock, 2 samples per word) during the acquisition windows,
+// approximated by an even rate over the echo train, and the sequence runs for its programmed length
+static void nmr_fsm_emu_start_timed (nmr_fsm_emu *emu, uint64_t words, uint64_t acq_cnt, uint64_t seq_cnt) {
+	double f_fsm = pll_reconfig_emu_freq(emu->pll, 0, emu->pll_fin) * 1e6;
+	double end;
+
+	if (f_fsm <= 0 || acq_cnt == 0) {
+		fifo_emu_start(emu->fifo, words);
+		return;
+	}
+	emu->seq_s = seq_cnt / f_fsm;
+	emu->fifo->rate = words / (acq_cnt / f_fsm);
+	emu->sig.samples_per_echo = *emu->samples_per_echo > 0 ? *emu->samples_per_echo : 1;
+	emu->sig.negate = (*emu->ctrl_out & PHASE_CYCLING) != 0;
+	fifo_emu_set_gen(emu->fifo, fifo_emu_echo, &emu->sig);
+	fifo_emu_start(emu->fifo, words);
+	end = emu->fifo->t_start.tv_nsec * 1e-9 + emu->seq_s;
+	emu->t_end.tv_sec = emu->fifo->t_start.tv_sec + (time_t) end;
+	emu->t_end.tv_nsec = (long) ((end - (time_t) end) * 1e9);
+}
+
+static int nmr_fsm_emu_seq_running (nmr_fsm_emu *emu) {
+	struct timespec now;
+
+	if (emu->pll == NULL) {
+		return 0;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec < emu->t_end.tv_sec || (now.tv_sec == emu->t_end.tv_sec && now.tv_nsec < emu->t_end.tv_nsec);
+}
+
+static void nmr_fsm_emu_ctrl_out_wr (void *ctx, uint32_t ofst, uint32_t val) {
+	nmr_fsm_emu *emu = (nmr_fsm_emu *) ctx;
+	uint32_t prev = *emu->ctrl_out;
+
+	*emu->ctrl_out = val;
+	if ((val & ADC_FIFO_RST) && !(prev & ADC_FIFO_RST)) {
+		fifo_emu_reset(emu->fifo);
+		emu->fifo_resets++;
+	}
+	if ((val & PLL_NMR_SYS_RST) && !(prev & PLL_NMR_SYS_RST)) {
+		emu->pll_resets++;
+	}
+	if ((val & NMR_CNT_RESET) && !(prev & NMR_CNT_RESET)) {
+		emu->wedged = 0;
+		emu->cnt_resets++;
+	}
+	if ((val & FSM_START) && !(prev & FSM_START)) { // the sequence starts on the rising edge
+		if (emu->wedge > 0) {
+			emu->wedge--;
+			emu->wedged = 1;
+		} else if (emu->pll != NULL) {
+			nmr_fsm_emu_start_timed(emu, ((uint64_t) *emu->samples_per_echo * *emu->echoes_per_scan) >> 1,
+					(uint64_t) *emu->echoes_per_scan * (REG(emu->regs.pulse2) + REG(emu->regs.delay2)),
+					(uint64_t) REG(emu->regs.t1_pulse) + REG(emu->regs.t1_delay) + REG(emu->regs.pulse1)
+							+ REG(emu->regs.delay1) + (uint64_t) *emu->echoes_per_scan
+							* (REG(emu->regs.pulse2) + REG(emu->regs.delay2)));
+		} else {
+			fifo_emu_start(emu->fifo, ((uint64_t) *emu->samples_per_echo * *emu->echoes_per_scan) >> 1);
+		}
+		emu->starts++;
+	}
+	if ((val & ACTIVATE_ADC_AVLN) && !(prev & ACTIVATE_ADC_AVLN) && emu->pll != NULL) { // the ADC alone (4 fsm clocks per sample)
+		nmr_fsm_emu_start_timed(emu, *emu->samples_per_echo >> 1, (uint64_t) *emu->samples_per_echo * 4,
+				(uint64_t) *emu->samples_per_echo * 4);
+	}
+	if (emu->ctrl_out_hook != NULL) {
+		emu->ctrl_out_hook(emu->ctrl_out_ctx, val);
+	}
+}
+
+static uint32_t nmr_fsm_emu_ctrl_out_rd (void *ctx, uint32_t ofst) {
+	return *((nmr_fsm_emu *) ctx)->ctrl_out;
+}
+
+static uint32_t nmr_fsm_emu_ctrl_in_rd (void *ctx, uint32_t ofst) {
+	nmr_fsm_emu *emu = (nmr_fsm_emu *) ctx;
+
+	return emu->pll_lock | (emu->wedged || fifo_emu_running(emu->fifo) || nmr_fsm_emu_seq_running(emu) ? NMR_SEQ_run : 0);
+}
+
+void nmr_fsm_emu_attach (nmr_fsm_emu *emu, fifo_emu *fifo, void *ctrl_out_addr, void *ctrl_in_addr,
+		void *samples_per_echo_addr, void *echoes_per_scan_addr) {
+	emu->fifo = fifo;
+	emu->ctrl_out = (volatile uint32_t *) ctrl_out_addr;
+	emu->samples_per_echo = (volatile uint32_t *) samples_per_echo_addr;
+	emu->echoes_per_scan = (volatile uint32_t *) echoes_per_scan_addr;
+	emu->pll_lock = PLL_NMR_SYS_lock | PLL_ANALYZER_lock;
+	emu->starts = 0;
+	emu->fifo_resets = 0;
+	emu->pll_resets = 0;
+	emu->cnt_resets = 0;
+	emu->wedge = 0;
+	emu->wedged = 0;
+	emu->pll = NULL;
+	emu->ctrl_out_hook = NULL;
+	*(volatile uint32_t *) ctrl_in_addr = emu->pll_lock;
+	sim_bus_map(ctrl_out_addr, 16, nmr_fsm_emu_ctrl_out_rd, nmr_fsm_emu_ctrl_out_wr, emu);
+	sim_bus_map(ctrl_in_addr, 16, nmr_fsm_emu_ctrl_in_rd, NULL, emu);
+}
+
+void nmr_fsm_emu_set_timing (nmr_fsm_emu *emu, pll_reconfig_emu *pll, double pll_fin, const nmr_fsm_emu_regs *regs) {
+	emu->pll = pll;
+	emu->pll_fin = pll_fin;
+	emu->regs = *regs;
+	emu->sig.offset = 8192;		// the ADC mid scale
+	emu->sig.amplitude = 2000;
+	emu->t_end.tv_sec = 0;
+	emu->t_end.tv_nsec = 0;
+}
+
+void nmr_fsm_emu_set_ctrl_out_hook (nmr_fsm_emu *emu, void (*hook) (void *ctx, uint32_t ctrl_out), void *ctx) {
+	emu->ctrl_out_hook = hook;
+	emu->ctrl_out_ctx = ctx;
+}
@@ -0,0 +1,57 @@
+// Register-level model of the NMR sequencer control on the sim_bus, for running the measurement functions off the board.
+// A write of FSM_START to ctrl_out starts the emulated ADC fifo with samples_per_echo * echoes_per_scan samples (taken
+// from the plain memory behind the NMR parameter registers), ADC_FIFO_RST empties it. ctrl_in reports NMR_SEQ_run while
+// the fifo is still being filled and the PLL lock bits are always set. The resets of the nmr system PLL are counted.
+// The TOKEN issue of ADC_WINGEN (see init_default_system_param) is modelled with wedge: the next wedge sequences hang,
+// NMR_SEQ_run stays set and no data comes, until NMR_CNT_RESET is pulsed.
+// ctrl_out is also kept in the plain memory, so alt_read_word on it sees the last value written through the bus.
+// With nmr_fsm_emu_set_timing the sequence takes as long as on the FPGA: its length comes from the programmed pulse and
+// delay counts (T1 part included) at the clock the nmr system PLL model puts out, the fifo fills at the ADC rate
+// (samples_per_echo per echo period) with a phase cycled echo train, and NMR_SEQ_run stays set until the sequence
+// ends. ACTIVATE_ADC_AVLN then also takes samples_per_echo samples at the ADC clock (noise_sampling). Without it the
+// fifo fills at its own rate and the sequence ends with the last word.
+
+#ifndef NMR_FSM_EMULATOR_H_
+#define NMR_FSM_EMULATOR_H_
+
+#include <stdint.h>
+#include "fifo_emulator.h"
+#include "pll_reconfig_emulator.h"
+
+typedef struct {
+	void *pulse1, *delay1, *pulse2, *delay2;	// the NMR parameter registers
+	void *t1_pulse, *t1_delay;
+} nmr_fsm_emu_regs;
+
+typedef struct {
+	fifo_emu *fifo;						// the ADC fifo filled by the sequence
+	volatile uint32_t *ctrl_out;		// the plain memory behind the registers
+	volatile uint32_t *samples_per_echo;
+	volatile uint32_t *echoes_per_scan;
+	uint32_t pll_lock;					// the lock bits reported in ctrl_in
+	unsigned int wedge;					// sequences still to hang
+	int wedged;							// a sequence hangs until NMR_CNT_RESET
+	unsigned long starts;				// sequences started
+	unsigned long fifo_resets;
+	unsigned long pll_resets;			// resets of the nmr system PLL
+	unsigned long cnt_resets;			// NMR_CNT_RESET pulses
+	// the timed sequence, pll is NULL when the sequence is not timed
+	pll_reconfig_emu *pll;				// its counter 0 is the nmr fsm clock
+	double pll_fin;						// MHz
+	nmr_fsm_emu_regs regs;
+	fifo_emu_echo_sig sig;
+	struct timespec t_end;				// the end of the running sequence
+	double seq_s;						// the length of the last sequence
+	// the lines of ctrl_out that go elsewhere on the board (the DAC LDAC), handed to another model after every write
+	void (*ctrl_out_hook) (void *ctx, uint32_t ctrl_out);
+	void *ctrl_out_ctx;
+} nmr_fsm_emu;
+
+// the ctrl_in and ctrl_out regions are mapped on the sim_bus. The lock bits are also written to the plain memory
+// of ctrl_in, for the loops that still poll it with alt_read_word
+void nmr_fsm_emu_attach (nmr_fsm_emu *emu, fifo_emu *fifo, void *ctrl_out_addr, void *ctrl_in_addr,
+		void *samples_per_echo_addr, void *echoes_per_scan_addr);
+void nmr_fsm_emu_set_timing (nmr_fsm_emu *emu, pll_reconfig_emu *pll, double pll_fin, const nmr_fsm_emu_regs *regs);
+void nmr_fsm_emu_set_ctrl_out_hook (nmr_fsm_emu *emu, void (*hook) (void *ctx, uint32_t ctrl_out), void *ctx);
+
+#endif
@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <string.h>
+#include "pll_cache.h"
+#include "pll_calculator.h"
+#include "pll_param_generator.h"
+
+typedef char pll_cache_param_check[(TOTAL_PLL_PARAM == 4) ? 1 : -1];
+
+void pll_cache_init (pll_cache *pc) {
+	memset(pc, 0, sizeof(pll_cache));
+}
+
+int pll_cache_calc (pll_cache *pc, uint32_t *param, double out_freq) {
+	pll_cache_memo *memo;
+	unsigned int k;
+
+	for (k = 0; k < pc->memo_len; k++) {
+		if (pc->memo[k].out_freq == out_freq) {
+			memcpy(param, pc->memo[k].param, sizeof(pc->memo[k].param));
+			pc->calc_hits++;
+			return 1;
+		}
+	}
+	pc->calc_misses++;
+	if (!pll_calculator(param, out_freq, INPUT_FREQ)) {
+		return 0;
+	}
+	if (pc->memo_len < PLL_CACHE_MEMO_SIZE) {
+		memo = &pc->memo[pc->memo_len++];
+	} else {
+		memo = &pc->memo[pc->memo_next];
+		pc->memo_next = (pc->memo_next + 1) % PLL_CACHE_MEMO_SIZE;
+	}
+	memo->out_freq = out_freq;
+	memcpy(memo->param, param, sizeof(memo->param));
+	return 1;
+}
+
+// the entry of the PLL at addr, a new one if it is not tracked yet (NULL when the table is full)
+static pll_cache_pll * pll_cache_find (pll_cache *pc, void *addr) {
+	unsigned int k;
+
+	for (k = 0; k < PLL_CACHE_MAX_PLL; k++) {
+		if (pc->pll[k].addr == addr) {
+			return &pc->pll[k];
+		}
+	}
+	for (k = 0; k < PLL_CACHE_MAX_PLL; k++) {
+		if (pc->pll[k].addr == NULL) {
+			pc->pll[k].addr = addr;
+			pc->pll[k].c_valid = 0;
+			return &pc->pll[k];
+		}
+	}
+	return NULL;
+}
+
+int pll_cache_set (pll_cache *pc, void *addr, uint32_t counter_select, double out_freq, double duty_cycle,
+		uint32_t enable_message) {
+	uint32_t param[TOTAL_PLL_PARAM];
+	pll_cache_pll *pll;
+
+	if (!pll_cache_calc(pc, param, out_freq)) {
+		printf("Set_PLL failed! Desired frequency (%f MHz) was failed to be found!\n", out_freq);
+		return PLL_CACHE_FAILED;
+	}
+	pll = counter_select < PLL_CACHE_MAX_COUNTER ? pll_cache_find(pc, addr) : NULL;
+	if (pll != NULL && (pll->c_valid & (1 << counter_select))
+			&& pll->param[N_COUNTER_ADDR] == param[N_COUNTER_ADDR]
+			&& pll->param[M_COUNTER_ADDR] == param[M_COUNTER_ADDR]
+			&& pll->param[M_FRAC_ADDR] == param[M_FRAC_ADDR]
+			&& pll->c[counter_select] == param[C_COUNTER_ADDR]
+			&& pll->duty[counter_select] == duty_cycle) {
+		pc->load_hits++;
+		return PLL_CACHE_LOADED;
+	}
+
+	pc->load_misses++;
+	if (!Set_PLL_Param(addr, param, counter_select, duty_cycle, enable_message)) {
+		if (pll != NULL) { // the reconfiguration did not finish: nothing loaded is known
+			pll->c_valid = 0;
+		}
+		return PLL_CACHE_FAILED;
+	}
+	if (pll != NULL) {
+		// a new N, M or MFRAC moves every other counter of the PLL as well
+		if (!(pll->c_valid) || pll->param[N_COUNTER_ADDR] != param[N_COUNTER_ADDR]
+				|| pll->param[M_COUNTER_ADDR] != param[M_COUNTER_ADDR]
+				|| pll->param[M_FRAC_ADDR] != param[M_FRAC_ADDR]) {
+			pll->c_valid = 0;
+		}
+		memcpy(pll->param, param, sizeof(pll->param));
+		pll->c[counter_select] = param[C_COUNTER_ADDR];
+		pll->duty[counter_select] = duty_cycle;
+		pll->c_valid |= 1 << counter_select;
+	}
+	return PLL_CACHE_PROGRAMMED;
+}
+
+void pll_cache_invalidate (pll_cache *pc, void *addr) {
+	unsigned int k;
+
+	for (k = 0; k < PLL_CACHE_MAX_PLL; k++) {
+		if (pc->pll[k].addr == addr) {
+			pc->pll[k].c_valid = 0;
+		}
+	}
+}
+
+void pll_cache_print_stat (const pll_cache *pc) {
+	printf("pll cache: calculator %lu hits / %lu misses, reconfiguration %lu skipped / %lu done\n",
+			pc->calc_hits, pc->calc_misses, pc->load_hits, pc->load_misses);
+}
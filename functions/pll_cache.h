@@ -0,0 +1,54 @@
+// PLL settings cache: remembers the pll_calculator results and what is loaded in every PLL reconfig block, so a
+// measurement loop that asks for the same clock on every scan does not search the counters again, reprogram the PLL,
+// reset it and wait for the lock. A setting is keyed by (PLL reconfig block, C counter, frequency, duty cycle).
+// The cache only knows about the writes made through it: anything else that reprograms or phase shifts a PLL
+// (Set_PLL, Set_DPS) has to call pll_cache_invalidate on that PLL.
+
+#ifndef PLL_CACHE_H_
+#define PLL_CACHE_H_
+
+#include <stdint.h>
+
+#define PLL_CACHE_MEMO_SIZE		16	// pll_calculator results remembered, the oldest one is replaced
+#define PLL_CACHE_MAX_PLL		4	// PLL reconfig blocks tracked
+#define PLL_CACHE_MAX_COUNTER	18
+
+// pll_cache_set
+#define PLL_CACHE_FAILED		0	// the frequency cannot be implemented (nothing was written) or the reconfiguration timed out
+#define PLL_CACHE_LOADED		1	// the setting is already loaded, nothing was written
+#define PLL_CACHE_PROGRAMMED	2	// the PLL was reconfigured: it has to be reset and locked again
+
+typedef struct {
+	double out_freq;
+	uint32_t param[4];				// TOTAL_PLL_PARAM, as pll_calculator
+} pll_cache_memo;
+
+typedef struct {
+	void *addr;						// the reconfig block, NULL if the entry is free
+	uint32_t param[4];				// N, M and MFRAC loaded (the C entry is not used)
+	uint32_t c_valid;				// bit k: counter k is known
+	uint32_t c[PLL_CACHE_MAX_COUNTER];	// the C counter loaded
+	double duty[PLL_CACHE_MAX_COUNTER];	// and the duty cycle it was set for
+} pll_cache_pll;
+
+typedef struct {
+	pll_cache_memo memo[PLL_CACHE_MEMO_SIZE];
+	unsigned int memo_len;
+	unsigned int memo_next;			// the entry replaced next when the memo is full
+	pll_cache_pll pll[PLL_CACHE_MAX_PLL];
+	unsigned long calc_hits;		// pll_calculator results found in the memo
+	unsigned long calc_misses;
+	unsigned long load_hits;		// settings found loaded, the reconfiguration was skipped
+	unsigned long load_misses;
+} pll_cache;
+
+void pll_cache_init (pll_cache *pc);	// forget everything (a zeroed pll_cache is initialized as well)
+// pll_calculator(param, out_freq, INPUT_FREQ) with the memo. Returns 0 if the frequency cannot be implemented
+int pll_cache_calc (pll_cache *pc, uint32_t *param, double out_freq);
+// Set_PLL, unless the setting is already loaded. Returns PLL_CACHE_FAILED, PLL_CACHE_LOADED or PLL_CACHE_PROGRAMMED
+int pll_cache_set (pll_cache *pc, void *addr, uint32_t counter_select, double out_freq, double duty_cycle,
+		uint32_t enable_message);
+void pll_cache_invalidate (pll_cache *pc, void *addr);	// the PLL was changed outside of the cache
+void pll_cache_print_stat (const pll_cache *pc);
+
+#endif
@@ -15,7 +15,58 @@
 // the second priority of is getting the right MFRAC value, between 0.05 and 0.95
 // last priority, is to divide the input frequency of the PLL (this one isn't gonna be used unless there's no choice)
 
+// the same search without the inner loops: for a given N and C, the only M that can give an MFRAC below 1 is the largest
+// one that keeps M*fin/N at or below the VCO, so it is computed directly, and C starts at the largest value the VCO limit
+// allows. The comparisons are the ones of pll_calculator_exhaustive, so both return exactly the same counters
 unsigned int pll_calculator (unsigned int * output, double fout, double fin) {
+	unsigned int n_counter, c_counter, c_start, m_counter;
+	double div_fin, vco, delta;
+	unsigned int delta_offset;
+
+	if (fout <= 0) {
+		return 0;
+	}
+	// the highest C with fout*C within the VCO limit
+	c_start = VCO_LIMIT / fout >= MAX_DUTY_CYCLE_RES ? MAX_DUTY_CYCLE_RES : (unsigned int) (VCO_LIMIT / fout);
+	while (c_start < MAX_DUTY_CYCLE_RES && fout * (c_start + 1) <= VCO_LIMIT) {
+		c_start++;
+	}
+	while (c_start >= MIN_DUTY_CYCLE_RES && fout * c_start > VCO_LIMIT) {
+		c_start--;
+	}
+
+	for (n_counter=1; n_counter<MAX_FIN_DIV; n_counter++) {		// last priority: change the n_counter
+		div_fin = fin/n_counter;
+		for (c_counter = c_start; c_counter>=MIN_DUTY_CYCLE_RES && c_counter>0; c_counter--) {	// first priority: the highest VCO
+			vco = fout*c_counter;
+			// the largest M with div_fin*M <= vco, corrected for the rounding of the division
+			m_counter = (unsigned int) (vco/div_fin);
+			while (vco >= div_fin*(m_counter+1)) {
+				m_counter++;
+			}
+			while (m_counter >= 1 && vco < div_fin*m_counter) {
+				m_counter--;
+			}
+			if (m_counter < 1) {
+				continue;
+			}
+			delta = (vco-div_fin*m_counter)/div_fin;	// second priority: MFRAC within limit
+			if (delta==0 || (delta>MIN_DELTA && delta<MAX_DELTA)) {
+				delta_offset = (unsigned int) (delta*(1<<(FRACTIONAL_CARRY_OUT-2)));
+				delta_offset <<= 2;
+				*(output+N_COUNTER_ADDR) = n_counter;
+				*(output+M_COUNTER_ADDR) = m_counter;
+				*(output+C_COUNTER_ADDR) = c_counter;
+				*(output+M_FRAC_ADDR) = delta_offset;
+				return 1;
+			}
+		}
+	}
+	return 0;	// the caller reports it
+}
+
+// the original search over N, C and M, kept as the reference of pll_calculator
+unsigned int pll_calculator_exhaustive (unsigned int * output, double fout, double fin) {
 	unsigned int n_counter,c_counter,m_counter;
 	double div_fin, vco, delta;
 	
@@ -50,7 +101,6 @@ unsigned int pll_calculator (unsigned int * output, double fout, double fin) {
 		}
 	}
 	if (fail) {
-		printf("The right parameter for fout = %f MHz cannot be found\n",fout);
 		return 0;
 	}
 	else {	// put the result at the output
@@ -28,4 +28,6 @@
 // the highest priority is highest VCO (means we can have higher duty cycle resolution)
 // the second priority of is getting the right MFRAC value, between 0.05 and 0.95
 // last priority, is to divide the input frequency of the PLL (this one isn't gonna be used unless there's no choice)
+// returns 0 without a message if fout cannot be implemented, the caller reports it
 unsigned int pll_calculator (unsigned int * output, double fout, double fin);
+unsigned int pll_calculator_exhaustive (unsigned int * output, double fout, double fin); // the reference search, same result as pll_calculator
@@ -1,6 +1,7 @@
 // this pll param generator is designed for output frequency of 1MHz to 10MHz
 
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/mman.h>
@@ -13,6 +14,7 @@
 #include "../hps_soc_system.h"
 #include "reconfig_functions.h"
 #include "pll_calculator.h"
+#include "sim_bus.h"
 
 // counter C read address (write address is different from read address)
 uint32_t CNT_READ_ADDR [18] = {
@@ -189,25 +191,152 @@ void Set_PLL (void *addr, uint32_t counter_select, double out_freq, double duty_
 	uint32_t pll_param [TOTAL_PLL_PARAM];
 	//printf("\nduty cycle: %f\n",duty_cycle);
 	if (pll_calculator (pll_param, out_freq, INPUT_FREQ)) { // frequency can be implemented
-		Set_M(addr, pll_param, enable_message);
-		Set_MFrac (addr, pll_param, enable_message);
-		Set_N(addr, pll_param, enable_message);
-		Set_C (addr, pll_param, counter_select, duty_cycle, enable_message);
-		//Set_DPS (addr, pll_param, counter_select, phase);
-
-		Start_Reconfig(addr,0x00);
-		
-		if (enable_message) {
-			double temp; // general variable to print value
-			temp = (double)INPUT_FREQ / (double)*(pll_param+N_COUNTER_ADDR) * ((double)*(pll_param+M_COUNTER_ADDR)+((double)*(pll_param+M_FRAC_ADDR)/(double)(4294967296))) / (double)*(pll_param+C_COUNTER_ADDR);
-			printf("Actual frequency\t: %5.2f MHz\n",temp);
-			uint32_t reg_value = alt_read_word(addr+CNT_READ_ADDR[counter_select]);
-			temp = (double)((reg_value & 0xFF00) >> 8)/(double)((reg_value & 0xFF) + ((reg_value & 0xFF00) >> 8));
-			printf("Actual duty cycle\t: %5.2f %%\n",temp*100);
-		}
+		Set_PLL_Param(addr, pll_param, counter_select, duty_cycle, enable_message);
 	}
 	else {	// frequency cannot be implemented
-		printf("Set_PLL failed! Desired frequency was failed to be found!\n");
+		printf("Set_PLL failed! Desired frequency (%f MHz) was failed to be found!\n", out_freq);
 	}
 	
 }
+
+// load the counters computed by pll_calculator and reconfigure
+int Set_PLL_Param (void *addr, uint32_t * pll_param, uint32_t counter_select, double duty_cycle, uint32_t enable_message) {
+	uint32_t polls;
+
+
+	Set_M(addr, pll_param, enable_message);
+	Set_MFrac (addr, pll_param, enable_message);
+	Set_N(addr, pll_param, enable_message);
+	Set_C (addr, pll_param, counter_select, duty_cycle, enable_message);
+	//Set_DPS (addr, pll_param, counter_select, phase);
+
+	polls = Start_Reconfig(addr,0x00);
+	
+	if (enable_message) {
+		double temp; // general variable to print value
+		temp = (double)INPUT_FREQ / (double)*(pll_param+N_COUNTER_ADDR) * ((double)*(pll_param+M_COUNTER_ADDR)+((double)*(pll_param+M_FRAC_ADDR)/(double)(4294967296))) / (double)*(pll_param+C_COUNTER_ADDR);
+		printf("Actual frequency\t: %5.2f MHz\n",temp);
+		uint32_t reg_value = bus_read_word(addr+CNT_READ_ADDR[counter_select]);
+		temp = (double)((reg_value & 0xFF00) >> 8)/(double)((reg_value & 0xFF) + ((reg_value & 0xFF00) >> 8));
+		printf("Actual duty cycle\t: %5.2f %%\n",temp*100);
+	}
+	return polls != 0;
+}
+
+void PLL_Tx_Init (pll_tx *tx, void *addr) {
+	memset(tx, 0, sizeof(pll_tx));
+	tx->addr = addr;
+}
+
+void PLL_Tx_Begin (pll_tx *tx) {
+	tx->c_known &= ~tx->c_staged; // c_div of those counters was overwritten by the staged value
+	tx->vco_staged = 0;
+	tx->c_staged = 0;
+	tx->dps_staged = 0;
+	memset(tx->dps_steps, 0, sizeof(tx->dps_steps));
+}
+
+int PLL_Tx_Set_PLL (pll_tx *tx, uint32_t counter_select, double out_freq, double duty_cycle) {
+	uint32_t pll_param [TOTAL_PLL_PARAM];
+
+	if (counter_select >= PLL_TX_NUM_OF_COUNTER || !pll_calculator (pll_param, out_freq, INPUT_FREQ)) {
+		printf("PLL_Tx_Set_PLL failed! Desired frequency (%f MHz) was failed to be found!\n", out_freq);
+		return 0;
+	}
+	if (tx->vco_staged && (tx->pll_param[N_COUNTER_ADDR] != pll_param[N_COUNTER_ADDR]
+			|| tx->pll_param[M_COUNTER_ADDR] != pll_param[M_COUNTER_ADDR]
+			|| tx->pll_param[M_FRAC_ADDR] != pll_param[M_FRAC_ADDR])) {
+		printf("WARNING: counter %u changes the VCO of the counters staged before it\n", counter_select);
+	}
+	memcpy(tx->pll_param, pll_param, sizeof(pll_param));
+	tx->vco_staged = 1;
+	tx->c_div[counter_select] = pll_param[C_COUNTER_ADDR];
+	tx->duty[counter_select] = duty_cycle;
+	tx->c_staged |= 1 << counter_select;
+	tx->single_writes += 5;	// M, MFRAC, N, C and START
+	tx->single_starts++;
+	return 1;
+}
+
+void PLL_Tx_Set_DPS (pll_tx *tx, uint32_t counter_select, uint32_t phase) {
+	double c_counter;
+
+	if (counter_select >= PLL_TX_NUM_OF_COUNTER) {
+		return;
+	}
+	if (!((tx->c_staged | tx->c_known) & (1 << counter_select))) {
+		tx->c_div[counter_select] = Read_C_Counter(tx->addr, counter_select);
+		tx->c_known |= 1 << counter_select;
+		tx->reads++;
+	}
+	c_counter = tx->c_div[counter_select];
+	// 1/8 VCO is the minimum phase shift, as Set_DPS
+	tx->dps_steps[counter_select] += (uint32_t) (((double)phase*(double)8*c_counter)/(double)360);
+	tx->dps_staged |= 1 << counter_select;
+	tx->single_writes += 2;	// DPS and START
+	tx->single_reads++;		// the C counter
+	tx->single_starts++;
+}
+
+int PLL_Tx_Commit (pll_tx *tx, uint32_t enable_message) {
+	uint32_t pll_param [TOTAL_PLL_PARAM];
+	uint32_t k;
+	uint32_t dps_steps = 0;
+	uint32_t polls;
+
+	for (k = 0; k < PLL_TX_NUM_OF_COUNTER; k++) {
+		dps_steps += tx->dps_steps[k];
+	}
+	if (!tx->vco_staged && !tx->c_staged && dps_steps == 0) { // nothing to load (phase shifts of 0 included)
+		tx->dps_staged = 0;
+		return 1;
+	}
+	memcpy(pll_param, tx->pll_param, sizeof(pll_param));
+	if (tx->vco_staged) {
+		Set_M(tx->addr, pll_param, enable_message);
+		Set_MFrac (tx->addr, pll_param, enable_message);
+		Set_N(tx->addr, pll_param, enable_message);
+		tx->writes += 3;
+	}
+	for (k = 0; k < PLL_TX_NUM_OF_COUNTER; k++) {
+		if (tx->c_staged & (1 << k)) {
+			pll_param[C_COUNTER_ADDR] = tx->c_div[k];
+			Set_C (tx->addr, pll_param, k, tx->duty[k], enable_message);
+			tx->writes++;
+		}
+	}
+	for (k = 0; k < PLL_TX_NUM_OF_COUNTER; k++) {
+		if ((tx->dps_staged & (1 << k)) && tx->dps_steps[k] > 0) { // a shift of 0 steps does nothing
+			Reconfig_DPS (tx->addr, k, tx->dps_steps[k], 1);
+			tx->writes++;
+			if (enable_message) {
+				printf("Actual phase shift C%02u : %f\n", k, (double)tx->dps_steps[k]/(double)(8*tx->c_div[k])*360);
+			}
+		}
+		tx->dps_steps[k] = 0;
+	}
+
+	polls = Start_Reconfig(tx->addr, 0x00);
+	tx->polls += polls;
+	tx->writes++;
+	tx->starts++;
+	if (polls) {
+		tx->c_known |= tx->c_staged;
+	} else { // what the PLL runs with is not known
+		tx->c_known = 0;
+	}
+	tx->vco_staged = 0;
+	tx->c_staged = 0;
+	tx->dps_staged = 0;
+	return polls != 0;
+}
+
+void PLL_Tx_Print_Stat (const pll_tx *tx) {
+	double polls_per_start = tx->starts ? (double) tx->polls / tx->starts : 0;
+
+	printf("pll transaction: %lu writes, %lu reads, %lu reconfigurations (%lu status polls)\n",
+			tx->writes, tx->reads, tx->starts, tx->polls);
+	printf("\tsaved against single calls: %lu writes, %lu reads, %lu reconfigurations (~%.0f status polls)\n",
+			tx->single_writes - tx->writes, tx->single_reads - tx->reads, tx->single_starts - tx->starts,
+			(tx->single_starts - tx->starts) * polls_per_start);
+}
@@ -1,10 +1,48 @@
 // This algorithm is developed to bridge between low level reconfig_function.h and pll_calculator.h
 
+#ifndef PLL_PARAM_GENERATOR_H_
+#define PLL_PARAM_GENERATOR_H_
+
+#include <stdint.h>
+#include "pll_calculator.h"
+
 #define INPUT_FREQ 50 // 50MHz
 
+#define PLL_TX_NUM_OF_COUNTER 18
+
+// PLL transaction: the counters and phase shifts of several Set_PLL and Set_DPS calls on one PLL are staged and loaded
+// with a single reconfiguration (one START and one STATUS poll loop instead of one per call). N, M and MFRAC are
+// written once, and the phase shifts use the C counters staged or committed before instead of reading them back.
+// Stage the counters before the phase shifts of the same counters. A phase shift right after a PLL reset needs its own
+// transaction, as the reset clears it.
+typedef struct {
+	void *addr;
+	uint32_t pll_param[TOTAL_PLL_PARAM];	// N, M and MFRAC staged
+	uint32_t vco_staged;					// 1 if N, M and MFRAC are staged
+	uint32_t c_staged;						// bit k: counter k is staged
+	uint32_t c_known;						// bit k: c_div[k] is loaded in the PLL (committed by this transaction)
+	uint32_t c_div[PLL_TX_NUM_OF_COUNTER];	// the C counter staged or loaded
+	double duty[PLL_TX_NUM_OF_COUNTER];
+	uint32_t dps_staged;					// bit k: a phase shift of counter k is staged
+	uint32_t dps_steps[PLL_TX_NUM_OF_COUNTER];	// 1/8 VCO period each
+	// bus traffic of the commits, and what the same steps cost as single Set_PLL and Set_DPS calls
+	unsigned long writes, reads, starts, polls;
+	unsigned long single_writes, single_reads, single_starts;
+} pll_tx;
+
 void Set_M (void *addr, uint32_t * pll_param, uint32_t enable_message);
 void Set_N (void *addr, uint32_t * pll_param, uint32_t enable_message);
 void Set_C (void *addr, uint32_t * pll_param, uint32_t counter_select, double duty_cycle, uint32_t enable_message);
 void Set_DPS (void *addr, uint32_t counter_select, uint32_t phase, uint32_t enable_message); // phase is 0 to 360
 void Set_MFrac (void *addr, uint32_t * pll_param, uint32_t enable_message);
 void Set_PLL (void *addr, uint32_t counter_select, double out_freq, double duty_cycle, uint32_t enable_message);
+int Set_PLL_Param (void *addr, uint32_t * pll_param, uint32_t counter_select, double duty_cycle, uint32_t enable_message); // pll_param from pll_calculator, returns 0 if the reconfiguration timed out
+
+void PLL_Tx_Init (pll_tx *tx, void *addr);	// nothing staged, nothing known about the PLL, statistics cleared
+void PLL_Tx_Begin (pll_tx *tx);				// drop what is staged and not committed
+int PLL_Tx_Set_PLL (pll_tx *tx, uint32_t counter_select, double out_freq, double duty_cycle); // returns 0 if out_freq cannot be implemented
+void PLL_Tx_Set_DPS (pll_tx *tx, uint32_t counter_select, uint32_t phase); // phase is 0 to 360, relative as Set_DPS
+int PLL_Tx_Commit (pll_tx *tx, uint32_t enable_message);	// write what is staged and reconfigure once, returns 0 if the reconfiguration timed out
+void PLL_Tx_Print_Stat (const pll_tx *tx);
+
+#endif
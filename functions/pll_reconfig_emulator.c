@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "pll_reconfig_emulator.h"
+#include "reconfig_functions.h"
+#include "sim_bus.h"
+
+#define PLL_EMU_STAGED_N		(1<<0)
+#define PLL_EMU_STAGED_M		(1<<1)
+#define PLL_EMU_STAGED_MFRAC	(1<<2)
+
+#define PLL_EMU_BYPASS			(1<<16)	// the bypass_enable bit of a counter word
+
+static void pll_reconfig_emu_start (pll_reconfig_emu *emu) {
+	unsigned int k;
+
+	if (emu->staged & PLL_EMU_STAGED_N)
+		emu->n = emu->new_n;
+	if (emu->staged & PLL_EMU_STAGED_M)
+		emu->m = emu->new_m;
+	if (emu->staged & PLL_EMU_STAGED_MFRAC)
+		emu->mfrac = emu->new_mfrac;
+	for (k = 0; k < PLL_EMU_NUM_OF_COUNTER; k++) {
+		if (emu->staged_c & (1 << k)) {
+			emu->c[k] = emu->new_c[k];
+		}
+		emu->phase_steps[k] += emu->new_steps[k];
+		emu->new_steps[k] = 0;
+	}
+	emu->staged = 0;
+	emu->staged_c = 0;
+	emu->starts++;
+}
+
+static void pll_reconfig_emu_wr (void *ctx, uint32_t ofst, uint32_t val) {
+	pll_reconfig_emu *emu = (pll_reconfig_emu *) ctx;
+	uint32_t k;
+
+	emu->writes++;
+	switch (ofst) {
+		case MODE:		emu->mode = val; break;
+		case START:		pll_reconfig_emu_start(emu); break;
+		case N_COUNTER:	emu->new_n = val; emu->staged |= PLL_EMU_STAGED_N; break;
+		case M_COUNTER:	emu->new_m = val; emu->staged |= PLL_EMU_STAGED_M; break;
+		case FRAC_REG:	emu->new_mfrac = val; emu->staged |= PLL_EMU_STAGED_MFRAC; break;
+		case C_COUNTER:
+			k = (val >> 18) & 0x1F;
+			if (k < PLL_EMU_NUM_OF_COUNTER) {
+				emu->new_c[k] = val & 0x3FFFF;
+				emu->staged_c |= 1 << k;
+			}
+			break;
+		case DPS_REG:
+			k = (val >> 16) & 0x1F;
+			if (k < PLL_EMU_NUM_OF_COUNTER) {
+				emu->new_steps[k] += (val & (1 << 21)) ? (long) (val & 0xFFFF) : -(long) (val & 0xFFFF);
+			}
+			break;
+		default:		break;
+	}
+}
+
+static uint32_t pll_reconfig_emu_rd (void *ctx, uint32_t ofst) {
+	pll_reconfig_emu *emu = (pll_reconfig_emu *) ctx;
+
+	switch (ofst) {
+		case MODE:		return emu->mode;
+		case STATUS:	emu->polls++; return emu->stuck ? 0x00 : 0x01;
+		case N_COUNTER:	return emu->n;
+		case M_COUNTER:	return emu->m;
+		case FRAC_REG:	return emu->mfrac;
+		default:
+			if (ofst >= C00_COUNTER && ofst <= C17_COUNTER) {
+				return emu->c[(ofst - C00_COUNTER) >> 2];
+			}
+			return 0;
+	}
+}
+
+void pll_reconfig_emu_attach (pll_reconfig_emu *emu, void *addr) {
+	unsigned int k;
+
+	memset(emu, 0, sizeof(pll_reconfig_emu));
+	emu->n = PLL_EMU_BYPASS;
+	emu->m = PLL_EMU_BYPASS;
+	for (k = 0; k < PLL_EMU_NUM_OF_COUNTER; k++) {
+		emu->c[k] = PLL_EMU_BYPASS;
+	}
+	sim_bus_map(addr, MIF_BASE_ADDR + 4, pll_reconfig_emu_rd, pll_reconfig_emu_wr, emu);
+}
+
+void pll_reconfig_emu_clear_stat (pll_reconfig_emu *emu) {
+	emu->writes = 0;
+	emu->starts = 0;
+	emu->polls = 0;
+}
+
+uint32_t pll_reconfig_emu_div (uint32_t word) {
+	if (word & PLL_EMU_BYPASS) {
+		return 1;
+	}
+	return (word & 0xFF) + ((word >> 8) & 0xFF);
+}
+
+double pll_reconfig_emu_freq (const pll_reconfig_emu *emu, uint32_t counter, double fin) {
+	return fin / pll_reconfig_emu_div(emu->n)
+			* (pll_reconfig_emu_div(emu->m) + (double) emu->mfrac / 4294967296.0)
+			/ pll_reconfig_emu_div(emu->c[counter]);
+}
+
+double pll_reconfig_emu_duty (const pll_reconfig_emu *emu, uint32_t counter) {
+	uint32_t word = emu->c[counter];
+
+	if (word & PLL_EMU_BYPASS) {
+		return 0.5;
+	}
+	// the odd division moves the falling edge half a VCO period earlier
+	return (((word >> 8) & 0xFF) - ((word >> 17) & 0x01) * 0.5) / pll_reconfig_emu_div(word);
+}
+
+double pll_reconfig_emu_phase (const pll_reconfig_emu *emu, uint32_t counter) {
+	double phase = fmod(emu->phase_steps[counter] * 360.0 / (8.0 * pll_reconfig_emu_div(emu->c[counter])), 360);
+
+	return phase < 0 ? phase + 360 : phase;
+}
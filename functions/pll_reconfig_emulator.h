@@ -0,0 +1,38 @@
+// Register-level model of the Altera PLL reconfig IP (reconfig_functions.h) on the sim_bus.
+// The N, M, MFRAC, C and DPS writes are staged and only take effect on the write to START, as in the IP. The C counters
+// are read back from their read addresses (C00_COUNTER to C17_COUNTER), STATUS reports the reconfiguration as done
+// unless stuck is set. The model counts the register writes, the START handshakes and the STATUS polls, so a caller can check how
+// much bus traffic a PLL setting costs, and it can compute the output frequency and phase of a counter from what is loaded.
+
+#ifndef PLL_RECONFIG_EMULATOR_H_
+#define PLL_RECONFIG_EMULATOR_H_
+
+#include <stdint.h>
+
+#define PLL_EMU_NUM_OF_COUNTER	18
+
+typedef struct {
+	uint32_t mode;
+	uint32_t n, m, mfrac;					// the loaded counter words (reconfig_functions.c encoding)
+	uint32_t c[PLL_EMU_NUM_OF_COUNTER];
+	long phase_steps[PLL_EMU_NUM_OF_COUNTER];	// accumulated DPS steps (1/8 of a VCO period each)
+	uint32_t new_n, new_m, new_mfrac;		// staged until START
+	uint32_t new_c[PLL_EMU_NUM_OF_COUNTER];
+	uint32_t staged;						// PLL_EMU_STAGED_ bits
+	uint32_t staged_c;						// bit k: new_c[k] is staged
+	long new_steps[PLL_EMU_NUM_OF_COUNTER];
+	unsigned long writes;					// register writes
+	unsigned long starts;					// reconfigurations (writes to START)
+	unsigned long polls;					// reads of STATUS
+	int stuck;								// STATUS never reports the reconfiguration as done
+} pll_reconfig_emu;
+
+// the counters start out as bypassed (divide by 1)
+void pll_reconfig_emu_attach (pll_reconfig_emu *emu, void *addr);
+void pll_reconfig_emu_clear_stat (pll_reconfig_emu *emu);
+uint32_t pll_reconfig_emu_div (uint32_t word);		// the division of a counter word
+double pll_reconfig_emu_freq (const pll_reconfig_emu *emu, uint32_t counter, double fin);	// MHz when fin is in MHz
+double pll_reconfig_emu_duty (const pll_reconfig_emu *emu, uint32_t counter);
+double pll_reconfig_emu_phase (const pll_reconfig_emu *emu, uint32_t counter);	// degree of the counter output, 0 to 360
+
+#endif
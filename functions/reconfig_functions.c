@@ -7,9 +7,14 @@
 #include "socal/hps.h"
 #include "socal/alt_gpio.h"
 #include "reconfig_functions.h"
+#include "sim_bus.h"
+#include "hw_wait.h"
 
 #include "../hps_soc_system.h"
 
+hw_wait_site wait_pll_reconfig = HW_WAIT_SITE_INIT("pll reconfig status");
+hw_wait_site wait_pll_lock = HW_WAIT_SITE_INIT("pll lock");
+
 // counter C read address (write address is different from read address)
 uint32_t COUNTER_READ_ADDR [18] = {
 	0x28,	// address C00
@@ -34,7 +39,7 @@ uint32_t COUNTER_READ_ADDR [18] = {
 
 void Reconfig_Mode (void * addr, uint32_t val) {
 	//Write in Mode Register "0" for waitrequest mode, "1" for polling mode
-	alt_write_word((addr+MODE), val);
+	bus_write_word((addr+MODE), val);
 	usleep(100);
 }
 
@@ -48,7 +53,7 @@ void Reconfig_N(
 	uint32_t val = (odd_division<<17) + (bypass_enable<<16) + (high_count<<8) + (low_count) ;
 	
 	//change the register value to val
-	alt_write_word((addr+N_COUNTER), val);
+	bus_write_word((addr+N_COUNTER), val);
 
 }
 
@@ -62,7 +67,7 @@ void Reconfig_M(
 	uint32_t val = (odd_division<<17) + (bypass_enable<<16) + (high_count<<8) + (low_count) ;
 
 	//change the register value to val
-	alt_write_word((addr+M_COUNTER), val);
+	bus_write_word((addr+M_COUNTER), val);
 
 }
 
@@ -82,7 +87,7 @@ void Reconfig_C(
 	uint32_t val = (counter_select<<18) + (odd_division<<17) + (bypass_enable<<16) + (high_count<<8) + (low_count) ;
 
 	//change the register value to val
-	alt_write_word((addr+C_COUNTER), val);
+	bus_write_word((addr+C_COUNTER), val);
 	//printf("C_COUNTER: %x",val);
 }
 
@@ -95,7 +100,7 @@ void Reconfig_DPS(
 	uint32_t val = (DPS_direction<<21) + (DPS_select<<16) + (DPS);
 	//printf("val for dps : %x\n",val);
 
-	alt_write_word((addr+DPS_REG), val);
+	bus_write_word((addr+DPS_REG), val);
 }
 
 void Reconfig_MFrac(
@@ -105,54 +110,55 @@ void Reconfig_MFrac(
 	//MFrac=K[X:0]/(2^X), X=6,16,24 or 32
 	//Only MFrac between 0.05 to 0.95 is allowed
 	//MTotal=M+MFrac
-	alt_write_word((addr+FRAC_REG),MFrac);
+	bus_write_word((addr+FRAC_REG),MFrac);
 }
 
 void Reconfig_BS (void * addr, uint32_t BS) {
-	alt_write_word((addr+BS_REG), BS);
+	bus_write_word((addr+BS_REG), BS);
 }
 
 void Reconfig_CPS (void * addr, uint32_t CPS) {
-	alt_write_word((addr+CPS_REG), CPS);
+	bus_write_word((addr+CPS_REG), CPS);
 }
 
 void Reconfig_VCO_DIV (void * addr, uint32_t VCO_DIV) {
-	alt_write_word((addr+VCO_DIV_REG), VCO_DIV);
+	bus_write_word((addr+VCO_DIV_REG), VCO_DIV);
 }
 
-void Start_Reconfig (void * addr, uint32_t enable_message) {
-	unsigned int status_reconfig;
+uint32_t Start_Reconfig (void * addr, uint32_t enable_message) {
+	uint32_t polls;
 
 	//Write anything to Start Register to Reconfiguration
-	alt_write_word((addr+START), 0x01);
+	bus_write_word((addr+START), 0x01);
 
 	//Polling Status Register
-	do {
-		status_reconfig=alt_read_word(addr+STATUS);
+	polls = hw_wait_reg(&wait_pll_reconfig, addr+STATUS, 0x01, 0x01, PLL_RECONFIG_TIMEOUT_NS);
+	if (!polls) {
+		printf("[ERROR] PLL reconfiguration at %p did not finish\n", addr);
 	}
-	while ((!status_reconfig) & 0x01);
 	
 	if (enable_message) {
 		Read_Reconfig_Registers (addr);
 	}
+	return polls;
 }
 
 void Read_Reconfig_Registers (void * addr) {
-	printf("\nMode: %d\n", alt_read_word(addr+MODE));
-	printf("N_COUNTER: %x\n", alt_read_word(addr+N_COUNTER));
-	printf("M_COUNTER: %x\n", alt_read_word(addr+M_COUNTER));
+	printf("\nMode: %d\n", bus_read_word(addr+MODE));
+	printf("N_COUNTER: %x\n", bus_read_word(addr+N_COUNTER));
+	printf("M_COUNTER: %x\n", bus_read_word(addr+M_COUNTER));
 	unsigned int i = 0;
 	printf("C_Counter Value:\n");
 	for (i = 0; i<18; i++) {
-		printf("\tC%02d : %x\n", i, alt_read_word(addr+COUNTER_READ_ADDR[i]));
+		printf("\tC%02d : %x\n", i, bus_read_word(addr+COUNTER_READ_ADDR[i]));
 	}
-	printf("Bandwidth Setting: %i\n", alt_read_word(addr+BS_REG));
-	printf("Charge Pump Setting: %i\n", alt_read_word(addr+CPS_REG));
-	printf("VCO DIV Setting: %i\n", alt_read_word(addr+VCO_DIV_REG));
+	printf("Bandwidth Setting: %i\n", bus_read_word(addr+BS_REG));
+	printf("Charge Pump Setting: %i\n", bus_read_word(addr+CPS_REG));
+	printf("VCO DIV Setting: %i\n", bus_read_word(addr+VCO_DIV_REG));
 }
 
 uint32_t Read_C_Counter (void * addr, uint32_t counter_select) {
-	uint32_t reg_value = alt_read_word(addr+COUNTER_READ_ADDR[counter_select]);
+	uint32_t reg_value = bus_read_word(addr+COUNTER_READ_ADDR[counter_select]);
 	return ( (reg_value & 0xFF) + ((reg_value & 0xFF00) >> 8));
 }
 
@@ -160,13 +166,17 @@ uint32_t Read_C_Counter (void * addr, uint32_t counter_select) {
 // reset offset is the offset of the reset input signal in the control register (the control register is general register, so it's not just for pll)
 // ctrl_out_signal is the current value of the control register. we don't want to change everything, but only the corresponding control bit for pll reset
 void Reset_PLL (void *ctl_out_reg, uint32_t rst_ofst, uint32_t ctrl_out_signal) {
-	alt_write_word((ctl_out_reg), (ctrl_out_signal | (0x01<<rst_ofst)) );		// reset pll
+	bus_write_word((ctl_out_reg), (ctrl_out_signal | (0x01<<rst_ofst)) );		// reset pll
 	usleep(100);
-	alt_write_word((ctl_out_reg), (ctrl_out_signal & ~(0x01<<rst_ofst)) );	// deassert reset pll
+	bus_write_word((ctl_out_reg), (ctrl_out_signal & ~(0x01<<rst_ofst)) );	// deassert reset pll
 }
 
 // ctl_in_reg is the register for lock signal coming from pll
 // lock_ofst is the corresponding bit for the lock signal on the ctl_in_reg
-void Wait_PLL_To_Lock (void *ctl_in_reg, uint32_t lock_ofst) {
-	while ( !( alt_read_word(ctl_in_reg) & (0x01<<lock_ofst) ) ) ;				// wait for pll to lock
+int Wait_PLL_To_Lock (void *ctl_in_reg, uint32_t lock_ofst) {
+	if (!hw_wait_reg(&wait_pll_lock, ctl_in_reg, 0x01<<lock_ofst, 0x01<<lock_ofst, PLL_LOCK_TIMEOUT_NS)) {	// wait for pll to lock
+		printf("[ERROR] PLL did not lock (ctrl_in bit %u)\n", lock_ofst);
+		return 0;
+	}
+	return 1;
 }
@@ -39,6 +39,13 @@
 #define C16_COUNTER		0x68
 #define C17_COUNTER		0x6C
 
+// bounds of the waits on the reconfig block and on the lock bits (hw_wait.h)
+#define PLL_RECONFIG_TIMEOUT_NS		10000000
+#define PLL_LOCK_TIMEOUT_NS			100000000
+
+extern struct hw_wait_site wait_pll_reconfig;
+extern struct hw_wait_site wait_pll_lock;
+
 
 
 void Reconfig_Mode (void * addr, uint32_t val);
@@ -50,8 +57,8 @@ void Reconfig_MFrac(void * addr, uint32_t MFrac);
 void Reconfig_BS (void * addr, uint32_t BS);
 void Reconfig_CPS (void * addr, uint32_t CPS);
 void Reconfig_VCO_DIV (void * addr, uint32_t VCO_DIV);
-void Start_Reconfig (void * addr, uint32_t enable_message);
+uint32_t Start_Reconfig (void * addr, uint32_t enable_message); // returns the polls of STATUS, 0 if it timed out
 void Read_Reconfig_Registers (void * addr);
 uint32_t Read_C_Counter (void * addr, uint32_t counter_select);
 void Reset_PLL (void *ctl_out_reg, uint32_t rst_ofst, uint32_t ctrl_out_signal);
-void Wait_PLL_To_Lock (void *ctl_in_reg, uint32_t lock_ofst);
\ No newline at end of file
+int Wait_PLL_To_Lock (void *ctl_in_reg, uint32_t lock_ofst);	// returns 0 if the PLL did not lock within PLL_LOCK_TIMEOUT_NS
\ No newline at end of file
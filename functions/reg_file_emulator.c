@@ -0,0 +1,24 @@
+#include "reg_file_emulator.h"
+#include "sim_bus.h"
+
+static uint32_t reg_file_emu_rd (void *ctx, uint32_t ofst) {
+	reg_file_emu *emu = (reg_file_emu *) ctx;
+
+	emu->reads++;
+	return emu->mem[ofst >> 2];
+}
+
+static void reg_file_emu_wr (void *ctx, uint32_t ofst, uint32_t val) {
+	reg_file_emu *emu = (reg_file_emu *) ctx;
+
+	emu->writes++;
+	emu->mem[ofst >> 2] = val;
+}
+
+void reg_file_emu_attach (reg_file_emu *emu, void *addr, size_t num_of_regs) {
+	emu->mem = (volatile uint32_t *) addr;
+	emu->num_of_regs = num_of_regs;
+	emu->reads = 0;
+	emu->writes = 0;
+	sim_bus_map(addr, num_of_regs * 4, reg_file_emu_rd, reg_file_emu_wr, emu);
+}
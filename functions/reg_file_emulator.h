@@ -0,0 +1,20 @@
+// Plain register file on the sim_bus: a register returns the last value written to it, as the PIO registers of the
+// sequence parameters and ctrl_out do. The values live in the plain memory behind the registers, so alt_read_word sees
+// them too, and every bus read and write is counted, so a caller can check what the software put on the bus.
+
+#ifndef REG_FILE_EMULATOR_H_
+#define REG_FILE_EMULATOR_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct {
+	volatile uint32_t *mem;		// the plain memory behind the registers
+	size_t num_of_regs;
+	unsigned long reads;
+	unsigned long writes;
+} reg_file_emu;
+
+void reg_file_emu_attach (reg_file_emu *emu, void *addr, size_t num_of_regs);
+
+#endif
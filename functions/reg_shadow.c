@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <string.h>
+#include "reg_shadow.h"
+#include "sim_bus.h"
+
+void reg_shadow_init (reg_shadow *sh) {
+	memset(sh, 0, sizeof(reg_shadow));
+	sh->en = 1;
+}
+
+int reg_shadow_add (reg_shadow *sh, void *addr) {
+	if (sh->num >= REG_SHADOW_MAX) {
+		printf("ERROR: reg_shadow register table is full\n");
+		return 0;
+	}
+	sh->reg[sh->num].addr = addr;
+	sh->reg[sh->num].valid = 0;
+	sh->num++;
+	return 1;
+}
+
+// a scan touches the same few registers over and over, so check the last one first
+static reg_shadow_reg * find_reg (reg_shadow *sh, void *addr) {
+	unsigned int k;
+
+	if (sh->last_hit != NULL && sh->last_hit->addr == addr) {
+		return sh->last_hit;
+	}
+	for (k = 0; k < sh->num; k++) {
+		if (sh->reg[k].addr == addr) {
+			sh->last_hit = &sh->reg[k];
+			return sh->last_hit;
+		}
+	}
+	return NULL;
+}
+
+void reg_shadow_write (reg_shadow *sh, void *addr, uint32_t val) {
+	reg_shadow_reg *r = sh->en ? find_reg(sh, addr) : NULL;
+
+	if (r != NULL && r->valid && r->val == val) {
+		sh->writes_elided++;
+		return;
+	}
+	bus_write_word(addr, val);
+	sh->bus_writes++;
+	if (r != NULL) {
+		r->val = val;
+		r->valid = 1;
+	}
+}
+
+uint32_t reg_shadow_read (reg_shadow *sh, void *addr) {
+	reg_shadow_reg *r = sh->en ? find_reg(sh, addr) : NULL;
+	uint32_t val;
+
+	if (r != NULL && r->valid) {
+		sh->reads_elided++;
+		return r->val;
+	}
+	val = bus_read_word(addr);
+	sh->bus_reads++;
+	if (r != NULL) {
+		r->val = val;
+		r->valid = 1;
+	}
+	return val;
+}
+
+void reg_shadow_forget (reg_shadow *sh, void *addr) {
+	reg_shadow_reg *r = find_reg(sh, addr);
+
+	if (r != NULL) {
+		r->valid = 0;
+	}
+}
+
+void reg_shadow_forget_all (reg_shadow *sh) {
+	unsigned int k;
+
+	for (k = 0; k < sh->num; k++) {
+		sh->reg[k].valid = 0;
+	}
+}
+
+unsigned int reg_shadow_check (reg_shadow *sh) {
+	unsigned int k;
+	unsigned int wrong = 0;
+
+	for (k = 0; k < sh->num; k++) {
+		if (sh->reg[k].valid && bus_read_word(sh->reg[k].addr) != sh->reg[k].val) {
+			printf("ERROR: the shadow of register %p holds 0x%08x, the register 0x%08x\n", sh->reg[k].addr,
+					sh->reg[k].val, bus_read_word(sh->reg[k].addr));
+			wrong++;
+		}
+	}
+	return wrong;
+}
+
+void reg_shadow_clear_stat (reg_shadow *sh) {
+	sh->bus_writes = 0;
+	sh->bus_reads = 0;
+	sh->writes_elided = 0;
+	sh->reads_elided = 0;
+}
+
+void reg_shadow_print_stat (const reg_shadow *sh, unsigned long scans) {
+	printf("register shadow: %lu bus writes (%lu elided), %lu bus reads (%lu served from the shadow)",
+			sh->bus_writes, sh->writes_elided, sh->bus_reads, sh->reads_elided);
+	if (scans != 0) {
+		printf(", %.1f bus transactions saved per scan",
+				(double) (sh->writes_elided + sh->reads_elided) / scans);
+	}
+	printf("\n");
+}
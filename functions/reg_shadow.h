@@ -0,0 +1,45 @@
+// Register shadow: the last value written to the FPGA registers that only the software writes (ctrl_out and the NMR
+// sequence parameters). A write of the value the register already holds is not put on the bus, and a read is served
+// from the shadow, so the read-modify-write of a ctrl_out bit costs one bus write and rewriting the unchanged sequence
+// parameters before every scan costs nothing.
+// A register is shadowed once reg_shadow_add registered it, and its shadow is valid after the first read or write
+// through the layer. Every access to a shadowed register must go through reg_shadow_read/reg_shadow_write; when
+// something else writes it (Reset_PLL, a reconfiguration of the FPGA), reg_shadow_forget makes the next access go to
+// the bus again. Accesses to unregistered addresses, and all accesses while en is 0, go straight to the bus.
+
+#ifndef REG_SHADOW_H_
+#define REG_SHADOW_H_
+
+#include <stdint.h>
+
+#define REG_SHADOW_MAX		16
+
+typedef struct {
+	void *addr;
+	uint32_t val;
+	int valid;
+} reg_shadow_reg;
+
+typedef struct {
+	reg_shadow_reg reg[REG_SHADOW_MAX];
+	unsigned int num;
+	reg_shadow_reg *last_hit;
+	int en;							// 0: write through, every access goes to the bus
+	// statistics
+	unsigned long bus_writes;
+	unsigned long bus_reads;
+	unsigned long writes_elided;
+	unsigned long reads_elided;
+} reg_shadow;
+
+void reg_shadow_init (reg_shadow *sh);	// no register, enabled
+int reg_shadow_add (reg_shadow *sh, void *addr);	// returns 0 when the table is full
+void reg_shadow_write (reg_shadow *sh, void *addr, uint32_t val);
+uint32_t reg_shadow_read (reg_shadow *sh, void *addr);
+void reg_shadow_forget (reg_shadow *sh, void *addr);	// addr was written behind the shadow
+void reg_shadow_forget_all (reg_shadow *sh);
+unsigned int reg_shadow_check (reg_shadow *sh);	// reads back every valid register and returns the number of them differing from the shadow
+void reg_shadow_clear_stat (reg_shadow *sh);
+void reg_shadow_print_stat (const reg_shadow *sh, unsigned long scans);	// with the bus transactions saved per scan when scans is not 0
+
+#endif
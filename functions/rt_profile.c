@@ -0,0 +1,129 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "rt_profile.h"
+
+static void rt_prefault_stack () {
+	volatile char stack[RT_PREFAULT_STACK];
+	size_t k;
+
+	for (k = 0; k < sizeof(stack); k += 4096) {
+		stack[k] = 0;
+	}
+}
+
+void rt_prefault (void *buf, size_t len) {
+	volatile char *p = (volatile char *) buf;
+	long page = sysconf(_SC_PAGESIZE);
+	size_t k;
+
+	if (buf == NULL) {
+		return;
+	}
+	for (k = 0; k < len; k += page) {
+		p[k] = p[k];
+	}
+}
+
+int rt_profile_enter (rt_profile *rt) {
+	struct sched_param param;
+	cpu_set_t cpus;
+	int err;
+
+	rt->active = 0;
+	rt->fifo = 0;
+	rt->pinned = 0;
+	rt->locked = 0;
+	if (rt->priority <= 0) {
+		return 0;
+	}
+	rt->active = 1;
+
+	pthread_getschedparam(pthread_self(), &rt->old_policy, &rt->old_param);
+
+	CPU_ZERO(&cpus);
+	CPU_SET(rt->acq_cpu, &cpus);
+	err = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);
+	if (err != 0) {
+		printf("WARNING: the acquisition cannot be pinned to core %d (%s)\n", rt->acq_cpu, strerror(err));
+	} else {
+		rt->pinned = 1;
+	}
+
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+		printf("WARNING: the memory cannot be locked (%s)\n", strerror(errno));
+	} else {
+		rt->locked = 1;
+	}
+	rt_prefault_stack();
+
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = rt->priority;
+	err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	if (err != 0) {
+		printf("WARNING: SCHED_FIFO priority %d cannot be set (%s)\n", rt->priority, strerror(err));
+	} else {
+		rt->fifo = 1;
+	}
+	return 1;
+}
+
+void rt_profile_leave (rt_profile *rt) {
+	cpu_set_t cpus;
+	long k;
+
+	if (!rt->active) {
+		return;
+	}
+	if (rt->fifo) {
+		pthread_setschedparam(pthread_self(), rt->old_policy, &rt->old_param);
+	}
+	if (rt->pinned) {
+		CPU_ZERO(&cpus);
+		for (k = 0; k < sysconf(_SC_NPROCESSORS_ONLN) && k < CPU_SETSIZE; k++) {
+			CPU_SET(k, &cpus);
+		}
+		pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);
+	}
+	if (rt->locked) {
+		munlockall();
+	}
+	rt->active = 0;
+}
+
+void rt_profile_housekeeping (const rt_profile *rt, pthread_t thread) {
+	cpu_set_t cpus;
+	int err;
+
+	if (!rt->active) {
+		return;
+	}
+	CPU_ZERO(&cpus);
+	CPU_SET(rt->housekeeping_cpu, &cpus);
+	err = pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpus);
+	if (err != 0) {
+		printf("WARNING: the writer cannot be moved to core %d (%s)\n", rt->housekeeping_cpu, strerror(err));
+	}
+}
+
+void rt_profile_print (const rt_profile *rt) {
+	if (!rt->active) {
+		printf("real-time profile: off\n");
+		return;
+	}
+	printf("real-time profile: core %d %s, SCHED_FIFO %d %s, memory %s\n", rt->acq_cpu,
+			rt->pinned ? "pinned" : "NOT PINNED", rt->priority, rt->fifo ? "set" : "NOT SET",
+			rt->locked ? "locked" : "NOT LOCKED");
+}
+
+int rt_profile_cores () {
+	cpu_set_t cpus;
+
+	if (pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus) != 0) {
+		return 0;
+	}
+	return CPU_COUNT(&cpus);
+}
@@ -0,0 +1,38 @@
+// Real-time profile of the acquisition, opt-in: the acquisition thread is pinned to one core of the Cortex-A9 and runs
+// SCHED_FIFO, the writer thread goes to the other core, all memory is locked with mlockall and the buffers of the scan
+// are pre-faulted before the first FSM_START, so neither a page fault nor an ordinary process lands in a fifo drain.
+// A step that cannot be done (no CAP_SYS_NICE or CAP_IPC_LOCK, a single core) is reported and the run goes on
+// without it. rt_profile_leave restores the scheduling, lets the thread run on all the cores again and unlocks the memory:
+// munlockall also drops the locks taken with mlock, the caller has to take them again.
+
+#ifndef RT_PROFILE_H_
+#define RT_PROFILE_H_
+
+#include <stddef.h>
+#include <pthread.h>
+#include <sched.h>
+
+#define RT_PREFAULT_STACK	(256 * 1024)	// bytes of stack touched by rt_profile_enter
+
+typedef struct {
+	int priority;				// SCHED_FIFO priority 1 to 99, 0: the profile is off
+	int acq_cpu;				// the core of the acquisition thread
+	int housekeeping_cpu;		// the core of the writer thread
+	// state
+	int active;
+	int fifo;					// SCHED_FIFO was set
+	int pinned;					// the affinity was set
+	int locked;					// mlockall succeeded
+	int old_policy;
+	struct sched_param old_param;
+} rt_profile;
+
+// the calling thread becomes the acquisition thread. Returns 0 if the profile is off
+int rt_profile_enter (rt_profile *rt);
+void rt_profile_leave (rt_profile *rt);
+void rt_profile_housekeeping (const rt_profile *rt, pthread_t thread);	// move a helper thread to the housekeeping core
+void rt_profile_print (const rt_profile *rt);
+int rt_profile_cores ();	// the cores the calling thread may run on
+void rt_prefault (void *buf, size_t len);	// touch every page of buf
+
+#endif
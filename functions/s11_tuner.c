@@ -0,0 +1,271 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "s11_tuner.h"
+
+#define S11_TUNER_GOLDEN	0.6180339887498949	// (sqrt(5) - 1) / 2
+#define S11_TUNER_INIT_ENTRIES	32
+
+void s11_tuner_default_config (s11_tuner_config *cfg) {
+	int k;
+
+	for (k = S11_TUNER_CSHUNT; k <= S11_TUNER_CSERIES; k++) {
+		cfg->lo[k] = 0;
+		cfg->hi[k] = 255;
+		cfg->res[k] = 1;
+		cfg->span[k] = 32;
+		cfg->cached_span[k] = 4;
+	}
+	cfg->lo[S11_TUNER_VVARAC] = -5;
+	cfg->hi[S11_TUNER_VVARAC] = 5;
+	cfg->res[S11_TUNER_VVARAC] = 0.02;
+	cfg->span[S11_TUNER_VVARAC] = 1.5;
+	cfg->cached_span[S11_TUNER_VVARAC] = 0.2;
+	cfg->rounds = 3;
+}
+
+void s11_tuner_init (s11_tuner *t, const s11_tuner_config *cfg, const s11_tuner_io *io, double freq) {
+	memset(t, 0, sizeof(s11_tuner));
+	t->cfg = *cfg;
+	t->io = *io;
+	t->freq = freq;
+	t->best_r = HUGE_VAL;
+}
+
+// the point as the network takes it: inside the bounds, on the resolution grid
+static void s11_tuner_snap (const s11_tuner *t, double *x) {
+	int k;
+
+	for (k = 0; k < S11_TUNER_DIM; k++) {
+		x[k] = t->cfg.lo[k] + round((x[k] - t->cfg.lo[k]) / t->cfg.res[k]) * t->cfg.res[k];
+		if (x[k] < t->cfg.lo[k]) {
+			x[k] = t->cfg.lo[k];
+		}
+		if (x[k] > t->cfg.hi[k]) {
+			x[k] = t->cfg.hi[k];
+		}
+	}
+}
+
+// the reflection at x, measured once per point. HUGE_VAL when the measurements are used up
+static double s11_tuner_eval (s11_tuner *t, const double *x_in) {
+	double x[S11_TUNER_DIM], r;
+	unsigned int n;
+
+	memcpy(x, x_in, sizeof(x));
+	s11_tuner_snap(t, x);
+	for (n = 0; n < t->evals; n++) {
+		if (memcmp(t->memo_x[n], x, sizeof(x)) == 0) {
+			return t->memo_r[n];
+		}
+	}
+	if (t->evals == S11_TUNER_MAX_EVALS) {
+		return HUGE_VAL;
+	}
+	t->io.set(t->io.ctx, x);
+	r = t->io.measure(t->io.ctx, t->freq);
+	memcpy(t->memo_x[t->evals], x, sizeof(x));
+	t->memo_r[t->evals] = r;
+	t->evals++;
+	if (r < t->best_r) {
+		memcpy(t->best, x, sizeof(x));
+		t->best_r = r;
+	}
+	return r;
+}
+
+// golden-section search of coordinate k in [best - span, best + span], the other coordinates at best
+static void s11_tuner_line (s11_tuner *t, int k, double span) {
+	double x[S11_TUNER_DIM], a, b, c, d, fc, fd;
+
+	memcpy(x, t->best, sizeof(x));
+	a = fmax(t->best[k] - span, t->cfg.lo[k]);
+	b = fmin(t->best[k] + span, t->cfg.hi[k]);
+	c = b - S11_TUNER_GOLDEN * (b - a);
+	d = a + S11_TUNER_GOLDEN * (b - a);
+	x[k] = c;
+	fc = s11_tuner_eval(t, x);
+	x[k] = d;
+	fd = s11_tuner_eval(t, x);
+	while (b - a > 2 * t->cfg.res[k] && t->evals < S11_TUNER_MAX_EVALS) {
+		if (fc <= fd) {
+			b = d;
+			d = c;
+			fd = fc;
+			c = b - S11_TUNER_GOLDEN * (b - a);
+			x[k] = c;
+			fc = s11_tuner_eval(t, x);
+		} else {
+			a = c;
+			c = d;
+			fc = fd;
+			d = a + S11_TUNER_GOLDEN * (b - a);
+			x[k] = d;
+			fd = s11_tuner_eval(t, x);
+		}
+	}
+	// the grid points left in the bracket
+	for (x[k] = a; x[k] <= b + 0.5 * t->cfg.res[k]; x[k] += t->cfg.res[k]) {
+		s11_tuner_eval(t, x);
+	}
+}
+
+double s11_tuner_run (s11_tuner *t, const double *start, int cached, double cached_refl) {
+	double span[S11_TUNER_DIM], round_r;
+	unsigned int round_n;
+	int k;
+
+	s11_tuner_eval(t, start);
+	if (cached && t->best_r <= cached_refl * S11_TUNER_RECHECK) {
+		return t->best_r;
+	}
+	memcpy(span, cached ? t->cfg.cached_span : t->cfg.span, sizeof(span));
+	for (round_n = 0; round_n < t->cfg.rounds && t->evals < S11_TUNER_MAX_EVALS; round_n++) {
+		round_r = t->best_r;
+		for (k = 0; k < S11_TUNER_DIM; k++) {
+			s11_tuner_line(t, k, span[k]);
+			span[k] = fmax(span[k] / 2, 2 * t->cfg.res[k]);
+		}
+		if (round_n > 0 && t->best_r >= round_r) { // the round found nothing better
+			break;
+		}
+	}
+	t->io.set(t->io.ctx, t->best);
+	return t->best_r;
+}
+
+// linear interpolation in a table of n values every spa from sta, the ends held
+static double s11_tuner_interp (double sta, double spa, unsigned int n, double freq, const uint16_t *u,
+		const double *d) {
+	double pos = (freq - sta) / spa, frac;
+	unsigned int i;
+
+	if (pos <= 0) {
+		return u != NULL ? u[0] : d[0];
+	}
+	if (pos >= n - 1) {
+		return u != NULL ? u[n - 1] : d[n - 1];
+	}
+	i = (unsigned int) pos;
+	frac = pos - i;
+	if (u != NULL) {
+		return (1 - frac) * u[i] + frac * u[i + 1];
+	}
+	return (1 - frac) * d[i] + frac * d[i + 1];
+}
+
+void s11_tuner_table_start (const s11_tuner_table *tbl, double freq, double *x) {
+	x[S11_TUNER_CSHUNT] = s11_tuner_interp(tbl->c_freq_sta, tbl->c_freq_spa, tbl->c_len, freq, tbl->cpar, NULL);
+	x[S11_TUNER_CSERIES] = s11_tuner_interp(tbl->c_freq_sta, tbl->c_freq_spa, tbl->c_len, freq, tbl->cser, NULL);
+	x[S11_TUNER_VVARAC] = s11_tuner_interp(tbl->v_freq_sta, tbl->v_freq_spa, tbl->v_len, freq, NULL, tbl->vvarac);
+}
+
+int s11_tuner_cache_load (s11_tuner_cache *c, const char *path) {
+	FILE *f;
+	char line[256];
+	double freq, x[S11_TUNER_DIM], refl;
+	unsigned int line_num = 0;
+	int fields;
+
+	memset(c, 0, sizeof(s11_tuner_cache));
+	f = fopen(path, "r");
+	if (f == NULL) { // nothing tuned yet
+		return 1;
+	}
+	while (fgets(line, sizeof(line), f) != NULL) {
+		line_num++;
+		if (strchr(line, '#') != NULL) {
+			*strchr(line, '#') = 0;
+		}
+		fields = sscanf(line, "%lf %lf %lf %lf %lf", &freq, &x[S11_TUNER_CSHUNT], &x[S11_TUNER_CSERIES],
+				&x[S11_TUNER_VVARAC], &refl);
+		if (fields <= 0) {
+			continue;
+		}
+		if (fields < 5) {
+			printf("ERROR: %s:%u is not a tuned point\n", path, line_num);
+			fclose(f);
+			return 0;
+		}
+		if (!s11_tuner_cache_put(c, freq, x, refl)) {
+			fclose(f);
+			return 0;
+		}
+	}
+	fclose(f);
+	return 1;
+}
+
+const s11_tuner_entry * s11_tuner_cache_find (const s11_tuner_cache *c, double freq) {
+	unsigned int n;
+
+	for (n = 0; n < c->num; n++) {
+		if (fabs(c->e[n].freq - freq) < S11_TUNER_FREQ_TOL) {
+			return &c->e[n];
+		}
+	}
+	return NULL;
+}
+
+int s11_tuner_cache_put (s11_tuner_cache *c, double freq, const double *x, double refl) {
+	s11_tuner_entry *e = (s11_tuner_entry *) s11_tuner_cache_find(c, freq);
+	unsigned int cap;
+
+	if (e == NULL) {
+		if (c->num == c->cap) {
+			cap = c->cap > 0 ? 2 * c->cap : S11_TUNER_INIT_ENTRIES;
+			e = realloc(c->e, cap * sizeof(s11_tuner_entry));
+			if (e == NULL) {
+				printf("ERROR: no memory for %u tuned points\n", cap);
+				return 0;
+			}
+			c->e = e;
+			c->cap = cap;
+		}
+		e = &c->e[c->num++];
+	}
+	e->freq = freq;
+	memcpy(e->x, x, sizeof(e->x));
+	e->refl = refl;
+	return 1;
+}
+
+static int cmp_entry (const void *a, const void *b) {
+	double fa = ((const s11_tuner_entry *) a)->freq, fb = ((const s11_tuner_entry *) b)->freq;
+
+	return (fa > fb) - (fa < fb);
+}
+
+int s11_tuner_cache_save (const s11_tuner_cache *c, const char *path) {
+	s11_tuner_entry *e;
+	FILE *f;
+	unsigned int n;
+
+	e = malloc((c->num > 0 ? c->num : 1) * sizeof(s11_tuner_entry));
+	if (e == NULL) {
+		printf("ERROR: no memory to sort the tuned points\n");
+		return 0;
+	}
+	memcpy(e, c->e, c->num * sizeof(s11_tuner_entry));
+	qsort(e, c->num, sizeof(s11_tuner_entry), cmp_entry);
+	f = fopen(path, "w");
+	if (f == NULL) {
+		printf("ERROR: cannot write the tuned points to %s\n", path);
+		free(e);
+		return 0;
+	}
+	fprintf(f, "# freq_mhz cshunt cseries vvarac reflection\n");
+	for (n = 0; n < c->num; n++) {
+		fprintf(f, "%.6f %.0f %.0f %.4f %.6g\n", e[n].freq, e[n].x[S11_TUNER_CSHUNT], e[n].x[S11_TUNER_CSERIES],
+				e[n].x[S11_TUNER_VVARAC], e[n].refl);
+	}
+	fclose(f);
+	free(e);
+	return 1;
+}
+
+void s11_tuner_cache_free (s11_tuner_cache *c) {
+	free(c->e);
+	memset(c, 0, sizeof(s11_tuner_cache));
+}
@@ -0,0 +1,89 @@
+// Matching network autotuner: finds the shunt and series capacitor relays and the varactor voltage with the lowest
+// reflection at one frequency, measuring the reflection instead of sweeping the network.
+// The search starts from the tables of the network (interpolated at the frequency), or from the point tuned before at
+// that frequency, kept in a cache file. It is a cyclic coordinate search: every coordinate in turn is minimised by a
+// golden-section search in a bracket around the best point so far, the brackets halving every round. The relays are
+// integers, so a point is rounded before it is set and a point measured once is not measured again. A few tens of
+// measurements replace the 256 x 256 relay sweep; a cached point that still reflects as little as before is taken with
+// a single measurement.
+// The network and the measurement are a pair of functions, so the tuner runs against a model of the network as well.
+
+#ifndef S11_TUNER_H_
+#define S11_TUNER_H_
+
+#include <stdint.h>
+
+#define S11_TUNER_CSHUNT		0
+#define S11_TUNER_CSERIES		1
+#define S11_TUNER_VVARAC		2
+#define S11_TUNER_DIM			3
+
+#define S11_TUNER_MAX_EVALS		128			// measurements of one tuning at most
+#define S11_TUNER_FREQ_TOL		0.001		// MHz, a cache entry is for the frequencies this close
+#define S11_TUNER_RECHECK		1.2			// a cached point is kept if it reflects at most this much more than when it was tuned
+
+typedef struct {
+	void (*set) (void *ctx, const double *x);	// put the network at x (the relays already rounded)
+	double (*measure) (void *ctx, double freq);	// the reflection at freq, in any unit, smaller is better
+	void *ctx;
+} s11_tuner_io;
+
+typedef struct {
+	double lo[S11_TUNER_DIM];			// the bounds of every coordinate
+	double hi[S11_TUNER_DIM];
+	double res[S11_TUNER_DIM];			// the resolution: a relay step, the varactor voltage step
+	double span[S11_TUNER_DIM];			// the half width of the first bracket around the start point
+	double cached_span[S11_TUNER_DIM];	// the same when the start point was tuned before
+	unsigned int rounds;				// coordinate rounds at most
+} s11_tuner_config;
+
+typedef struct {
+	s11_tuner_config cfg;
+	s11_tuner_io io;
+	double freq;
+	double memo_x[S11_TUNER_MAX_EVALS][S11_TUNER_DIM];	// the points measured
+	double memo_r[S11_TUNER_MAX_EVALS];
+	unsigned int evals;
+	double best[S11_TUNER_DIM];
+	double best_r;
+} s11_tuner;
+
+// the tables of the network: relay values every c_freq_spa MHz from c_freq_sta, varactor voltages every v_freq_spa
+typedef struct {
+	double c_freq_sta;
+	double c_freq_spa;
+	const uint16_t *cpar;				// the shunt capacitor
+	const uint16_t *cser;				// the series capacitor
+	unsigned int c_len;
+	double v_freq_sta;
+	double v_freq_spa;
+	const double *vvarac;
+	unsigned int v_len;
+} s11_tuner_table;
+
+typedef struct {
+	double freq;
+	double x[S11_TUNER_DIM];
+	double refl;						// the reflection when it was tuned
+} s11_tuner_entry;
+
+typedef struct {
+	s11_tuner_entry *e;
+	unsigned int num;
+	unsigned int cap;
+} s11_tuner_cache;
+
+void s11_tuner_default_config (s11_tuner_config *cfg);	// 8 bit relays, a +-5 V varactor
+void s11_tuner_init (s11_tuner *t, const s11_tuner_config *cfg, const s11_tuner_io *io, double freq);
+// tune from start, cached: start was tuned before with the reflection cached_refl. Returns the lowest reflection,
+// the network is left at t->best
+double s11_tuner_run (s11_tuner *t, const double *start, int cached, double cached_refl);
+void s11_tuner_table_start (const s11_tuner_table *tbl, double freq, double *x);	// interpolated, the ends held
+
+int s11_tuner_cache_load (s11_tuner_cache *c, const char *path);	// a missing file is an empty cache. Returns 0 on a bad file or without memory
+const s11_tuner_entry * s11_tuner_cache_find (const s11_tuner_cache *c, double freq);	// NULL if freq was not tuned
+int s11_tuner_cache_put (s11_tuner_cache *c, double freq, const double *x, double refl);	// replaces the entry of freq
+int s11_tuner_cache_save (const s11_tuner_cache *c, const char *path);	// sorted by frequency
+void s11_tuner_cache_free (s11_tuner_cache *c);
+
+#endif
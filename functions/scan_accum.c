@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "general.h"
+#include "echo_unpack.h"
+#include "scan_accum.h"
+
+int scan_accum_init (scan_accum *acc, unsigned int samples_per_echo, unsigned int echoes_per_scan) {
+	memset(acc, 0, sizeof(scan_accum));
+	acc->num_of_samples = (unsigned long) samples_per_echo * echoes_per_scan;
+	acc->samples_per_echo = samples_per_echo;
+	acc->echoes_per_scan = echoes_per_scan;
+	acc->part = (int32_t *) calloc(acc->num_of_samples, sizeof(int32_t));
+	acc->sum = (int64_t *) calloc(acc->num_of_samples, sizeof(int64_t));
+	if (acc->part == NULL || acc->sum == NULL) {
+		printf("ERROR: cannot allocate the sums of %lu samples\n", acc->num_of_samples);
+		scan_accum_free(acc);
+		return 0;
+	}
+	return 1;
+}
+
+void scan_accum_free (scan_accum *acc) {
+	free(acc->part);
+	free(acc->sum);
+	acc->part = NULL;
+	acc->sum = NULL;
+}
+
+void scan_accum_clear (scan_accum *acc) {
+	memset(acc->part, 0, acc->num_of_samples * sizeof(int32_t));
+	memset(acc->sum, 0, acc->num_of_samples * sizeof(int64_t));
+	acc->part_scans = 0;
+	acc->scans = 0;
+	acc->scans_negated = 0;
+}
+
+void scan_accum_fold (scan_accum *acc) {
+	unsigned long k;
+
+	if (acc->part_scans == 0) {
+		return;
+	}
+	for (k = 0; k < acc->num_of_samples; k++) {
+		acc->sum[k] += acc->part[k];
+		acc->part[k] = 0;
+	}
+	acc->part_scans = 0;
+}
+
+static void accum_count (scan_accum *acc, int negate) {
+	acc->scans++;
+	if (negate)
+		acc->scans_negated++;
+	if (++acc->part_scans == SCAN_ACCUM_FOLD_SCANS) {
+		scan_accum_fold(acc);
+	}
+}
+
+void scan_accum_add_words (scan_accum *acc, const uint32_t *fifo_words, int negate) {
+	int32_t *part = acc->part;
+	unsigned long num_of_words = acc->num_of_samples >> 1; // an odd last sample never comes out of the fifo
+	unsigned long w;
+
+	if (negate) { // two loops so that the compiler can vectorize both without a multiply
+		for (w = 0; w < num_of_words; w++) {
+			part[w * 2] -= fifo_words[w] & ADC_SAMPLE_MASK;
+			part[w * 2 + 1] -= (fifo_words[w] >> 16) & ADC_SAMPLE_MASK;
+		}
+	} else {
+		for (w = 0; w < num_of_words; w++) {
+			part[w * 2] += fifo_words[w] & ADC_SAMPLE_MASK;
+			part[w * 2 + 1] += (fifo_words[w] >> 16) & ADC_SAMPLE_MASK;
+		}
+	}
+	accum_count(acc, negate);
+}
+
+void scan_accum_add_samples (scan_accum *acc, const uint16_t *samples, int negate) {
+	int32_t *part = acc->part;
+	unsigned long k;
+
+	if (negate) {
+		for (k = 0; k < acc->num_of_samples; k++)
+			part[k] -= samples[k];
+	} else {
+		for (k = 0; k < acc->num_of_samples; k++)
+			part[k] += samples[k];
+	}
+	accum_count(acc, negate);
+}
+
+int scan_accum_negate (const scan_file_header *hdr) {
+	return (hdr->ph_cycl & SCAN_PH_CYCL_EN) && (hdr->ph_cycl & SCAN_PH_CYCL_STATE);
+}
+
+int scan_accum_write (scan_accum *acc, scan_file_header *hdr, uint8_t format, const char *folder,
+		const char *filename, const char *avgname) {
+	char path[200];
+	int64_t echo_sum;
+	unsigned long k;
+	unsigned int p, e;
+	FILE *fp;
+
+	scan_accum_fold(acc);
+
+	hdr->samples_per_echo = acc->samples_per_echo;
+	hdr->echoes_per_scan = acc->echoes_per_scan;
+	hdr->num_of_scans = acc->scans;
+	hdr->ph_cycl &= ~SCAN_PH_CYCL_STATE; // the sums are in the phase of the scans that were added
+	if (format == DATA_FILE_BIN) {
+		snprintf(path, sizeof(path), "%s/%s%s", folder, filename, SCAN_FILE_EXT);
+		if (!scan_file_write(path, hdr, SCAN_DATA_S64, acc->sum, acc->num_of_samples)) {
+			return 0;
+		}
+	} else {
+		snprintf(path, sizeof(path), "%s/%s", folder, filename);
+		fp = fopen(path, "w");
+		if (fp == NULL) {
+			printf("File does not exists \n");
+			return 0;
+		}
+		for (k = 0; k < acc->num_of_samples; k++) {
+			fprintf(fp, "%lld\n", (long long) acc->sum[k]);
+		}
+		fclose(fp);
+	}
+
+	// the echo sum of the accumulated train, as in avg_NNN
+	snprintf(path, sizeof(path), "%s/%s", folder, avgname);
+	fp = fopen(path, "w");
+	if (fp == NULL) {
+		printf("File does not exists \n");
+		return 0;
+	}
+	for (p = 0; p < acc->samples_per_echo; p++) {
+		echo_sum = 0;
+		for (e = 0; e < acc->echoes_per_scan; e++) {
+			echo_sum += acc->sum[(unsigned long) e * acc->samples_per_echo + p];
+		}
+		fprintf(fp, "%lld\n", (long long) echo_sum);
+	}
+	fclose(fp);
+	return 1;
+}
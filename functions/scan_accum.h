@@ -0,0 +1,40 @@
+// On-line accumulation of the CPMG echo train over many scans.
+// Every scan is added to a running sum sample by sample, negated when the phase cycling inverted the
+// excitation, so the echo adds up and the receiver offset cancels between the two phases. Only the final
+// sum (and optional checkpoints) is written instead of dat_NNN/avg_NNN for every scan.
+// The hot loop adds into 32-bit partial sums, which are folded into the 64-bit totals before they can
+// overflow (every 14-bit scan adds at most 2^14 to a sum, so 2^17 scans always fit in 31 bit).
+
+#ifndef SCAN_ACCUM_H_
+#define SCAN_ACCUM_H_
+
+#include <stdint.h>
+#include "scan_file.h"
+
+#define SCAN_ACCUM_FOLD_SCANS	(1UL<<17)	// scans added to the 32-bit partial sums before they are folded
+
+typedef struct {
+	int32_t *part;					// partial sums since the last fold
+	int64_t *sum;					// folded sums
+	unsigned long num_of_samples;	// samples_per_echo * echoes_per_scan
+	unsigned int samples_per_echo;
+	unsigned int echoes_per_scan;
+	unsigned long part_scans;		// scans in part
+	unsigned long scans;			// scans added in total
+	unsigned long scans_negated;	// of which were subtracted
+} scan_accum;
+
+int scan_accum_init (scan_accum *acc, unsigned int samples_per_echo, unsigned int echoes_per_scan); // returns 0 if it cannot allocate
+void scan_accum_free (scan_accum *acc);
+void scan_accum_clear (scan_accum *acc);
+// add one scan, given as packed fifo words (num_of_samples / 2 words) or as unpacked samples
+void scan_accum_add_words (scan_accum *acc, const uint32_t *fifo_words, int negate);
+void scan_accum_add_samples (scan_accum *acc, const uint16_t *samples, int negate);
+// the negate argument for a scan with this header: the phase cycling was enabled and the phase was inverted
+int scan_accum_negate (const scan_file_header *hdr);
+void scan_accum_fold (scan_accum *acc);	// bring acc->sum up to date
+// fold and write the sums (text, or a SCAN_DATA_S64 scan file for format DATA_FILE_BIN) and their echo sum
+int scan_accum_write (scan_accum *acc, scan_file_header *hdr, uint8_t format, const char *folder,
+		const char *filename, const char *avgname); // returns 0 on error
+
+#endif
@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/uio.h>
+#include "scan_file.h"
+
+void scan_file_init_header (scan_file_header *hdr, double b1_freq, double adc_freq, double fsm_clkfreq) {
+	memset(hdr, 0, sizeof(scan_file_header));
+	memcpy(hdr->magic, SCAN_FILE_MAGIC, 4);
+	hdr->version = SCAN_FILE_VERSION;
+	hdr->header_size = sizeof(scan_file_header);
+	hdr->b1_freq = b1_freq;
+	hdr->adc_freq = adc_freq;
+	hdr->fsm_clkfreq = fsm_clkfreq;
+}
+
+void scan_file_stamp (scan_file_header *hdr) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	hdr->time_sec = now.tv_sec;
+	hdr->time_nsec = now.tv_nsec;
+}
+
+unsigned long scan_file_data_size (const scan_file_header *hdr) {
+	if (hdr->data_type == SCAN_DATA_FIFO_WORDS) {
+		return ((unsigned long) hdr->num_of_samples + 1) / 2 * 4;
+	}
+	if (hdr->data_type == SCAN_DATA_S64) {
+		return (unsigned long) hdr->num_of_samples * 8;
+	}
+	if (hdr->data_type == SCAN_DATA_IQ32) {
+		return (unsigned long) hdr->num_of_samples * 4;
+	}
+	return (unsigned long) hdr->num_of_samples * 2;
+}
+
+int scan_file_write (const char *path, scan_file_header *hdr, uint32_t data_type,
+		const void *data, uint32_t num_of_samples) {
+	struct iovec iov[2];
+	ssize_t n;
+	int fd;
+
+	hdr->data_type = data_type;
+	hdr->num_of_samples = num_of_samples;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		printf("File does not exists \n");
+		return 0;
+	}
+	iov[0].iov_base = hdr;
+	iov[0].iov_len = sizeof(scan_file_header);
+	iov[1].iov_base = (void *) data;
+	iov[1].iov_len = scan_file_data_size(hdr);
+	while (iov[0].iov_len + iov[1].iov_len > 0) { // normally done in one go, repeat only on a partial write
+		n = writev(fd, iov, 2);
+		if (n < 0) {
+			printf("ERROR: writing %s failed\n", path);
+			close(fd);
+			return 0;
+		}
+		if ((size_t) n >= iov[0].iov_len) {
+			n -= iov[0].iov_len;
+			iov[0].iov_len = 0;
+			iov[1].iov_base = (char *) iov[1].iov_base + n;
+			iov[1].iov_len -= n;
+		} else {
+			iov[0].iov_base = (char *) iov[0].iov_base + n;
+			iov[0].iov_len -= n;
+		}
+	}
+	close(fd);
+	return 1;
+}
+
+int scan_file_read (const char *path, scan_file_header *hdr, void **data) {
+	FILE *fp;
+	unsigned long size;
+
+	*data = NULL;
+	fp = fopen(path, "rb");
+	if (fp == NULL) {
+		printf("File does not exists \n");
+		return 0;
+	}
+	if (fread(hdr, sizeof(scan_file_header), 1, fp) != 1 || memcmp(hdr->magic, SCAN_FILE_MAGIC, 4) != 0) {
+		printf("ERROR: %s is not a scan file\n", path);
+		fclose(fp);
+		return 0;
+	}
+	if (hdr->version != SCAN_FILE_VERSION || hdr->header_size != sizeof(scan_file_header)) {
+		printf("ERROR: %s has version %u, only version %u is supported\n", path, hdr->version, SCAN_FILE_VERSION);
+		fclose(fp);
+		return 0;
+	}
+	size = scan_file_data_size(hdr);
+	*data = malloc(size > 0 ? size : 1);
+	if (*data == NULL || fread(*data, 1, size, fp) != size) {
+		printf("ERROR: %s is truncated\n", path);
+		free(*data);
+		*data = NULL;
+		fclose(fp);
+		return 0;
+	}
+	fclose(fp);
+	return 1;
+}
+
+int64_t scan_file_sample (const scan_file_header *hdr, const void *data, unsigned long k) {
+	if (hdr->data_type == SCAN_DATA_FIFO_WORDS) {
+		return (((const uint32_t *) data)[k / 2] >> ((k & 1) * 16)) & 0x3FFF; // 14 significant bit
+	}
+	if (hdr->data_type == SCAN_DATA_S64) {
+		return ((const int64_t *) data)[k];
+	}
+	if (hdr->data_type == SCAN_DATA_IQ16) {
+		return ((const int16_t *) data)[k];
+	}
+	if (hdr->data_type == SCAN_DATA_IQ32) {
+		return ((const int32_t *) data)[k];
+	}
+	return ((const uint16_t *) data)[k];
+}
+
+int scan_file_to_text (const char *path, const char *dat_path, const char *avg_path) {
+	scan_file_header hdr;
+	void *data;
+	FILE *fp;
+	unsigned long k;
+	unsigned long num_of_echo_samples;
+	int64_t *avr_data;
+
+	if (!scan_file_read(path, &hdr, &data)) {
+		return 0;
+	}
+
+	fp = fopen(dat_path, "w");
+	if (fp == NULL) {
+		printf("File does not exists \n");
+		free(data);
+		return 0;
+	}
+	for (k = 0; k < hdr.num_of_samples; k++) {
+		fprintf(fp, "%lld\n", (long long) scan_file_sample(&hdr, data, k));
+	}
+	fclose(fp);
+
+	if (avg_path != NULL && hdr.samples_per_echo > 0) { // the echo sum, as in avg_NNN
+		avr_data = (int64_t *) calloc(hdr.samples_per_echo, sizeof(int64_t));
+		num_of_echo_samples = (unsigned long) hdr.samples_per_echo * hdr.echoes_per_scan;
+		if (num_of_echo_samples > hdr.num_of_samples) {
+			num_of_echo_samples = hdr.num_of_samples;
+		}
+		for (k = 0; k < num_of_echo_samples; k++) {
+			avr_data[k % hdr.samples_per_echo] += scan_file_sample(&hdr, data, k);
+		}
+		fp = fopen(avg_path, "w");
+		if (fp == NULL) {
+			printf("File does not exists \n");
+			free(avr_data);
+			free(data);
+			return 0;
+		}
+		for (k = 0; k < hdr.samples_per_echo; k++) {
+			fprintf(fp, "%lld\n", (long long) avr_data[k]);
+		}
+		fclose(fp);
+		free(avr_data);
+	}
+	free(data);
+	return 1;
+}
+
+/* conversion tool : uncomment this main function below and build it alone (gcc scan_file.c -o scan2txt), it does not need the hwlib
+// usage: scan2txt dat_001.bin dat_001 [avg_001]
+int main (int argc, char * argv[]) {
+	scan_file_header hdr;
+	void *data;
+
+	if (argc < 3) {
+		printf("usage: %s <scan file> <text data file> [text average file]\n", argv[0]);
+		return 1;
+	}
+	if (!scan_file_to_text(argv[1], argv[2], argc > 3 ? argv[3] : NULL)) {
+		return 1;
+	}
+	if (scan_file_read(argv[1], &hdr, &data)) {
+		printf("b1Freq = %4.3f\nadcFreq = %4.3f\nnrPnts = %u\nnrEchoes = %u\np90LengthCnt = %u\nd90LengthCnt = %u\np180LengthCnt = %u\nd180LengthCnt = %u\nusePhaseCycle = %u (phase %u)\nnrScans = %u\ntime = %llu.%09u\n",
+				hdr.b1_freq, hdr.adc_freq, hdr.samples_per_echo, hdr.echoes_per_scan, hdr.pulse1_cnt, hdr.delay1_cnt,
+				hdr.pulse2_cnt, hdr.delay2_cnt, hdr.ph_cycl & SCAN_PH_CYCL_EN, (hdr.ph_cycl & SCAN_PH_CYCL_STATE) ? 1 : 0,
+				hdr.num_of_scans, (unsigned long long) hdr.time_sec, hdr.time_nsec);
+		free(data);
+	}
+	return 0;
+}
+*/
@@ -0,0 +1,61 @@
+// Binary scan file: a fixed header followed by the data, little endian (the native order of the HPS and of x86).
+// The data is either the packed fifo words as they come out of the fifo (2 samples per word, lower half
+// first, 14 significant bit each), 16-bit samples, the signed 64-bit sums of several scans (scan_accum.h) or the
+// interleaved I/Q of the downconverter or of the echo integration (ddc.h, echo_integ.h, the sample counts then count I and Q separately). The whole file is written with one system call.
+// The header carries the scan parameters that are otherwise only in acqu.par, so a single file can be
+// interpreted on its own. scan_file_to_text turns the file back into the legacy text layout (one sample per line).
+
+#ifndef SCAN_FILE_H_
+#define SCAN_FILE_H_
+
+#include <stdint.h>
+
+#define SCAN_FILE_MAGIC			"NMRD"
+#define SCAN_FILE_VERSION		1
+#define SCAN_FILE_EXT			".bin"	// appended to the legacy file name
+
+// data type
+#define SCAN_DATA_FIFO_WORDS	0	// packed fifo words, 4 bytes per 2 samples
+#define SCAN_DATA_U16			1	// uint16_t samples
+#define SCAN_DATA_S64			2	// int64_t sums of num_of_scans scans
+#define SCAN_DATA_IQ16			3	// int16_t I, Q, I, Q, ... at adc_freq / decimation
+#define SCAN_DATA_IQ32			4	// int32_t I, Q of every echo, in 2^-ECHO_INTEG_FRAC_BITS LSB (echo_integ.h)
+
+// ph_cycl bits
+#define SCAN_PH_CYCL_EN			(1<<0)	// usePhaseCycle
+#define SCAN_PH_CYCL_STATE		(1<<1)	// the PHASE_CYCLING bit of ctrl_out during the scan
+
+typedef struct {
+	char magic[4];					// SCAN_FILE_MAGIC
+	uint16_t version;
+	uint16_t header_size;			// the data starts at this offset
+	uint32_t data_type;
+	uint32_t num_of_samples;		// samples in the file
+	uint32_t samples_per_echo;		// nrPnts
+	uint32_t echoes_per_scan;		// nrEchoes
+	uint32_t pulse1_cnt;			// p90LengthCnt (nmr fsm clock cycles)
+	uint32_t delay1_cnt;			// d90LengthCnt
+	uint32_t pulse2_cnt;			// p180LengthCnt
+	uint32_t delay2_cnt;			// d180LengthCnt
+	uint32_t init_adc_delay_cnt;	// adc clock cycles
+	uint32_t ph_cycl;
+	double b1_freq;					// b1Freq in MHz
+	double adc_freq;				// adcFreq in MHz
+	double fsm_clkfreq;				// nmr fsm clock in MHz
+	uint64_t time_sec;				// scan start (CLOCK_REALTIME)
+	uint32_t time_nsec;
+	uint32_t num_of_scans;			// scans summed into the data, 0 for a single scan
+} scan_file_header;
+
+typedef char scan_file_header_size_check[(sizeof(scan_file_header) == 88) ? 1 : -1]; // the layout must not depend on the compiler
+
+void scan_file_init_header (scan_file_header *hdr, double b1_freq, double adc_freq, double fsm_clkfreq);
+void scan_file_stamp (scan_file_header *hdr);	// set the timestamp to now
+unsigned long scan_file_data_size (const scan_file_header *hdr);	// in bytes
+int scan_file_write (const char *path, scan_file_header *hdr, uint32_t data_type,
+		const void *data, uint32_t num_of_samples); // returns 0 on error
+int scan_file_read (const char *path, scan_file_header *hdr, void **data); // data is malloc'ed, returns 0 on error
+int64_t scan_file_sample (const scan_file_header *hdr, const void *data, unsigned long k); // the k-th sample (or sum) of the data
+int scan_file_to_text (const char *path, const char *dat_path, const char *avg_path); // avg_path can be NULL
+
+#endif
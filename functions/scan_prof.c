@@ -0,0 +1,149 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "scan_prof.h"
+
+const char *scan_prof_stage_name[SCAN_PROF_STAGES] = { "wait", "setup", "pll", "sequence", "drain", "process",
+		"write", "other", "total" };
+
+static uint64_t scan_prof_now () {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &t);
+	return (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+void scan_prof_init (scan_prof *p) {
+	memset(p, 0, sizeof(scan_prof));
+}
+
+void scan_prof_free (scan_prof *p) {
+	int k;
+
+	for (k = 0; k < SCAN_PROF_STAGES; k++) {
+		free(p->ns[k]);
+	}
+	scan_prof_init(p);
+}
+
+void scan_prof_reset (scan_prof *p) {
+	p->active = 0;
+	p->scans = 0;
+}
+
+void scan_prof_begin (scan_prof *p) {
+	memset(p->cur_ns, 0, sizeof(p->cur_ns));
+	p->t_begin_ns = scan_prof_now();
+	p->t_last_ns = p->t_begin_ns;
+	p->active = 1;
+}
+
+void scan_prof_mark (scan_prof *p, int stage) {
+	uint64_t t;
+
+	if (!p->active) {
+		return;
+	}
+	t = scan_prof_now();
+	p->cur_ns[stage] += t - p->t_last_ns;
+	p->t_last_ns = t;
+}
+
+void scan_prof_end (scan_prof *p) {
+	unsigned long size;
+	uint64_t *ns;
+	int k;
+
+	if (!p->active) {
+		return;
+	}
+	scan_prof_mark(p, SCAN_PROF_OTHER);
+	p->cur_ns[SCAN_PROF_TOTAL] = p->t_last_ns - p->t_begin_ns;
+	p->active = 0;
+
+	if (p->scans == p->size) {
+		size = p->size ? 2 * p->size : 256;
+		for (k = 0; k < SCAN_PROF_STAGES; k++) {
+			ns = realloc(p->ns[k], size * sizeof(uint64_t));
+			if (ns == NULL) {
+				printf("ERROR: no memory for the scan profile, scan %lu is dropped\n", p->scans);
+				return;
+			}
+			p->ns[k] = ns;
+		}
+		p->size = size;
+	}
+	for (k = 0; k < SCAN_PROF_STAGES; k++) {
+		p->ns[k][p->scans] = p->cur_ns[k];
+	}
+	p->scans++;
+}
+
+static int cmp_u64 (const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *) a;
+	uint64_t y = *(const uint64_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+// nearest rank: the smallest value with at least q of the scans at or below it
+static double rank_us (const uint64_t *sorted, unsigned long n, double q) {
+	unsigned long r = (unsigned long) (q * n + 0.999999);
+
+	if (r < 1) {
+		r = 1;
+	}
+	return sorted[(r > n ? n : r) - 1] * 1e-3;
+}
+
+void scan_prof_get_stat (const scan_prof *p, int stage, scan_prof_stat *st) {
+	unsigned long n = p->scans;
+	uint64_t *sorted;
+	double sum = 0;
+	unsigned long k;
+
+	memset(st, 0, sizeof(scan_prof_stat));
+	if (n == 0) {
+		return;
+	}
+	sorted = malloc(n * sizeof(uint64_t));
+	if (sorted == NULL) {
+		return;
+	}
+	memcpy(sorted, p->ns[stage], n * sizeof(uint64_t));
+	qsort(sorted, n, sizeof(uint64_t), cmp_u64);
+	for (k = 0; k < n; k++) {
+		sum += sorted[k];
+	}
+	st->count = n;
+	st->mean_us = sum * 1e-3 / n;
+	st->p50_us = rank_us(sorted, n, 0.50);
+	st->p90_us = rank_us(sorted, n, 0.90);
+	st->p99_us = rank_us(sorted, n, 0.99);
+	st->max_us = sorted[n - 1] * 1e-3;
+	free(sorted);
+}
+
+void scan_prof_print (const scan_prof *p) {
+	scan_prof_stat st;
+	int k;
+
+	printf("scan profile: %lu scans\n\t%-9s %10s %10s %10s %10s %10s\n", p->scans, "stage", "mean us", "p50 us",
+			"p90 us", "p99 us", "max us");
+	for (k = 0; k < SCAN_PROF_STAGES; k++) {
+		scan_prof_get_stat(p, k, &st);
+		printf("\t%-9s %10.1f %10.1f %10.1f %10.1f %10.1f\n", scan_prof_stage_name[k], st.mean_us, st.p50_us,
+				st.p90_us, st.p99_us, st.max_us);
+	}
+}
+
+void scan_prof_write_csv (const scan_prof *p, FILE *f, const char *point) {
+	scan_prof_stat st;
+	int k;
+
+	for (k = 0; k < SCAN_PROF_STAGES; k++) {
+		scan_prof_get_stat(p, k, &st);
+		fprintf(f, "%s,%s,%lu,%.3f,%.3f,%.3f,%.3f,%.3f\n", point, scan_prof_stage_name[k], st.count, st.mean_us,
+				st.p50_us, st.p90_us, st.p99_us, st.max_us);
+	}
+}
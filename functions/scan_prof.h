@@ -0,0 +1,60 @@
+// Per-scan latency breakdown: a scan is cut into stages by marks put in the acquisition code, and the time between
+// two marks is added to the stage of the second one. The caller brackets every scan with scan_prof_begin and
+// scan_prof_end, which keeps one value per stage and scan, so the percentiles of every stage can be reported per
+// measurement point. The time after the last mark of a scan goes to SCAN_PROF_OTHER, and SCAN_PROF_TOTAL is the whole
+// scan, so the stages always add up to the total.
+// The marks are free while the profiler is not active (outside begin/end), so they stay in the code for good.
+// Timestamps are CLOCK_MONOTONIC_RAW, which NTP does not slew.
+
+#ifndef SCAN_PROF_H_
+#define SCAN_PROF_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define SCAN_PROF_WAIT			0	// the scan spacing or the wait for the scheduler
+#define SCAN_PROF_SETUP			1	// the sequence parameters and the control lines
+#define SCAN_PROF_PLL			2	// the nmr system pll or the dps
+#define SCAN_PROF_SEQUENCE		3	// the sequence itself, until NMR_SEQ_run goes low
+#define SCAN_PROF_DRAIN			4	// reading the fifo (overlaps the sequence when streaming)
+#define SCAN_PROF_PROCESS		5	// unpacking, summing, handing the scan off
+#define SCAN_PROF_WRITE			6	// writing the data files
+#define SCAN_PROF_OTHER			7	// after the last mark
+#define SCAN_PROF_TOTAL			8
+#define SCAN_PROF_STAGES		9
+
+#define SCAN_PROF_CSV_HEADER	"measurement,samples_per_echo,echoes_per_scan,iterations,stage,count,mean_us,p50_us,p90_us,p99_us,max_us\n"
+
+typedef struct {
+	int active;						// between scan_prof_begin and scan_prof_end
+	uint64_t t_begin_ns;
+	uint64_t t_last_ns;				// the last mark
+	uint64_t cur_ns[SCAN_PROF_STAGES];	// the scan being profiled
+	uint64_t *ns[SCAN_PROF_STAGES];	// one value per stage and scan
+	unsigned long scans;
+	unsigned long size;				// of the ns arrays, grown by scan_prof_end
+} scan_prof;
+
+typedef struct {
+	unsigned long count;
+	double mean_us;
+	double p50_us;
+	double p90_us;
+	double p99_us;
+	double max_us;
+} scan_prof_stat;
+
+extern const char *scan_prof_stage_name[SCAN_PROF_STAGES];
+
+void scan_prof_init (scan_prof *p);
+void scan_prof_free (scan_prof *p);
+void scan_prof_reset (scan_prof *p);	// drop the scans, for the next measurement point
+void scan_prof_begin (scan_prof *p);
+void scan_prof_mark (scan_prof *p, int stage);	// the time since the last mark goes to stage
+void scan_prof_end (scan_prof *p);
+void scan_prof_get_stat (const scan_prof *p, int stage, scan_prof_stat *st);	// nearest-rank percentiles
+void scan_prof_print (const scan_prof *p);
+// one row per stage, point is the first four columns of SCAN_PROF_CSV_HEADER without the trailing comma
+void scan_prof_write_csv (const scan_prof *p, FILE *f, const char *point);
+
+#endif
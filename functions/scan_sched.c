@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "scan_sched.h"
+
+static uint64_t scan_monotonic_now (void *ctx) {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static void scan_monotonic_sleep_until (void *ctx, uint64_t t_ns) {
+	struct timespec t;
+
+	t.tv_sec = t_ns / 1000000000;
+	t.tv_nsec = t_ns % 1000000000;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) != 0)
+		; // interrupted by a signal: the deadline is absolute, so just sleep again
+}
+
+const scan_clock scan_clock_monotonic = { scan_monotonic_now, scan_monotonic_sleep_until, NULL };
+
+static uint64_t scan_fake_now (void *ctx) {
+	return *(uint64_t *) ctx;
+}
+
+static void scan_fake_sleep_until (void *ctx, uint64_t t_ns) {
+	if (t_ns > *(uint64_t *) ctx) {
+		*(uint64_t *) ctx = t_ns;
+	}
+}
+
+void scan_clock_fake (scan_clock *clk, uint64_t *t_ns) {
+	clk->now = scan_fake_now;
+	clk->sleep_until = scan_fake_sleep_until;
+	clk->ctx = t_ns;
+}
+
+int scan_sched_init (scan_sched *s, const scan_clock *clk, uint64_t period_ns, unsigned long log_size) {
+	memset(s, 0, sizeof(scan_sched));
+	s->clk = *clk;
+	s->period_ns = period_ns;
+	if (log_size > 0) {
+		s->jitter_log = (int64_t *) malloc(log_size * sizeof(int64_t));
+		if (s->jitter_log == NULL) {
+			printf("ERROR: cannot allocate the jitter log of %lu scans\n", log_size);
+			return 0;
+		}
+		s->log_size = log_size;
+	}
+	return 1;
+}
+
+void scan_sched_free (scan_sched *s) {
+	free(s->jitter_log);
+	memset(s, 0, sizeof(scan_sched)); // period_ns 0: not scheduling
+}
+
+void scan_sched_wait (scan_sched *s) {
+	if (s->deadline_ns == 0) { // the first scan starts now
+		s->deadline_ns = s->clk.now(s->clk.ctx);
+		s->late = 0;
+		return;
+	}
+	s->late = s->clk.now(s->clk.ctx) > s->deadline_ns;
+	if (!s->late) {
+		s->clk.sleep_until(s->clk.ctx, s->deadline_ns);
+	}
+}
+
+void scan_sched_started (scan_sched *s) {
+	uint64_t t = s->clk.now(s->clk.ctx);
+	int64_t jitter = (int64_t) (t - s->deadline_ns);
+
+	if (s->scans < s->log_size) {
+		s->jitter_log[s->scans] = jitter;
+	}
+	if (s->scans == 0) {
+		s->t_first_ns = t;
+	}
+	s->t_last_ns = t;
+	s->scans++;
+
+	if (s->late) { // the grid restarts from this scan
+		s->overruns++;
+		s->deadline_ns = t + s->period_ns;
+		return;
+	}
+	if (s->scans - s->overruns == 1 || jitter < s->jitter_min_ns) {
+		s->jitter_min_ns = jitter;
+	}
+	if (s->scans - s->overruns == 1 || jitter > s->jitter_max_ns) {
+		s->jitter_max_ns = jitter;
+	}
+	s->jitter_sum_ns += jitter;
+	s->deadline_ns += s->period_ns;
+}
+
+void scan_sched_print_stat (const scan_sched *s) {
+	unsigned long on_time = s->scans - s->overruns;
+
+	printf("scan scheduler: %lu scans every %.3f ms, mean period %.3f ms, %lu overruns\n", s->scans,
+			s->period_ns * 1e-6, s->scans > 1 ? (s->t_last_ns - s->t_first_ns) * 1e-6 / (s->scans - 1) : 0,
+			s->overruns);
+	if (on_time > 0) {
+		printf("\tstart jitter: min %.1f us, mean %.1f us, max %.1f us\n", s->jitter_min_ns * 1e-3,
+				s->jitter_sum_ns * 1e-3 / on_time, s->jitter_max_ns * 1e-3);
+	}
+}
+
+int scan_sched_write_log (const scan_sched *s, const char *path) {
+	unsigned long n, len = s->scans < s->log_size ? s->scans : s->log_size;
+	FILE *f = fopen(path, "w");
+
+	if (f == NULL) {
+		printf("ERROR: cannot write %s\n", path);
+		return 0;
+	}
+	for (n = 0; n < len; n++) {
+		fprintf(f, "%.3f\n", s->jitter_log[n] * 1e-3);
+	}
+	fclose(f);
+	return 1;
+}
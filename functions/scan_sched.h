@@ -0,0 +1,48 @@
+// Absolute-time scan scheduler: the sequences are started on a grid of CLOCK_MONOTONIC deadlines one period apart,
+// with clock_nanosleep(TIMER_ABSTIME), instead of sleeping a fixed spacing in front of every scan. The set up, the
+// readout and the file writing of a scan then fill the gap to the next start instead of adding to the repetition time.
+// A scan that is not ready at its deadline starts at once and the grid moves with it, so two starts are never closer
+// than one period and the T1 recovery stays the same for every scan.
+// The start of every scan is taken right after FSM_START; its lateness against the deadline is the jitter, which is
+// logged per scan. The clock is a pair of functions, so the scheduling also runs against a fake clock.
+
+#ifndef SCAN_SCHED_H_
+#define SCAN_SCHED_H_
+
+#include <stdint.h>
+
+typedef struct {
+	uint64_t (*now) (void *ctx);						// in ns
+	void (*sleep_until) (void *ctx, uint64_t t_ns);		// absolute, returns at once if t_ns has passed
+	void *ctx;
+} scan_clock;
+
+typedef struct {
+	scan_clock clk;
+	uint64_t period_ns;
+	uint64_t deadline_ns;			// the start of the next scan, 0 before the first one (it starts at once)
+	int late;						// the deadline had passed when scan_sched_wait was called
+	unsigned long scans;
+	unsigned long overruns;			// scans that were not ready at their deadline
+	int64_t jitter_min_ns;			// of the scans that were on time
+	int64_t jitter_max_ns;
+	int64_t jitter_sum_ns;
+	uint64_t t_first_ns;			// the first and the last start
+	uint64_t t_last_ns;
+	int64_t *jitter_log;			// the lateness of every scan, log_size entries
+	unsigned long log_size;
+} scan_sched;
+
+extern const scan_clock scan_clock_monotonic;
+// a clock that stands still except when it is told to sleep (it jumps to the deadline) or is moved by the caller
+void scan_clock_fake (scan_clock *clk, uint64_t *t_ns);
+
+// period_ns between the starts, the jitter of the first log_size scans is kept. Returns 0 if the log cannot be allocated
+int scan_sched_init (scan_sched *s, const scan_clock *clk, uint64_t period_ns, unsigned long log_size);
+void scan_sched_free (scan_sched *s);			// also clears period_ns
+void scan_sched_wait (scan_sched *s);		// sleep until the deadline of the next scan, right before FSM_START
+void scan_sched_started (scan_sched *s);	// right after FSM_START: take the start time and set the next deadline
+void scan_sched_print_stat (const scan_sched *s);
+int scan_sched_write_log (const scan_sched *s, const char *path);	// one line per scan: start lateness in us. Returns 0 on error
+
+#endif
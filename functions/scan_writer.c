@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "general.h"
+#include "echo_unpack.h"
+#include "scan_writer.h"
+
+void stage_time_add (stage_time *st, const struct timespec *t_start, const struct timespec *t_end) {
+	int64_t ns = (int64_t) (t_end->tv_sec - t_start->tv_sec) * 1000000000LL
+			+ (t_end->tv_nsec - t_start->tv_nsec);
+
+	if (ns < 0) {
+		ns = 0;
+	}
+	st->count++;
+	st->total_ns += ns;
+	if ((uint64_t) ns > st->max_ns) {
+		st->max_ns = ns;
+	}
+}
+
+static int sem_wait_intr (sem_t *sem) { // sem_wait that is not broken by a signal
+	while (sem_wait(sem) != 0) {
+		if (errno != EINTR) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static int writer_reserve (void **buf, size_t *capacity, size_t count, size_t elem_size) {
+	void *p;
+
+	if (count <= *capacity) {
+		return 1;
+	}
+	p = realloc(*buf, count * elem_size);
+	if (p == NULL) {
+		printf("ERROR: cannot allocate %lu words for the scan writer\n", (unsigned long) count);
+		return 0;
+	}
+	*buf = p;
+	*capacity = count;
+	return 1;
+}
+
+// unpack, sum and write one scan, only with the buffers of the writer
+static void writer_write_slot (scan_writer *w, scan_slot *s) {
+	struct timespec t0, t1, t2;
+	char path[2 * SCAN_NAME_LENGTH + 8];
+	size_t num_of_samples = s->num_of_words * 2;
+	size_t k;
+	FILE *fp;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (!writer_reserve((void **) &w->avr_data, &w->avr_capacity, s->samples_per_echo, sizeof(unsigned int))
+			|| (w->format != DATA_FILE_BIN
+					&& !writer_reserve((void **) &w->samples, &w->samples_capacity, num_of_samples, sizeof(uint16_t)))) {
+		w->errors++;
+		return;
+	}
+	memset(w->avr_data, 0, s->samples_per_echo * sizeof(unsigned int));
+	echo_unpack_sum(s->words, s->num_of_words, s->samples_per_echo,
+			w->format == DATA_FILE_BIN ? NULL : w->samples, w->avr_data);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	trace_event(w->trace, TRACE_WRITE_BEGIN, 0);
+
+	// the raw data
+	if (w->format == DATA_FILE_BIN) {
+		snprintf(path, sizeof(path), "%s/%s%s", w->folder, s->filename, SCAN_FILE_EXT);
+		if (!scan_file_write(path, &s->hdr, SCAN_DATA_FIFO_WORDS, s->words, num_of_samples)) {
+			w->errors++;
+		}
+	} else {
+		snprintf(path, sizeof(path), "%s/%s", w->folder, s->filename);
+		fp = fopen(path, "w");
+		if (fp == NULL) {
+			printf("File does not exists \n");
+			w->errors++;
+		} else {
+			for (k = 0; k < num_of_samples; k++) {
+				fprintf(fp, "%d\n", w->samples[k]);
+			}
+			fclose(fp);
+		}
+	}
+
+	// the echo sum
+	snprintf(path, sizeof(path), "%s/%s", w->folder, s->avgname);
+	fp = fopen(path, "w");
+	if (fp == NULL) {
+		printf("File does not exists \n");
+		w->errors++;
+	} else {
+		for (k = 0; k < s->samples_per_echo; k++) {
+			fprintf(fp, "%d\n", w->avr_data[k]);
+		}
+		fclose(fp);
+	}
+	trace_event(w->trace, TRACE_WRITE_END, 0);
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+
+	stage_time_add(&w->t_unpack, &t0, &t1);
+	stage_time_add(&w->t_write, &t1, &t2);
+}
+
+static void * writer_thread (void *arg) {
+	scan_writer *w = (scan_writer *) arg;
+	scan_slot *s;
+
+	for (;;) {
+		if (!sem_wait_intr(&w->full_slots)) {
+			break;
+		}
+		s = &w->slot[w->tail % SCAN_WRITER_DEPTH];
+		if (s->stop) {
+			break;
+		}
+		writer_write_slot(w, s);
+		w->tail++;
+		sem_post(&w->free_slots); // the slot can be filled again
+	}
+	return NULL;
+}
+
+int scan_writer_start (scan_writer *w, const char *folder, uint8_t format) {
+	memset(w, 0, sizeof(scan_writer));
+	snprintf(w->folder, SCAN_NAME_LENGTH, "%s", folder);
+	w->format = format;
+	if (sem_init(&w->free_slots, 0, SCAN_WRITER_DEPTH) != 0 || sem_init(&w->full_slots, 0, 0) != 0) {
+		printf("ERROR: cannot create the scan writer semaphores\n");
+		return 0;
+	}
+	if (pthread_create(&w->thread, NULL, writer_thread, w) != 0) {
+		printf("ERROR: cannot start the scan writer thread\n");
+		sem_destroy(&w->free_slots);
+		sem_destroy(&w->full_slots);
+		return 0;
+	}
+	w->running = 1;
+	return 1;
+}
+
+// take a free slot, blocking while the writer is behind by SCAN_WRITER_DEPTH scans
+static scan_slot * writer_acquire (scan_writer *w) {
+	struct timespec t0, t1;
+	unsigned int queued;
+	int free_slots = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (!sem_wait_intr(&w->free_slots)) {
+		return NULL;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	stage_time_add(&w->t_wait, &t0, &t1);
+
+	sem_getvalue(&w->free_slots, &free_slots);
+	queued = SCAN_WRITER_DEPTH - free_slots; // including the one being filled
+	if (queued > w->max_queued) {
+		w->max_queued = queued;
+	}
+	return &w->slot[w->head % SCAN_WRITER_DEPTH];
+}
+
+static void writer_publish (scan_writer *w) {
+	w->head++;
+	sem_post(&w->full_slots); // the semaphore also orders the slot contents before the writer reads them
+}
+
+int scan_writer_submit (scan_writer *w, const scan_file_header *hdr, const uint32_t *words,
+		size_t num_of_words, unsigned int samples_per_echo, unsigned int echoes_per_scan,
+		const char *filename, const char *avgname) {
+	struct timespec t0, t1;
+	scan_slot *s;
+
+	if (!w->running || (s = writer_acquire(w)) == NULL) {
+		return 0;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (!writer_reserve((void **) &s->words, &s->capacity, num_of_words, sizeof(uint32_t))) {
+		w->submit_errors++;
+		sem_post(&w->free_slots); // give the slot back
+		return 0;
+	}
+	memcpy(s->words, words, num_of_words * sizeof(uint32_t));
+	s->num_of_words = num_of_words;
+	s->samples_per_echo = samples_per_echo;
+	s->echoes_per_scan = echoes_per_scan;
+	s->hdr = *hdr;
+	s->hdr.samples_per_echo = samples_per_echo;
+	s->hdr.echoes_per_scan = echoes_per_scan;
+	snprintf(s->filename, SCAN_NAME_LENGTH, "%s", filename);
+	snprintf(s->avgname, SCAN_NAME_LENGTH, "%s", avgname);
+	s->stop = 0;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	stage_time_add(&w->t_copy, &t0, &t1);
+
+	writer_publish(w);
+	return 1;
+}
+
+void scan_writer_skip (scan_writer *w, const char *filename) {
+	if (!w->running) {
+		return;
+	}
+	w->skipped++;
+	printf("[ERROR] scan writer: %s is skipped, the scan was not captured\n", filename);
+}
+
+void scan_writer_flush (scan_writer *w) {
+	int k;
+
+	if (!w->running) {
+		return;
+	}
+	for (k = 0; k < SCAN_WRITER_DEPTH; k++) { // holding every slot means that nothing is left to write
+		sem_wait_intr(&w->free_slots);
+	}
+	for (k = 0; k < SCAN_WRITER_DEPTH; k++) {
+		sem_post(&w->free_slots);
+	}
+}
+
+void scan_writer_stop (scan_writer *w) {
+	int k;
+
+	if (!w->running) {
+		return;
+	}
+	if (sem_wait_intr(&w->free_slots)) { // the writer finishes the scans before it and exits on this slot
+		w->slot[w->head % SCAN_WRITER_DEPTH].stop = 1;
+		writer_publish(w);
+	}
+	pthread_join(w->thread, NULL);
+	w->running = 0;
+
+	sem_destroy(&w->free_slots);
+	sem_destroy(&w->full_slots);
+	for (k = 0; k < SCAN_WRITER_DEPTH; k++) {
+		free(w->slot[k].words);
+		w->slot[k].words = NULL;
+		w->slot[k].capacity = 0;
+	}
+	free(w->samples);
+	w->samples = NULL;
+	free(w->avr_data);
+	w->avr_data = NULL;
+}
+
+static void print_stage (const char *name, const stage_time *st) {
+	printf("  %-8s: %6lu x, avg %9.3f ms, max %9.3f ms\n", name, st->count,
+			st->count ? (double) st->total_ns / st->count * 1e-6 : 0.0, (double) st->max_ns * 1e-6);
+}
+
+void scan_writer_print_stat (scan_writer *w) {
+	printf("scan writer (%d slots, at most %u in use, %lu errors, %lu scans skipped):\n", SCAN_WRITER_DEPTH,
+			w->max_queued, w->errors + w->submit_errors, w->skipped); // read after scan_writer_stop joined the writer
+	print_stage("acquire", &w->t_acq);
+	print_stage("wait", &w->t_wait);
+	print_stage("copy", &w->t_copy);
+	print_stage("unpack", &w->t_unpack);
+	print_stage("write", &w->t_write);
+}
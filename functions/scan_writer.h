@@ -0,0 +1,79 @@
+// Background writer for the scan data.
+// The acquisition hands every scan (packed fifo words plus its header and file names) to a bounded
+// single-producer/single-consumer queue of scan slots; a writer thread unpacks the words, sums the
+// echoes and writes the data files. The file writing of scan k then overlaps the repetition delay and
+// the acquisition of scan k+1, and the acquisition only waits when all slots are still being written.
+// The writer only uses its own buffers and local variables, so it does not race with the globals
+// (adc_arena, i, j, fptr, pathname) used by the acquisition.
+
+#ifndef SCAN_WRITER_H_
+#define SCAN_WRITER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include "scan_file.h"
+#include "trace_ring.h"
+
+#define SCAN_WRITER_DEPTH		4	// scan slots in the queue
+#define SCAN_NAME_LENGTH		100
+
+typedef struct {
+	unsigned long count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+} stage_time;
+
+typedef struct {
+	uint32_t *words;				// packed fifo words
+	size_t capacity;				// in words, grows on demand and is kept for the next scans
+	size_t num_of_words;
+	unsigned int samples_per_echo;
+	unsigned int echoes_per_scan;
+	scan_file_header hdr;
+	char filename[SCAN_NAME_LENGTH];
+	char avgname[SCAN_NAME_LENGTH];
+	int stop;						// tells the writer thread to exit
+} scan_slot;
+
+typedef struct {
+	scan_slot slot[SCAN_WRITER_DEPTH];
+	unsigned long head;				// slots published by the producer
+	unsigned long tail;				// slots released by the writer
+	sem_t free_slots;
+	sem_t full_slots;
+	pthread_t thread;
+	int running;
+	char folder[SCAN_NAME_LENGTH];
+	uint8_t format;					// DATA_FILE_TEXT or DATA_FILE_BIN
+	uint16_t *samples;				// writer-side unpack buffer
+	size_t samples_capacity;
+	unsigned int *avr_data;			// writer-side echo sum
+	size_t avr_capacity;
+	// per-stage timing
+	stage_time t_acq;				// acquisition of one scan (filled by the producer with stage_time_add)
+	stage_time t_wait;				// the producer waited for a free slot
+	stage_time t_copy;				// copying the words into the slot
+	stage_time t_unpack;			// unpacking and echo sum in the writer
+	stage_time t_write;				// file writing in the writer
+	unsigned int max_queued;		// the most scans waiting at once
+	unsigned long errors;			// files the writer thread could not write, only counted by the writer
+	unsigned long submit_errors;	// scans not queued, only counted by the producer
+	unsigned long skipped;			// scans not captured, their files are missing (counted by the producer)
+	trace_ring *trace;				// the file writes of the writer thread, set after scan_writer_start, can be NULL
+} scan_writer;
+
+void stage_time_add (stage_time *st, const struct timespec *t_start, const struct timespec *t_end);
+int scan_writer_start (scan_writer *w, const char *folder, uint8_t format); // returns 0 if the thread cannot be started
+int scan_writer_submit (scan_writer *w, const scan_file_header *hdr, const uint32_t *words,
+		size_t num_of_words, unsigned int samples_per_echo, unsigned int echoes_per_scan,
+		const char *filename, const char *avgname); // blocks while the queue is full, returns 0 on error
+// a scan that is not submitted because it was not captured: logged and counted so that the missing files are explained
+void scan_writer_skip (scan_writer *w, const char *filename);
+void scan_writer_flush (scan_writer *w);	// wait until every submitted scan is written
+void scan_writer_stop (scan_writer *w);		// write the remaining scans, stop the thread and free the buffers
+void scan_writer_print_stat (scan_writer *w);
+
+#endif
@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include "sim_bus.h"
+
+typedef struct {
+	char *base;
+	size_t span;
+	sim_bus_rd_fn rd;
+	sim_bus_wr_fn wr;
+	void *ctx;
+} sim_bus_region;
+
+int sim_bus_en = 0;
+
+static sim_bus_region region[SIM_BUS_MAX_REGION];
+static unsigned int num_of_region = 0;
+static sim_bus_region *last_hit = NULL; // the acquisition loops hit the same register over and over, so check the last region first
+
+int sim_bus_map (void *base, size_t span, sim_bus_rd_fn rd, sim_bus_wr_fn wr, void *ctx) {
+	if (num_of_region >= SIM_BUS_MAX_REGION) {
+		printf("ERROR: sim_bus region table is full\n");
+		return 0;
+	}
+	region[num_of_region].base = (char *) base;
+	region[num_of_region].span = span;
+	region[num_of_region].rd = rd;
+	region[num_of_region].wr = wr;
+	region[num_of_region].ctx = ctx;
+	num_of_region++;
+	return 1;
+}
+
+void sim_bus_unmap_all () {
+	num_of_region = 0;
+	last_hit = NULL;
+}
+
+static sim_bus_region * find_region (char *addr) {
+	unsigned int k;
+
+	if (last_hit != NULL && addr >= last_hit->base && addr < last_hit->base + last_hit->span) {
+		return last_hit;
+	}
+	for (k = 0; k < num_of_region; k++) {
+		if (addr >= region[k].base && addr < region[k].base + region[k].span) {
+			last_hit = &region[k];
+			return last_hit;
+		}
+	}
+	return NULL;
+}
+
+uint32_t sim_bus_read (void *addr) {
+	sim_bus_region *r = find_region((char *) addr);
+
+	if (r == NULL || r->rd == NULL) {
+		return *(volatile uint32_t *) addr;
+	}
+	return r->rd(r->ctx, (uint32_t) ((char *) addr - r->base));
+}
+
+void sim_bus_write (void *addr, uint32_t val) {
+	sim_bus_region *r = find_region((char *) addr);
+
+	if (r == NULL || r->wr == NULL) {
+		*(volatile uint32_t *) addr = val;
+		return;
+	}
+	r->wr(r->ctx, (uint32_t) ((char *) addr - r->base), val);
+}
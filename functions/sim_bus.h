@@ -0,0 +1,30 @@
+// Simulated avalon bus.
+// Register accesses that need to be emulated off the board go through bus_read_word/bus_write_word.
+// On the board these are the plain alt_read_word/alt_write_word (sim_bus_en is 0).
+// When sim_bus_en is set, every access falling into a region registered with sim_bus_map is handed
+// to the model of that peripheral. Accesses outside of the mapped regions go to plain memory,
+// which is enough for write-only registers like the NMR sequence parameters.
+
+#ifndef SIM_BUS_H_
+#define SIM_BUS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "socal/socal.h"
+
+#define SIM_BUS_MAX_REGION		16
+
+typedef uint32_t (*sim_bus_rd_fn) (void *ctx, uint32_t ofst);				// ofst is the byte offset from the region base
+typedef void (*sim_bus_wr_fn) (void *ctx, uint32_t ofst, uint32_t val);
+
+extern int sim_bus_en;	// 0: real hardware, 1: dispatch to the peripheral models
+
+int sim_bus_map (void *base, size_t span, sim_bus_rd_fn rd, sim_bus_wr_fn wr, void *ctx);	// returns 0 when the region table is full
+void sim_bus_unmap_all ();
+uint32_t sim_bus_read (void *addr);
+void sim_bus_write (void *addr, uint32_t val);
+
+#define bus_read_word(addr)			(sim_bus_en ? sim_bus_read((void *)(addr)) : alt_read_word(addr))
+#define bus_write_word(addr, val)	do { if (sim_bus_en) sim_bus_write((void *)(addr), (val)); else alt_write_word((addr), (val)); } while (0)
+
+#endif
@@ -0,0 +1,164 @@
+#include <string.h>
+#include <time.h>
+#include "spi_emulator.h"
+#include "avalon_spi.h"
+#include "dac_ad5722r_driver.h"
+#include "general.h"
+#include "sim_bus.h"
+
+static uint64_t spi_emu_now_ns () {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+void spi_emu_init (spi_emu *emu, double sclk_hz, uint32_t bits) {
+	memset(emu, 0, sizeof(spi_emu));
+	emu->sclk_hz = sclk_hz;
+	emu->bits = bits;
+}
+
+static void spi_emu_load (spi_emu *emu) {
+	emu->out[0] = emu->in[0];
+	emu->out[1] = emu->in[1];
+	emu->ldac_loads++;
+}
+
+// a frame at the DAC
+static void spi_emu_dac (spi_emu *emu, uint32_t frame) {
+	uint32_t reg = (frame >> 19) & 0x07, addr = frame & (0x07 << 16);
+	uint16_t data = frame & 0xFFFF;
+
+	if (emu->frames < SPI_EMU_MAX_LOG) {
+		emu->log[emu->frames] = frame;
+	}
+	emu->frames++;
+	if (frame & RD_DAC) { // the read back is not modelled
+		return;
+	}
+	switch (reg << 19) {
+	case DAC_REG:
+		if (addr == DAC_A || addr == DAC_AB) {
+			emu->in[0] = data;
+		}
+		if (addr == DAC_B || addr == DAC_AB) {
+			emu->in[1] = data;
+		}
+		if (!emu->ldac) {
+			emu->out[0] = emu->in[0];
+			emu->out[1] = emu->in[1];
+			emu->frame_loads++;
+		}
+		break;
+	case OUT_RANGE_SEL_REG:
+		if (addr == DAC_A || addr == DAC_AB) {
+			emu->range[0] = data & 0x07;
+		}
+		if (addr == DAC_B || addr == DAC_AB) {
+			emu->range[1] = data & 0x07;
+		}
+		break;
+	case PWR_CNT_REG:
+		emu->power = data;
+		break;
+	case CNT_REG:
+		if (addr == Load) {
+			spi_emu_load(emu);
+		} else if (addr == Clear) {
+			memset(emu->in, 0, sizeof(emu->in));
+			memset(emu->out, 0, sizeof(emu->out));
+		} else if (addr == Other_opt) {
+			emu->ctrl = data & 0x0F;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+void spi_emu_update (spi_emu *emu) {
+	uint64_t now = spi_emu_now_ns(), start;
+
+	for (;;) {
+		if (emu->shift_full && emu->shift_done_ns <= now) {
+			spi_emu_dac(emu, emu->shift);
+			emu->shift_full = 0;
+		}
+		if (emu->shift_full || !emu->hold_full) {
+			return;
+		}
+		// the next frame starts when the previous one ended, or when it was written
+		start = emu->hold_ns > emu->shift_done_ns ? emu->hold_ns : emu->shift_done_ns;
+		emu->shift = emu->hold;
+		emu->shift_full = 1;
+		emu->shift_done_ns = start + (uint64_t) (emu->bits * 1e9 / emu->sclk_hz);
+		emu->hold_full = 0;
+	}
+}
+
+void spi_emu_set_ldac (spi_emu *emu, int level) {
+	spi_emu_update(emu);
+	if (emu->ldac && !level) {
+		emu->ldac_early += emu->shift_full || emu->hold_full;
+		spi_emu_load(emu);
+	}
+	emu->ldac = level;
+}
+
+void spi_emu_ctrl_out (void *ctx, uint32_t ctrl_out) {
+	spi_emu_set_ldac((spi_emu *) ctx, (ctrl_out & DAC_LDAC_en) != 0);
+}
+
+static uint32_t spi_emu_rd (void *ctx, uint32_t ofst) {
+	spi_emu *emu = (spi_emu *) ctx;
+
+	emu->bus_reads++;
+	spi_emu_update(emu);
+	switch (ofst >> 2) {
+	case SPI_STATUS_offst:
+		return (!emu->hold_full ? 1 << status_TRDY_bit : 0)
+				| (!emu->hold_full && !emu->shift_full ? 1 << status_TMT_bit : 0)
+				| (emu->toe ? (1 << status_TOE_bit) | (1 << status_E_bit) : 0);
+	case SPI_CONTROL_offst:
+		return emu->control;
+	case SPI_SLAVESELECT_offst:
+		return emu->slaveselect;
+	default:
+		return 0;
+	}
+}
+
+static void spi_emu_wr (void *ctx, uint32_t ofst, uint32_t val) {
+	spi_emu *emu = (spi_emu *) ctx;
+
+	emu->bus_writes++;
+	spi_emu_update(emu);
+	switch (ofst >> 2) {
+	case SPI_TXDATA_offst:
+		if (emu->hold_full) {
+			emu->toe = 1;
+			break;
+		}
+		emu->hold = val & ((1ULL << emu->bits) - 1);
+		emu->hold_ns = spi_emu_now_ns();
+		emu->hold_full = 1;
+		spi_emu_update(emu);
+		break;
+	case SPI_STATUS_offst: // a write clears the error bits
+		emu->toe = 0;
+		break;
+	case SPI_CONTROL_offst:
+		emu->control = val;
+		break;
+	case SPI_SLAVESELECT_offst:
+		emu->slaveselect = val;
+		break;
+	default:
+		break;
+	}
+}
+
+void spi_emu_attach (spi_emu *emu, void *addr) {
+	sim_bus_map(addr, (SPI_SLAVESELECT_offst + 1) * 4, spi_emu_rd, spi_emu_wr, emu);
+}
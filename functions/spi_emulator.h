@@ -0,0 +1,50 @@
+// Emulated Avalon SPI master (altera_avalon_spi, as dac_preamp) with an AD5722R on its slave select.
+// A word written to TXDATA waits in the holding register (TRDY low) until the shift register is free and is shifted
+// out in bits sclk periods, right after the previous one; TMT is set once both are empty. A write while the holding
+// register is full is lost and sets TOE. Every frame that reaches the DAC is logged as it was shifted.
+// The DAC keeps an input and an output register per channel: a DAC register frame loads the input registers of its
+// channel(s), and the outputs too while LDAC is low; the falling edge of LDAC and the Load command copy both input
+// registers to the outputs. spi_emu_ctrl_out takes the LDAC line from ctrl_out (DAC_LDAC_en set: LDAC high).
+
+#ifndef SPI_EMULATOR_H_
+#define SPI_EMULATOR_H_
+
+#include <stdint.h>
+
+#define SPI_EMU_MAX_LOG		64
+
+typedef struct {
+	double sclk_hz;
+	uint32_t bits;				// per frame
+	uint32_t control;
+	uint32_t slaveselect;
+	uint32_t toe;				// the sticky TOE bit
+	int hold_full;
+	uint32_t hold;
+	uint64_t hold_ns;			// when the holding register was written
+	int shift_full;
+	uint32_t shift;
+	uint64_t shift_done_ns;		// the shift register is empty then
+	// the AD5722R
+	int ldac;					// the LDAC line
+	uint16_t in[2];				// the input registers of DAC A and B, the data bits of the frame
+	uint16_t out[2];			// the output registers
+	uint16_t range[2];
+	uint16_t power;
+	uint16_t ctrl;
+	uint32_t log[SPI_EMU_MAX_LOG];	// the first frames shifted
+	unsigned long frames;
+	unsigned long frame_loads;	// output registers loaded by a frame (LDAC low)
+	unsigned long ldac_loads;	// loads by an LDAC edge or the Load command
+	unsigned long ldac_early;	// LDAC edges with a frame still shifting
+	unsigned long bus_reads;
+	unsigned long bus_writes;
+} spi_emu;
+
+void spi_emu_init (spi_emu *emu, double sclk_hz, uint32_t bits);
+void spi_emu_update (spi_emu *emu);	// shift out the frames that are due
+void spi_emu_set_ldac (spi_emu *emu, int level);
+void spi_emu_ctrl_out (void *ctx, uint32_t ctrl_out);	// a nmr_fsm_emu ctrl_out hook, ctx is the spi_emu
+void spi_emu_attach (spi_emu *emu, void *addr);
+
+#endif
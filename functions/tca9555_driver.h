@@ -5,4 +5,5 @@
 #define CNT_REG_POL_INV_PORT0	0x04
 #define CNT_REG_POL_INV_PORT1	0x05
 #define CNT_REG_CONF_PORT0		0x06
-#define CNT_REG_CONF_PORT1		0x07
\ No newline at end of file
+#define CNT_REG_CONF_PORT1		0x07
+#define TCA9555_ADDR			0x20		// A2..A0 low, one expander on each i2c core
@@ -0,0 +1,125 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "trace_ring.h"
+
+static const struct {
+	const char *name;
+	char ph;						// Chrome trace phase: B/E span, C counter, i instant
+} trace_type[TRACE_TYPES] = {
+	{ "none", 'i' },
+	{ "scan start", 'i' },
+	{ "FSM_START", 'i' },
+	{ "FSM done", 'i' },
+	{ "fifo level", 'C' },
+	{ "drain done", 'i' },
+	{ "write", 'B' },
+	{ "write", 'E' },
+	{ "pll reconfig", 'B' },
+	{ "pll reconfig", 'E' },
+};
+
+static __thread uint16_t trace_tid;
+static __thread int trace_tid_known;
+
+int trace_ring_init (trace_ring *tr, uint64_t events) {
+	uint64_t size = 1;
+
+	while (size < events) {
+		size <<= 1;
+	}
+	tr->buf = malloc(size * sizeof(trace_rec));
+	if (tr->buf == NULL) {
+		printf("ERROR: no memory for a trace of %llu events\n", (unsigned long long) size);
+		return 0;
+	}
+	memset(tr->buf, 0, size * sizeof(trace_rec)); // no page fault while recording
+	tr->mask = size - 1;
+	tr->head = 0;
+	return 1;
+}
+
+void trace_ring_free (trace_ring *tr) {
+	free(tr->buf);
+	tr->buf = NULL;
+	tr->mask = 0;
+	tr->head = 0;
+}
+
+void trace_ring_record (trace_ring *tr, uint16_t type, uint32_t arg) {
+	struct timespec t;
+	trace_rec *rec;
+
+	if (!trace_tid_known) {
+		trace_tid = (uint16_t) syscall(SYS_gettid);
+		trace_tid_known = 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	rec = &tr->buf[__atomic_fetch_add(&tr->head, 1, __ATOMIC_RELAXED) & tr->mask];
+	rec->t_ns = (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
+	rec->arg = arg;
+	rec->tid = trace_tid;
+	__atomic_store_n(&rec->type, type, __ATOMIC_RELEASE);
+}
+
+// the first event still in the ring
+static uint64_t trace_ring_first (const trace_ring *tr) {
+	return tr->head > tr->mask + 1 ? tr->head - (tr->mask + 1) : 0;
+}
+
+uint64_t trace_ring_count (const trace_ring *tr, uint16_t type) {
+	uint64_t n, count = 0;
+
+	if (tr->buf == NULL) {
+		return 0;
+	}
+	for (n = trace_ring_first(tr); n < tr->head; n++) {
+		count += tr->buf[n & tr->mask].type == type;
+	}
+	return count;
+}
+
+int trace_ring_export_chrome (const trace_ring *tr, const char *path) {
+	const trace_rec *rec;
+	uint64_t n, t0 = 0;
+	int first = 1;
+	FILE *f;
+
+	if (tr->buf == NULL) {
+		return 0;
+	}
+	f = fopen(path, "w");
+	if (f == NULL) {
+		printf("ERROR: cannot write the trace to %s\n", path);
+		return 0;
+	}
+	fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	for (n = trace_ring_first(tr); n < tr->head; n++) {
+		rec = &tr->buf[n & tr->mask];
+		if (rec->type == TRACE_NONE || rec->type >= TRACE_TYPES) {
+			continue;
+		}
+		if (first) {
+			t0 = rec->t_ns;
+		}
+		fprintf(f, "%s{\"name\":\"%s\",\"cat\":\"nmr\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u",
+				first ? "" : ",\n", trace_type[rec->type].name, trace_type[rec->type].ph,
+				((int64_t) (rec->t_ns - t0)) * 1e-3, (int) getpid(), rec->tid);
+		if (trace_type[rec->type].ph == 'C') {
+			fprintf(f, ",\"args\":{\"words\":%u}}", rec->arg);
+		} else if (trace_type[rec->type].ph == 'i') {
+			fprintf(f, ",\"s\":\"t\",\"args\":{\"arg\":%u}}", rec->arg);
+		} else {
+			fprintf(f, ",\"args\":{\"arg\":%u}}", rec->arg);
+		}
+		first = 0;
+	}
+	fprintf(f, "\n],\"otherData\":{\"events\":%llu,\"overwritten\":%llu}}\n", (unsigned long long) tr->head,
+			(unsigned long long) trace_ring_first(tr));
+	fclose(f);
+	return 1;
+}
@@ -0,0 +1,53 @@
+// Hot-path trace recorder: fixed-size events (a CLOCK_MONOTONIC timestamp, a type, an argument and the thread)
+// written into a preallocated ring. A producer claims its slot with one atomic add on the head, so the acquisition and
+// the writer thread record without a lock, and a full ring overwrites its oldest events: the ring always holds the
+// last events before the export, which is what explains a slow scan. Recording is a clock read and a 16 byte store,
+// a few tens of ns, so the trace can stay on in production runs; with the ring not allocated trace_event is a
+// single test.
+// The ring is exported as Chrome trace JSON (chrome://tracing, ui.perfetto.dev) once the producers have stopped:
+// spans for the PLL reconfigurations and the file writes, a counter for the fifo level, instants for the rest.
+
+#ifndef TRACE_RING_H_
+#define TRACE_RING_H_
+
+#include <stdint.h>
+
+#define TRACE_RING_DEFAULT_EVENTS	(1<<16)	// 1 MB
+
+// event types, arg in brackets
+#define TRACE_NONE				0	// a slot never written
+#define TRACE_SCAN_START		1	// (samples in the scan)
+#define TRACE_FSM_START			2	// FSM_START written
+#define TRACE_FSM_DONE			3	// NMR_SEQ_run low (0: the wait timed out)
+#define TRACE_FIFO_LEVEL		4	// (fifo level in words)
+#define TRACE_DRAIN_DONE		5	// the scan is read (words read)
+#define TRACE_WRITE_BEGIN		6	// the data files of a scan
+#define TRACE_WRITE_END			7
+#define TRACE_PLL_BEGIN			8	// a pll reconfiguration
+#define TRACE_PLL_END			9	// (1: the pll was reprogrammed, 0: it was up to date)
+#define TRACE_TYPES				10
+
+typedef struct {
+	uint64_t t_ns;
+	uint32_t arg;
+	uint16_t tid;					// the low bits of the thread id
+	uint16_t type;					// written last, TRACE_NONE until the event is complete
+} trace_rec;
+
+typedef struct {
+	trace_rec *buf;					// NULL: the recorder is off
+	uint64_t mask;					// number of slots - 1
+	uint64_t head;					// events recorded, only increments
+} trace_ring;
+
+// the events go nowhere while tr is NULL or its ring is not allocated
+#define trace_event(tr, type, arg)	do { if ((tr) != NULL && (tr)->buf != NULL) trace_ring_record((tr), (type), (arg)); } while (0)
+
+int trace_ring_init (trace_ring *tr, uint64_t events);	// rounded up to a power of 2, the ring is touched up front. Returns 0 without memory
+void trace_ring_free (trace_ring *tr);
+void trace_ring_record (trace_ring *tr, uint16_t type, uint32_t arg);
+uint64_t trace_ring_count (const trace_ring *tr, uint16_t type);	// the events of type still in the ring
+// write the events in the ring to path as Chrome trace JSON, the times in us from the first event. Returns 0 on error
+int trace_ring_export_chrome (const trace_ring *tr, const char *path);
+
+#endif
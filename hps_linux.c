@@ -1,11 +1,15 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <signal.h>
 #include <unistd.h>
 #include <time.h>
 #include <math.h>
@@ -25,11 +29,28 @@
 #include "functions/general.h"
 #include "functions/reconfig_functions.h"
 #include "functions/pll_param_generator.h"
+#include "functions/pll_calculator.h"
 #include "functions/adc_functions.h"
 #include "functions/cpmg_functions.h"
 #include "functions/AlteraIP/altera_avalon_fifo_regs.h"
 #include "functions/nmr_table.h"
 #include "functions/avalon_dma.h"
+#include "functions/sim_bus.h"
+#include "functions/fifo_stream.h"
+#include "functions/fifo_emulator.h"
+#include "functions/dma_capture.h"
+#include "functions/dma_emulator.h"
+#include "functions/echo_unpack.h"
+#include "functions/scan_file.h"
+#include "functions/nmr_fsm_emulator.h"
+#include "functions/nmr_daemon.h"
+#include "functions/pll_cache.h"
+#include "functions/pll_reconfig_emulator.h"
+#include "functions/s11_tuner.h"
+#include "functions/i2c_batch.h"
+#include "functions/i2c_emulator.h"
+#include "functions/dac_update.h"
+#include "functions/spi_emulator.h"
 #include "./hps_soc_system.h"
 
 void open_physical_memory_device() {
@@ -108,6 +129,14 @@ void mmap_fpga_peripherals() {
 		exit (EXIT_FAILURE);
 	}
 
+	set_fpga_peripheral_addr();
+#if ADC_FIFO_MEM_IN_CSR_USE_IRQ
+	fifo_event_open_uio(&adc_event, ADC_FIFO_UIO_DEV);
+#endif
+}
+
+// the addresses of the peripherals behind the bridges, once h2f_lw_axi_master and h2f_axi_master are mapped
+void set_fpga_peripheral_addr() {
 	h2p_ctrl_out_addr = h2f_lw_axi_master + CTRL_OUT_BASE;
 	h2p_ctrl_in_addr = h2f_lw_axi_master + CTRL_IN_BASE;
 	h2p_pulse1_addr = h2f_lw_axi_master + NMR_PARAMETERS_PULSE_90DEG_BASE;
@@ -119,24 +148,48 @@ void mmap_fpga_peripherals() {
 			+ NMR_PARAMETERS_ECHOES_PER_SCAN_BASE;
 	h2p_i2c_ext_addr = h2f_lw_axi_master + I2C_EXT_BASE;
 	h2p_i2c_int_addr = h2f_lw_axi_master + I2C_INT_BASE;
+	i2c_batch_init(&ctrl_i2c_batch);
+	i2c_batch_add_core(&ctrl_i2c_batch, (void *) h2p_i2c_ext_addr, I2C_EXT_FIFO_DEPTH);
+	i2c_batch_add_core(&ctrl_i2c_batch, (void *) h2p_i2c_int_addr, I2C_INT_FIFO_DEPTH);
 	h2p_adc_fifo_addr = h2f_lw_axi_master + ADC_FIFO_MEM_OUT_BASE;
 	h2p_adc_fifo_status_addr = h2f_lw_axi_master + ADC_FIFO_MEM_IN_CSR_BASE;
+	fifo_event_init_poll(&adc_event, h2p_adc_fifo_status_addr);
+	adc_event.trace = &adc_trace;
 	h2p_adc_samples_per_echo_addr = h2f_lw_axi_master
 			+ NMR_PARAMETERS_SAMPLES_PER_ECHO_BASE;
 	h2p_init_adc_delay_addr = h2f_lw_axi_master
 			+ NMR_PARAMETERS_INIT_DELAY_BASE;
 	h2p_dac_addr = h2f_lw_axi_master + DAC_PREAMP_BASE;
+	dac_update_init(&preamp_dac, (void *) h2p_dac_addr, DAC_FULL_SCALE);
 	//h2p_analyzer_pll_addr			= h2f_lw_axi_master + ANALYZER_PLL_RECONFIG_BASE;
 	h2p_t1_pulse = h2f_lw_axi_master + NMR_PARAMETERS_PULSE_T1_BASE;
 	h2p_t1_delay = h2f_lw_axi_master + NMR_PARAMETERS_DELAY_T1_BASE;
 
-	//h2p_dma_addr					= h2f_lw_axi_master + DMA_FIFO_BASE;
-	//h2p_sdram_addr					= h2f_axi_master + SDRAM_BASE;
+	// the registers only written by the software, a new mapping knows none of their values
+	reg_shadow_init(&fpga_shadow);
+	reg_shadow_add(&fpga_shadow, h2p_ctrl_out_addr);
+	reg_shadow_add(&fpga_shadow, h2p_pulse1_addr);
+	reg_shadow_add(&fpga_shadow, h2p_pulse2_addr);
+	reg_shadow_add(&fpga_shadow, h2p_delay1_addr);
+	reg_shadow_add(&fpga_shadow, h2p_delay2_addr);
+	reg_shadow_add(&fpga_shadow, h2p_echo_per_scan_addr);
+	reg_shadow_add(&fpga_shadow, h2p_adc_samples_per_echo_addr);
+	reg_shadow_add(&fpga_shadow, h2p_init_adc_delay_addr);
+	reg_shadow_add(&fpga_shadow, h2p_t1_pulse);
+	reg_shadow_add(&fpga_shadow, h2p_t1_delay);
+
+#if defined(DMA_FIFO_BASE) && defined(SDRAM_BASE) // only when the DMA and the SDRAM are included in the FPGA design
+	h2p_dma_addr = h2f_lw_axi_master + DMA_FIFO_BASE;
+	h2p_sdram_addr = h2f_axi_master + SDRAM_BASE;
+	dma_sdram_wr_addr = SDRAM_BASE;
+	dma_capture_init(&adc_dma, h2p_dma_addr);
+#endif
 	//h2p_switches_addr				= h2f_axi_master + SWITCHES_BASE;
 
 }
 
 void munmap_fpga_peripherals() {
+	fifo_event_close(&adc_event);
 
 	if (munmap(h2f_lw_axi_master, h2f_lw_axi_master_span) != 0) {
 		printf("Error: h2f_lw_axi_master munmap() failed\n");
@@ -161,6 +214,103 @@ void munmap_peripherals() {
 	munmap_fpga_peripherals();
 }
 
+// the simulated backend in place of /dev/mem: the lightweight bridge is plain memory, the sequencer control and the ADC
+// fifo are emulated on the sim_bus, and so are the reconfig blocks of the nmr system PLL and of the analyzer PLL (which
+// the FPGA design does not have, the model is put at SIM_ANALYZER_PLL_RECONFIG_BASE so that tx_sampling runs). The NMR
+// parameter registers are register files counting the bus transactions, the i2c cores are models with an expander each
+// and the DAC SPI core is a model with its AD5722R, taking LDAC from ctrl_out. With fill_rate > 0 the fifo fills at
+// fill_rate words per second, with 0 the sequences are timed like on the FPGA: from the programmed counts at the nmr
+// system PLL frequency, with a phase cycled echo train as data.
+// The PLLs are always locked. The DMA, the SDRAM and the HPS peripherals are not available
+void mmap_sim_peripherals(double fill_rate) {
+	nmr_fsm_emu_regs regs;
+
+	h2f_lw_axi_master = calloc(1, h2f_lw_axi_master_span);
+	if (h2f_lw_axi_master == NULL
+			|| !fifo_emu_init(&sim_adc_fifo, ADC_FIFO_MEM_OUT_FIFO_DEPTH, fill_rate)) {
+		printf("Error: cannot allocate the simulated peripherals\n");
+		exit (EXIT_FAILURE);
+	}
+	h2f_axi_master = NULL;
+	set_fpga_peripheral_addr();
+	h2p_analyzer_pll_addr = h2f_lw_axi_master + SIM_ANALYZER_PLL_RECONFIG_BASE;
+
+	pll_reconfig_emu_attach(&sim_nmr_pll, h2p_nmr_sys_pll_addr);
+	pll_reconfig_emu_attach(&sim_analyzer_pll, h2p_analyzer_pll_addr);
+	pll_cache_init(&nmr_pll_cache); // a new PLL
+	fifo_emu_attach(&sim_adc_fifo, h2p_adc_fifo_addr,
+			(void *) h2p_adc_fifo_status_addr, NULL);
+	nmr_fsm_emu_attach(&sim_nmr_fsm, &sim_adc_fifo, h2p_ctrl_out_addr,
+			h2p_ctrl_in_addr, h2p_adc_samples_per_echo_addr,
+			h2p_echo_per_scan_addr);
+	reg_file_emu_attach(&sim_nmr_param, h2f_lw_axi_master + NMR_PARAMETERS_PULSE_T1_BASE,
+			(NMR_PARAMETERS_DELAY_NOSIG_BASE + 16 - NMR_PARAMETERS_PULSE_T1_BASE) / 4);
+	reg_file_emu_attach(&sim_nmr_samples, h2p_adc_samples_per_echo_addr, 1);
+	i2c_emu_init(&sim_i2c_ext, I2C_EXT_FREQ, I2C_EXT_FIFO_DEPTH);
+	i2c_emu_add_dev(&sim_i2c_ext, TCA9555_ADDR);
+	i2c_emu_attach(&sim_i2c_ext, (void *) h2p_i2c_ext_addr);
+	i2c_emu_init(&sim_i2c_int, I2C_INT_FREQ, I2C_INT_FIFO_DEPTH);
+	i2c_emu_add_dev(&sim_i2c_int, TCA9555_ADDR);
+	i2c_emu_attach(&sim_i2c_int, (void *) h2p_i2c_int_addr);
+	spi_emu_init(&sim_dac, DAC_PREAMP_TARGETCLOCK, DAC_PREAMP_DATABITS);
+	spi_emu_attach(&sim_dac, (void *) h2p_dac_addr);
+	nmr_fsm_emu_set_ctrl_out_hook(&sim_nmr_fsm, spi_emu_ctrl_out, &sim_dac);
+	if (fill_rate <= 0) {
+		regs.pulse1 = h2p_pulse1_addr;
+		regs.delay1 = h2p_delay1_addr;
+		regs.pulse2 = h2p_pulse2_addr;
+		regs.delay2 = h2p_delay2_addr;
+		regs.t1_pulse = h2p_t1_pulse;
+		regs.t1_delay = h2p_t1_delay;
+		nmr_fsm_emu_set_timing(&sim_nmr_fsm, &sim_nmr_pll, INPUT_FREQ, &regs);
+	}
+	sim_bus_en = 1;
+	sim_backend = 1;
+}
+
+void munmap_sim_peripherals() {
+	sim_bus_en = 0;
+	sim_backend = 0;
+	sim_bus_unmap_all();
+	fifo_emu_free(&sim_adc_fifo);
+	free(h2f_lw_axi_master);
+	h2f_lw_axi_master = NULL;
+	h2p_analyzer_pll_addr = NULL;
+}
+
+// the FPGA through /dev/mem, or the simulated backend when SIM_BACKEND_ENV is set: its value is the fill rate of
+// mmap_sim_peripherals, empty or 0 times the sequences like the FPGA does
+void open_fpga_backend() {
+	const char *sim = getenv(SIM_BACKEND_ENV);
+
+	if (getenv(TRACE_ENV) != NULL) {
+		trace_ring_init(&adc_trace, TRACE_RING_DEFAULT_EVENTS);
+	}
+	if (sim != NULL) {
+		printf("simulated FPGA backend (%s)\n", atof(sim) > 0 ? sim : "timed sequences");
+		mmap_sim_peripherals(atof(sim));
+		return;
+	}
+	open_physical_memory_device();
+	mmap_peripherals();
+}
+
+void close_fpga_backend() {
+	if (adc_trace.buf != NULL) {
+		if (trace_ring_export_chrome(&adc_trace, getenv(TRACE_ENV))) {
+			printf("trace of the last %llu events written to %s\n", (unsigned long long) (adc_trace.head
+					< adc_trace.mask + 1 ? adc_trace.head : adc_trace.mask + 1), getenv(TRACE_ENV));
+		}
+		trace_ring_free(&adc_trace);
+	}
+	if (sim_backend) {
+		munmap_sim_peripherals();
+		return;
+	}
+	munmap_peripherals();
+	close_physical_memory_device();
+}
+
 void setup_hps_gpio() {
 	// Initialize the HPS PIO controller:
 	//     Set the direction of the HPS_LED GPIO bit to "output"
@@ -210,151 +360,266 @@ void create_measurement_folder(char * foldertype) {
 	// system(command);
 }
 
-/*
- void fifo_to_sdram_dma_trf (uint32_t transfer_length) {
- alt_write_word(h2p_dma_addr+DMA_CONTROL_OFST,	DMA_CTRL_SWRST_MSK); 	// write twice to do software reset
- alt_write_word(h2p_dma_addr+DMA_CONTROL_OFST,	DMA_CTRL_SWRST_MSK); 	// software resetted
- alt_write_word(h2p_dma_addr+DMA_STATUS_OFST,	0x0); 					// clear the DONE bit
- alt_write_word(h2p_dma_addr+DMA_READADDR_OFST,	ADC_FIFO_MEM_OUT_BASE); // set DMA read address
- alt_write_word(h2p_dma_addr+DMA_WRITEADDR_OFST,	SDRAM_BASE);			// set DMA write address
- alt_write_word(h2p_dma_addr+DMA_LENGTH_OFST,	transfer_length*4);		// set transfer length (in byte, so multiply by 4 to get word-addressing)
- alt_write_word(h2p_dma_addr+DMA_CONTROL_OFST,	(DMA_CTRL_WORD_MSK|DMA_CTRL_LEEN_MSK|DMA_CTRL_RCON_MSK)); // set settings for transfer
- alt_write_word(h2p_dma_addr+DMA_CONTROL_OFST,	(DMA_CTRL_WORD_MSK|DMA_CTRL_LEEN_MSK|DMA_CTRL_RCON_MSK|DMA_CTRL_GO_MSK)); // set settings & also enable transfer
- }
- */
+// start the DMA moving transfer_length words from the fifo to the SDRAM buffer sdram_buf (0 or 1). It returns immediately
+int fifo_to_sdram_dma_trf(uint32_t transfer_length, uint32_t sdram_buf) {
+	if ((unsigned long) transfer_length * 4 > DMA_SDRAM_BUF_SPAN) {
+		printf("[ERROR] DMA transfer of %u words does not fit into the SDRAM buffer\n",
+				transfer_length);
+		return 0;
+	}
+	dma_capture_start(&adc_dma, dma_fifo_rd_addr,
+			dma_sdram_wr_addr + sdram_buf * DMA_SDRAM_BUF_SPAN, transfer_length);
+	return 1;
+}
+
+// wait until the sequence stops and the DMA has moved the rest of the fifo. Returns 0 if the DMA did not finish
+int sdram_dma_wait(uint8_t en_mesg) {
+	// wait until fsm stops (a hung sequence leaves the DMA short of data, which is reported below)
+	wait_nmr_seq(scan_hdr.pulse1_cnt, scan_hdr.delay1_cnt, scan_hdr.pulse2_cnt,
+			scan_hdr.delay2_cnt, scan_hdr.echoes_per_scan, scan_hdr.fsm_clkfreq);
+
+	if (dma_capture_wait(&adc_dma, DMA_DRAIN_TIMEOUT_US) == DMA_CAPTURE_TIMEOUT) {
+		printf("[ERROR] DMA did not finish the transfer (%u bytes ordered)\n",
+				adc_dma.length);
+		dma_capture_print_status(&adc_dma);
+		return 0;
+	}
+	if (en_mesg) {
+		dma_capture_print_status(&adc_dma);
+	}
+	return 1;
+}
 
-/*
- void datawrite_with_dma (uint32_t transfer_length, uint8_t en_mesg) {
- int i_sd = 0;
+// unpack the SDRAM buffer sdram_buf into adc_arena.samples (reserved for transfer_length words by the caller) and add every echo to avr_data (NULL if there is no echo average)
+void sdram_dma_unpack(uint32_t transfer_length, uint32_t sdram_buf,
+		unsigned int samples_per_echo, unsigned int *avr_data) {
+	volatile unsigned int *sdram_buf_addr = h2p_sdram_addr
+			+ sdram_buf * (DMA_SDRAM_BUF_SPAN / 4);
+	unsigned int fifo_data_read;
+	uint32_t i_sd;
+	unsigned int pos = 0; // sample position within the echo
+
+	for (i_sd = 0; i_sd < transfer_length; i_sd++) {
+		fifo_data_read = bus_read_word(sdram_buf_addr + i_sd);
+
+		// the data is 2 symbols-per-beat in the fifo.
+		// And the symbol arrangement can be found in Altera Embedded Peripherals pdf.
+		// The 32-bit data per beat is transfered from FIFO to the SDRAM with the same
+		// format so this formatting should follow the FIFO format.
+		adc_arena.samples[i_sd * 2] = fifo_data_read & ADC_SAMPLE_MASK;
+		adc_arena.samples[i_sd * 2 + 1] = (fifo_data_read >> 16) & ADC_SAMPLE_MASK;
+		if (avr_data != NULL) { // the SDRAM is uncached, so the echo sum is done in the same sweep instead of with echo_unpack_sum
+			avr_data[pos] += adc_arena.samples[i_sd * 2];
+			if (++pos == samples_per_echo)
+				pos = 0;
+			avr_data[pos] += adc_arena.samples[i_sd * 2 + 1];
+			if (++pos == samples_per_echo)
+				pos = 0;
+		}
+	}
+}
 
- fifo_to_sdram_dma_trf (transfer_length);
+// the DMA is started right after the fsm and the data is unpacked to adc_arena.samples once the sequence stops. Returns 0 if the data is not valid
+int datawrite_with_dma(uint32_t transfer_length, unsigned int samples_per_echo,
+		unsigned int *avr_data, uint8_t en_mesg) {
+	if (!fifo_to_sdram_dma_trf(transfer_length, 0)) {
+		return 0;
+	}
+	if (!sdram_dma_wait(en_mesg)) {
+		return 0;
+	}
+	sdram_dma_unpack(transfer_length, 0, samples_per_echo, avr_data);
+	return 1;
+}
 
- unsigned int dma_status;
- do {
- dma_status = alt_read_word(h2p_dma_addr+DMA_STATUS_OFST);
- if (en_mesg) {
- printf("\tstatus reg: 0x%x\n",dma_status);
- if (!(dma_status & DMA_STAT_DONE_MSK)) {
- printf("\tDMA transaction is not done.\n");
- }
- if (dma_status & DMA_STAT_BUSY_MSK) {
- printf("\tDMA is busy.\n");
- }
- }
- usleep(10); // wait time to prevent overloading the DMA bus arbitration request
- }
- while (!(dma_status & DMA_STAT_DONE_MSK) || (dma_status & DMA_STAT_BUSY_MSK)); // keep in the loop when the 'DONE' bit is '0' and 'BUSY' bit is '1'
+// set the nmr system pll (counter 0, 50% duty cycle) to freq. The reconfiguration, the pll reset and the wait for the
+// lock are skipped when nmr_pll_cache knows the setting is already loaded and the pll is still locked.
+// Returns 0 when the frequency cannot be set or the pll does not lock: the scan must not run on that clock
+int set_nmr_sys_pll(double freq) {
+	int status;
+
+	trace_event(&adc_trace, TRACE_PLL_BEGIN, 0);
+	status = pll_cache_set(&nmr_pll_cache, h2p_nmr_sys_pll_addr, 0, freq, 0.5, DISABLE_MESSAGE);
+	if (status == PLL_CACHE_FAILED) {
+		trace_event(&adc_trace, TRACE_PLL_END, 0);
+		printf("[ERROR] the nmr system pll cannot be set to %.3f MHz\n", freq);
+		return 0;
+	}
+	if (status == PLL_CACHE_LOADED
+			&& (bus_read_word(h2p_ctrl_in_addr) & (0x01 << PLL_NMR_SYS_lock_ofst))) {
+		trace_event(&adc_trace, TRACE_PLL_END, 0);
+		return 1;
+	}
+	Reset_PLL(h2p_ctrl_out_addr, PLL_NMR_SYS_RST_ofst, ctrl_out);
+	reg_shadow_forget(&fpga_shadow, h2p_ctrl_out_addr); // written by Reset_PLL
+	status = Wait_PLL_To_Lock(h2p_ctrl_in_addr, PLL_NMR_SYS_lock_ofst);
+	trace_event(&adc_trace, TRACE_PLL_END, 1);
+	return status;
+}
 
- if (en_mesg) {
- if (dma_status & DMA_STAT_REOP_MSK) {
- printf("\tDMA transaction completed due to end-of-packet on read side.\n");
- }
- if (dma_status & DMA_STAT_WEOP_MSK) {
- printf("\tDMA transaction completed due to end-of-packet on write side.\n");
- }
- if (dma_status & DMA_STAT_LEN_MSK) {
- printf("\tDMA transaction completed due to length-register decrements to 0.\n");
- }
- }
+// write the T1 pulse and delay in front of the CPMG sequence, they are remembered for the deadline of wait_nmr_seq
+void write_t1_param(uint32_t pulse180_t1_int, uint32_t delay180_t1_int) {
+	reg_shadow_write(&fpga_shadow, h2p_t1_pulse, pulse180_t1_int);
+	reg_shadow_write(&fpga_shadow, h2p_t1_delay, delay180_t1_int);
+	nmr_t1_cnt = (uint64_t) pulse180_t1_int + delay180_t1_int;
+}
 
- unsigned int fifo_data_read;
- for (i_sd=0; i_sd < transfer_length; i_sd++) {
- fifo_data_read = alt_read_word(h2p_sdram_addr+i_sd);
+// wait for the end of the sequence that was started with these counts (nmr fsm clock cycles) and the T1 part of
+// write_t1_param. The deadline is NMR_SEQ_TIMEOUT_FACTOR times the programmed length plus NMR_SEQ_TIMEOUT_MARGIN_NS.
+// A sequence that does not end is the TOKEN issue of ADC_WINGEN (see init_default_system_param): the sequencer is reset
+// and 0 is returned, the readout that follows then finds the data missing
+int wait_nmr_seq(uint32_t pulse1_cnt, uint32_t delay1_cnt, uint32_t pulse2_cnt,
+		uint32_t delay2_cnt, uint32_t echoes_per_scan, double nmr_fsm_clkfreq) {
+	double seq_us = 0;
+	uint64_t timeout_ns;
+
+	if (nmr_fsm_clkfreq > 0) {
+		seq_us = ((double) pulse1_cnt + delay1_cnt + nmr_t1_cnt
+				+ (double) echoes_per_scan * ((double) pulse2_cnt + delay2_cnt))
+				/ nmr_fsm_clkfreq;
+	}
+	timeout_ns = (uint64_t) (seq_us * 1000 * NMR_SEQ_TIMEOUT_FACTOR)
+			+ NMR_SEQ_TIMEOUT_MARGIN_NS;
+	if (hw_wait_reg(&wait_nmr_seq_site, h2p_ctrl_in_addr, NMR_SEQ_run, 0,
+			timeout_ns)) {
+		trace_event(&adc_trace, TRACE_FSM_DONE, 1);
+		return 1;
+	}
+	trace_event(&adc_trace, TRACE_FSM_DONE, 0);
 
- // the data is 2 symbols-per-beat in the fifo.
- // And the symbol arrangement can be found in Altera Embedded Peripherals pdf.
- // The 32-bit data per beat is transfered from FIFO to the SDRAM with the same
- // format so this formatting should follow the FIFO format.
- rddata_16[i_sd*2] = fifo_data_read & 0x3FFF;
- rddata_16[i_sd*2+1] = (fifo_data_read>>16) & 0x3FFF;
- }
- }
- */
+	printf("[ERROR] the nmr sequence (%.3f ms) did not end within %.3f ms, the sequencer is reset\n",
+			seq_us * 1e-3, timeout_ns * 1e-6);
+	ctrl_out |= NMR_CNT_RESET;
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out);
+	usleep(10);
+	ctrl_out &= ~(NMR_CNT_RESET);
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out);
+	return 0;
+}
+
+// set the clocks of tx_sampling: the nmr system pll at samp_freq * 4 and the 4 quadrature outputs of the analyzer pll at
+// tx_freq. Returns 0 if a pll does not lock, or without the analyzer pll: only the simulated backend has one, the FPGA
+// design has none
+int tx_sampling_pll(double tx_freq, double samp_freq) {
+	int locked;
 
-void tx_sampling(double tx_freq, double samp_freq,
+	if (h2p_analyzer_pll_addr == NULL) {
+		printf("[ERROR] this FPGA design has no analyzer pll, the tx sampling is not run\n");
+		return 0;
+	}
+
+	// read the current ctrl_out
+	ctrl_out = reg_shadow_read(&fpga_shadow, h2p_ctrl_out_addr);
+
+	// set the system frequency, which is sampling frequency*4
+	if (!set_nmr_sys_pll(samp_freq * 4)) {
+		printf("[ERROR] the nmr system pll is not locked, the tx sampling is not run\n");
+		return 0;
+	}
+	Set_DPS(h2p_nmr_sys_pll_addr, 0, 0, DISABLE_MESSAGE);
+
+	// set pll for the tx sampling: the 4 counters in one reconfiguration, then the quadrature phases in another one
+	// (the pll reset in between clears the phase shifts)
+	trace_event(&adc_trace, TRACE_PLL_BEGIN, 0);
+	PLL_Tx_Init(&pll_tx_analyzer, h2p_analyzer_pll_addr);
+	PLL_Tx_Set_PLL(&pll_tx_analyzer, 0, tx_freq, 0.5);
+	PLL_Tx_Set_PLL(&pll_tx_analyzer, 1, tx_freq, 0.5);
+	PLL_Tx_Set_PLL(&pll_tx_analyzer, 2, tx_freq, 0.5);
+	PLL_Tx_Set_PLL(&pll_tx_analyzer, 3, tx_freq, 0.5);
+	locked = PLL_Tx_Commit(&pll_tx_analyzer, DISABLE_MESSAGE);
+	Reset_PLL(h2p_ctrl_out_addr, PLL_ANALYZER_RST_ofst, ctrl_out);
+	reg_shadow_forget(&fpga_shadow, h2p_ctrl_out_addr); // written by Reset_PLL
+	locked = Wait_PLL_To_Lock(h2p_ctrl_in_addr, PLL_ANALYZER_lock_ofst) && locked;
+	PLL_Tx_Begin(&pll_tx_analyzer);
+	PLL_Tx_Set_DPS(&pll_tx_analyzer, 0, 0);
+	PLL_Tx_Set_DPS(&pll_tx_analyzer, 1, 90);
+	PLL_Tx_Set_DPS(&pll_tx_analyzer, 2, 180);
+	PLL_Tx_Set_DPS(&pll_tx_analyzer, 3, 270);
+	locked = PLL_Tx_Commit(&pll_tx_analyzer, DISABLE_MESSAGE) && locked;
+	locked = Wait_PLL_To_Lock(h2p_ctrl_in_addr, PLL_ANALYZER_lock_ofst) && locked;
+	trace_event(&adc_trace, TRACE_PLL_END, 1);
+	if (!locked) {
+		printf("[ERROR] the analyzer pll is not locked, the tx sampling is not run\n");
+		return 0;
+	}
+	scan_prof_mark(&adc_prof, SCAN_PROF_PLL);
+	return 1;
+}
+
+// capture tx_num_of_samples of the tx signal into adc_arena.samples with the clocks set by tx_sampling_pll, and write
+// them to filename (no file when filename is NULL). The receiver input (RX_IN_SEL) is left as it is. Returns 0 if the
+// capture failed
+int tx_capture(double tx_freq, double samp_freq,
 		unsigned int tx_num_of_samples, char * filename) {
 
+	if (!capture_arena_reserve(&adc_arena, (tx_num_of_samples + 1) >> 1, 0)) {
+		return 0;
+	}
+	trace_event(&adc_trace, TRACE_SCAN_START, tx_num_of_samples);
+
 	// the bigger is the gain at this stage, the bigger is the impedance. The impedance should be ideally 50ohms which is achieved by using rx_gain between 0x00 and 0x07
 	// write_i2c_rx_gain (0x00 & 0x0F);	// WARNING! GENERATES ERROR IF UNCOMMENTED: IT WILL RUIN THE OPERATION OF SWITCHED MATCHING NETWORK. set the gain of the last stage opamp --> 0x0F is to mask the unused 4 MSBs
 
 	// read the current ctrl_out
-	ctrl_out = alt_read_word(h2p_ctrl_out_addr);
-
-	// KEEP THIS CODE AND ENABLE IT IF YOU USE C-ONLY, OPPOSED TO USING PYTHON
-	// activate signal_coup path (from the directional coupler) for the receiver
-	// write_i2c_cnt (DISABLE, RX_IN_SEL_1_msk, DISABLE_MESSAGE);
-	// write_i2c_cnt (ENABLE, RX_IN_SEL_2_msk, DISABLE_MESSAGE);
+	ctrl_out = reg_shadow_read(&fpga_shadow, h2p_ctrl_out_addr);
 
 	// set parameters for acquisition (using CPMG registers and CPMG sequence: not a good practice)
-	alt_write_word((h2p_pulse1_addr), 100); // random safe number
-	alt_write_word((h2p_delay1_addr), 100); // random safe number
-	alt_write_word((h2p_pulse2_addr), 100); // random safe number
-	alt_write_word((h2p_delay2_addr), tx_num_of_samples * 4 * 2); // *4 is because the system clock is 4*ADC clock. *2 factor is to increase the delay_window to about 2*acquisition window for safety.
-	alt_write_word((h2p_init_adc_delay_addr),
+	reg_shadow_write(&fpga_shadow, h2p_pulse1_addr, 100); // random safe number
+	reg_shadow_write(&fpga_shadow, h2p_delay1_addr, 100); // random safe number
+	reg_shadow_write(&fpga_shadow, h2p_pulse2_addr, 100); // random safe number
+	reg_shadow_write(&fpga_shadow, h2p_delay2_addr, tx_num_of_samples * 4 * 2); // *4 is because the system clock is 4*ADC clock. *2 factor is to increase the delay_window to about 2*acquisition window for safety.
+	reg_shadow_write(&fpga_shadow, h2p_init_adc_delay_addr,
 			(unsigned int) (tx_num_of_samples / 2)); // put adc acquisition window exactly at the middle of the delay windo
-	alt_write_word((h2p_echo_per_scan_addr), 1);
-	alt_write_word((h2p_adc_samples_per_echo_addr), tx_num_of_samples);
-	// set the system frequency, which is sampling frequency*4
-	Set_PLL(h2p_nmr_sys_pll_addr, 0, samp_freq * 4, 0.5, DISABLE_MESSAGE);
-	Reset_PLL(h2p_ctrl_out_addr, PLL_NMR_SYS_RST_ofst, ctrl_out);
-	Set_DPS(h2p_nmr_sys_pll_addr, 0, 0, DISABLE_MESSAGE);
-	Wait_PLL_To_Lock(h2p_ctrl_in_addr, PLL_NMR_SYS_lock_ofst);
-
-	// set pll for the tx sampling
-	Set_PLL(h2p_analyzer_pll_addr, 0, tx_freq, 0.5, DISABLE_MESSAGE);
-	Set_PLL(h2p_analyzer_pll_addr, 1, tx_freq, 0.5, DISABLE_MESSAGE);
-	Set_PLL(h2p_analyzer_pll_addr, 2, tx_freq, 0.5, DISABLE_MESSAGE);
-	Set_PLL(h2p_analyzer_pll_addr, 3, tx_freq, 0.5, DISABLE_MESSAGE);
-	Reset_PLL(h2p_ctrl_out_addr, PLL_ANALYZER_RST_ofst, ctrl_out);
-	Wait_PLL_To_Lock(h2p_ctrl_in_addr, PLL_ANALYZER_lock_ofst);
-	Set_DPS(h2p_analyzer_pll_addr, 0, 0, DISABLE_MESSAGE);
-	Set_DPS(h2p_analyzer_pll_addr, 1, 90, DISABLE_MESSAGE);
-	Set_DPS(h2p_analyzer_pll_addr, 2, 180, DISABLE_MESSAGE);
-	Set_DPS(h2p_analyzer_pll_addr, 3, 270, DISABLE_MESSAGE);
-	Wait_PLL_To_Lock(h2p_ctrl_in_addr, PLL_ANALYZER_lock_ofst);
+	reg_shadow_write(&fpga_shadow, h2p_echo_per_scan_addr, 1);
+	reg_shadow_write(&fpga_shadow, h2p_adc_samples_per_echo_addr, tx_num_of_samples);
 
 	// reset buffer
 	ctrl_out |= (0x01 << ADC_FIFO_RST_ofst);
-	alt_write_word((h2p_ctrl_out_addr), ctrl_out);
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out);
 	usleep(10);
 	ctrl_out &= ~(0x01 << ADC_FIFO_RST_ofst);
-	alt_write_word((h2p_ctrl_out_addr), ctrl_out);
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out);
 	usleep(10);
 
 	// enable PLL_analyzer path, disable RF gate path
 	ctrl_out &= ~(NMR_CLK_GATE_AVLN);
-	alt_write_word((h2p_ctrl_out_addr), ctrl_out);
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out);
 	usleep(10);
 
+	scan_file_init_header(&scan_hdr, tx_freq, samp_freq, samp_freq * 4);
+	scan_hdr.samples_per_echo = tx_num_of_samples;
+	scan_hdr.echoes_per_scan = 1;
+	scan_file_stamp(&scan_hdr);
+	scan_prof_mark(&adc_prof, SCAN_PROF_SETUP);
+
 	// start the state machine to capture data
-	alt_write_word((h2p_ctrl_out_addr), ctrl_out | (0x01 << FSM_START_ofst));
-	alt_write_word((h2p_ctrl_out_addr), ctrl_out & ~(0x01 << FSM_START_ofst));
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out | (0x01 << FSM_START_ofst));
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out & ~(0x01 << FSM_START_ofst));
+	trace_event(&adc_trace, TRACE_FSM_START, 0);
 	// wait until fsm stops
-	while (alt_read_word(h2p_ctrl_in_addr) & (0x01 << NMR_SEQ_run_ofst))
-		;
+	wait_nmr_seq(100, 100, 100, tx_num_of_samples * 4 * 2, 1, samp_freq * 4);
 	usleep(10);
 
 	// disable PLL_analyzer path and enable the default RF gate path
 	ctrl_out |= NMR_CLK_GATE_AVLN;
-	alt_write_word((h2p_ctrl_out_addr), ctrl_out);
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out);
 	usleep(10);
+	scan_prof_mark(&adc_prof, SCAN_PROF_SEQUENCE);
 
-	// KEEP THIS CODE AND ENABLE IT IF YOU USE C-ONLY, OPPOSED TO USING PYTHON
-	// activate normal signal path for the receiver
-	// write_i2c_cnt (ENABLE, RX_IN_SEL_1_msk, DISABLE_MESSAGE);
-	// write_i2c_cnt (DISABLE, RX_IN_SEL_2_msk, DISABLE_MESSAGE);
-
-	uint32_t fifo_mem_level = alt_read_word(
+	uint32_t fifo_mem_level = bus_read_word(
 			h2p_adc_fifo_status_addr + ALTERA_AVALON_FIFO_LEVEL_REG); // the fill level of FIFO memory
+	trace_event(&adc_trace, TRACE_FIFO_LEVEL, fifo_mem_level);
 	for (i = 0; fifo_mem_level > 0; i++) {
-		rddata[i] = alt_read_word(h2p_adc_fifo_addr);
+		capture_arena_put(&adc_arena, i, bus_read_word(h2p_adc_fifo_addr));
 
 		fifo_mem_level--;
 		if (fifo_mem_level == 0) {
-			fifo_mem_level = alt_read_word(
+			fifo_mem_level = bus_read_word(
 					h2p_adc_fifo_status_addr + ALTERA_AVALON_FIFO_LEVEL_REG);
 		}
 	}
+	trace_event(&adc_trace, TRACE_DRAIN_DONE, i);
+	scan_prof_mark(&adc_prof, SCAN_PROF_DRAIN);
 
 	if (i * 2 == tx_num_of_samples) { // if the amount of data captured matched with the amount of data being ordered, then continue the process. if not, then don't process the datas (requesting empty data from the fifo will cause the FPGA to crash, so this one is to avoid that)
 		// printf("number of captured data vs requested data : MATCHED\n");
@@ -362,36 +627,146 @@ void tx_sampling(double tx_freq, double samp_freq,
 		j = 0;
 		// FIFO is 32-bit, while 1-sample is only 16-bit. FIFO organize this automatically.
 		for (i = 0; i < ((long) tx_num_of_samples >> 1); i++) {
-			rddata_16[j++] = (rddata[i] & 0x3FFF);		// 14 significant bit
-			rddata_16[j++] = ((rddata[i] >> 16) & 0x3FFF);// 14 significant bit
+			adc_arena.samples[j++] = (adc_arena.words[i] & 0x3FFF);		// 14 significant bit
+			adc_arena.samples[j++] = ((adc_arena.words[i] >> 16) & 0x3FFF);// 14 significant bit
 		}
+		scan_prof_mark(&adc_prof, SCAN_PROF_PROCESS);
 
-		// write the raw data from adc to a file
-		sprintf(pathname, "%s/%s", foldername, filename);// put the data into the data folder
-		fptr = fopen(pathname, "w");
-		if (fptr == NULL) {
-			printf("File does not exists \n");
-		}
-		for (i = 0; i < ((long) tx_num_of_samples); i++) {
-			fprintf(fptr, "%d\n", rddata_16[i]);
+		if (filename != NULL) { // write the raw data from adc to a file
+			trace_event(&adc_trace, TRACE_WRITE_BEGIN, 0);
+			write_raw_data(&scan_hdr, filename, tx_num_of_samples, adc_arena.words);
+			trace_event(&adc_trace, TRACE_WRITE_END, 0);
+			scan_prof_mark(&adc_prof, SCAN_PROF_WRITE);
 		}
-		fclose (fptr);
+		return 1;
 
 	} else { // if the amount of data captured didn't match the amount of data being ordered, then something's going on with the acquisition
 		printf(
 				"number of data captured and data order : NOT MATCHED\nReconfigure the FPGA immediately\n");
 	}
+	return 0;
+}
+
+// tx_sampling_pll and tx_capture
+int tx_sampling(double tx_freq, double samp_freq,
+		unsigned int tx_num_of_samples, char * filename) {
+	return tx_sampling_pll(tx_freq, samp_freq)
+			&& tx_capture(tx_freq, samp_freq, tx_num_of_samples, filename);
+}
+
+// the reflection at tx_freq: a tx_capture through the S11 path (the wave coming back through the directional
+// coupler), 4 samples per period, and the rms of the samples around their mean, in ADC counts. The clocks and the
+// receiver input are set by s11_path_begin, no file is written. HUGE_VAL if the capture failed or without the analyzer
+// pll (the S11 path only works on the simulated backend with this FPGA design)
+double s11_reflection(double tx_freq, unsigned int tx_num_of_samples) {
+	double mean = 0, rms = 0;
+	unsigned int k;
+
+	if (h2p_analyzer_pll_addr == NULL
+			|| !tx_capture(tx_freq, tx_freq * 4, tx_num_of_samples, NULL)) {
+		return HUGE_VAL;
+	}
+	for (k = 0; k < tx_num_of_samples; k++) {
+		mean += adc_arena.samples[k];
+	}
+	mean /= tx_num_of_samples;
+	for (k = 0; k < tx_num_of_samples; k++) {
+		rms += (adc_arena.samples[k] - mean) * (adc_arena.samples[k] - mean);
+	}
+	return sqrt(rms / tx_num_of_samples);
+}
+
+// the measure function of the tuner on the board
+double s11_measure(void *ctx, double freq) {
+	return s11_reflection(freq, s11_num_of_samples);
+}
+
+// set up the S11 path at freq: the analyzer pll (once for all the measurements at freq) and the receiver switched from
+// the normal input (RX_IN_SEL_1) to the directional coupler (RX_IN_SEL_2). The receiver input bits before are stored
+// in rx_sel for s11_path_end. Returns 0 without the analyzer pll, if a pll does not lock or the switch is not written
+int s11_path_begin(double freq, uint32_t *rx_sel) {
+	*rx_sel = ctrl_i2c & (RX_IN_SEL_1_msk | RX_IN_SEL_2_msk);
+	if (!tx_sampling_pll(freq, freq * 4)) {
+		return 0;
+	}
+	i2c_batch_begin(&ctrl_i2c_batch);
+	write_i2c_cnt(DISABLE, RX_IN_SEL_1_msk, DISABLE_MESSAGE);
+	write_i2c_cnt(ENABLE, RX_IN_SEL_2_msk, DISABLE_MESSAGE);
+	if (!i2c_batch_end(&ctrl_i2c_batch)) {
+		printf("[ERROR] the receiver cannot be switched to the directional coupler\n");
+		s11_path_end(*rx_sel);
+		return 0;
+	}
+	return 1;
+}
+
+// switch the receiver input back to rx_sel, as s11_path_begin found it
+int s11_path_end(uint32_t rx_sel) {
+	i2c_batch_begin(&ctrl_i2c_batch);
+	write_i2c_cnt((rx_sel & RX_IN_SEL_2_msk) ? ENABLE : DISABLE, RX_IN_SEL_2_msk, DISABLE_MESSAGE);
+	write_i2c_cnt((rx_sel & RX_IN_SEL_1_msk) ? ENABLE : DISABLE, RX_IN_SEL_1_msk, DISABLE_MESSAGE);
+	return i2c_batch_end(&ctrl_i2c_batch);
+}
+
+// tune the matching network at freq with io (io->measure is s11_measure on the board): from the point tuned before at
+// freq if cache_path has one, otherwise from the network tables, and the tuned point is stored back in cache_path.
+// On the board the S11 path is set up once for the whole tuning (s11_path_begin) and the receiver input is restored
+// after it. Returns the lowest reflection, the network is left at the tuned point. HUGE_VAL if the S11 path cannot be
+// set up: the FPGA design has no analyzer pll, only the simulated backend can be tuned this way
+double tune_board(double freq, const s11_tuner_io *io, char * cache_path) {
+	s11_tuner_table tbl = { mtch_ntwrk_freq_sta, mtch_ntwrk_freq_spa, cpar_tbl, cser_tbl,
+			sizeof(cpar_tbl) / sizeof(cpar_tbl[0]), vvarac_freq_sta, vvarac_freq_spa, vvarac_tbl,
+			sizeof(vvarac_tbl) / sizeof(vvarac_tbl[0]) };
+	s11_tuner_config cfg;
+	s11_tuner_cache cache;
+	const s11_tuner_entry *e;
+	double start[S11_TUNER_DIM], refl;
+	int board = io->measure == s11_measure;
+	uint32_t rx_sel;
+
+	s11_tuner_default_config(&cfg);
+	s11_tuner_init(&s11_tune, &cfg, io, freq);
+	if (!s11_tuner_cache_load(&cache, cache_path)) {
+		return HUGE_VAL;
+	}
+	if (board && !s11_path_begin(freq, &rx_sel)) {
+		printf("[ERROR] the S11 path cannot be set up at %.3f MHz, the network is not tuned\n", freq);
+		s11_tuner_cache_free(&cache);
+		return HUGE_VAL;
+	}
+	e = s11_tuner_cache_find(&cache, freq);
+	if (e != NULL) {
+		memcpy(start, e->x, sizeof(start));
+	} else {
+		s11_tuner_table_start(&tbl, freq, start);
+	}
+	refl = s11_tuner_run(&s11_tune, start, e != NULL, e != NULL ? e->refl : 0);
+	if (board) {
+		s11_path_end(rx_sel);
+	}
+	printf("tune at %.3f MHz: cshunt %.0f, cseries %.0f, vvarac %.3f V, reflection %.3g after %u measurements (from %s)\n",
+			freq, s11_tune.best[S11_TUNER_CSHUNT], s11_tune.best[S11_TUNER_CSERIES], s11_tune.best[S11_TUNER_VVARAC],
+			refl, s11_tune.evals, e != NULL ? "the cache" : "the tables");
+	if (isfinite(refl) && s11_tuner_cache_put(&cache, freq, s11_tune.best, refl)) {
+		s11_tuner_cache_save(&cache, cache_path);
+	}
+	s11_tuner_cache_free(&cache);
+	return refl;
 }
 
 void noise_sampling(unsigned char signal_path, unsigned int num_of_samples,
 		char * filename) {
 	// signal path: the signal path used with the ADC, can be normal signal path or S11 signal path
 
+	if (!capture_arena_reserve(&adc_arena, (num_of_samples + 1) >> 1, 0)) {
+		return;
+	}
+
 	// read the current ctrl_out
-	ctrl_out = alt_read_word(h2p_ctrl_out_addr);
+	ctrl_out = reg_shadow_read(&fpga_shadow, h2p_ctrl_out_addr);
 
-	alt_write_word((h2p_init_adc_delay_addr), 0); // don't need adc_delay for sampling the data
-	alt_write_word((h2p_adc_samples_per_echo_addr), num_of_samples); // the number of samples taken for tx sampling
+	reg_shadow_write(&fpga_shadow, h2p_init_adc_delay_addr, 0); // don't need adc_delay for sampling the data
+	reg_shadow_write(&fpga_shadow, h2p_adc_samples_per_echo_addr, num_of_samples); // the number of samples taken for tx sampling
 
 	// KEEP THIS CODE IF YOU DON'T USE PYTHON
 	//if (signal_path == SIG_NORM_PATH) {
@@ -420,27 +795,32 @@ void noise_sampling(unsigned char signal_path, unsigned int num_of_samples,
 
 	// reset buffer
 	ctrl_out |= (0x01 << ADC_FIFO_RST_ofst);
-	alt_write_word((h2p_ctrl_out_addr), ctrl_out);
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out);
 	usleep(10);
 	ctrl_out &= ~(0x01 << ADC_FIFO_RST_ofst);
-	alt_write_word((h2p_ctrl_out_addr), ctrl_out);
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out);
 	usleep(10);
 
+	scan_file_init_header(&scan_hdr, 0, 0, 0); // the sampling clock is not set here
+	scan_hdr.samples_per_echo = num_of_samples;
+	scan_hdr.echoes_per_scan = 1;
+	scan_file_stamp(&scan_hdr);
+
 	// send ADC start pulse signal
 	ctrl_out |= ACTIVATE_ADC_AVLN; // this signal is connected to pulser, so it needs to be turned of as quickly as possible after it is turned on
-	alt_write_word((h2p_ctrl_out_addr), ctrl_out);
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out);
 	ctrl_out &= ~ACTIVATE_ADC_AVLN; // turning off the ADC start signal
-	alt_write_word((h2p_ctrl_out_addr), ctrl_out);
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out);
 	usleep(10000); // delay for data acquisition
 
-	uint32_t fifo_mem_level = alt_read_word(
+	uint32_t fifo_mem_level = bus_read_word(
 			h2p_adc_fifo_status_addr + ALTERA_AVALON_FIFO_LEVEL_REG); // the fill level of FIFO memory
 	for (i = 0; fifo_mem_level > 0; i++) {
-		rddata[i] = alt_read_word(h2p_adc_fifo_addr);
+		capture_arena_put(&adc_arena, i, bus_read_word(h2p_adc_fifo_addr));
 
 		fifo_mem_level--;
 		if (fifo_mem_level == 0) {
-			fifo_mem_level = alt_read_word(
+			fifo_mem_level = bus_read_word(
 					h2p_adc_fifo_status_addr + ALTERA_AVALON_FIFO_LEVEL_REG);
 		}
 	}
@@ -455,29 +835,298 @@ void noise_sampling(unsigned char signal_path, unsigned int num_of_samples,
 		j = 0;
 		// FIFO is 32-bit, while 1-sample is only 16-bit. FIFO organize this automatically.
 		for (i = 0; i < ((long) num_of_samples >> 1); i++) {
-			rddata_16[j++] = (rddata[i] & 0x3FFF);		// 14 significant bit
-			rddata_16[j++] = ((rddata[i] >> 16) & 0x3FFF);// 14 significant bit
+			adc_arena.samples[j++] = (adc_arena.words[i] & 0x3FFF);		// 14 significant bit
+			adc_arena.samples[j++] = ((adc_arena.words[i] >> 16) & 0x3FFF);// 14 significant bit
 		}
 
 		// write the raw data from adc to a file
-		sprintf(pathname, "%s/%s", foldername, filename);// put the data into the data folder
+		write_raw_data(&scan_hdr, filename, num_of_samples, adc_arena.words);
+
+	} else { // if the amount of data captured didn't match the amount of data being ordered, then something's going on with the acquisition
+		printf(
+				"number of data captured and data order : NOT MATCHED\nReconfigure the FPGA immediately\n");
+	}
+}
+
+// drain the fifo while the sequence is running, then write the raw data and the averaged echo straight from the ring buffer.
+// The echo train length is not limited by the fifo depth, the samples and the echo sum are in adc_arena.
+void CPMG_stream_readout(unsigned int samples_per_echo,
+		unsigned int echoes_per_scan, char * filename, char * avgname) {
+	unsigned long num_of_words = ((unsigned long) samples_per_echo
+			* (unsigned long) echoes_per_scan) >> 1;
+
+	if (adc_ring.buf == NULL) {
+		if (!fifo_ring_init(&adc_ring, FIFO_RING_INIT_SIZE)) {
+			return;
+		}
+	}
+	fifo_ring_clear(&adc_ring);
+
+	fifo_stream_drain(&adc_ring, h2p_adc_fifo_addr, &adc_event,
+			h2p_ctrl_in_addr, num_of_words, ADC_FIFO_MEM_IN_CSR_FIFO_DEPTH / 2,
+			&adc_stream_stat);
+	trace_event(&adc_trace, TRACE_DRAIN_DONE, adc_stream_stat.words);
+	scan_prof_mark(&adc_prof, SCAN_PROF_DRAIN); // the sequence is drained while it runs
+	// printf("bursts: %lu, max fifo level: %u\n", adc_stream_stat.bursts, adc_stream_stat.max_level);
+
+	if (adc_stream_stat.words != num_of_words || adc_stream_stat.overflow) {
+		printf(
+				"[ERROR] number of data captured (%lu) and data ordered (%lu): NOT MATCHED%s\nData are flushed!\nReconfigure the FPGA immediately\n",
+				adc_stream_stat.words * 2, num_of_words * 2,
+				adc_stream_stat.overflow ? " (fifo overflow)" : "");
+		scan_writer_skip(&adc_writer, filename); // no file for this scan
+		return;
+	}
+
+	if (CPMG_scan_handoff(&fifo_ring_at(&adc_ring, 0), num_of_words,
+			samples_per_echo, echoes_per_scan, filename, avgname)) {
+		return;
+	}
+
+	if (!capture_arena_reserve(&adc_arena, num_of_words, samples_per_echo)) {
+		return;
+	}
+	memset(adc_arena.avr_data, 0, samples_per_echo * sizeof(unsigned int));
+
+	// the ring was cleared and the whole scan reserved by fifo_stream_drain, so the words are contiguous from the start of the ring
+	echo_unpack_sum(&fifo_ring_at(&adc_ring, 0), num_of_words,
+			samples_per_echo, NULL, adc_arena.avr_data); // the raw data is written from the words
+	scan_prof_mark(&adc_prof, SCAN_PROF_PROCESS);
+	write_cpmg_data(&scan_hdr, samples_per_echo, echoes_per_scan, adc_arena.avr_data,
+			&fifo_ring_at(&adc_ring, 0), filename, avgname);
+	scan_prof_mark(&adc_prof, SCAN_PROF_WRITE);
+}
+
+// give the packed words of a complete scan to the accumulator or to the writer thread when CPMG_iterate uses one.
+// Returns 0 if the scan is to be unpacked and written in line
+int CPMG_scan_handoff(const uint32_t *fifo_words, unsigned long num_of_words,
+		unsigned int samples_per_echo, unsigned int echoes_per_scan,
+		char * filename, char * avgname) {
+	if (adc_dsp != ADC_DSP_RAW) { // only the processed data is written
+		if (!capture_arena_reserve(&adc_arena, num_of_words, samples_per_echo)) {
+			return 1;
+		}
+		memset(adc_arena.avr_data, 0, samples_per_echo * sizeof(unsigned int));
+		echo_unpack_sum(fifo_words, num_of_words, samples_per_echo,
+				adc_arena.samples, adc_arena.avr_data);
+		scan_prof_mark(&adc_prof, SCAN_PROF_PROCESS);
+		if (!write_dsp_data(&scan_hdr, adc_arena.samples, adc_arena.avr_data,
+				samples_per_echo, echoes_per_scan, filename, avgname)) {
+			write_cpmg_data(&scan_hdr, samples_per_echo, echoes_per_scan,
+					adc_arena.avr_data, fifo_words, filename, avgname);
+		}
+		scan_prof_mark(&adc_prof, SCAN_PROF_WRITE);
+		return 1;
+	}
+	if (adc_accum.sum != NULL) { // only the sums are kept
+		scan_accum_add_words(&adc_accum, fifo_words,
+				scan_accum_negate(&scan_hdr));
+		scan_prof_mark(&adc_prof, SCAN_PROF_PROCESS);
+		return 1;
+	}
+	if (adc_writer.running) { // the writer thread unpacks and writes the scan while the next one is acquired
+		scan_writer_submit(&adc_writer, &scan_hdr, fifo_words, num_of_words,
+				samples_per_echo, echoes_per_scan, filename, avgname);
+		scan_prof_mark(&adc_prof, SCAN_PROF_PROCESS);
+		return 1;
+	}
+	return 0;
+}
+
+// downconvert the samples of one scan with adc_ddc and write the I/Q to filename (one value per line, I and Q
+// alternating, or a SCAN_DATA_IQ16 scan file) and the echo sum of the I/Q to avgname. Returns 0 if the ddc cannot be set
+// up for the scan, nothing is written then
+int write_ddc_data(scan_file_header *hdr, const uint16_t *samples,
+		unsigned int samples_per_echo, unsigned int echoes_per_scan,
+		char * filename, char * avgname) {
+	scan_file_header iq_hdr = *hdr;
+	unsigned long num_of_values;
+	unsigned long k;
+	unsigned int values_per_echo;
+	unsigned int e;
+	long sum;
+
+	if (adc_ddc.iq == NULL || adc_ddc.in_len != samples_per_echo
+			|| adc_ddc.echoes_per_scan != echoes_per_scan) {
+		ddc_free(&adc_ddc);
+		if (!ddc_init(&adc_ddc, &adc_ddc_cfg, samples_per_echo,
+				echoes_per_scan)) {
+			printf("[ERROR] the ddc cannot be set up for %u samples x %u echoes, %s is written as raw data\n",
+					samples_per_echo, echoes_per_scan, filename);
+			return 0;
+		}
+	}
+	ddc_run(&adc_ddc, samples, echoes_per_scan, adc_ddc.iq);
+
+	values_per_echo = adc_ddc.out_len * 2;
+	num_of_values = (unsigned long) values_per_echo * echoes_per_scan;
+	iq_hdr.samples_per_echo = values_per_echo;
+	iq_hdr.adc_freq = hdr->adc_freq
+			/ (adc_ddc_cfg.cic_decim * adc_ddc_cfg.fir_decim); // the output rate
+
+	if (data_file_format == DATA_FILE_BIN) {
+		sprintf(pathname, "%s/%s%s", foldername, filename, SCAN_FILE_EXT);
+		scan_file_write(pathname, &iq_hdr, SCAN_DATA_IQ16, adc_ddc.iq,
+				num_of_values);
+	} else {
+		sprintf(pathname, "%s/%s", foldername, filename);
 		fptr = fopen(pathname, "w");
 		if (fptr == NULL) {
 			printf("File does not exists \n");
+			return 1;
 		}
-		for (i = 0; i < ((long) num_of_samples); i++) {
-			fprintf(fptr, "%d\n", rddata_16[i]);
+		for (k = 0; k < num_of_values; k++) {
+			fprintf(fptr, "%d\n", adc_ddc.iq[k]);
 		}
-		fclose (fptr);
+		fclose(fptr);
+	}
 
-	} else { // if the amount of data captured didn't match the amount of data being ordered, then something's going on with the acquisition
-		printf(
-				"number of data captured and data order : NOT MATCHED\nReconfigure the FPGA immediately\n");
+	sprintf(pathname, "%s/%s", foldername, avgname);
+	fptr = fopen(pathname, "w");
+	if (fptr == NULL) {
+		printf("File does not exists \n");
+		return 1;
+	}
+	for (k = 0; k < values_per_echo; k++) {
+		sum = 0;
+		for (e = 0; e < echoes_per_scan; e++) {
+			sum += adc_ddc.iq[(unsigned long) e * values_per_echo + k];
+		}
+		fprintf(fptr, "%ld\n", sum);
 	}
+	fclose(fptr);
+	return 1;
+}
+
+// integrate every echo of one scan with adc_integ and write the decay (I and Q of every echo, one value per line, or a
+// SCAN_DATA_IQ32 scan file) to filename. The echo sum of the samples in avr_data is written to avgname as usual, it shows
+// where the window is
+void write_integ_data(scan_file_header *hdr, const uint16_t *samples,
+		unsigned int *avr_data, unsigned int samples_per_echo,
+		unsigned int echoes_per_scan, char * filename, char * avgname) {
+	scan_file_header decay_hdr = *hdr;
+
+	if (adc_integ.iq == NULL || adc_integ.samples_per_echo != samples_per_echo
+			|| adc_integ.echoes_per_scan != echoes_per_scan
+			|| adc_integ.centre != adc_echo_centre + adc_integ_cfg.centre_shift) {
+		echo_integ_free(&adc_integ);
+		if (!echo_integ_init(&adc_integ, &adc_integ_cfg, samples_per_echo,
+				echoes_per_scan, adc_echo_centre)) {
+			return;
+		}
+	}
+	echo_integ_run(&adc_integ, samples, echoes_per_scan, adc_integ.iq);
+
+	decay_hdr.samples_per_echo = 2; // I and Q
+	if (data_file_format == DATA_FILE_BIN) {
+		sprintf(pathname, "%s/%s%s", foldername, filename, SCAN_FILE_EXT);
+		scan_file_write(pathname, &decay_hdr, SCAN_DATA_IQ32, adc_integ.iq,
+				echoes_per_scan * 2);
+	} else {
+		sprintf(pathname, "%s/%s", foldername, filename);
+		fptr = fopen(pathname, "w");
+		if (fptr == NULL) {
+			printf("File does not exists \n");
+			return;
+		}
+		for (i = 0; i < echoes_per_scan * 2; i++) {
+			fprintf(fptr, "%d\n", adc_integ.iq[i]);
+		}
+		fclose(fptr);
+	}
+
+	sprintf(pathname, "%s/%s", foldername, avgname);
+	fptr = fopen(pathname, "w");
+	if (fptr == NULL) {
+		printf("File does not exists \n");
+		return;
+	}
+	for (i = 0; i < samples_per_echo; i++) {
+		fprintf(fptr, "%d\n", avr_data[i]);
+	}
+	fclose(fptr);
+}
+
+// write the scan as selected by adc_dsp from the unpacked samples and their echo sum. Returns 0 for ADC_DSP_RAW and when
+// the ddc cannot be set up, the raw data is then to be written by the caller
+int write_dsp_data(scan_file_header *hdr, const uint16_t *samples,
+		unsigned int *avr_data, unsigned int samples_per_echo,
+		unsigned int echoes_per_scan, char * filename, char * avgname) {
+	int written;
+
+	if (adc_dsp == ADC_DSP_DDC) {
+		trace_event(&adc_trace, TRACE_WRITE_BEGIN, 0);
+		written = write_ddc_data(hdr, samples, samples_per_echo, echoes_per_scan,
+				filename, avgname);
+		trace_event(&adc_trace, TRACE_WRITE_END, 0);
+		return written;
+	}
+	if (adc_dsp == ADC_DSP_INTEG) {
+		trace_event(&adc_trace, TRACE_WRITE_BEGIN, 0);
+		write_integ_data(hdr, samples, avr_data, samples_per_echo,
+				echoes_per_scan, filename, avgname);
+		trace_event(&adc_trace, TRACE_WRITE_END, 0);
+		return 1;
+	}
+	return 0;
+}
+
+// write the raw data of one scan to filename in the data folder: one sample per line, or a binary scan file
+// (data_file_format == DATA_FILE_BIN). Both are written straight from the packed fifo words if they are available,
+// from adc_arena.samples otherwise
+void write_raw_data(scan_file_header *hdr, char * filename,
+		unsigned int num_of_samples, const uint32_t *fifo_words) {
+	if (data_file_format == DATA_FILE_BIN) {
+		sprintf(pathname, "%s/%s%s", foldername, filename, SCAN_FILE_EXT); // put the data into the data folder
+		if (fifo_words != NULL) {
+			scan_file_write(pathname, hdr, SCAN_DATA_FIFO_WORDS, fifo_words,
+					num_of_samples);
+			return;
+		}
+		scan_file_write(pathname, hdr, SCAN_DATA_U16, adc_arena.samples,
+				num_of_samples);
+		return;
+	}
+
+	// write the raw data from adc to a file
+	sprintf(pathname, "%s/%s", foldername, filename); // put the data into the data folder
+	fptr = fopen(pathname, "w");
+	if (fptr == NULL) {
+		printf("File does not exists \n");
+		return;
+	}
+	for (i = 0; i < num_of_samples; i++) {
+		fprintf(fptr, "%d\n", fifo_words != NULL ? fifo_sample_at(fifo_words, i) : adc_arena.samples[i]);
+	}
+	fclose (fptr);
+}
+
+// write the raw data (adc_arena.samples, or the packed fifo_words if not NULL) and the echo sum in avr_data to files in the data folder
+void write_cpmg_data(scan_file_header *hdr, unsigned int samples_per_echo,
+		unsigned int echoes_per_scan, unsigned int *avr_data,
+		const uint32_t *fifo_words, char * filename, char * avgname) {
+	trace_event(&adc_trace, TRACE_WRITE_BEGIN, 0);
+	write_raw_data(hdr, filename, samples_per_echo * echoes_per_scan,
+			fifo_words);
+
+	// write the averaged data to a file
+	sprintf(pathname, "%s/%s", foldername, avgname); // put the data into the data folder
+	fptr = fopen(pathname, "w");
+	if (fptr == NULL) {
+		printf("File does not exists \n");
+		return;
+	}
+	for (i = 0; i < samples_per_echo; i++) {
+		fprintf(fptr, "%d\n", avr_data[i]);
+	}
+	fclose(fptr);
+	trace_event(&adc_trace, TRACE_WRITE_END, 0);
 }
 
 // duty cycle is not functioning anymore
-void CPMG_Sequence(double cpmg_freq, double pulse1_us, double pulse2_us,
+// Returns 0 if the scan was not run (the pll did not lock, no memory), its data were not captured, or with filename
+// NULL and READ_DMA if the DMA transfer was not started: sdram_dma_wait must not be called for it then
+int CPMG_Sequence(double cpmg_freq, double pulse1_us, double pulse2_us,
 		double pulse1_dtcl, double pulse2_dtcl, double echo_spacing_us,
 		long unsigned scan_spacing_us, unsigned int samples_per_echo,
 		unsigned int echoes_per_scan, double init_adc_delay_compensation,
@@ -486,17 +1135,22 @@ void CPMG_Sequence(double cpmg_freq, double pulse1_us, double pulse2_us,
 	unsigned int cpmg_param[5];
 	double adc_ltc1746_freq = cpmg_freq * 4;
 	double nmr_fsm_clkfreq = cpmg_freq * 16;
+	int captured = 1;
 
 	double init_delay_inherent = 2.25; // inherehent delay factor from the HDL structure, in ADC clock cycles
 
 	// read settings
-	uint8_t data_nowrite = 0; // do not write the data from fifo to text file (external reading mechanism should be implemented)
-	uint8_t read_with_dma = 0; // else the program reads data directly from the fifo
+	uint8_t data_nowrite = (filename == NULL); // do not write the data from fifo to text file (external reading mechanism should be implemented, CPMG_iterate does it for READ_DMA)
 
-	usleep(scan_spacing_us);
+	trace_event(&adc_trace, TRACE_SCAN_START, samples_per_echo * echoes_per_scan);
+
+	if (adc_sched.period_ns == 0) { // on the scan scheduler the wait is right before FSM_START
+		usleep(scan_spacing_us);
+	}
+	scan_prof_mark(&adc_prof, SCAN_PROF_WAIT);
 
 	// read the current ctrl_out
-	ctrl_out = alt_read_word(h2p_ctrl_out_addr);
+	ctrl_out = reg_shadow_read(&fpga_shadow, h2p_ctrl_out_addr);
 
 	// local variables
 	uint32_t fifo_mem_level; // the fill level of fifo memory
@@ -507,13 +1161,33 @@ void CPMG_Sequence(double cpmg_freq, double pulse1_us, double pulse2_us,
 			adc_ltc1746_freq, init_adc_delay_compensation, pulse1_us, pulse2_us,
 			echo_spacing_us, samples_per_echo);
 
-	alt_write_word((h2p_pulse1_addr), cpmg_param[PULSE1_OFFST]);
-	alt_write_word((h2p_delay1_addr), cpmg_param[DELAY1_OFFST]);
-	alt_write_word((h2p_pulse2_addr), cpmg_param[PULSE2_OFFST]);
-	alt_write_word((h2p_delay2_addr), cpmg_param[DELAY2_OFFST]);
-	alt_write_word((h2p_init_adc_delay_addr), cpmg_param[INIT_DELAY_ADC_OFFST]);
-	alt_write_word((h2p_echo_per_scan_addr), echoes_per_scan);
-	alt_write_word((h2p_adc_samples_per_echo_addr), samples_per_echo);
+	reg_shadow_write(&fpga_shadow, h2p_pulse1_addr, cpmg_param[PULSE1_OFFST]);
+	reg_shadow_write(&fpga_shadow, h2p_delay1_addr, cpmg_param[DELAY1_OFFST]);
+	reg_shadow_write(&fpga_shadow, h2p_pulse2_addr, cpmg_param[PULSE2_OFFST]);
+	reg_shadow_write(&fpga_shadow, h2p_delay2_addr, cpmg_param[DELAY2_OFFST]);
+	reg_shadow_write(&fpga_shadow, h2p_init_adc_delay_addr, cpmg_param[INIT_DELAY_ADC_OFFST]);
+	reg_shadow_write(&fpga_shadow, h2p_echo_per_scan_addr, echoes_per_scan);
+	reg_shadow_write(&fpga_shadow, h2p_adc_samples_per_echo_addr, samples_per_echo);
+
+	scan_file_init_header(&scan_hdr, cpmg_freq, adc_ltc1746_freq,
+			nmr_fsm_clkfreq);
+	scan_hdr.pulse1_cnt = cpmg_param[PULSE1_OFFST];
+	scan_hdr.delay1_cnt = cpmg_param[DELAY1_OFFST];
+	scan_hdr.pulse2_cnt = cpmg_param[PULSE2_OFFST];
+	scan_hdr.delay2_cnt = cpmg_param[DELAY2_OFFST];
+	scan_hdr.init_adc_delay_cnt = cpmg_param[INIT_DELAY_ADC_OFFST];
+	scan_hdr.samples_per_echo = samples_per_echo;
+	scan_hdr.echoes_per_scan = echoes_per_scan;
+	adc_echo_centre = cpmg_echo_centre_ltc1746(adc_ltc1746_freq,
+			init_adc_delay_compensation, pulse2_us, echo_spacing_us,
+			cpmg_param[INIT_DELAY_ADC_OFFST]);
+
+	if (!data_nowrite
+			&& !capture_arena_reserve(&adc_arena,
+					((unsigned long) samples_per_echo * echoes_per_scan + 1) >> 1,
+					samples_per_echo)) { // a no-op once CPMG_iterate has sized the arena for the measurement
+		return 0;
+	}
 
 	if (enable_message) {
 		printf("CPMG Sequence Actual Parameter:\n");
@@ -541,11 +1215,15 @@ void CPMG_Sequence(double cpmg_freq, double pulse1_us, double pulse2_us,
 				"\tWARNING: Computed ADC_init_delay is less than 2, ADC_init_delay is force driven to 2 inside the HDL!");
 	}
 
+	scan_prof_mark(&adc_prof, SCAN_PROF_SETUP);
+
 	// set pll for CPMG
-	Set_PLL(h2p_nmr_sys_pll_addr, 0, nmr_fsm_clkfreq, 0.5, DISABLE_MESSAGE);
-	Reset_PLL(h2p_ctrl_out_addr, PLL_NMR_SYS_RST_ofst, ctrl_out);
+	if (!set_nmr_sys_pll(nmr_fsm_clkfreq)) { // only reprograms, resets and waits for the lock when the frequency changed
+		printf("[ERROR] the nmr system pll is not locked, the scan is not run\n");
+		return 0;
+	}
+	scan_prof_mark(&adc_prof, SCAN_PROF_PLL);
 	// Set_DPS (h2p_nmr_sys_pll_addr, 0, 0, DISABLE_MESSAGE);
-	Wait_PLL_To_Lock(h2p_ctrl_in_addr, PLL_NMR_SYS_lock_ofst);
 
 	// cycle phase for CPMG measurement
 	if (ph_cycl_en == ENABLE) {
@@ -554,7 +1232,7 @@ void CPMG_Sequence(double cpmg_freq, double pulse1_us, double pulse2_us,
 		} else {
 			ctrl_out |= (0x01 << PHASE_CYCLING_ofst);
 		}
-		alt_write_word((h2p_ctrl_out_addr), ctrl_out);
+		reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out);
 		usleep(10);
 	}
 
@@ -566,10 +1244,10 @@ void CPMG_Sequence(double cpmg_freq, double pulse1_us, double pulse2_us,
 
 	// reset buffer
 	ctrl_out |= (0x01 << ADC_FIFO_RST_ofst);
-	alt_write_word((h2p_ctrl_out_addr), ctrl_out);
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out);
 	usleep(10);
 	ctrl_out &= ~(0x01 << ADC_FIFO_RST_ofst);
-	alt_write_word((h2p_ctrl_out_addr), ctrl_out);
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out);
 	usleep(10);
 
 	// start fsm
@@ -577,9 +1255,21 @@ void CPMG_Sequence(double cpmg_freq, double pulse1_us, double pulse2_us,
 	// the pll_rst_dly should be longer than the delay coming from changing the phase
 	// otherwise, the fsm will start with wrong relationship between 4 pll output clocks (1/2 pi difference between clock)
 	// alt_write_word( (h2p_nmr_pll_rst_dly_addr) , 1000000 );	// set the amount of delay for pll reset (with 50MHz system clock, every tick means 20ns) -> default: 100000
-	ctrl_out = alt_read_word(h2p_ctrl_out_addr);
-	alt_write_word((h2p_ctrl_out_addr), ctrl_out | (0x01 << FSM_START_ofst));
-	alt_write_word((h2p_ctrl_out_addr), ctrl_out & ~(0x01 << FSM_START_ofst));
+	ctrl_out = reg_shadow_read(&fpga_shadow, h2p_ctrl_out_addr);
+	scan_prof_mark(&adc_prof, SCAN_PROF_SETUP);
+	if (adc_sched.period_ns != 0) {
+		scan_sched_wait(&adc_sched);
+		scan_prof_mark(&adc_prof, SCAN_PROF_WAIT);
+	}
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out | (0x01 << FSM_START_ofst));
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out & ~(0x01 << FSM_START_ofst));
+	trace_event(&adc_trace, TRACE_FSM_START, 0);
+	if (adc_sched.period_ns != 0) {
+		scan_sched_started(&adc_sched);
+	}
+	scan_file_stamp(&scan_hdr);
+	scan_hdr.ph_cycl = (ph_cycl_en == ENABLE ? SCAN_PH_CYCL_EN : 0)
+			| ((ctrl_out & PHASE_CYCLING) ? SCAN_PH_CYCL_STATE : 0);
 	// shift the pll phase accordingly
 	// Set_DPS (h2p_nmr_pll_addr, 0, 0, DISABLE_MESSAGE);
 	// Set_DPS (h2p_nmr_pll_addr, 1, 90, DISABLE_MESSAGE);
@@ -588,96 +1278,93 @@ void CPMG_Sequence(double cpmg_freq, double pulse1_us, double pulse2_us,
 	// usleep(scan_spacing_us);
 
 	if (!data_nowrite) { // write data to text with C programming
-		if (read_with_dma) { // if read with dma is intended
-			// datawrite_with_dma(samples_per_echo*echoes_per_scan/2,DISABLE_MESSAGE);
+		if (adc_read_mode == READ_FIFO_STREAM) { // drain the fifo while the sequence is running
+			CPMG_stream_readout(samples_per_echo, echoes_per_scan, filename,
+					avgname);
+			return 1;
+		}
+
+		unsigned int *avr_data = adc_arena.avr_data; // the echo sum
+		memset(avr_data, 0, samples_per_echo * sizeof(unsigned int));
+
+		if (adc_read_mode == READ_DMA) { // if read with dma is intended
+			if (!datawrite_with_dma(samples_per_echo * echoes_per_scan / 2,
+					samples_per_echo, avr_data, DISABLE_MESSAGE)) { // the SDRAM still holds an older scan
+				printf("[ERROR] DMA transfer failed: %s is not written\n", filename);
+				return 0;
+			}
+			trace_event(&adc_trace, TRACE_DRAIN_DONE, samples_per_echo * echoes_per_scan / 2);
+			scan_prof_mark(&adc_prof, SCAN_PROF_DRAIN); // the sequence, the transfer and the echo sum
 		} else { // if read from fifo is intended
 				 // wait until fsm stops
-			while (alt_read_word(h2p_ctrl_in_addr) & (0x01 << NMR_SEQ_run_ofst))
-				;
+			wait_nmr_seq(cpmg_param[PULSE1_OFFST], cpmg_param[DELAY1_OFFST],
+					cpmg_param[PULSE2_OFFST], cpmg_param[DELAY2_OFFST],
+					echoes_per_scan, nmr_fsm_clkfreq);
 			usleep(300);
+			scan_prof_mark(&adc_prof, SCAN_PROF_SEQUENCE);
 
 			// PRINT # of DATAS in FIFO
 			// fifo_mem_level = alt_read_word(h2p_adc_fifo_status_addr+ALTERA_AVALON_FIFO_LEVEL_REG); // the fill level of FIFO memory
 			// printf("num of data in fifo: %d\n",fifo_mem_level);
 
 			// READING DATA FROM FIFO
-			fifo_mem_level = alt_read_word(
+			fifo_mem_level = bus_read_word(
 					h2p_adc_fifo_status_addr + ALTERA_AVALON_FIFO_LEVEL_REG); // the fill level of FIFO memory
+			trace_event(&adc_trace, TRACE_FIFO_LEVEL, fifo_mem_level);
 			for (i = 0; fifo_mem_level > 0; i++) { // FIFO is 32-bit, while 1-sample is only 16-bit. FIFO organize this automatically. So, fetch only amount_of_data shifted by 2 to get amount_of_data/2.
-				rddata[i] = alt_read_word(h2p_adc_fifo_addr);
+				capture_arena_put(&adc_arena, i, bus_read_word(h2p_adc_fifo_addr));
 
 				fifo_mem_level--;
 				if (fifo_mem_level == 0) {
-					fifo_mem_level = alt_read_word(
+					fifo_mem_level = bus_read_word(
 							h2p_adc_fifo_status_addr
 									+ ALTERA_AVALON_FIFO_LEVEL_REG);
 				}
 				//usleep(1);
 			}
 			usleep(100);
+			trace_event(&adc_trace, TRACE_DRAIN_DONE, i);
+			scan_prof_mark(&adc_prof, SCAN_PROF_DRAIN);
 
 			if (i * 2 == samples_per_echo * echoes_per_scan) { // if the amount of data captured matched with the amount of data being ordered, then continue the process. if not, then don't process the datas (requesting empty data from the fifo will cause the FPGA to crash, so this one is to avoid that)
 			// printf("number of captured data vs requested data : MATCHED\n");
 
-				j = 0;
-				for (i = 0;
-						i
-								< (((long) samples_per_echo
-										* (long) echoes_per_scan) >> 1); i++) {
-					rddata_16[j++] = (rddata[i] & 0x3FFF);// 14 significant bit
-					rddata_16[j++] = ((rddata[i] >> 16) & 0x3FFF);// 14 significant bit
+				if (CPMG_scan_handoff(adc_arena.words, i, samples_per_echo,
+						echoes_per_scan, filename, avgname)) {
+					return 1;
 				}
 
+				// unpack the 2 samples per word and sum the echoes in one sweep
+				echo_unpack_sum(adc_arena.words, i, samples_per_echo,
+						adc_arena.samples, avr_data);
+				scan_prof_mark(&adc_prof, SCAN_PROF_PROCESS);
+
 			} else { // if the amount of data captured didn't match the amount of data being ordered, then something's going on with the acquisition
 				printf(
 						"[ERROR] number of data captured (%ld) and data ordered (%d): NOT MATCHED\nData are flushed!\nReconfigure the FPGA immediately\n",
 						i * 2, samples_per_echo * echoes_per_scan);
+				if (adc_writer.running || adc_accum.sum != NULL) { // nothing is written for this scan
+					return 0;
+				}
+				captured = 0;
 			}
 		}
 
-		// write the raw data from adc to a file
-		sprintf(pathname, "%s/%s", foldername, filename); // put the data into the data folder
-		fptr = fopen(pathname, "w");
-		if (fptr == NULL) {
-			printf("File does not exists \n");
-		}
-		for (i = 0; i < (((long) samples_per_echo * (long) echoes_per_scan));
-				i++) {
-			fprintf(fptr, "%d\n", rddata_16[i]);
-		}
-		fclose (fptr);
-
-		// write the averaged data to a file
-		unsigned int avr_data[samples_per_echo];
-		// initialize array
-		for (i = 0; i < samples_per_echo; i++) {
-			avr_data[i] = 0;
-		};
-		for (i = 0; i < samples_per_echo; i++) {
-			for (j = i;
-					j < (((long) samples_per_echo * (long) echoes_per_scan));
-					j += samples_per_echo) {
-				avr_data[i] += rddata_16[j];
-			}
-		}
-		sprintf(pathname, "%s/%s", foldername, avgname); // put the data into the data folder
-		fptr = fopen(pathname, "w");
-		if (fptr == NULL) {
-			printf("File does not exists \n");
-		}
-		for (i = 0; i < samples_per_echo; i++) {
-			fprintf(fptr, "%d\n", avr_data[i]);
-		}
-		fclose(fptr);
+		write_cpmg_data(&scan_hdr, samples_per_echo, echoes_per_scan, avr_data,
+				adc_read_mode == READ_DMA ? NULL : adc_arena.words, filename, avgname); // the packed words are only in adc_arena.words for the fifo readout
+		scan_prof_mark(&adc_prof, SCAN_PROF_WRITE);
 	} else { // do not write data to text with C programming: external mechanism should be implemented
-			 // fifo_to_sdram_dma_trf (samples_per_echo*echoes_per_scan/2); // start DMA process
-			 //while ( alt_read_word(h2p_ctrl_in_addr) & (0x01<<NMR_SEQ_run_ofst) ); // might not be needed as the system will wait until data is available anyway
+		if (adc_read_mode == READ_DMA) {
+			return fifo_to_sdram_dma_trf(samples_per_echo * echoes_per_scan / 2,
+					dma_sdram_buf); // start DMA process, collected with sdram_dma_wait and sdram_dma_unpack
+		}
+		//while ( alt_read_word(h2p_ctrl_in_addr) & (0x01<<NMR_SEQ_run_ofst) ); // might not be needed as the system will wait until data is available anyway
 	}
-
+	return captured;
 }
 
 // duty cycle is not functioning anymore
-void CPMG_Manual(double cpmg_freq, double pulse1_us, double pulse2_us,
+int CPMG_Manual(double cpmg_freq, double pulse1_us, double pulse2_us,
 		double pulse1_dtcl, double pulse2_dtcl, double delay1_us,
 		double delay2_us, long unsigned scan_spacing_us,
 		unsigned int samples_per_echo, unsigned int echoes_per_scan,
@@ -691,12 +1378,19 @@ void CPMG_Manual(double cpmg_freq, double pulse1_us, double pulse2_us,
 
 	// read settings
 	uint8_t data_nowrite = 0; // do not write the data from fifo to text file (external reading mechanism should be implemented)
-	uint8_t read_with_dma = 0; // else the program reads data directly from the fifo
+	int captured = 0;
+
+	if (!data_nowrite
+			&& !capture_arena_reserve(&adc_arena,
+					((unsigned long) samples_per_echo * echoes_per_scan + 1) >> 1,
+					samples_per_echo)) {
+		return 0;
+	}
 
 	usleep(scan_spacing_us);
 
 	// read the current ctrl_out
-	ctrl_out = alt_read_word(h2p_ctrl_out_addr);
+	ctrl_out = reg_shadow_read(&fpga_shadow, h2p_ctrl_out_addr);
 
 	// local variables
 	uint32_t fifo_mem_level; // the fill level of fifo memory
@@ -715,13 +1409,13 @@ void CPMG_Manual(double cpmg_freq, double pulse1_us, double pulse2_us,
 			samples_per_echo	// the total adc samples captured in one echo
 			);
 
-	alt_write_word((h2p_pulse1_addr), cpmg_param[PULSE1_OFFST]);
-	alt_write_word((h2p_delay1_addr), cpmg_param[DELAY1_OFFST]);
-	alt_write_word((h2p_pulse2_addr), cpmg_param[PULSE2_OFFST]);
-	alt_write_word((h2p_delay2_addr), cpmg_param[DELAY2_OFFST]);
-	alt_write_word((h2p_init_adc_delay_addr), cpmg_param[INIT_DELAY_ADC_OFFST]);
-	alt_write_word((h2p_echo_per_scan_addr), echoes_per_scan);
-	alt_write_word((h2p_adc_samples_per_echo_addr), samples_per_echo);
+	reg_shadow_write(&fpga_shadow, h2p_pulse1_addr, cpmg_param[PULSE1_OFFST]);
+	reg_shadow_write(&fpga_shadow, h2p_delay1_addr, cpmg_param[DELAY1_OFFST]);
+	reg_shadow_write(&fpga_shadow, h2p_pulse2_addr, cpmg_param[PULSE2_OFFST]);
+	reg_shadow_write(&fpga_shadow, h2p_delay2_addr, cpmg_param[DELAY2_OFFST]);
+	reg_shadow_write(&fpga_shadow, h2p_init_adc_delay_addr, cpmg_param[INIT_DELAY_ADC_OFFST]);
+	reg_shadow_write(&fpga_shadow, h2p_echo_per_scan_addr, echoes_per_scan);
+	reg_shadow_write(&fpga_shadow, h2p_adc_samples_per_echo_addr, samples_per_echo);
 
 	if (enable_message) {
 		printf("CPMG Sequence Actual Parameter:\n");
@@ -750,10 +1444,11 @@ void CPMG_Manual(double cpmg_freq, double pulse1_us, double pulse2_us,
 	}
 
 	// set pll for CPMG
-	Set_PLL(h2p_nmr_sys_pll_addr, 0, nmr_fsm_clkfreq, 0.5, DISABLE_MESSAGE);
-	Reset_PLL(h2p_ctrl_out_addr, PLL_NMR_SYS_RST_ofst, ctrl_out);
+	if (!set_nmr_sys_pll(nmr_fsm_clkfreq)) { // only reprograms, resets and waits for the lock when the frequency changed
+		printf("[ERROR] the nmr system pll is not locked, the scan is not run\n");
+		return 0;
+	}
 	// Set_DPS (h2p_nmr_sys_pll_addr, 0, 0, DISABLE_MESSAGE);
-	Wait_PLL_To_Lock(h2p_ctrl_in_addr, PLL_NMR_SYS_lock_ofst);
 
 	// cycle phase for CPMG measurement
 	if (ph_cycl_en == ENABLE) {
@@ -762,7 +1457,7 @@ void CPMG_Manual(double cpmg_freq, double pulse1_us, double pulse2_us,
 		} else {
 			ctrl_out |= (0x01 << PHASE_CYCLING_ofst);
 		}
-		alt_write_word((h2p_ctrl_out_addr), ctrl_out);
+		reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out);
 		usleep(10);
 	}
 
@@ -774,10 +1469,10 @@ void CPMG_Manual(double cpmg_freq, double pulse1_us, double pulse2_us,
 
 	// reset buffer
 	ctrl_out |= (0x01 << ADC_FIFO_RST_ofst);
-	alt_write_word((h2p_ctrl_out_addr), ctrl_out);
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out);
 	usleep(10);
 	ctrl_out &= ~(0x01 << ADC_FIFO_RST_ofst);
-	alt_write_word((h2p_ctrl_out_addr), ctrl_out);
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out);
 	usleep(10);
 
 	// start fsm
@@ -785,9 +1480,9 @@ void CPMG_Manual(double cpmg_freq, double pulse1_us, double pulse2_us,
 	// the pll_rst_dly should be longer than the delay coming from changing the phase
 	// otherwise, the fsm will start with wrong relationship between 4 pll output clocks (1/2 pi difference between clock)
 	// alt_write_word( (h2p_nmr_pll_rst_dly_addr) , 1000000 );	// set the amount of delay for pll reset (with 50MHz system clock, every tick means 20ns) -> default: 100000
-	ctrl_out = alt_read_word(h2p_ctrl_out_addr);
-	alt_write_word((h2p_ctrl_out_addr), ctrl_out | (0x01 << FSM_START_ofst));
-	alt_write_word((h2p_ctrl_out_addr), ctrl_out & ~(0x01 << FSM_START_ofst));
+	ctrl_out = reg_shadow_read(&fpga_shadow, h2p_ctrl_out_addr);
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out | (0x01 << FSM_START_ofst));
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out & ~(0x01 << FSM_START_ofst));
 	// shift the pll phase accordingly
 	// Set_DPS (h2p_nmr_pll_addr, 0, 0, DISABLE_MESSAGE);
 	// Set_DPS (h2p_nmr_pll_addr, 1, 90, DISABLE_MESSAGE);
@@ -796,12 +1491,14 @@ void CPMG_Manual(double cpmg_freq, double pulse1_us, double pulse2_us,
 	// usleep(scan_spacing_us);
 
 	if (!data_nowrite) { // write data to text with C programming
-		if (read_with_dma) { // if read with dma is intended
-			// datawrite_with_dma(samples_per_echo*echoes_per_scan/2,DISABLE_MESSAGE);
+		if (adc_read_mode == READ_DMA) { // if read with dma is intended
+			captured = datawrite_with_dma(samples_per_echo * echoes_per_scan / 2,
+					samples_per_echo, NULL, DISABLE_MESSAGE);
 		} else { // if read from fifo is intended
 				 // wait until fsm stops
-			while (alt_read_word(h2p_ctrl_in_addr) & (0x01 << NMR_SEQ_run_ofst))
-				;
+			wait_nmr_seq(cpmg_param[PULSE1_OFFST], cpmg_param[DELAY1_OFFST],
+					cpmg_param[PULSE2_OFFST], cpmg_param[DELAY2_OFFST],
+					echoes_per_scan, nmr_fsm_clkfreq);
 			usleep(300);
 
 			// PRINT # of DATAS in FIFO
@@ -809,14 +1506,14 @@ void CPMG_Manual(double cpmg_freq, double pulse1_us, double pulse2_us,
 			// printf("num of data in fifo: %d\n",fifo_mem_level);
 
 			// READING DATA FROM FIFO
-			fifo_mem_level = alt_read_word(
+			fifo_mem_level = bus_read_word(
 					h2p_adc_fifo_status_addr + ALTERA_AVALON_FIFO_LEVEL_REG); // the fill level of FIFO memory
 			for (i = 0; fifo_mem_level > 0; i++) { // FIFO is 32-bit, while 1-sample is only 16-bit. FIFO organize this automatically. So, fetch only amount_of_data shifted by 2 to get amount_of_data/2.
-				rddata[i] = alt_read_word(h2p_adc_fifo_addr);
+				capture_arena_put(&adc_arena, i, bus_read_word(h2p_adc_fifo_addr));
 
 				fifo_mem_level--;
 				if (fifo_mem_level == 0) {
-					fifo_mem_level = alt_read_word(
+					fifo_mem_level = bus_read_word(
 							h2p_adc_fifo_status_addr
 									+ ALTERA_AVALON_FIFO_LEVEL_REG);
 				}
@@ -827,13 +1524,14 @@ void CPMG_Manual(double cpmg_freq, double pulse1_us, double pulse2_us,
 			if (i * 2 == samples_per_echo * echoes_per_scan) { // if the amount of data captured matched with the amount of data being ordered, then continue the process. if not, then don't process the datas (requesting empty data from the fifo will cause the FPGA to crash, so this one is to avoid that)
 			// printf("number of captured data vs requested data : MATCHED\n");
 
+				captured = 1;
 				j = 0;
 				for (i = 0;
 						i
 								< (((long) samples_per_echo
 										* (long) echoes_per_scan) >> 1); i++) {
-					rddata_16[j++] = (rddata[i] & 0x3FFF);// 14 significant bit
-					rddata_16[j++] = ((rddata[i] >> 16) & 0x3FFF);// 14 significant bit
+					adc_arena.samples[j++] = (adc_arena.words[i] & 0x3FFF);// 14 significant bit
+					adc_arena.samples[j++] = ((adc_arena.words[i] >> 16) & 0x3FFF);// 14 significant bit
 				}
 
 			} else { // if the amount of data captured didn't match the amount of data being ordered, then something's going on with the acquisition
@@ -847,7 +1545,7 @@ void CPMG_Manual(double cpmg_freq, double pulse1_us, double pulse2_us,
 			 // fifo_to_sdram_dma_trf (samples_per_echo*echoes_per_scan/2); // start DMA process
 			 //while ( alt_read_word(h2p_ctrl_in_addr) & (0x01<<NMR_SEQ_run_ofst) ); // might not be needed as the system will wait until data is available anyway
 	}
-
+	return captured;
 }
 
 void CPMG_iterate(double cpmg_freq, double pulse1_us, double pulse2_us,
@@ -855,14 +1553,33 @@ void CPMG_iterate(double cpmg_freq, double pulse1_us, double pulse2_us,
 		long unsigned scan_spacing_us, unsigned int samples_per_echo,
 		unsigned int echoes_per_scan, double init_adc_delay_compensation,
 		unsigned int number_of_iteration, uint32_t ph_cycl_en) {
+	create_measurement_folder("cpmg");
+	// printf("Approximated measurement time : %.2f mins\n",( scan_spacing_us*(double)number_of_iteration) *1e-6/60);
+
+	CPMG_measure(cpmg_freq, pulse1_us, pulse2_us, pulse1_dtcl, pulse2_dtcl,
+			echo_spacing_us, scan_spacing_us, samples_per_echo, echoes_per_scan,
+			init_adc_delay_compensation, number_of_iteration, ph_cycl_en);
+}
+
+// the scans of CPMG_iterate, with acqu.par and the data files written into the folder in foldername.
+// Returns 0 if the measurement was aborted before the scans: the pll does not lock or the buffers cannot be allocated
+int CPMG_measure(double cpmg_freq, double pulse1_us, double pulse2_us,
+		double pulse1_dtcl, double pulse2_dtcl, double echo_spacing_us,
+		long unsigned scan_spacing_us, unsigned int samples_per_echo,
+		unsigned int echoes_per_scan, double init_adc_delay_compensation,
+		unsigned int number_of_iteration, uint32_t ph_cycl_en) {
 	double nmr_fsm_clkfreq = 16 * cpmg_freq;
 	double adc_ltc1746_freq = 4 * cpmg_freq;
 
+	reg_shadow_clear_stat(&fpga_shadow);
+
 	// read the current ctrl_out
-	ctrl_out = alt_read_word(h2p_ctrl_out_addr);
+	ctrl_out = reg_shadow_read(&fpga_shadow, h2p_ctrl_out_addr);
 
-	create_measurement_folder("cpmg");
-	// printf("Approximated measurement time : %.2f mins\n",( scan_spacing_us*(double)number_of_iteration) *1e-6/60);
+	if (!set_nmr_sys_pll(nmr_fsm_clkfreq)) { // the scans find it set
+		printf("[ERROR] the nmr system pll is not locked, the measurement in %s is aborted\n", foldername);
+		return 0;
+	}
 
 	unsigned int cpmg_param[5];
 	cpmg_param_calculator_ltc1746(cpmg_param, nmr_fsm_clkfreq, cpmg_freq,
@@ -897,6 +1614,7 @@ void CPMG_iterate(double cpmg_freq, double pulse1_us, double pulse2_us,
 					/ nmr_fsm_clkfreq);
 	fprintf(fptr, "echoTimeGiven = %4.3f\n", echo_spacing_us);
 	fprintf(fptr, "ieTime = %lu\n", scan_spacing_us / 1000);
+	fprintf(fptr, "scanPeriod = %u\n", scan_period_us);
 	fprintf(fptr, "nrPnts = %d\n", samples_per_echo);
 	fprintf(fptr, "nrEchoes = %d\n", echoes_per_scan);
 	fprintf(fptr, "echoShift = %4.3f\n", init_adc_delay_compensation);
@@ -905,6 +1623,26 @@ void CPMG_iterate(double cpmg_freq, double pulse1_us, double pulse2_us,
 	fprintf(fptr, "adcFreq = %4.3f\n", adc_ltc1746_freq);
 	fprintf(fptr, "dwellTime = %4.3f\n", 1 / adc_ltc1746_freq);
 	fprintf(fptr, "usePhaseCycle = %d\n", ph_cycl_en);
+	fprintf(fptr, "dataFormat = %s\n",
+			data_file_format == DATA_FILE_BIN ? "bin" : "text");
+	fprintf(fptr, "accumulate = %d\n", accum_en);
+	fprintf(fptr, "accumulateCheckpoint = %u\n", accum_checkpoint);
+	fprintf(fptr, "adcDsp = %s\n", adc_dsp == ADC_DSP_DDC ? "ddc" :
+			(adc_dsp == ADC_DSP_INTEG ? "integ" : "raw"));
+	if (adc_dsp == ADC_DSP_DDC) {
+		fprintf(fptr, "ddcCicOrder = %u\n", adc_ddc_cfg.cic_order);
+		fprintf(fptr, "ddcCicDecim = %u\n", adc_ddc_cfg.cic_decim);
+		fprintf(fptr, "ddcFirDecim = %u\n", adc_ddc_cfg.fir_decim);
+		fprintf(fptr, "ddcFirTaps = %u\n", adc_ddc_cfg.fir_len);
+		fprintf(fptr, "ddcFreq = %4.3f\n", adc_ltc1746_freq
+				/ (adc_ddc_cfg.cic_decim * adc_ddc_cfg.fir_decim));
+	}
+	if (adc_dsp == ADC_DSP_INTEG) {
+		fprintf(fptr, "integWindow = %u\n", adc_integ_cfg.window);
+		fprintf(fptr, "integWidth = %u\n", adc_integ_cfg.width);
+		fprintf(fptr, "integCentreShift = %4.3f\n", adc_integ_cfg.centre_shift);
+		fprintf(fptr, "integFracBits = %d\n", ECHO_INTEG_FRAC_BITS);
+	}
 	fclose (fptr);
 
 	// print matlab script to analyze datas
@@ -927,32 +1665,233 @@ void CPMG_iterate(double cpmg_freq, double pulse1_us, double pulse2_us,
 	char *nameavg;
 	nameavg = (char*) malloc(FILENAME_LENGTH * sizeof(char));
 
+	uint32_t num_of_words = samples_per_echo * echoes_per_scan / 2; // the DMA transfer length
+	int dma_valid = 0; // the previous DMA transfer completed
+	int started; // CPMG_Sequence started the sequence and the DMA transfer
+	if (!capture_arena_reserve(&adc_arena,
+			((unsigned long) samples_per_echo * echoes_per_scan + 1) >> 1,
+			samples_per_echo)) { // sized once for the whole measurement
+		free(name);
+		free(nameavg);
+		return 0;
+	}
+	unsigned int *avr_data = adc_arena.avr_data; // the echo sum of the scan being written
+	scan_file_header prev_hdr; // the header of the scan being written
+	struct timespec t_scan_start, t_scan_end;
+	unsigned long next_checkpoint = accum_checkpoint;
+
+	if (adc_dsp != ADC_DSP_RAW) { // every scan is processed in line
+		if (accum_en || scan_writer_en) {
+			printf("the processed scans are written in line, accumulation and the writer thread are not used\n");
+		}
+	} else if (accum_en) { // only the sums of all scans are written
+		if (!scan_accum_init(&adc_accum, samples_per_echo, echoes_per_scan)) { // not one file per scan instead
+			printf("[ERROR] the scans cannot be accumulated, the measurement in %s is aborted\n", foldername);
+			free(name);
+			free(nameavg);
+			return 0;
+		}
+	} else if (scan_writer_en && adc_read_mode != READ_DMA) { // the files of scan k are written while scan k+1 is acquired
+		scan_writer_start(&adc_writer, foldername, data_file_format);
+		adc_writer.trace = &adc_trace;
+	}
+	if (scan_period_us > 0
+			&& !scan_sched_init(&adc_sched, &scan_clock_monotonic,
+					(uint64_t) scan_period_us * 1000, number_of_iteration)) {
+		printf("the scans are started after scan_spacing_us instead\n");
+	}
+	if (rt_profile_enter(&adc_rt)) { // before the first FSM_START
+		if (adc_writer.running) {
+			rt_profile_housekeeping(&adc_rt, adc_writer.thread);
+		}
+		if (adc_read_mode == READ_FIFO_STREAM
+				&& (adc_ring.buf != NULL
+						|| fifo_ring_init(&adc_ring, FIFO_RING_INIT_SIZE))
+				&& fifo_ring_reserve(&adc_ring, num_of_words)) { // grown here instead of in the first drain
+			rt_prefault(adc_ring.buf, adc_ring.size * sizeof(uint32_t));
+		}
+		rt_prefault(adc_arena.base, adc_arena.size);
+		hw_wait_clear(&wait_nmr_seq_site);
+	}
+
 	for (iterate = 1; iterate <= number_of_iteration; iterate++) {
 		// printf("\n*** RUN %d ***\n",iterate);
 
-		snprintf(name, FILENAME_LENGTH, "dat_%03d", iterate);
-		snprintf(nameavg, FILENAME_LENGTH, "avg_%03d", iterate);
+		if (adc_read_mode == READ_DMA) { // double buffered: the DMA fills one SDRAM buffer while the previous scan is written from the other one
+			dma_sdram_buf = iterate & 0x01;
+			prev_hdr = scan_hdr;
+			started = CPMG_Sequence(cpmg_freq, pulse1_us, pulse2_us, pulse1_dtcl,
+					pulse2_dtcl, echo_spacing_us, scan_spacing_us,
+					samples_per_echo, echoes_per_scan,
+					init_adc_delay_compensation, ph_cycl_en, NULL, NULL,
+					DISABLE_MESSAGE); // returns right after the fsm and the DMA are started
+
+			if (iterate > 1 && dma_valid && adc_accum.sum != NULL) {
+				sdram_dma_unpack(num_of_words, (iterate - 1) & 0x01,
+						samples_per_echo, NULL);
+				scan_accum_add_samples(&adc_accum, adc_arena.samples,
+						scan_accum_negate(&prev_hdr));
+			} else if (iterate > 1 && dma_valid) { // names still point to the previous scan
+				for (i = 0; i < samples_per_echo; i++) {
+					avr_data[i] = 0;
+				}
+				sdram_dma_unpack(num_of_words, (iterate - 1) & 0x01,
+						samples_per_echo, avr_data);
+				if (!write_dsp_data(&prev_hdr, adc_arena.samples, avr_data,
+						samples_per_echo, echoes_per_scan, name, nameavg)) {
+					write_cpmg_data(&prev_hdr, samples_per_echo,
+							echoes_per_scan, avr_data, NULL, name, nameavg);
+				}
+			}
+			// the previous scan is written above either way, its SDRAM buffer is not the one of this scan. Without a
+			// transfer the buffer of this scan holds old data: nothing is waited for, unpacked or written for it
+			dma_valid = started && sdram_dma_wait(DISABLE_MESSAGE);
 
-		CPMG_Sequence(cpmg_freq,						//cpmg_freq
-				pulse1_us,						//pulse1_us
-				pulse2_us,						//pulse2_us
-				pulse1_dtcl,					//pulse1_dtcl
-				pulse2_dtcl,					//pulse2_dtcl
-				echo_spacing_us,				//echo_spacing_us
-				scan_spacing_us,				//scan_spacing_us
-				samples_per_echo,				//samples_per_echo
-				echoes_per_scan,				//echoes_per_scan
-				init_adc_delay_compensation,//compensation delay number (counted by the adc base clock)
-				ph_cycl_en,						//phase cycle enable/disable
-				name,							//filename for data
-				nameavg,						//filename for average data
-				DISABLE_MESSAGE);
+			snprintf(name, FILENAME_LENGTH, "dat_%03d", iterate);
+			snprintf(nameavg, FILENAME_LENGTH, "avg_%03d", iterate);
+		} else {
+			snprintf(name, FILENAME_LENGTH, "dat_%03d", iterate);
+			snprintf(nameavg, FILENAME_LENGTH, "avg_%03d", iterate);
+
+			clock_gettime(CLOCK_MONOTONIC, &t_scan_start);
+			CPMG_Sequence(cpmg_freq,						//cpmg_freq
+					pulse1_us,						//pulse1_us
+					pulse2_us,						//pulse2_us
+					pulse1_dtcl,					//pulse1_dtcl
+					pulse2_dtcl,					//pulse2_dtcl
+					echo_spacing_us,				//echo_spacing_us
+					scan_spacing_us,				//scan_spacing_us
+					samples_per_echo,				//samples_per_echo
+					echoes_per_scan,				//echoes_per_scan
+					init_adc_delay_compensation,//compensation delay number (counted by the adc base clock)
+					ph_cycl_en,						//phase cycle enable/disable
+					name,							//filename for data
+					nameavg,						//filename for average data
+					DISABLE_MESSAGE);
+			clock_gettime(CLOCK_MONOTONIC, &t_scan_end);
+			if (adc_writer.running) {
+				stage_time_add(&adc_writer.t_acq, &t_scan_start, &t_scan_end);
+			}
+		}
 
+		if (adc_accum.sum != NULL && accum_checkpoint > 0
+				&& adc_accum.scans >= next_checkpoint) { // the sums so far, in case the measurement is stopped early
+			prev_hdr = scan_hdr;
+			snprintf(name, FILENAME_LENGTH, "dat_sum_%03lu", adc_accum.scans);
+			snprintf(nameavg, FILENAME_LENGTH, "avg_sum_%03lu", adc_accum.scans);
+			scan_accum_write(&adc_accum, &prev_hdr, data_file_format, foldername,
+					name, nameavg);
+			next_checkpoint += accum_checkpoint;
+		}
+	}
+
+	if (adc_writer.running) { // write the scans still in the queue
+		scan_writer_stop(&adc_writer);
+		scan_writer_print_stat(&adc_writer);
 	}
 
+	if (adc_read_mode == READ_DMA && number_of_iteration > 0 && dma_valid
+			&& adc_accum.sum != NULL) { // the last scan
+		sdram_dma_unpack(num_of_words, number_of_iteration & 0x01,
+				samples_per_echo, NULL);
+		scan_accum_add_samples(&adc_accum, adc_arena.samples,
+				scan_accum_negate(&scan_hdr));
+	} else if (adc_read_mode == READ_DMA && number_of_iteration > 0
+			&& dma_valid) {
+		for (i = 0; i < samples_per_echo; i++) {
+			avr_data[i] = 0;
+		}
+		sdram_dma_unpack(num_of_words, number_of_iteration & 0x01,
+				samples_per_echo, avr_data);
+		if (!write_dsp_data(&scan_hdr, adc_arena.samples, avr_data,
+				samples_per_echo, echoes_per_scan, name, nameavg)) {
+			write_cpmg_data(&scan_hdr, samples_per_echo, echoes_per_scan,
+					avr_data, NULL, name, nameavg);
+		}
+	}
+
+	if (adc_accum.sum != NULL) { // the final record
+		prev_hdr = scan_hdr;
+		scan_accum_write(&adc_accum, &prev_hdr, data_file_format, foldername,
+				"dat_sum", "avg_sum");
+		printf("accumulated %lu scans (%lu subtracted) into %s/dat_sum\n",
+				adc_accum.scans, adc_accum.scans_negated, foldername);
+		scan_accum_free(&adc_accum);
+	}
+	if (adc_rt.active) {
+		rt_profile_print(&adc_rt);
+		printf("worst-case wakeup latency: %.1f us in the sequence waits",
+				wait_nmr_seq_site.max_late_ns * 1e-3);
+		if (adc_sched.period_ns != 0) {
+			printf(", %.1f us at the scan starts",
+					adc_sched.jitter_max_ns * 1e-3);
+		}
+		printf("\n");
+		rt_profile_leave(&adc_rt);
+		capture_arena_relock(&adc_arena); // munlockall dropped its mlock as well
+	}
+	reg_shadow_print_stat(&fpga_shadow, number_of_iteration);
+	capture_arena_print_stat(&adc_arena); // the peak memory of the scans
+	if (adc_sched.period_ns != 0) {
+		char jitter_path[PATH_MAX];
+
+		scan_sched_print_stat(&adc_sched);
+		snprintf(jitter_path, sizeof(jitter_path), "%s/scan_jitter.txt", foldername);
+		scan_sched_write_log(&adc_sched, jitter_path);
+		scan_sched_free(&adc_sched);
+	}
+	ddc_free(&adc_ddc);
+	echo_integ_free(&adc_integ);
+
 	free(name);
 	free(nameavg);
+	return 1;
+}
 
+// measure every point of sw with CPMG_measure into one session folder, a sub folder per point named by its index in the
+// list (point_NNN). The points are reordered first, so the nmr system PLL is only reprogrammed when the frequency
+// changes. The time of every point and the sweep report (sweep.csv) are in sw and in the session folder
+void CPMG_sweep(cpmg_sweep *sw, double pulse1_dtcl, double pulse2_dtcl,
+		long unsigned scan_spacing_us, unsigned int number_of_iteration,
+		uint32_t ph_cycl_en) {
+	char session[sizeof(foldername)];
+	cpmg_sweep_point *p;
+	struct timespec t0, t1;
+	unsigned long pll_programmed;
+	double scan_us;
+	unsigned int k;
+
+	create_measurement_folder("cpmg_sweep");
+	strcpy(session, foldername);
+	cpmg_sweep_order(sw);
+
+	for (k = 0; k < sw->num; k++) {
+		p = &sw->pt[k];
+		snprintf(foldername, sizeof(foldername), "%s/point_%03u", session, p->index);
+		if (mkdir(foldername, 0777) != 0 && errno != EEXIST) {
+			printf("ERROR: cannot create %s (%s), the point is skipped\n", foldername, strerror(errno));
+			continue;
+		}
+		scan_us = scan_period_us > 0 ? fmax(scan_period_us, cpmg_sweep_seq_us(p))
+				: scan_spacing_us + cpmg_sweep_seq_us(p);
+		pll_programmed = nmr_pll_cache.load_misses;
+
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		p->done = CPMG_measure(p->cpmg_freq, p->pulse1_us, p->pulse2_us, pulse1_dtcl,
+				pulse2_dtcl, p->echo_spacing_us, scan_spacing_us,
+				p->samples_per_echo, p->echoes_per_scan,
+				p->init_adc_delay_compensation, number_of_iteration, ph_cycl_en);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+
+		p->pll_programmed = nmr_pll_cache.load_misses != pll_programmed;
+		p->run_ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) * 1e-6;
+		p->min_ms = number_of_iteration * scan_us * 1e-3;
+	}
+
+	strcpy(foldername, session);
+	cpmg_sweep_print(sw);
+	sprintf(pathname, "%s/sweep.csv", foldername);
+	cpmg_sweep_write_report(sw, pathname);
 }
 
 void FID(double cpmg_freq, double pulse2_us, double pulse2_dtcl,
@@ -960,12 +1899,17 @@ void FID(double cpmg_freq, double pulse2_us, double pulse2_dtcl,
 		char * filename, uint32_t enable_message) {
 	double adc_ltc1746_freq = cpmg_freq * 4;
 	double nmr_fsm_clkfreq = cpmg_freq * 16;
-	uint8_t read_with_dma = 0; // else the program reads data directly from the fifo
 
 	usleep(scan_spacing_us);
+	trace_event(&adc_trace, TRACE_SCAN_START, samples_per_echo);
+	scan_prof_mark(&adc_prof, SCAN_PROF_WAIT);
+
+	if (!capture_arena_reserve(&adc_arena, (samples_per_echo + 1) >> 1, 0)) {
+		return;
+	}
 
 	// read the current ctrl_out
-	ctrl_out = alt_read_word(h2p_ctrl_out_addr);
+	ctrl_out = reg_shadow_read(&fpga_shadow, h2p_ctrl_out_addr);
 
 	// local variables
 	uint32_t fifo_mem_level; // the fill level of fifo memory
@@ -983,13 +1927,22 @@ void FID(double cpmg_freq, double pulse2_us, double pulse2_dtcl,
 		init_delay_inherent = (double) fixed_init_adc_delay + 0.25; // look at ERRATA from the HDL to get 0.25
 	}
 
-	alt_write_word((h2p_pulse1_addr), 0);
-	alt_write_word((h2p_delay1_addr), 0);
-	alt_write_word((h2p_pulse2_addr), pulse2_int);
-	alt_write_word((h2p_delay2_addr), delay2_int);
-	alt_write_word((h2p_init_adc_delay_addr), fixed_init_adc_delay);
-	alt_write_word((h2p_echo_per_scan_addr), fixed_echo_per_scan);
-	alt_write_word((h2p_adc_samples_per_echo_addr), samples_per_echo);
+	reg_shadow_write(&fpga_shadow, h2p_pulse1_addr, 0);
+	reg_shadow_write(&fpga_shadow, h2p_delay1_addr, 0);
+	reg_shadow_write(&fpga_shadow, h2p_pulse2_addr, pulse2_int);
+	reg_shadow_write(&fpga_shadow, h2p_delay2_addr, delay2_int);
+	reg_shadow_write(&fpga_shadow, h2p_init_adc_delay_addr, fixed_init_adc_delay);
+	reg_shadow_write(&fpga_shadow, h2p_echo_per_scan_addr, fixed_echo_per_scan);
+	reg_shadow_write(&fpga_shadow, h2p_adc_samples_per_echo_addr, samples_per_echo);
+
+	scan_file_init_header(&scan_hdr, cpmg_freq, adc_ltc1746_freq,
+			nmr_fsm_clkfreq);
+	scan_hdr.pulse2_cnt = pulse2_int;
+	scan_hdr.delay2_cnt = delay2_int;
+	scan_hdr.init_adc_delay_cnt = fixed_init_adc_delay;
+	scan_hdr.samples_per_echo = samples_per_echo;
+	scan_hdr.echoes_per_scan = fixed_echo_per_scan;
+	scan_file_stamp(&scan_hdr);
 
 	if (enable_message) {
 		printf("CPMG Sequence Actual Parameter:\n");
@@ -1008,15 +1961,19 @@ void FID(double cpmg_freq, double pulse2_us, double pulse2_dtcl,
 				"\tWARNING: Computed ADC_init_delay is less than 2, ADC_init_delay is force driven to 2 inside the HDL!");
 	}
 
+	scan_prof_mark(&adc_prof, SCAN_PROF_SETUP);
+
 	// set pll for CPMG system
-	Set_PLL(h2p_nmr_sys_pll_addr, 0, nmr_fsm_clkfreq, 0.5, DISABLE_MESSAGE); // set pll frequency
-	Reset_PLL(h2p_ctrl_out_addr, PLL_NMR_SYS_RST_ofst, ctrl_out); // reset pll, changes the phase
+	if (!set_nmr_sys_pll(nmr_fsm_clkfreq)) { // set pll frequency, reset pll (changes the phase) and wait for pll to lock
+		printf("[ERROR] the nmr system pll is not locked, the scan is not run\n");
+		return;
+	}
 	Set_DPS(h2p_nmr_sys_pll_addr, 0, 0, DISABLE_MESSAGE); // set pll phase to 0 (might not be needed)
-	Wait_PLL_To_Lock(h2p_ctrl_in_addr, PLL_NMR_SYS_lock_ofst); // wait for pll to lock
+	scan_prof_mark(&adc_prof, SCAN_PROF_PLL);
 
 	// set a fix phase cycle state
 	ctrl_out &= ~(0x01 << PHASE_CYCLING_ofst);
-	alt_write_word((h2p_ctrl_out_addr), ctrl_out);
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out);
 	usleep(10);
 
 	// reset the selected ADC (the ADC reset was omitted)
@@ -1027,10 +1984,10 @@ void FID(double cpmg_freq, double pulse2_us, double pulse2_dtcl,
 
 	// reset ADC buffer
 	ctrl_out |= (0x01 << ADC_FIFO_RST_ofst);
-	alt_write_word((h2p_ctrl_out_addr), ctrl_out);
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out);
 	usleep(10);
 	ctrl_out &= ~(0x01 << ADC_FIFO_RST_ofst);
-	alt_write_word((h2p_ctrl_out_addr), ctrl_out);
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out);
 	usleep(10);
 
 	// start fsm
@@ -1038,9 +1995,11 @@ void FID(double cpmg_freq, double pulse2_us, double pulse2_dtcl,
 	// the pll_rst_dly should be longer than the delay coming from changing the phase
 	// otherwise, the fsm will start with wrong relationship between 4 pll output clocks (1/2 pi difference between clock)
 	// alt_write_word( (h2p_nmr_pll_rst_dly_addr) , 1000000 );	// set the amount of delay for pll reset (with 50MHz system clock, every tick means 20ns) -> default: 100000
-	ctrl_out = alt_read_word(h2p_ctrl_out_addr);
-	alt_write_word((h2p_ctrl_out_addr), ctrl_out | (0x01 << FSM_START_ofst));
-	alt_write_word((h2p_ctrl_out_addr), ctrl_out & ~(0x01 << FSM_START_ofst));
+	ctrl_out = reg_shadow_read(&fpga_shadow, h2p_ctrl_out_addr);
+	scan_prof_mark(&adc_prof, SCAN_PROF_SETUP);
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out | (0x01 << FSM_START_ofst));
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out & ~(0x01 << FSM_START_ofst));
+	trace_event(&adc_trace, TRACE_FSM_START, 0);
 	// shift the pll phase accordingly
 	// Set_DPS (h2p_nmr_pll_addr, 0, 0, DISABLE_MESSAGE);
 	// Set_DPS (h2p_nmr_pll_addr, 1, 90, DISABLE_MESSAGE);
@@ -1048,42 +2007,53 @@ void FID(double cpmg_freq, double pulse2_us, double pulse2_dtcl,
 	// Set_DPS (h2p_nmr_pll_addr, 3, 270, DISABLE_MESSAGE);
 	// usleep(scan_spacing_us);
 
-	if (read_with_dma) { // if read with dma is intended
-		//datawrite_with_dma (samples_per_echo/2,enable_message); // divided by 2 to compensate 2 symbol per beat in the fifo interface
+	if (adc_read_mode == READ_DMA) { // if read with dma is intended
+		if (!datawrite_with_dma(samples_per_echo / 2, samples_per_echo, NULL,
+				enable_message)) { // divided by 2 to compensate 2 symbol per beat in the fifo interface
+			printf("[ERROR] DMA transfer failed: %s is not written\n", filename); // the SDRAM still holds an older scan
+			return;
+		}
+		trace_event(&adc_trace, TRACE_DRAIN_DONE, samples_per_echo / 2);
+		scan_prof_mark(&adc_prof, SCAN_PROF_DRAIN); // the sequence and the transfer
 	} else { // if read from fifo is intended
 			 // wait until fsm stops
-		while (alt_read_word(h2p_ctrl_in_addr) & (0x01 << NMR_SEQ_run_ofst))
-			;
+		wait_nmr_seq(0, 0, pulse2_int, delay2_int, fixed_echo_per_scan,
+				nmr_fsm_clkfreq);
 		usleep(300);
+		scan_prof_mark(&adc_prof, SCAN_PROF_SEQUENCE);
 
 		// PRINT # of DATAS in FIFO
 		// fifo_mem_level = alt_read_word(h2p_adc_fifo_status_addr+ALTERA_AVALON_FIFO_LEVEL_REG); // the fill level of FIFO memory
 		// printf("num of data in fifo: %d\n",fifo_mem_level);
 
 		// READING DATA FROM FIFO
-		fifo_mem_level = alt_read_word(
+		fifo_mem_level = bus_read_word(
 				h2p_adc_fifo_status_addr + ALTERA_AVALON_FIFO_LEVEL_REG); // the fill level of FIFO memory
+		trace_event(&adc_trace, TRACE_FIFO_LEVEL, fifo_mem_level);
 		for (i = 0; fifo_mem_level > 0; i++) { // FIFO is 32-bit, while 1-sample is only 16-bit. FIFO organize this automatically. So, fetch only amount_of_data shifted by 2 to get amount_of_data/2.
-			rddata[i] = alt_read_word(h2p_adc_fifo_addr);
+			capture_arena_put(&adc_arena, i, bus_read_word(h2p_adc_fifo_addr));
 
 			fifo_mem_level--;
 			if (fifo_mem_level == 0) {
-				fifo_mem_level = alt_read_word(
+				fifo_mem_level = bus_read_word(
 						h2p_adc_fifo_status_addr
 								+ ALTERA_AVALON_FIFO_LEVEL_REG);
 			}
 			//usleep(1);
 		}
 		usleep(100);
+		trace_event(&adc_trace, TRACE_DRAIN_DONE, i);
+		scan_prof_mark(&adc_prof, SCAN_PROF_DRAIN);
 
 		if (i * 2 == samples_per_echo) { // if the amount of data captured matched with the amount of data being ordered, then continue the process. if not, then don't process the datas (requesting empty data from the fifo will cause the FPGA to crash, so this one is to avoid that)
 			// printf("number of captured data vs requested data : MATCHED\n");
 
 			j = 0;
 			for (i = 0; i < (((long) samples_per_echo) >> 1); i++) {
-				rddata_16[j++] = (rddata[i] & 0x3FFF);	// 14 significant bit
-				rddata_16[j++] = ((rddata[i] >> 16) & 0x3FFF);// 14 significant bit
+				adc_arena.samples[j++] = (adc_arena.words[i] & 0x3FFF);	// 14 significant bit
+				adc_arena.samples[j++] = ((adc_arena.words[i] >> 16) & 0x3FFF);// 14 significant bit
 			}
+			scan_prof_mark(&adc_prof, SCAN_PROF_PROCESS);
 
 		} else { // if the amount of data captured didn't match the amount of data being ordered, then something's going on with the acquisition
 			printf(
@@ -1093,15 +2063,11 @@ void FID(double cpmg_freq, double pulse2_us, double pulse2_dtcl,
 	}
 
 	// write the raw data from adc to a file
-	sprintf(pathname, "%s/%s", foldername, filename); // put the data into the data folder
-	fptr = fopen(pathname, "w");
-	if (fptr == NULL) {
-		printf("File does not exists \n");
-	}
-	for (i = 0; i < (((long) samples_per_echo)); i++) {
-		fprintf(fptr, "%d\n", rddata_16[i]);
-	}
-	fclose (fptr);
+	trace_event(&adc_trace, TRACE_WRITE_BEGIN, 0);
+	write_raw_data(&scan_hdr, filename, samples_per_echo,
+			adc_read_mode == READ_DMA ? NULL : adc_arena.words);
+	trace_event(&adc_trace, TRACE_WRITE_END, 0);
+	scan_prof_mark(&adc_prof, SCAN_PROF_WRITE);
 
 }
 
@@ -1126,7 +2092,7 @@ void FID_iterate(double cpmg_freq, double pulse2_us, double pulse2_dtcl,
 			* (nmr_fsm_clkfreq / adc_ltc1746_freq) * 10); // the number of delay after 180 deg pulse. It is simply samples_per_echo multiplied by (nmr_fsm_clkfreq/adc_ltc1746_freq) factor, as the delay2_int is counted by nmr_fsm_clkfreq, not by adc_ltc1746_freq. It is also multiplied by a constant 2 as safety factor to make sure the ADC acquisition is inside FSMSTAT (refer to HDL) 'on' window.
 
 	// read the current ctrl_out
-	ctrl_out = alt_read_word(h2p_ctrl_out_addr);
+	ctrl_out = reg_shadow_read(&fpga_shadow, h2p_ctrl_out_addr);
 
 	create_measurement_folder("fid");
 	// printf("Approximated measurement time : %.2f mins\n",( scan_spacing_us*(double)number_of_iteration)*1e-6/60);
@@ -1197,12 +2163,17 @@ void noise(double cpmg_freq, long unsigned scan_spacing_us,
 		uint32_t enable_message) {
 	double adc_ltc1746_freq = cpmg_freq * 4;
 	double nmr_fsm_clkfreq = cpmg_freq * 16;
-	uint8_t read_with_dma = 0; // else the program reads data directly from the fifo
 
 	usleep(scan_spacing_us);
+	trace_event(&adc_trace, TRACE_SCAN_START, samples_per_echo);
+	scan_prof_mark(&adc_prof, SCAN_PROF_WAIT);
+
+	if (!capture_arena_reserve(&adc_arena, (samples_per_echo + 1) >> 1, 0)) {
+		return;
+	}
 
 	// read the current ctrl_out
-	ctrl_out = alt_read_word(h2p_ctrl_out_addr);
+	ctrl_out = reg_shadow_read(&fpga_shadow, h2p_ctrl_out_addr);
 
 	// local variables
 	uint32_t fifo_mem_level; // the fill level of fifo memory
@@ -1218,13 +2189,22 @@ void noise(double cpmg_freq, long unsigned scan_spacing_us,
 		init_delay_inherent = (double) fixed_init_adc_delay + 0.25; // look at ERRATA from the HDL to get 0.25
 	}
 
-	alt_write_word((h2p_pulse1_addr), 0);
-	alt_write_word((h2p_delay1_addr), 0);
-	alt_write_word((h2p_pulse2_addr), 0);
-	alt_write_word((h2p_delay2_addr), delay2_int);
-	alt_write_word((h2p_init_adc_delay_addr), fixed_init_adc_delay);
-	alt_write_word((h2p_echo_per_scan_addr), fixed_echo_per_scan);
-	alt_write_word((h2p_adc_samples_per_echo_addr), samples_per_echo);
+	reg_shadow_write(&fpga_shadow, h2p_pulse1_addr, 0);
+	reg_shadow_write(&fpga_shadow, h2p_delay1_addr, 0);
+	reg_shadow_write(&fpga_shadow, h2p_pulse2_addr, 0);
+	reg_shadow_write(&fpga_shadow, h2p_delay2_addr, delay2_int);
+	reg_shadow_write(&fpga_shadow, h2p_init_adc_delay_addr, fixed_init_adc_delay);
+	reg_shadow_write(&fpga_shadow, h2p_echo_per_scan_addr, fixed_echo_per_scan);
+	reg_shadow_write(&fpga_shadow, h2p_adc_samples_per_echo_addr, samples_per_echo);
+
+	scan_file_init_header(&scan_hdr, cpmg_freq, adc_ltc1746_freq,
+			nmr_fsm_clkfreq);
+	scan_hdr.pulse2_cnt = 0;
+	scan_hdr.delay2_cnt = delay2_int;
+	scan_hdr.init_adc_delay_cnt = fixed_init_adc_delay;
+	scan_hdr.samples_per_echo = samples_per_echo;
+	scan_hdr.echoes_per_scan = fixed_echo_per_scan;
+	scan_file_stamp(&scan_hdr);
 
 	if (enable_message) {
 		printf("CPMG Sequence Actual Parameter:\n");
@@ -1241,15 +2221,19 @@ void noise(double cpmg_freq, long unsigned scan_spacing_us,
 				"\tWARNING: Computed ADC_init_delay is less than 2, ADC_init_delay is force driven to 2 inside the HDL!");
 	}
 
+	scan_prof_mark(&adc_prof, SCAN_PROF_SETUP);
+
 	// set pll for CPMG system
-	Set_PLL(h2p_nmr_sys_pll_addr, 0, nmr_fsm_clkfreq, 0.5, DISABLE_MESSAGE); // set pll frequency
-	Reset_PLL(h2p_ctrl_out_addr, PLL_NMR_SYS_RST_ofst, ctrl_out); // reset pll, changes the phase
+	if (!set_nmr_sys_pll(nmr_fsm_clkfreq)) { // set pll frequency, reset pll (changes the phase) and wait for pll to lock
+		printf("[ERROR] the nmr system pll is not locked, the scan is not run\n");
+		return;
+	}
 	Set_DPS(h2p_nmr_sys_pll_addr, 0, 0, DISABLE_MESSAGE); // set pll phase to 0 (might not be needed)
-	Wait_PLL_To_Lock(h2p_ctrl_in_addr, PLL_NMR_SYS_lock_ofst); // wait for pll to lock
+	scan_prof_mark(&adc_prof, SCAN_PROF_PLL);
 
 	// set a fix phase cycle state
 	ctrl_out &= ~(0x01 << PHASE_CYCLING_ofst);
-	alt_write_word((h2p_ctrl_out_addr), ctrl_out);
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out);
 	usleep(10);
 
 	// reset the selected ADC (the ADC reset was omitted)
@@ -1260,10 +2244,10 @@ void noise(double cpmg_freq, long unsigned scan_spacing_us,
 
 	// reset ADC buffer
 	ctrl_out |= (0x01 << ADC_FIFO_RST_ofst);
-	alt_write_word((h2p_ctrl_out_addr), ctrl_out);
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out);
 	usleep(10);
 	ctrl_out &= ~(0x01 << ADC_FIFO_RST_ofst);
-	alt_write_word((h2p_ctrl_out_addr), ctrl_out);
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out);
 	usleep(10);
 
 	// start fsm
@@ -1271,10 +2255,12 @@ void noise(double cpmg_freq, long unsigned scan_spacing_us,
 	// the pll_rst_dly should be longer than the delay coming from changing the phase
 	// otherwise, the fsm will start with wrong relationship between 4 pll output clocks (1/2 pi difference between clock)
 	// alt_write_word( (h2p_nmr_pll_rst_dly_addr) , 1000000 );	// set the amount of delay for pll reset (with 50MHz system clock, every tick means 20ns) -> default: 100000
-	ctrl_out = alt_read_word(h2p_ctrl_out_addr);
-	alt_write_word((h2p_ctrl_out_addr), ctrl_out | (0x01 << FSM_START_ofst));
+	ctrl_out = reg_shadow_read(&fpga_shadow, h2p_ctrl_out_addr);
+	scan_prof_mark(&adc_prof, SCAN_PROF_SETUP);
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out | (0x01 << FSM_START_ofst));
 	usleep(10);
-	alt_write_word((h2p_ctrl_out_addr), ctrl_out & ~(0x01 << FSM_START_ofst));
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out & ~(0x01 << FSM_START_ofst));
+	trace_event(&adc_trace, TRACE_FSM_START, 0);
 	// shift the pll phase accordingly
 	// Set_DPS (h2p_nmr_pll_addr, 0, 0, DISABLE_MESSAGE);
 	// Set_DPS (h2p_nmr_pll_addr, 1, 90, DISABLE_MESSAGE);
@@ -1282,42 +2268,53 @@ void noise(double cpmg_freq, long unsigned scan_spacing_us,
 	// Set_DPS (h2p_nmr_pll_addr, 3, 270, DISABLE_MESSAGE);
 	// usleep(scan_spacing_us);
 
-	if (read_with_dma) { // if read with dma is intended
-		//datawrite_with_dma(samples_per_echo/2,enable_message); // divided by 2 to compensate 2 symbol per beat in the fifo interface
+	if (adc_read_mode == READ_DMA) { // if read with dma is intended
+		if (!datawrite_with_dma(samples_per_echo / 2, samples_per_echo, NULL,
+				enable_message)) { // divided by 2 to compensate 2 symbol per beat in the fifo interface
+			printf("[ERROR] DMA transfer failed: %s is not written\n", filename); // the SDRAM still holds an older scan
+			return;
+		}
+		trace_event(&adc_trace, TRACE_DRAIN_DONE, samples_per_echo / 2);
+		scan_prof_mark(&adc_prof, SCAN_PROF_DRAIN); // the sequence and the transfer
 	} else { // if read from fifo is intended
 			 // wait until fsm stops
-		while (alt_read_word(h2p_ctrl_in_addr) & (0x01 << NMR_SEQ_run_ofst))
-			;
+		wait_nmr_seq(0, 0, 0, delay2_int, fixed_echo_per_scan,
+				nmr_fsm_clkfreq);
 		usleep(300);
+		scan_prof_mark(&adc_prof, SCAN_PROF_SEQUENCE);
 
 		// PRINT # of DATAS in FIFO
 		// fifo_mem_level = alt_read_word(h2p_adc_fifo_status_addr+ALTERA_AVALON_FIFO_LEVEL_REG); // the fill level of FIFO memory
 		// printf("num of data in fifo: %d\n",fifo_mem_level);
 
 		// READING DATA FROM FIFO
-		fifo_mem_level = alt_read_word(
+		fifo_mem_level = bus_read_word(
 				h2p_adc_fifo_status_addr + ALTERA_AVALON_FIFO_LEVEL_REG); // the fill level of FIFO memory
+		trace_event(&adc_trace, TRACE_FIFO_LEVEL, fifo_mem_level);
 		for (i = 0; fifo_mem_level > 0; i++) { // FIFO is 32-bit, while 1-sample is only 16-bit. FIFO organize this automatically. So, fetch only amount_of_data shifted by 2 to get amount_of_data/2.
-			rddata[i] = alt_read_word(h2p_adc_fifo_addr);
+			capture_arena_put(&adc_arena, i, bus_read_word(h2p_adc_fifo_addr));
 
 			fifo_mem_level--;
 			if (fifo_mem_level == 0) {
-				fifo_mem_level = alt_read_word(
+				fifo_mem_level = bus_read_word(
 						h2p_adc_fifo_status_addr
 								+ ALTERA_AVALON_FIFO_LEVEL_REG);
 			}
 			//usleep(1);
 		}
 		usleep(100);
+		trace_event(&adc_trace, TRACE_DRAIN_DONE, i);
+		scan_prof_mark(&adc_prof, SCAN_PROF_DRAIN);
 
 		if (i * 2 == samples_per_echo) { // if the amount of data captured matched with the amount of data being ordered, then continue the process. if not, then don't process the datas (requesting empty data from the fifo will cause the FPGA to crash, so this one is to avoid that)
 			// printf("number of captured data vs requested data : MATCHED\n");
 
 			j = 0;
 			for (i = 0; i < (((long) samples_per_echo) >> 1); i++) {
-				rddata_16[j++] = (rddata[i] & 0x3FFF);	// 14 significant bit
-				rddata_16[j++] = ((rddata[i] >> 16) & 0x3FFF);// 14 significant bit
+				adc_arena.samples[j++] = (adc_arena.words[i] & 0x3FFF);	// 14 significant bit
+				adc_arena.samples[j++] = ((adc_arena.words[i] >> 16) & 0x3FFF);// 14 significant bit
 			}
+			scan_prof_mark(&adc_prof, SCAN_PROF_PROCESS);
 
 		} else { // if the amount of data captured didn't match the amount of data being ordered, then something's going on with the acquisition
 			printf(
@@ -1327,15 +2324,11 @@ void noise(double cpmg_freq, long unsigned scan_spacing_us,
 	}
 
 	// write the raw data from adc to a file
-	sprintf(pathname, "%s/%s", foldername, filename); // put the data into the data folder
-	fptr = fopen(pathname, "w");
-	if (fptr == NULL) {
-		printf("File does not exists \n");
-	}
-	for (i = 0; i < (((long) samples_per_echo)); i++) {
-		fprintf(fptr, "%d\n", rddata_16[i]);
-	}
-	fclose (fptr);
+	trace_event(&adc_trace, TRACE_WRITE_BEGIN, 0);
+	write_raw_data(&scan_hdr, filename, samples_per_echo,
+			adc_read_mode == READ_DMA ? NULL : adc_arena.words);
+	trace_event(&adc_trace, TRACE_WRITE_END, 0);
+	scan_prof_mark(&adc_prof, SCAN_PROF_WRITE);
 
 }
 
@@ -1358,7 +2351,7 @@ void noise_iterate(double cpmg_freq, long unsigned scan_spacing_us,
 			* (nmr_fsm_clkfreq / adc_ltc1746_freq) * 10); // the number of delay after 180 deg pulse. It is simply samples_per_echo multiplied by (nmr_fsm_clkfreq/adc_ltc1746_freq) factor, as the delay2_int is counted by nmr_fsm_clkfreq, not by adc_ltc1746_freq. It is also multiplied by a constant 2 as safety factor to make sure the ADC acquisition is inside FSMSTAT (refer to HDL) 'on' window.
 
 	// read the current ctrl_out
-	ctrl_out = alt_read_word(h2p_ctrl_out_addr);
+	ctrl_out = reg_shadow_read(&fpga_shadow, h2p_ctrl_out_addr);
 
 	create_measurement_folder("noise");
 	// printf("Approximated measurement time : %.2f mins\n",( scan_spacing_us*(double)number_of_iteration)*1e-6/60);
@@ -1442,11 +2435,116 @@ void noise_meas(unsigned int signal_path, unsigned int num_of_samples) {
 	noise_sampling(signal_path, num_of_samples, noisename);
 }
 
+// the control lines (ctrl_i2c, port 0 the low byte) are on the expander of the internal i2c core, the relays of the
+// matching network on the expander of the external one (cshunt on port 0, cseries on port 1). Writes go out at once,
+// unless a batch is open: i2c_batch_begin(&ctrl_i2c_batch) ... i2c_batch_end(&ctrl_i2c_batch) sends them in one burst
+static int i2c_tca9555_write16(void *core, uint8_t reg_port0, uint16_t val) {
+	uint8_t data[2] = { val & 0xFF, val >> 8 };
+
+	if (!i2c_batch_write(&ctrl_i2c_batch, core, TCA9555_ADDR, reg_port0, data, 2)) {
+		if (!i2c_batch_commit(&ctrl_i2c_batch)
+				|| !i2c_batch_write(&ctrl_i2c_batch, core, TCA9555_ADDR, reg_port0, data, 2)) {
+			return 0;
+		}
+	}
+	return ctrl_i2c_batch.open > 0 ? 1 : i2c_batch_commit(&ctrl_i2c_batch);
+}
+
+// the i2c cores and both expanders: the outputs at ctrl_i2c and the relays open, then all the pins driven. For the
+// C-only use, the python scripts set up the expanders otherwise
+int init_i2c_expanders() {
+	int ok;
+
+	i2c_core_init((void *) h2p_i2c_ext_addr, I2C_EXT_FREQ, I2C_BUS_HZ);
+	i2c_core_init((void *) h2p_i2c_int_addr, I2C_INT_FREQ, I2C_BUS_HZ);
+	i2c_batch_begin(&ctrl_i2c_batch);
+	i2c_tca9555_write16((void *) h2p_i2c_int_addr, CNT_REG_OUT_PORT0, ctrl_i2c);
+	i2c_tca9555_write16((void *) h2p_i2c_ext_addr, CNT_REG_OUT_PORT0, 0);
+	i2c_tca9555_write16((void *) h2p_i2c_int_addr, CNT_REG_CONF_PORT0, 0);
+	i2c_tca9555_write16((void *) h2p_i2c_ext_addr, CNT_REG_CONF_PORT0, 0);
+	ok = i2c_batch_end(&ctrl_i2c_batch);
+	if (!ok) {
+		printf("ERROR: the i2c expanders do not answer\n");
+	}
+	return ok;
+}
+
+// set (en = ENABLE) or clear the control lines of addr_msk
+int write_i2c_cnt(uint32_t en, uint32_t addr_msk, uint32_t en_mesg) {
+	int ok;
+
+	if (en) {
+		ctrl_i2c |= addr_msk;
+	} else {
+		ctrl_i2c &= ~addr_msk;
+	}
+	ok = i2c_tca9555_write16((void *) h2p_i2c_int_addr, CNT_REG_OUT_PORT0, ctrl_i2c);
+	if (en_mesg) {
+		printf("i2c control lines: 0x%04x%s\n", ctrl_i2c, ok ? "" : " (NOT WRITTEN)");
+	}
+	return ok;
+}
+
+int write_i2c_relay_cnt(uint8_t cshunt, uint8_t cseries, uint32_t en_mesg) {
+	int ok = i2c_tca9555_write16((void *) h2p_i2c_ext_addr, CNT_REG_OUT_PORT0, cshunt | (cseries << 8));
+
+	if (en_mesg) {
+		printf("relays: cshunt %u, cseries %u%s\n", cshunt, cseries, ok ? "" : " (NOT WRITTEN)");
+	}
+	return ok;
+}
+
+// shift the staged DAC frames with LDAC held high and release it: the staged channels change on the same edge, and
+// settle once
+static int dac_commit() {
+	int ok;
+
+	ctrl_out = reg_shadow_read(&fpga_shadow, h2p_ctrl_out_addr);
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out | DAC_LDAC_en);
+	ok = dac_update_shift(&preamp_dac);
+	ctrl_out &= ~DAC_LDAC_en;
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out);
+	usleep(DAC_SETTLE_US);
+	return ok;
+}
+
+// power up both channels and the reference, the +-DAC_FULL_SCALE range, both outputs at 0 V
+int init_dac_ad5722r() {
+	bus_write_word(h2p_dac_addr + SPI_SLAVESELECT_offst, 1);
+	dac_update_stage_frame(&preamp_dac, WR_DAC | PWR_CNT_REG | DAC_A_PU | DAC_B_PU | REF_PU);
+	dac_update_stage_frame(&preamp_dac, WR_DAC | OUT_RANGE_SEL_REG | DAC_AB | PN50);
+	dac_update_stage(&preamp_dac, DAC_AB, 0);
+	return dac_commit();
+}
+
+int write_vbias(double vbias) {
+	dac_update_stage(&preamp_dac, DAC_VBIAS_CH, vbias);
+	return dac_commit();
+}
+
+int write_vvarac(double vvarac) {
+	dac_update_stage(&preamp_dac, DAC_VVARAC_CH, vvarac);
+	return dac_commit();
+}
+
+// both in one update
+int write_vbias_vvarac(double vbias, double vvarac) {
+	dac_update_stage(&preamp_dac, DAC_VBIAS_CH, vbias);
+	dac_update_stage(&preamp_dac, DAC_VVARAC_CH, vvarac);
+	return dac_commit();
+}
+
+// the set function of the tuner on the board: the relays and the varactor voltage
+void s11_set_network(void *ctx, const double *x) {
+	write_i2c_relay_cnt((uint8_t) x[S11_TUNER_CSHUNT], (uint8_t) x[S11_TUNER_CSERIES], DISABLE_MESSAGE);
+	write_vvarac(x[S11_TUNER_VVARAC]);
+}
+
 void init_default_system_param() {
 
 	// initialize control lines to default value
 	ctrl_out = CNT_OUT_default;
-	alt_write_word(h2p_ctrl_out_addr, ctrl_out);
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out);
 	usleep(100);
 
 	// initialize i2c default
@@ -1494,30 +2592,267 @@ void init_default_system_param() {
 	// the TOKEN is not resetted to 0, which will prevent the state machine from running. It is fixed by having reset button implemented to reset the TOKEN to 0 just
 	// before any acquisition.
 	ctrl_out |= NMR_CNT_RESET;
-	alt_write_word(h2p_ctrl_out_addr, ctrl_out);	// write down the control
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out);	// write down the control
 	usleep(10);
 	ctrl_out &= ~(NMR_CNT_RESET);
-	alt_write_word(h2p_ctrl_out_addr, ctrl_out);	// write down the control
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out);	// write down the control
 
 	// usleep(500000); // this delay is extremely necessary! or data will be bad in first cpmg scan. also used to wait for vvarac and vbias to settle down
 
 }
 
-void close_system() {
+// the result of a measurement command: the data folder and the time spent
+static int daemon_result(nmrd_buf *reply, const struct timespec *t0) {
+	struct timespec t1;
+	nmrd_result *res = (nmrd_result *) nmrd_buf_append(reply,
+			sizeof(nmrd_result));
 
+	if (res == NULL) {
+		return NMRD_ERR_IO;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	memset(res, 0, sizeof(nmrd_result));
+	strncpy(res->folder, foldername, sizeof(res->folder) - 1);
+	res->run_ns = (uint64_t) (t1.tv_sec - t0->tv_sec) * 1000000000
+			+ t1.tv_nsec - t0->tv_nsec;
+	return NMRD_OK;
+}
+
+// runs the requests of the acquisition daemon (nmr_daemon.h), with the peripherals mapped and the system initialized
+int daemon_handler(uint16_t cmd, const void *req, uint32_t req_len,
+		nmrd_buf *reply) {
+	const nmrd_param *par = (const nmrd_param *) req;
+	const nmrd_cpmg *cpmg = (const nmrd_cpmg *) req;
+	const nmrd_cpmg_manual *man = (const nmrd_cpmg_manual *) req;
+	const nmrd_fid *fid = (const nmrd_fid *) req;
+	const nmrd_noise *noise = (const nmrd_noise *) req;
+	const nmrd_tx_sampling *tx = (const nmrd_tx_sampling *) req;
+	struct timespec t0;
+	char name[NMRD_READ_NAME_MAX + 1];
+	char path[PATH_MAX];
+	unsigned long num_of_samples;
+	long size;
+	void *data;
+	int captured;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	switch (cmd) {
+	case NMRD_CMD_SET_PARAM:
+		if (req_len != sizeof(nmrd_param)) {
+			return NMRD_ERR_PROTO;
+		}
+		switch (par->id) {
+		case NMRD_PAR_READ_MODE:
+			if (par->value[0] < READ_FIFO_AFTER_SEQ || par->value[0] > READ_DMA) {
+				return NMRD_ERR_PARAM;
+			}
+			if (par->value[0] == READ_DMA && h2p_dma_addr == NULL) {
+				return NMRD_ERR_HW;
+			}
+			adc_read_mode = (uint8_t) par->value[0];
+			return NMRD_OK;
+		case NMRD_PAR_FILE_FORMAT:
+			if (par->value[0] != DATA_FILE_TEXT && par->value[0] != DATA_FILE_BIN) {
+				return NMRD_ERR_PARAM;
+			}
+			data_file_format = (uint8_t) par->value[0];
+			return NMRD_OK;
+		case NMRD_PAR_SCAN_WRITER:
+			scan_writer_en = par->value[0] != 0;
+			return NMRD_OK;
+		case NMRD_PAR_ACCUM:
+			if (par->value[1] < 0) {
+				return NMRD_ERR_PARAM;
+			}
+			accum_en = par->value[0] != 0;
+			accum_checkpoint = (unsigned int) par->value[1];
+			return NMRD_OK;
+		case NMRD_PAR_ADC_DSP:
+			if (par->value[0] < ADC_DSP_RAW || par->value[0] > ADC_DSP_INTEG
+					|| par->value[1] < 1 || par->value[2] < 1) {
+				return NMRD_ERR_PARAM;
+			}
+			adc_dsp = (uint8_t) par->value[0];
+			ddc_default_config(&adc_ddc_cfg, (unsigned int) par->value[1],
+					(unsigned int) par->value[2]);
+			return NMRD_OK;
+		case NMRD_PAR_ECHO_INTEG:
+			if (par->value[0] < ECHO_INTEG_BOX || par->value[0] > ECHO_INTEG_GAUSS
+					|| par->value[1] < 0) {
+				return NMRD_ERR_PARAM;
+			}
+			adc_integ_cfg.window = (unsigned int) par->value[0];
+			adc_integ_cfg.width = (unsigned int) par->value[1];
+			adc_integ_cfg.centre_shift = par->value[2];
+			return NMRD_OK;
+		case NMRD_PAR_SCAN_PERIOD:
+			if (par->value[0] < 0 || par->value[0] > UINT32_MAX) {
+				return NMRD_ERR_PARAM;
+			}
+			scan_period_us = (uint32_t) par->value[0];
+			return NMRD_OK;
+		case NMRD_PAR_RT_PROFILE:
+			if (par->value[0] < 0 || par->value[0] > 99 || par->value[1] < 0
+					|| par->value[2] < 0) {
+				return NMRD_ERR_PARAM;
+			}
+			adc_rt.priority = (int) par->value[0];
+			adc_rt.acq_cpu = (int) par->value[1];
+			adc_rt.housekeeping_cpu = (int) par->value[2];
+			return NMRD_OK;
+		default:
+			return NMRD_ERR_PARAM;
+		}
+
+	case NMRD_CMD_INIT:
+		if (req_len != 0) {
+			return NMRD_ERR_PROTO;
+		}
+		init_default_system_param();
+		return NMRD_OK;
+
+	case NMRD_CMD_CPMG:
+		if (req_len != sizeof(nmrd_cpmg)) {
+			return NMRD_ERR_PROTO;
+		}
+		if (cpmg->cpmg_freq <= 0 || cpmg->samples_per_echo == 0
+				|| cpmg->echoes_per_scan == 0 || cpmg->number_of_iteration == 0) {
+			return NMRD_ERR_PARAM;
+		}
+		// write t1-IR measurement parameters (put both to 0 if IR is not desired)
+		write_t1_param(cpmg->pulse180_t1_int, cpmg->delay180_t1_int);
+		CPMG_iterate(cpmg->cpmg_freq, cpmg->pulse1_us, cpmg->pulse2_us,
+				cpmg->pulse1_dtcl, cpmg->pulse2_dtcl, cpmg->echo_spacing_us,
+				cpmg->scan_spacing_us, cpmg->samples_per_echo,
+				cpmg->echoes_per_scan, cpmg->init_adc_delay_compensation,
+				cpmg->number_of_iteration, cpmg->ph_cycl_en);
+		return daemon_result(reply, &t0);
+
+	case NMRD_CMD_CPMG_MANUAL:
+		if (req_len != sizeof(nmrd_cpmg_manual)) {
+			return NMRD_ERR_PROTO;
+		}
+		num_of_samples = (unsigned long) man->samples_per_echo * man->echoes_per_scan;
+		if (man->cpmg_freq <= 0 || num_of_samples == 0
+				|| num_of_samples * sizeof(uint16_t) > NMRD_MAX_PAYLOAD) {
+			return NMRD_ERR_PARAM;
+		}
+		write_t1_param(man->pulse180_t1_int, man->delay180_t1_int);
+
+		// enable EN_PA and wait, as the CPMG Manual main
+		ctrl_out |= EN_PA;
+		reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out);
+		usleep(man->en_pa_delay);
+		captured = CPMG_Manual(man->cpmg_freq, man->pulse1_us, man->pulse2_us,
+				man->pulse1_dtcl, man->pulse2_dtcl, man->delay1_us,
+				man->delay2_us, man->scan_spacing_us, man->samples_per_echo,
+				man->echoes_per_scan, man->init_adc_delay_compensation,
+				man->ph_cycl_en, DISABLE_MESSAGE);
+		ctrl_out &= ~(EN_PA);
+		reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out);
+
+		if (!captured) {
+			return NMRD_ERR_ACQ;
+		}
+		data = nmrd_buf_append(reply, num_of_samples * sizeof(uint16_t));
+		if (data == NULL) {
+			return NMRD_ERR_IO;
+		}
+		memcpy(data, adc_arena.samples, num_of_samples * sizeof(uint16_t));
+		return NMRD_OK;
+
+	case NMRD_CMD_FID:
+		if (req_len != sizeof(nmrd_fid)) {
+			return NMRD_ERR_PROTO;
+		}
+		if (fid->cpmg_freq <= 0 || fid->samples_per_echo == 0
+				|| fid->number_of_iteration == 0) {
+			return NMRD_ERR_PARAM;
+		}
+		FID_iterate(fid->cpmg_freq, fid->pulse2_us, fid->pulse2_dtcl,
+				fid->scan_spacing_us, fid->samples_per_echo,
+				fid->number_of_iteration, DISABLE_MESSAGE);
+		return daemon_result(reply, &t0);
+
+	case NMRD_CMD_NOISE:
+		if (req_len != sizeof(nmrd_noise)) {
+			return NMRD_ERR_PROTO;
+		}
+		if (noise->samp_freq <= 0 || noise->samples_per_echo == 0
+				|| noise->number_of_iteration == 0) {
+			return NMRD_ERR_PARAM;
+		}
+		// the building block that's used is still nmr cpmg, so the sampling frequency is fixed to 4*cpmg_frequency
+		noise_iterate(noise->samp_freq / 4, noise->scan_spacing_us,
+				noise->samples_per_echo, noise->number_of_iteration,
+				DISABLE_MESSAGE);
+		return daemon_result(reply, &t0);
+
+	case NMRD_CMD_TX_SAMPLING:
+		if (req_len != sizeof(nmrd_tx_sampling)) {
+			return NMRD_ERR_PROTO;
+		}
+		if (h2p_analyzer_pll_addr == NULL) {
+			return NMRD_ERR_HW;
+		}
+		if (tx->tx_freq <= 0 || tx->samp_freq <= 0 || tx->num_of_samples == 0) {
+			return NMRD_ERR_PARAM;
+		}
+		create_measurement_folder("tx_sampling");
+		if (!tx_sampling(tx->tx_freq, tx->samp_freq, tx->num_of_samples, "dat")) {
+			return NMRD_ERR_ACQ;
+		}
+		return daemon_result(reply, &t0);
+
+	case NMRD_CMD_READ_FILE:
+		// only the files of the last measurement folder
+		if (req_len == 0 || req_len > NMRD_READ_NAME_MAX) {
+			return NMRD_ERR_PROTO;
+		}
+		memcpy(name, req, req_len);
+		name[req_len] = '\0';
+		if (strlen(name) != req_len || strchr(name, '/') != NULL
+				|| strcmp(name, ".") == 0 || strstr(name, "..") != NULL
+				|| foldername[0] == '\0') {
+			return NMRD_ERR_PARAM;
+		}
+		if (snprintf(path, sizeof(path), "%s/%s", foldername, name) >= (int) sizeof(path)) {
+			return NMRD_ERR_PARAM;
+		}
+		fptr = fopen(path, "rb");
+		if (fptr == NULL) {
+			return NMRD_ERR_IO;
+		}
+		if (fseek(fptr, 0, SEEK_END) != 0 || (size = ftell(fptr)) < 0
+				|| fseek(fptr, 0, SEEK_SET) != 0
+				|| (data = nmrd_buf_append(reply, (uint32_t) size)) == NULL
+				|| fread(data, 1, size, fptr) != (size_t) size) {
+			fclose(fptr);
+			return NMRD_ERR_IO;
+		}
+		fclose(fptr);
+		return NMRD_OK;
+
+	default:
+		return NMRD_ERR_CMD;
+	}
 }
 
-// MAIN SYSTEM (ENABLE ONE AT A TIME)
+// release the acquisition buffers, before close_fpga_backend
+void close_system() {
+	capture_arena_free(&adc_arena);
+	fifo_ring_free(&adc_ring);
+}
+
+// MAIN SYSTEM (ENABLE ONE AT A TIME). The checks that run without the FPGA are the programs in tests/
 
 /* Init default system param (rename the output to "init")
  int main() {
  // printf("Init system\n");
 
- open_physical_memory_device();
- mmap_peripherals();
+ open_fpga_backend();
  init_default_system_param();
- munmap_peripherals();
- close_physical_memory_device();
+ close_fpga_backend();
  return 0;
  }
  */
@@ -1542,14 +2877,50 @@ void close_system() {
  uint32_t ph_cycl_en = atoi(argv[12]);
  unsigned int pulse180_t1_int = atoi(argv[13]);
  unsigned int delay180_t1_int = atoi(argv[14]);
+ if (argc > 15) {
+ adc_read_mode = atoi(argv[15]); // optional: 0 reads the fifo after the sequence, 1 streams the fifo during the sequence, 2 uses the DMA
+ }
+ if (argc > 16) {
+ data_file_format = atoi(argv[16]); // optional: 0 writes text files, 1 writes binary scan files (convert them with scan2txt)
+ }
+ if (argc > 17) {
+ scan_writer_en = atoi(argv[17]); // optional: 1 writes the files from a background thread while the next scan runs (fifo readouts only)
+ }
+ if (argc > 18) {
+ accum_en = atoi(argv[18]); // optional: 1 only writes the phase cycle corrected sum of all scans (dat_sum, avg_sum)
+ }
+ if (argc > 19) {
+ accum_checkpoint = atoi(argv[19]); // optional: with accumulation, also write the sums every n scans (dat_sum_NNN)
+ }
+ if (argc > 20) {
+ adc_dsp = atoi(argv[20]); // optional: 1 writes the downconverted I/Q instead of the samples, 2 only one I/Q amplitude per echo
+ }
+ ddc_default_config(&adc_ddc_cfg, argc > 21 ? atoi(argv[21]) : 4, argc > 22 ? atoi(argv[22]) : 2); // optional with adc_dsp 1: the CIC and the FIR decimation
+ if (adc_dsp == ADC_DSP_INTEG) {
+ adc_integ_cfg.window = argc > 21 ? atoi(argv[21]) : ECHO_INTEG_BOX; // optional with adc_dsp 2: 0 box, 1 hann, 2 gauss
+ adc_integ_cfg.width = argc > 22 ? atoi(argv[22]) : 0; // optional with adc_dsp 2: the window width in samples (0: the whole echo)
+ adc_integ_cfg.centre_shift = argc > 23 ? atof(argv[23]) : 0; // optional with adc_dsp 2: moves the window, in samples
+ }
+ if (argc > 24) {
+ scan_period_us = atoi(argv[24]); // optional: start the scans every n us on an absolute schedule (0: wait scan_spacing_us before every scan)
+ }
+ if (argc > 25) {
+ adc_rt.priority = atoi(argv[25]); // optional: run the scans at this SCHED_FIFO priority, pinned and with the memory locked (0: off)
+ }
+ if (argc > 26) {
+ adc_rt.acq_cpu = atoi(argv[26]); // optional with the real-time profile: the core of the acquisition, the writer gets the other one
+ adc_rt.housekeeping_cpu = !adc_rt.acq_cpu;
+ }
 
- open_physical_memory_device();
- mmap_peripherals();
+ open_fpga_backend();
  init_default_system_param();
+ if (adc_read_mode == READ_DMA && h2p_dma_addr == NULL) {
+ printf("DMA is not included in the FPGA design, the fifo is read after the sequence\n");
+ adc_read_mode = READ_FIFO_AFTER_SEQ;
+ }
 
  // write t1-IR measurement parameters (put both to 0 if IR is not desired)
- alt_write_word( h2p_t1_pulse , pulse180_t1_int );
- alt_write_word( h2p_t1_delay , delay180_t1_int );
+ write_t1_param(pulse180_t1_int, delay180_t1_int);
 
  // printf("cpmg_freq = %0.3f\n",cpmg_freq);
  CPMG_iterate (
@@ -1567,13 +2938,89 @@ void close_system() {
  ph_cycl_en
  );
 
- // close_system();
- munmap_peripherals();
- close_physical_memory_device();
+ close_system();
+ close_fpga_backend();
  return 0;
  }
  */
 
+/* CPMG sweep (rename the output to "cpmg_sweep")
+ // every point of a list in one process and one session folder: one point per line of argv[1], as read by
+ // cpmg_sweep_load (cpmg_freq pulse1_us pulse2_us echo_spacing_us samples_per_echo echoes_per_scan [echo shift]).
+ // The points are measured ordered by frequency, the data of a point is in point_NNN (NNN: its line among the points)
+ int main(int argc, char * argv[]) {
+
+ // input parameters
+ char *points_name = argv[1];
+ long unsigned scan_spacing_us = atoi(argv[2]);
+ unsigned int number_of_iteration = atoi(argv[3]);
+ uint32_t ph_cycl_en = atoi(argv[4]);
+ if (argc > 5) {
+ adc_read_mode = atoi(argv[5]); // optional: 0 reads the fifo after the sequence, 1 streams the fifo during the sequence, 2 uses the DMA
+ }
+ if (argc > 6) {
+ data_file_format = atoi(argv[6]); // optional: 0 writes text files, 1 writes binary scan files (convert them with scan2txt)
+ }
+ if (argc > 7) {
+ scan_writer_en = atoi(argv[7]); // optional: 1 writes the files from a background thread while the next scan runs (fifo readouts only)
+ }
+
+ cpmg_sweep sweep;
+
+ if (!cpmg_sweep_init(&sweep) || cpmg_sweep_load(&sweep, points_name) <= 0) {
+ printf("no sweep points\n");
+ return 1;
+ }
+ open_fpga_backend();
+ init_default_system_param();
+ if (adc_read_mode == READ_DMA && h2p_dma_addr == NULL) {
+ printf("DMA is not included in the FPGA design, the fifo is read after the sequence\n");
+ adc_read_mode = READ_FIFO_AFTER_SEQ;
+ }
+ write_t1_param(0, 0);
+
+ CPMG_sweep(&sweep, 0.5, 0.5, scan_spacing_us, number_of_iteration, ph_cycl_en);
+
+ cpmg_sweep_free(&sweep);
+ close_system();
+ close_fpga_backend();
+ return 0;
+ }
+ */
+
+/* Tune the matching network (rename the output to "tune")
+ // tune the matching network at argv[1] MHz: from the point tuned before at that frequency in the cache file argv[2],
+ // otherwise from the network tables, and store the tuned point back. The reflection is measured through the S11 path
+ // with argv[3] samples. This FPGA design has no analyzer pll: only the simulated backend (SIM_BACKEND_ENV) can be tuned
+ int main(int argc, char * argv[]) {
+
+ // input parameters
+ double freq = atof(argv[1]);
+ char *cache_path = argc > 2 ? argv[2] : "s11_cache.txt";
+ if (argc > 3) {
+ s11_num_of_samples = atoi(argv[3]);
+ }
+
+ s11_tuner_io io = { s11_set_network, s11_measure, NULL };
+
+ open_fpga_backend();
+ init_default_system_param();
+ if (!init_i2c_expanders() || !init_dac_ad5722r()) {
+ close_fpga_backend();
+ return 1;
+ }
+ create_measurement_folder("tune");
+ int tuned = isfinite(tune_board(freq, &io, cache_path));
+ i2c_batch_print(&ctrl_i2c_batch);
+ dac_update_print(&preamp_dac);
+
+ close_system();
+ close_fpga_backend();
+ return tuned ? 0 : 1;
+ }
+ */
+
+#ifndef HPS_LINUX_NO_MAIN // the programs in tests/ include this file for everything but its main
 // CPMG Manual (rename the output to "cpmg_iterate"). data_nowrite in CPMG_Sequence should 0
 // if CPMG Sequence is used without writing to text file, rename the output to "cpmg_iterate_direct". Set this setting in CPMG_Sequence: data_nowrite = 1
 int main(int argc, char * argv[]) {
@@ -1596,17 +3043,15 @@ int main(int argc, char * argv[]) {
 	unsigned int delay180_t1_int = atoi(argv[14]);
 	unsigned int en_pa_delay = atoi(argv[15]);
 
-	open_physical_memory_device();
-	mmap_peripherals();
+	open_fpga_backend();
 	init_default_system_param();
 
 	// write t1-IR measurement parameters (put both to 0 if IR is not desired)
-	alt_write_word(h2p_t1_pulse, pulse180_t1_int);
-	alt_write_word(h2p_t1_delay, delay180_t1_int);
+	write_t1_param(pulse180_t1_int, delay180_t1_int);
 
 	// enable EN_PA and wait
 	ctrl_out |= EN_PA;
-	alt_write_word(h2p_ctrl_out_addr, ctrl_out);	// write down the control
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out);	// write down the control
 	usleep(en_pa_delay);
 
 	// printf("cpmg_freq = %0.3f\n",cpmg_freq);
@@ -1625,12 +3070,13 @@ int main(int argc, char * argv[]) {
 
 	// disable EN_PA;
 	ctrl_out &= ~(EN_PA);
-	alt_write_word(h2p_ctrl_out_addr, ctrl_out);	// write down the control
+	reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, ctrl_out);	// write down the control
 
-	munmap_peripherals();
-	close_physical_memory_device();
+	close_system();
+	close_fpga_backend();
 	return 0;
 }
+#endif
 
 /* FID Iterate (rename the output to "fid")
  int main(int argc, char * argv[]) {
@@ -1643,8 +3089,7 @@ int main(int argc, char * argv[]) {
  unsigned int samples_per_echo = atoi(argv[5]);
  unsigned int number_of_iteration = atoi(argv[6]);
 
- open_physical_memory_device();
- mmap_peripherals();
+ open_fpga_backend();
  //init_default_system_param();
 
  FID_iterate (
@@ -1657,9 +3102,8 @@ int main(int argc, char * argv[]) {
  ENABLE_MESSAGE
  );
 
- // close_system();
- munmap_peripherals();
- close_physical_memory_device();
+ close_system();
+ close_fpga_backend();
  return 0;
  }
  */
@@ -1673,8 +3117,7 @@ int main(int argc, char * argv[]) {
  unsigned int samples_per_echo = atoi(argv[3]);
  unsigned int number_of_iteration = atoi(argv[4]);
 
- open_physical_memory_device();
- mmap_peripherals();
+ open_fpga_backend();
  init_default_system_param();
 
  double cpmg_freq = samp_freq/4; // the building block that's used is still nmr cpmg, so the sampling frequency is fixed to 4*cpmg_frequency
@@ -1686,9 +3129,147 @@ int main(int argc, char * argv[]) {
  ENABLE_MESSAGE
  );
 
- // close_system();
- munmap_peripherals();
- close_physical_memory_device();
+ close_system();
+ close_fpga_backend();
  return 0;
  }
  */
+
+/* Acquisition daemon (rename the output to "nmr_daemon")
+ // maps the peripherals and initializes the system once, then runs the measurements requested on the socket (nmr_daemon.h)
+ // until NMRD_CMD_QUIT, SIGINT or SIGTERM. "nmr_daemon sim [fill_rate] [socket]" runs it on the simulated peripherals
+ int main(int argc, char * argv[]) {
+
+ // input parameters
+ int sim = argc > 1 && strcmp(argv[1], "sim") == 0; // optional: sim runs without the FPGA
+ double fill_rate = argc > 2 ? atof(argv[2]) : 100000; // optional with sim: fifo fill rate in words per second
+ const char *socket_path = argc > 3 ? argv[3] : NMRD_SOCKET_PATH; // optional: the socket
+
+ nmrd_stat stat;
+
+ if (sim) {
+ mmap_sim_peripherals(fill_rate);
+ } else {
+ open_fpga_backend();
+ }
+ init_default_system_param();
+ ddc_default_config(&adc_ddc_cfg, 4, 2);
+
+ printf("nmr daemon listening on %s\n", socket_path);
+ if (!nmrd_serve(socket_path, daemon_handler, &stat)) {
+ printf("ERROR: the daemon could not be started\n");
+ }
+ printf("clients: %lu (%lu refused), requests: %lu, errors: %lu, busy: %.3f s\n",
+ stat.clients, stat.refused, stat.requests, stat.errors, stat.busy_ns * 1e-9);
+
+ close_system();
+ close_fpga_backend();
+ return 0;
+ }
+ */
+
+/* Per-scan latency breakdown over a parameter grid (rename the output to "scan_bench")
+ // CPMG_Sequence, FID, noise and tx_sampling over a grid of samples_per_echo, echoes_per_scan and scans per point,
+ // every scan cut into the adc_prof stages. One CSV row per point and stage (SCAN_PROF_CSV_HEADER) goes to argv[2],
+ // with the mean and the percentiles of the stage in us. The CPMG scans are streamed, so the echo trains can be longer
+ // than the fifo; FID, noise and tx_sampling are read after their sequence and stay within the fifo.
+ // The test is on the profile: every scan is profiled and its stages add up to its total. Scans lost to a fifo
+ // overflow are counted and reported, they are a result of the benchmark (the drain stalled) rather than a failure.
+ // Runs on the board, or without the FPGA on the simulated backend: NMR_SIM_BACKEND=0 ./scan_bench
+ int main(int argc, char * argv[]) {
+
+ // input parameters
+ unsigned int number_of_iteration = argc > 1 ? atoi(argv[1]) : 10;
+ char *csv_name = argc > 2 ? argv[2] : "scan_bench.csv";
+
+ const char *meas_name[4] = { "CPMG_Sequence", "FID", "noise", "tx_sampling" };
+ unsigned int cpmg_samples[3] = { 20, 60, 120 }; // up to 150k fifo words per second with the 400 us echo spacing
+ unsigned int cpmg_echoes[3] = { 50, 200, 500 };
+ unsigned int single_samples[3] = { 256, 1024, 2048 }; // one echo, at most the fifo
+ unsigned int samples_per_echo, echoes_per_scan;
+ unsigned int s, e, n;
+ char point[128];
+ scan_prof_stat st;
+ uint64_t sum;
+ unsigned long fails = 0, lost = 0; // lost: CPMG scans not streamed completely
+ unsigned long k;
+ int meas, stage;
+ FILE *csv;
+
+ csv = fopen(csv_name, "w");
+ if (csv == NULL) {
+ printf("ERROR: cannot write %s\n", csv_name);
+ return 1;
+ }
+ fprintf(csv, SCAN_PROF_CSV_HEADER);
+
+ open_fpga_backend();
+ init_default_system_param();
+ scan_prof_init(&adc_prof);
+ create_measurement_folder("scan_bench");
+
+ printf("%-14s %7s %7s %5s %9s %9s %9s %9s %9s %9s %9s %9s (p50 us)\n", "measurement", "samples", "echoes",
+ "scans", "wait", "setup", "pll", "sequence", "drain", "process", "write", "total");
+ for (meas = 0; meas < 4; meas++) {
+ for (s = 0; s < 3; s++) {
+ for (e = 0; e < (meas == 0 ? 3 : 1); e++) {
+ samples_per_echo = meas == 0 ? cpmg_samples[s] : single_samples[s];
+ echoes_per_scan = meas == 0 ? cpmg_echoes[e] : 1;
+ adc_read_mode = meas == 0 ? READ_FIFO_STREAM : READ_FIFO_AFTER_SEQ;
+
+ scan_prof_reset(&adc_prof);
+ for (n = 0; n < number_of_iteration; n++) {
+ scan_prof_begin(&adc_prof);
+ switch (meas) {
+ case 0:
+ CPMG_Sequence(4.3, 5, 10, 0.5, 0.5, 400, 0, samples_per_echo, echoes_per_scan, 0, ENABLE, "dat",
+ "avg", DISABLE_MESSAGE);
+ lost += adc_stream_stat.overflow || adc_stream_stat.words * 2 != samples_per_echo * echoes_per_scan;
+ break;
+ case 1:
+ FID(4.3, 10, 0.5, 0, samples_per_echo, "dat", DISABLE_MESSAGE);
+ break;
+ case 2:
+ noise(4.3, 0, samples_per_echo, "dat", DISABLE_MESSAGE);
+ break;
+ case 3:
+ tx_sampling(4.3, 17.2, samples_per_echo, "dat");
+ break;
+ }
+ scan_prof_end(&adc_prof);
+ }
+
+ sprintf(point, "%s,%u,%u,%u", meas_name[meas], samples_per_echo, echoes_per_scan,
+ number_of_iteration);
+ scan_prof_write_csv(&adc_prof, csv, point);
+ printf("%-14s %7u %7u %5lu", meas_name[meas], samples_per_echo, echoes_per_scan, adc_prof.scans);
+ for (stage = 0; stage < SCAN_PROF_STAGES; stage++) {
+ if (stage != SCAN_PROF_OTHER) {
+ scan_prof_get_stat(&adc_prof, stage, &st);
+ printf(" %9.1f", st.p50_us);
+ }
+ }
+ printf("\n");
+
+ // every scan is profiled, and its stages add up to its total
+ fails += adc_prof.scans != number_of_iteration;
+ for (k = 0; k < adc_prof.scans; k++) {
+ sum = 0;
+ for (stage = 0; stage < SCAN_PROF_TOTAL; stage++) {
+ sum += adc_prof.ns[stage][k];
+ }
+ fails += sum != adc_prof.ns[SCAN_PROF_TOTAL][k] || adc_prof.ns[SCAN_PROF_DRAIN][k] == 0;
+ }
+ }
+ }
+ }
+ fclose(csv);
+ printf("report written to %s, %lu CPMG scans lost (fifo overflow: the drain fell behind)\n", csv_name, lost);
+ printf("scan bench : %s\n", fails == 0 ? "PASSED" : "FAILED");
+
+ scan_prof_free(&adc_prof);
+ close_system();
+ close_fpga_backend();
+ return fails != 0;
+ }
+ */
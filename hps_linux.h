@@ -6,12 +6,53 @@
 
 #include <socal/hps.h>
 #include "functions/general.h"
+#include "functions/fifo_stream.h"
+#include "functions/dma_capture.h"
+#include "functions/scan_file.h"
+#include "functions/scan_writer.h"
+#include "functions/capture_arena.h"
+#include "functions/scan_accum.h"
+#include "functions/ddc.h"
+#include "functions/echo_integ.h"
+#include "functions/fifo_emulator.h"
+#include "functions/nmr_fsm_emulator.h"
+#include "functions/nmr_daemon.h"
+#include "functions/pll_param_generator.h"
+#include "functions/pll_cache.h"
+#include "functions/pll_reconfig_emulator.h"
+#include "functions/reg_file_emulator.h"
+#include "functions/hw_wait.h"
+#include "functions/scan_sched.h"
+#include "functions/rt_profile.h"
+#include "functions/reg_shadow.h"
+#include "functions/scan_prof.h"
+#include "functions/trace_ring.h"
+#include "functions/cpmg_sweep.h"
+#include "functions/s11_tuner.h"
+#include "functions/i2c_batch.h"
+#include "functions/i2c_emulator.h"
+#include "functions/dac_update.h"
+#include "functions/spi_emulator.h"
 #include "hps_soc_system.h"
 
 #define ALT_AXI_FPGASLVS_OFST (0xC0000000) // axi_master
 #define HW_FPGA_AXI_SPAN (0x40000000) // Bridge span
 #define HW_FPGA_AXI_MASK ( HW_FPGA_AXI_SPAN - 1 )
 
+#define DMA_SDRAM_BUF_SPAN (0x02000000) // the SDRAM is split into 2 buffers of this size (in bytes): the DMA fills one while the other one is processed
+#define DMA_DRAIN_TIMEOUT_US (100000) // time given to the DMA to empty the fifo after the sequence stops
+#define NMR_SEQ_TIMEOUT_FACTOR (2) // wait_nmr_seq gives the sequence this times its programmed length
+#define NMR_SEQ_TIMEOUT_MARGIN_NS (100000000) // plus this for the pll reset delay and the scheduling
+#define SIM_ANALYZER_PLL_RECONFIG_BASE (0x1000) // the simulated backend has the analyzer pll reconfig block here, the FPGA design has none
+#define SIM_BACKEND_ENV "NMR_SIM_BACKEND" // open_fpga_backend uses the simulated backend when this environment variable is set
+#define TRACE_ENV "NMR_TRACE" // open_fpga_backend starts adc_trace when this environment variable is set, close_fpga_backend writes it to the file it names
+#define I2C_BUS_HZ (100000) // the scl of the i2c cores set up by init_i2c_expanders
+#define DAC_FULL_SCALE (5.0) // V, init_dac_ad5722r sets both channels to +-DAC_FULL_SCALE
+#define DAC_VBIAS_CH (DAC_A) // the DAC channel of vbias
+#define DAC_VVARAC_CH (DAC_B) // the DAC channel of vvarac
+#define DAC_SETTLE_US (10) // the outputs settle this long after an update
+#define ADC_FIFO_UIO_DEV "/dev/uio0" // the UIO device of the ADC fifo interrupt, used when the FPGA design has the interrupt (ADC_FIFO_MEM_IN_CSR_USE_IRQ)
+
 // |=============|==========|==============|==========|
 // | Signal Name | HPS GPIO | Register/bit | Function |
 // |=============|==========|==============|==========|
@@ -102,6 +143,8 @@ void *h2p_switches_addr = NULL;
 // DMA & SDRAM
 volatile unsigned int *h2p_dma_addr = NULL;
 volatile unsigned int *h2p_sdram_addr = NULL;
+uint32_t dma_fifo_rd_addr = ADC_FIFO_MEM_OUT_BASE; // the fifo output seen by the DMA read master
+uint32_t dma_sdram_wr_addr = 0; // the SDRAM seen by the DMA write master
 
 void open_physical_memory_device();
 void close_physical_memory_device();
@@ -109,6 +152,11 @@ void mmap_hps_peripherals();
 void munmap_hps_peripherals();
 void mmap_fpga_peripherals();
 void munmap_fpga_peripherals();
+void set_fpga_peripheral_addr();
+void mmap_sim_peripherals(double fill_rate);
+void munmap_sim_peripherals();
+void open_fpga_backend();
+void close_fpga_backend();
 void mmap_peripherals();
 void munmap_peripherals();
 void setup_hps_gpio();
@@ -119,25 +167,126 @@ void handle_fpga_leds();
 // FUNCTIONS
 void create_measurement_folder();// create a folder in the system for the measurement data
 int exit_program();										// terminate the program
+int init_i2c_expanders();
+int write_i2c_cnt(uint32_t en, uint32_t addr_msk, uint32_t en_mesg);
+int write_i2c_relay_cnt(uint8_t cshunt, uint8_t cseries, uint32_t en_mesg);
+int init_dac_ad5722r();
+int write_vbias(double vbias);
+int write_vvarac(double vvarac);
+int write_vbias_vvarac(double vbias, double vvarac);
+void s11_set_network(void *ctx, const double *x);
 void init_default_system_param();// initialize the system with tuned default parameter;										// sweep the rx gain (FOREVER LOOP)
-void fifo_to_sdram_dma_trf(uint32_t transfer_length);
-void datawrite_with_dma(uint32_t transfer_length, uint8_t en_mesg);
+int fifo_to_sdram_dma_trf(uint32_t transfer_length, uint32_t sdram_buf);
+int sdram_dma_wait(uint8_t en_mesg);
+void sdram_dma_unpack(uint32_t transfer_length, uint32_t sdram_buf,
+		unsigned int samples_per_echo, unsigned int *avr_data);
+int datawrite_with_dma(uint32_t transfer_length, unsigned int samples_per_echo,
+		unsigned int *avr_data, uint8_t en_mesg);
+void write_raw_data(scan_file_header *hdr, char * filename,
+		unsigned int num_of_samples, const uint32_t *fifo_words);
+void write_cpmg_data(scan_file_header *hdr, unsigned int samples_per_echo,
+		unsigned int echoes_per_scan, unsigned int *avr_data,
+		const uint32_t *fifo_words, char * filename, char * avgname);
 void close_system();
-void CPMG_Sequence(double cpmg_freq, double pulse1_us, double pulse2_us,
+int CPMG_Sequence(double cpmg_freq, double pulse1_us, double pulse2_us,
 		double pulse1_dtcl, double pulse2_dtcl, double echo_spacing_us,
 		long unsigned scan_spacing_us, unsigned int samples_per_echo,
 		unsigned int echoes_per_scan, double init_adc_delay_compensation,
 		uint32_t ph_cycl_en, char * filename, char * avgname,
 		uint32_t enable_message);
-void tx_sampling(double tx_freq, double sampfreq, unsigned int samples_per_echo,
+int set_nmr_sys_pll(double freq);
+void write_t1_param(uint32_t pulse180_t1_int, uint32_t delay180_t1_int);
+int wait_nmr_seq(uint32_t pulse1_cnt, uint32_t delay1_cnt, uint32_t pulse2_cnt,
+		uint32_t delay2_cnt, uint32_t echoes_per_scan, double nmr_fsm_clkfreq);
+int tx_sampling_pll(double tx_freq, double samp_freq);
+int tx_capture(double tx_freq, double samp_freq, unsigned int tx_num_of_samples,
+		char * filename);
+int tx_sampling(double tx_freq, double sampfreq, unsigned int samples_per_echo,
 		char * filename);
+double s11_reflection(double tx_freq, unsigned int tx_num_of_samples);
+double s11_measure(void *ctx, double freq);
+int s11_path_begin(double freq, uint32_t *rx_sel);
+int s11_path_end(uint32_t rx_sel);
+double tune_board(double freq, const s11_tuner_io *io, char * cache_path);
+void CPMG_stream_readout(unsigned int samples_per_echo,
+		unsigned int echoes_per_scan, char * filename, char * avgname);
+int write_ddc_data(scan_file_header *hdr, const uint16_t *samples,
+		unsigned int samples_per_echo, unsigned int echoes_per_scan,
+		char * filename, char * avgname);
+void write_integ_data(scan_file_header *hdr, const uint16_t *samples,
+		unsigned int *avr_data, unsigned int samples_per_echo,
+		unsigned int echoes_per_scan, char * filename, char * avgname);
+int write_dsp_data(scan_file_header *hdr, const uint16_t *samples,
+		unsigned int *avr_data, unsigned int samples_per_echo,
+		unsigned int echoes_per_scan, char * filename, char * avgname);
+int CPMG_measure(double cpmg_freq, double pulse1_us, double pulse2_us,
+		double pulse1_dtcl, double pulse2_dtcl, double echo_spacing_us,
+		long unsigned scan_spacing_us, unsigned int samples_per_echo,
+		unsigned int echoes_per_scan, double init_adc_delay_compensation,
+		unsigned int number_of_iteration, uint32_t ph_cycl_en);
+void CPMG_sweep(cpmg_sweep *sw, double pulse1_dtcl, double pulse2_dtcl,
+		long unsigned scan_spacing_us, unsigned int number_of_iteration,
+		uint32_t ph_cycl_en);
+int CPMG_Manual(double cpmg_freq, double pulse1_us, double pulse2_us,
+		double pulse1_dtcl, double pulse2_dtcl, double delay1_us,
+		double delay2_us, long unsigned scan_spacing_us,
+		unsigned int samples_per_echo, unsigned int echoes_per_scan,
+		double init_adc_delay_compensation, uint32_t ph_cycl_en,
+		uint32_t enable_message);
+int daemon_handler(uint16_t cmd, const void *req, uint32_t req_len,
+		nmrd_buf *reply);
+int CPMG_scan_handoff(const uint32_t *fifo_words, unsigned long num_of_words,
+		unsigned int samples_per_echo, unsigned int echoes_per_scan,
+		char * filename, char * avgname);
 
 // global variables
 FILE *fptr;
 long i;
 long j;
-unsigned int rddata[128000];
-unsigned int rddata_16[32000000];
+capture_arena adc_arena; // the packed fifo words, the samples and the echo sum of a scan, sized by the measurement
+fifo_ring adc_ring; // ring buffer for the streaming readout, grows with the echo train and is reused for every scan
+fifo_stream_stat adc_stream_stat; // statistics of the last streaming readout
+fifo_event adc_event; // how the streaming readout waits for the fifo: polling, or the fifo interrupt through UIO
+uint8_t adc_read_mode = READ_FIFO_AFTER_SEQ; // READ_FIFO_AFTER_SEQ, READ_FIFO_STREAM or READ_DMA
+dma_capture adc_dma; // the fifo to SDRAM DMA
+uint32_t dma_sdram_buf = 0; // the SDRAM buffer used by the next DMA transfer started by CPMG_Sequence
+uint8_t data_file_format = DATA_FILE_TEXT; // DATA_FILE_TEXT or DATA_FILE_BIN
+scan_file_header scan_hdr; // the parameters of the current scan, written into the binary data files
+uint8_t scan_writer_en = 0; // CPMG_iterate hands the scans to a background writer thread (fifo readouts only)
+scan_writer adc_writer; // the background writer, running while CPMG_iterate is pipelined
+uint8_t accum_en = 0; // CPMG_iterate sums the scans on-line (phase cycle aware) and only writes dat_sum/avg_sum
+unsigned int accum_checkpoint = 0; // with accum_en, also write the sums every accum_checkpoint scans (0: only at the end)
+scan_accum adc_accum; // the running sums, allocated while CPMG_iterate accumulates
+uint8_t adc_dsp = ADC_DSP_RAW; // ADC_DSP_RAW, ADC_DSP_DDC or ADC_DSP_INTEG (CPMG scans only)
+ddc_config adc_ddc_cfg; // the filter chain used with ADC_DSP_DDC, set with ddc_default_config
+ddc adc_ddc; // set up by the first scan and again when the echo length changes
+echo_integ_config adc_integ_cfg = { ECHO_INTEG_BOX, 0, 0, NULL, 0 }; // the window used with ADC_DSP_INTEG
+echo_integ adc_integ; // set up by the first scan and again when the echo length or centre changes
+double adc_echo_centre = 0; // the echo centre in the capture window of the last CPMG_Sequence, in samples
+pll_tx pll_tx_analyzer; // the transaction of the analyzer pll settings of tx_sampling (with its bus traffic)
+pll_cache nmr_pll_cache; // the nmr system pll settings loaded by this process (zeroed: nothing known)
+uint64_t nmr_t1_cnt = 0; // the T1 pulse and delay last written by write_t1_param, in nmr fsm clock cycles
+hw_wait_site wait_nmr_seq_site = HW_WAIT_SITE_INIT("nmr sequence"); // the waits for the end of the sequences
+uint32_t scan_period_us = 0; // CPMG_iterate starts the scans every scan_period_us on an absolute schedule (0: usleep(scan_spacing_us) before every scan)
+scan_sched adc_sched; // the schedule of CPMG_iterate, period_ns is 0 when the scans are not scheduled
+rt_profile adc_rt = { .priority = 0, .acq_cpu = 1, .housekeeping_cpu = 0 }; // the real-time profile of CPMG_iterate (priority 0: off), acquisition on core 1, writer on core 0
+reg_shadow fpga_shadow; // the last values written to ctrl_out and the sequence parameters, unchanged writes are not put on the bus
+trace_ring adc_trace; // the hot-path events of the acquisition (ring not allocated: off), see TRACE_ENV
+scan_prof adc_prof; // the stages of CPMG_Sequence, FID, noise and tx_sampling, only timed between scan_prof_begin and scan_prof_end
+unsigned int s11_num_of_samples = 1024; // the samples of one reflection measurement of s11_measure
+s11_tuner s11_tune; // the last tuning of tune_board, with every point measured
+i2c_batch ctrl_i2c_batch; // the writes to the expanders of both i2c cores, see write_i2c_cnt
+dac_update preamp_dac; // the frames staged for the DAC of the preamp, see write_vbias_vvarac
+uint8_t sim_backend = 0; // the peripherals are simulated (mmap_sim_peripherals), no FPGA
+fifo_emu sim_adc_fifo; // the ADC fifo of the simulated backend
+nmr_fsm_emu sim_nmr_fsm; // the sequencer control of the simulated backend
+pll_reconfig_emu sim_nmr_pll; // the nmr system pll reconfig block of the simulated backend
+pll_reconfig_emu sim_analyzer_pll; // the analyzer pll reconfig block of the simulated backend
+reg_file_emu sim_nmr_param; // the NMR parameter registers of the simulated backend, but samples_per_echo
+reg_file_emu sim_nmr_samples; // and that one, it is apart from the others
+i2c_emu sim_i2c_ext; // the external i2c core of the simulated backend, with the relay expander
+i2c_emu sim_i2c_int; // the internal i2c core of the simulated backend, with the control expander
+spi_emu sim_dac; // the DAC SPI core of the simulated backend, with the AD5722R
 char foldername[50]; // variable to store folder name of the measurement data
 char pathname[60];
 
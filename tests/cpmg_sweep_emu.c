@@ -0,0 +1,79 @@
+// CPMG sweep against the simulated backend, runs without the FPGA
+// a list with the frequencies interleaved, loaded from a file, is swept on the simulated backend: the PLL must be
+// reprogrammed once per frequency, every point must have its data and its parameters in its own folder of the one
+// session, and no point may be faster than its sequences
+
+#define HPS_LINUX_NO_MAIN
+#include "../hps_linux.c"
+
+int main(int argc, char * argv[]) {
+
+	// input parameters
+	unsigned int number_of_iteration = argc > 1 ? atoi(argv[1]) : 4;
+
+	const char *points = "# freq p1 p2 echo_spacing samples echoes\n"
+			"4.3 5 10 200 20 100\n4.1 5 10 200 20 100\n4.3 5 10 300 20 100\n"
+			"\n4.1 5 10 300 20 100 # a comment\n4.2 5 10 200 20 100\n";
+	unsigned int num_of_freq = 3;
+	cpmg_sweep sweep;
+	cpmg_sweep_point *p;
+	unsigned long fails = 0, bad;
+	unsigned int k, programmed = 0;
+	char line[100];
+	char path[200];
+	double freq;
+	FILE *f;
+
+	f = fopen("sweep_points.txt", "w");
+	fputs(points, f);
+	fclose(f);
+	cpmg_sweep_init(&sweep);
+	if (cpmg_sweep_load(&sweep, "sweep_points.txt") != 5) {
+		printf("the points file is not read correctly\n");
+		fails++;
+	}
+
+	setenv(SIM_BACKEND_ENV, "0", 1); // timed sequences
+	open_fpga_backend();
+	init_default_system_param();
+	adc_read_mode = READ_FIFO_AFTER_SEQ;
+	set_nmr_sys_pll(16 * 4.0); // none of the points
+	CPMG_sweep(&sweep, 0.5, 0.5, 0, number_of_iteration, ENABLE);
+
+	for (k = 0; k < sweep.num; k++) {
+		p = &sweep.pt[k];
+		programmed += p->pll_programmed;
+		// acqu.par and the last scan of the point
+		snprintf(path, sizeof(path), "%s/point_%03u/acqu.par", foldername, p->index);
+		freq = 0;
+		f = fopen(path, "r");
+		if (f != NULL) {
+			while (fgets(line, sizeof(line), f) != NULL) {
+				sscanf(line, "b1Freq = %lf", &freq);
+			}
+			fclose(f);
+		}
+		snprintf(path, sizeof(path), "%s/point_%03u/dat_%03u", foldername, p->index, number_of_iteration);
+		f = fopen(path, "r");
+		bad = f == NULL || fabs(freq - p->cpmg_freq) > 1e-3 || !p->done || p->run_ms < p->min_ms;
+		if (f != NULL) {
+			fclose(f);
+		}
+		printf("\tpoint %u: %.3f MHz, echo spacing %.0f us, pll %s, %.3f ms (sequences %.3f ms): %s\n", p->index,
+				p->cpmg_freq, p->echo_spacing_us, p->pll_programmed ? "reprogrammed" : "kept", p->run_ms, p->min_ms,
+				bad ? "FAILED" : "ok");
+		fails += bad;
+	}
+	fails += programmed != num_of_freq;
+	snprintf(path, sizeof(path), "%s/sweep.csv", foldername);
+	f = fopen(path, "r");
+	fails += f == NULL;
+	if (f != NULL) {
+		fclose(f);
+	}
+	printf("cpmg sweep : %s\n", fails == 0 ? "PASSED" : "FAILED");
+
+	cpmg_sweep_free(&sweep);
+	close_fpga_backend();
+	return fails != 0;
+}
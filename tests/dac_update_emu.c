@@ -0,0 +1,73 @@
+// Coalesced DAC updates against the simulated SPI core, runs without the FPGA
+// the frames the DAC receives must be exactly the 24 bit words of the AD5722R for the set up, for vbias and vvarac
+// written together (one LDAC edge, both outputs changing on it) and one at a time, and for a voltage out of range
+
+#define HPS_LINUX_NO_MAIN
+#include "../hps_linux.c"
+
+int main(int argc, char * argv[]) {
+
+	// input parameters
+	unsigned int steps = argc > 1 ? atoi(argv[1]) : 20;
+
+	const uint32_t init_frames[3] = { 0x100015, 0x0C0003, 0x040000 }; // power up A, B and the reference; +-5 V; both 0 V
+	unsigned long fails = 0, loads, frames;
+	uint64_t single_ns, both_ns;
+	struct timespec t0, t1;
+	unsigned int k;
+	int ok;
+
+	setenv(SIM_BACKEND_ENV, "0", 1);
+	open_fpga_backend();
+	init_default_system_param();
+
+	ok = init_dac_ad5722r() && sim_dac.frames == 3 && memcmp(sim_dac.log, init_frames, sizeof(init_frames)) == 0
+			&& sim_dac.range[0] == PN50 && sim_dac.range[1] == PN50 && sim_dac.slaveselect == 1;
+	printf("set up: %06x %06x %06x: %s\n", sim_dac.log[0], sim_dac.log[1], sim_dac.log[2], ok ? "ok" : "FAILED");
+	fails += !ok;
+
+	// -3.35 V: code -1372 = 0xAA4, -1.2 V: code -492 = 0xE14
+	frames = sim_dac.frames;
+	loads = sim_dac.ldac_loads;
+	ok = write_vbias_vvarac(-3.35, -1.2) && sim_dac.frames == frames + 2 && sim_dac.log[frames] == 0x00AA40
+			&& sim_dac.log[frames + 1] == 0x02E140 && sim_dac.ldac_loads == loads + 1 && sim_dac.frame_loads == 0
+			&& sim_dac.out[0] == 0xAA40 && sim_dac.out[1] == 0xE140 && sim_dac.ldac_early == 0 && sim_dac.toe == 0;
+	printf("vbias and vvarac together: %06x %06x, %lu LDAC edge: %s\n", sim_dac.log[frames], sim_dac.log[frames + 1],
+			sim_dac.ldac_loads - loads, ok ? "ok" : "FAILED");
+	fails += !ok;
+
+	// 7 V is clamped to the top code, -5 V is the bottom one
+	frames = sim_dac.frames;
+	ok = write_vvarac(7) && write_vbias(-5) && sim_dac.log[frames] == 0x027FF0 && sim_dac.log[frames + 1] == 0x008000
+			&& fabs(dac_ad5722r_volt(sim_dac.out[0], DAC_FULL_SCALE) + 5) < 1e-9
+			&& fabs(dac_ad5722r_volt(0x00AA40, DAC_FULL_SCALE) + 3.3496) < 1e-3;
+	printf("one at a time, out of range: %06x %06x: %s\n", sim_dac.log[frames], sim_dac.log[frames + 1],
+			ok ? "ok" : "FAILED");
+	fails += !ok;
+
+	// a varactor sweep with the bias following, one update per channel and both in one update
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (k = 0; k < steps; k++) {
+		write_vbias(-3.35 + 0.01 * k);
+		write_vvarac(-2 + 0.1 * k);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	single_ns = (t1.tv_sec - t0.tv_sec) * 1000000000ULL + t1.tv_nsec - t0.tv_nsec;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (k = 0; k < steps; k++) {
+		write_vbias_vvarac(-3.35 + 0.01 * k, -2 + 0.1 * k);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	both_ns = (t1.tv_sec - t0.tv_sec) * 1000000000ULL + t1.tv_nsec - t0.tv_nsec;
+	ok = both_ns < single_ns && sim_dac.ldac_early == 0 && sim_dac.toe == 0
+			&& sim_dac.out[0] == (dac_ad5722r_frame(DAC_A, -3.35 + 0.01 * (steps - 1), DAC_FULL_SCALE) & 0xFFFF)
+			&& sim_dac.out[1] == (dac_ad5722r_frame(DAC_B, -2 + 0.1 * (steps - 1), DAC_FULL_SCALE) & 0xFFFF);
+	printf("sweep of %u steps: %.3f ms one channel per update, %.3f ms both in one update (%.2fx): %s\n", steps,
+			single_ns * 1e-6, both_ns * 1e-6, (double) single_ns / both_ns, ok ? "ok" : "FAILED");
+	fails += !ok;
+	dac_update_print(&preamp_dac);
+
+	printf("dac update : %s\n", fails == 0 ? "PASSED" : "FAILED");
+	close_fpga_backend();
+	return fails != 0;
+}
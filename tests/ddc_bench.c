@@ -0,0 +1,76 @@
+// DDC accuracy and throughput benchmark, runs without the FPGA
+// a noisy tone near cpmg_freq is downconverted with the integer chain and with the double precision reference
+// (scaled by the gain of the integer chain). The error is in output LSB, the throughput is compared to the ADC rate
+
+#define HPS_LINUX_NO_MAIN
+#include "../hps_linux.c"
+
+int main(int argc, char * argv[]) {
+
+	// input parameters
+	double cpmg_freq = argc > 1 ? atof(argv[1]) : 4.3; // MHz, the ADC runs at 4 * cpmg_freq
+	double offset_freq = argc > 2 ? atof(argv[2]) : 20; // kHz, the tone is at cpmg_freq + offset_freq
+	unsigned int num_of_reps = argc > 3 ? atoi(argv[3]) : 20;
+
+	unsigned int shape[][2] = { { 64, 1000 }, { 200, 1000 }, { 1000, 200 }, { 4000, 50 } }; // samples_per_echo x echoes_per_scan
+	unsigned int decim[][2] = { { 2, 1 }, { 4, 1 }, { 4, 2 }, { 8, 2 }, { 16, 4 } }; // cic_decim x fir_decim
+	double adc_freq = 4 * cpmg_freq;
+	double amplitude = 6000;
+	unsigned int s, d, r, e;
+	unsigned long k, num_of_samples, num_of_values;
+	uint16_t *samples;
+	double *ref;
+	double gain, err, max_err, sum_sq, x;
+	struct timespec t_start, t_end;
+	double t_run, rate;
+
+	printf("ddc uses the %s path, adc at %.3f MHz, tone at %+.3f kHz\n", ddc_impl(), adc_freq, offset_freq);
+	printf("samples x echoes  cic x fir  out/echo  max err [LSB]  rms err [LSB]  scan [ms]  rate [Msample/s]  x adc rate\n");
+	for (s = 0; s < sizeof(shape) / sizeof(shape[0]); s++) {
+		num_of_samples = (unsigned long) shape[s][0] * shape[s][1];
+		samples = malloc(num_of_samples * sizeof(uint16_t));
+		ref = malloc(((unsigned long) shape[s][0] + 1) * 2 * sizeof(double));
+		srand(s);
+		for (k = 0; k < num_of_samples; k++) {
+			x = DDC_ADC_MIDSCALE + amplitude * cos(2 * M_PI * (0.25 + offset_freq * 1e-3 / adc_freq) * (k % shape[s][0]) + 0.3)
+					+ (rand() % 201 - 100);
+			samples[k] = x < 0 ? 0 : (x > ADC_SAMPLE_MASK ? ADC_SAMPLE_MASK : (uint16_t) x);
+		}
+
+		for (d = 0; d < sizeof(decim) / sizeof(decim[0]); d++) {
+			ddc_default_config(&adc_ddc_cfg, decim[d][0], decim[d][1]);
+			if (!ddc_init(&adc_ddc, &adc_ddc_cfg, shape[s][0], shape[s][1]) || adc_ddc.out_len == 0) {
+				ddc_free(&adc_ddc);
+				continue;
+			}
+			num_of_values = (unsigned long) adc_ddc.out_len * 2;
+
+			clock_gettime(CLOCK_MONOTONIC, &t_start);
+			for (r = 0; r < num_of_reps; r++) {
+				ddc_run(&adc_ddc, samples, shape[s][1], adc_ddc.iq);
+			}
+			clock_gettime(CLOCK_MONOTONIC, &t_end);
+			t_run = ((t_end.tv_sec - t_start.tv_sec) * 1e3 + (t_end.tv_nsec - t_start.tv_nsec) * 1e-6) / num_of_reps;
+			rate = num_of_samples / t_run * 1e-3; // Msample/s
+
+			gain = ddc_gain(&adc_ddc);
+			max_err = 0;
+			sum_sq = 0;
+			for (e = 0; e < shape[s][1]; e++) {
+				ddc_reference(&adc_ddc, samples + (unsigned long) e * shape[s][0], ref);
+				for (k = 0; k < num_of_values; k++) {
+					err = fabs(adc_ddc.iq[e * num_of_values + k] - ref[k] * gain);
+					max_err = err > max_err ? err : max_err;
+					sum_sq += err * err;
+				}
+			}
+			printf("%6u x %5u   %3u x %u   %8u  %13.3f  %13.3f  %9.3f  %16.1f  %10.1f\n", shape[s][0], shape[s][1],
+					decim[d][0], decim[d][1], adc_ddc.out_len, max_err, sqrt(sum_sq / (num_of_values * shape[s][1])),
+					t_run, rate, rate / adc_freq);
+			ddc_free(&adc_ddc);
+		}
+		free(samples);
+		free(ref);
+	}
+	return 0;
+}
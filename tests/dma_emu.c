@@ -0,0 +1,106 @@
+// DMA capture against the emulated fifo and DMA, runs without the FPGA
+// compares the serial readout (DMA, wait, write) with the double buffered one of CPMG_iterate (write the previous scan while the DMA runs)
+
+#define HPS_LINUX_NO_MAIN
+#include "../hps_linux.c"
+
+int main(int argc, char * argv[]) {
+
+	// input parameters
+	double fill_rate = argc > 1 ? atof(argv[1]) : 200000; // fifo fill rate in words per second (one word holds 2 samples)
+	unsigned int samples_per_echo = argc > 2 ? atoi(argv[2]) : 100;
+	unsigned int echoes_per_scan = argc > 3 ? atoi(argv[3]) : 200;
+	unsigned int number_of_iteration = argc > 4 ? atoi(argv[4]) : 10;
+
+	fifo_emu fifo;
+	dma_emu dma;
+	uint32_t num_of_words = samples_per_echo * echoes_per_scan / 2;
+	unsigned int iterate;
+	unsigned int mode;
+	unsigned long k;
+	unsigned long wrong_samples;
+	unsigned long fails = 0;
+	int dma_valid = 0;
+	struct timespec t_start, t_end;
+	char name[20];
+	char nameavg[20];
+	unsigned int *avr_data;
+
+	// plain memory stands in for the bridges, the fifo, ctrl_in and the DMA are handled by the emulators
+	h2f_lw_axi_master = calloc(1, h2f_lw_axi_master_span);
+	h2p_ctrl_in_addr = h2f_lw_axi_master + CTRL_IN_BASE;
+	h2p_adc_fifo_addr = h2f_lw_axi_master + ADC_FIFO_MEM_OUT_BASE;
+	h2p_adc_fifo_status_addr = h2f_lw_axi_master + ADC_FIFO_MEM_IN_CSR_BASE;
+	h2p_dma_addr = calloc(8, sizeof(unsigned int));
+	h2p_sdram_addr = malloc(2 * DMA_SDRAM_BUF_SPAN);
+	dma_sdram_wr_addr = 0x40000000; // any DMA master address outside of the fifo
+	dma_capture_init(&adc_dma, h2p_dma_addr);
+	capture_arena_reserve(&adc_arena, num_of_words, samples_per_echo);
+	avr_data = adc_arena.avr_data;
+
+	fifo_emu_init(&fifo, ADC_FIFO_MEM_OUT_FIFO_DEPTH, fill_rate);
+	fifo_emu_attach(&fifo, h2p_adc_fifo_addr, (void *) h2p_adc_fifo_status_addr, h2p_ctrl_in_addr);
+	dma_emu_init(&dma, 0);
+	dma_emu_map_window(&dma, dma_sdram_wr_addr, 2 * DMA_SDRAM_BUF_SPAN, (void *) h2p_sdram_addr);
+	dma_emu_set_source_fifo(&dma, &fifo);
+	dma_emu_attach(&dma, (void *) h2p_dma_addr);
+	sim_bus_en = 1;
+
+	create_measurement_folder("dma_emu");
+
+	for (mode = 0; mode < 2; mode++) {
+		clock_gettime(CLOCK_MONOTONIC, &t_start);
+		for (iterate = 1; iterate <= number_of_iteration; iterate++) {
+			fifo_emu_reset(&fifo);
+			fifo_emu_start(&fifo, num_of_words); // the sequence starts
+
+			if (mode == 0) { // serial
+				snprintf(name, sizeof(name), "dat_%03d", iterate);
+				snprintf(nameavg, sizeof(nameavg), "avg_%03d", iterate);
+				memset(avr_data, 0, samples_per_echo * sizeof(unsigned int));
+				dma_valid = datawrite_with_dma(num_of_words, samples_per_echo, avr_data, DISABLE_MESSAGE);
+				write_cpmg_data(&scan_hdr, samples_per_echo, echoes_per_scan, avr_data, NULL, name, nameavg);
+				continue;
+			}
+
+			// double buffered, the same order as CPMG_iterate
+			fifo_to_sdram_dma_trf(num_of_words, iterate & 0x01);
+			if (iterate > 1 && dma_valid) {
+				memset(avr_data, 0, samples_per_echo * sizeof(unsigned int));
+				sdram_dma_unpack(num_of_words, (iterate - 1) & 0x01, samples_per_echo, avr_data);
+				write_cpmg_data(&scan_hdr, samples_per_echo, echoes_per_scan, avr_data, NULL, name, nameavg);
+			}
+			dma_valid = sdram_dma_wait(DISABLE_MESSAGE);
+			snprintf(name, sizeof(name), "dat_%03d", iterate);
+			snprintf(nameavg, sizeof(nameavg), "avg_%03d", iterate);
+		}
+		if (mode == 1 && dma_valid) {
+			memset(avr_data, 0, samples_per_echo * sizeof(unsigned int));
+			sdram_dma_unpack(num_of_words, number_of_iteration & 0x01, samples_per_echo, avr_data);
+			write_cpmg_data(&scan_hdr, samples_per_echo, echoes_per_scan, avr_data, NULL, name, nameavg);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t_end);
+
+		// the emulated fifo produces sample n with the value n & 0x3FFF
+		wrong_samples = 0;
+		for (k = 0; k < (unsigned long) num_of_words * 2; k++) {
+			if (adc_arena.samples[k] != (k & 0x3FFF)) {
+				wrong_samples++;
+			}
+		}
+		printf("%s: %.3f ms per scan (sequence alone: %.3f ms), dropped words: %lu, wrong samples: %lu, dma polls: %lu : %s\n",
+				mode == 0 ? "serial         " : "double buffered",
+				((t_end.tv_sec - t_start.tv_sec) * 1e3 + (t_end.tv_nsec - t_start.tv_nsec) * 1e-6) / number_of_iteration,
+				num_of_words / fill_rate * 1e3, (unsigned long) fifo.dropped, wrong_samples, adc_dma.polls,
+				(dma_valid && fifo.dropped == 0 && wrong_samples == 0) ? "MATCHED" : "NOT MATCHED");
+		fails += !dma_valid || fifo.dropped != 0 || wrong_samples != 0;
+	}
+
+	sim_bus_en = 0;
+	sim_bus_unmap_all();
+	fifo_emu_free(&fifo);
+	free((void *) h2p_sdram_addr);
+	free((void *) h2p_dma_addr);
+	free(h2f_lw_axi_master);
+	return fails != 0;
+}
@@ -0,0 +1,92 @@
+// Echo integration benchmark, runs without the FPGA
+// decaying Gaussian echoes are placed where cpmg_param_calculator_ltc1746 puts the echo centre and integrated from the
+// packed fifo words (unpack + integration, as in CPMG_scan_handoff). The result is compared with the double precision
+// reference, the phase with the one of the echoes, and the throughput with the ADC rate
+
+#define HPS_LINUX_NO_MAIN
+#include "../hps_linux.c"
+
+int main(int argc, char * argv[]) {
+
+	// input parameters
+	double cpmg_freq = argc > 1 ? atof(argv[1]) : 4.3; // MHz, the ADC runs at 4 * cpmg_freq
+	double pulse2_us = argc > 2 ? atof(argv[2]) : 10;
+	double echo_spacing_us = argc > 3 ? atof(argv[3]) : 200;
+	double init_adc_delay_compensation = argc > 4 ? atof(argv[4]) : 0; // us
+	unsigned int num_of_reps = argc > 5 ? atoi(argv[5]) : 20;
+
+	unsigned int shape[][2] = { { 32, 4000 }, { 64, 2000 }, { 200, 1000 }, { 1000, 200 } }; // samples_per_echo x echoes_per_scan
+	const char *window_name[] = { "box", "hann", "gauss" };
+	double adc_freq = 4 * cpmg_freq;
+	double nmr_fsm_clkfreq = 16 * cpmg_freq;
+	double phase = 0.7, amplitude = 5000;
+	unsigned int cpmg_param[5];
+	unsigned int s, w, r, e;
+	unsigned long k, num_of_words;
+	uint32_t *fifo_words;
+	uint32_t half;
+	double x, env, err, max_err, phase_err, max_phase_err, ref[2];
+	struct timespec t_start, t_end;
+	double t_run, rate;
+
+	printf("echo integration with the %s dot product, adc at %.3f MHz\n", ddc_impl(), adc_freq);
+	printf("samples x echoes  centre  window        max err [LSB]  max phase err [deg]  scan [ms]  rate [Msample/s]  x adc rate  data reduction\n");
+	for (s = 0; s < sizeof(shape) / sizeof(shape[0]); s++) {
+		num_of_words = (unsigned long) shape[s][0] * shape[s][1] / 2;
+		cpmg_param_calculator_ltc1746(cpmg_param, nmr_fsm_clkfreq, cpmg_freq, adc_freq, init_adc_delay_compensation,
+				pulse2_us / 2, pulse2_us, echo_spacing_us, shape[s][0]);
+		adc_echo_centre = cpmg_echo_centre_ltc1746(adc_freq, init_adc_delay_compensation, pulse2_us, echo_spacing_us,
+				cpmg_param[INIT_DELAY_ADC_OFFST]);
+		capture_arena_reserve(&adc_arena, num_of_words, shape[s][0]);
+		fifo_words = malloc(num_of_words * sizeof(uint32_t));
+		srand(s);
+		for (k = 0; k < num_of_words * 2; k++) {
+			e = k / shape[s][0];
+			env = exp(-0.5 * pow(((k % shape[s][0]) - adc_echo_centre) / (shape[s][0] / 6.0), 2)) * exp(-(double) e / shape[s][1] * 3);
+			x = DDC_ADC_MIDSCALE + amplitude * env * cos(M_PI / 2 * (k % shape[s][0]) + phase) + (rand() % 101 - 50);
+			half = (uint16_t) x | (rand() & 0xC000); // the 2 unused bits are not always 0
+			if (k & 1) { // the lower half first
+				fifo_words[k / 2] |= half << 16;
+			} else {
+				fifo_words[k / 2] = half;
+			}
+		}
+
+		for (w = 0; w < 4; w++) {
+			adc_integ_cfg.window = w < 3 ? w : ECHO_INTEG_BOX;
+			adc_integ_cfg.width = w < 3 ? 0 : shape[s][0] / 2;
+			if (!echo_integ_init(&adc_integ, &adc_integ_cfg, shape[s][0], shape[s][1], adc_echo_centre)) {
+				continue;
+			}
+
+			clock_gettime(CLOCK_MONOTONIC, &t_start);
+			for (r = 0; r < num_of_reps; r++) {
+				memset(adc_arena.avr_data, 0, shape[s][0] * sizeof(unsigned int));
+				echo_unpack_sum(fifo_words, num_of_words, shape[s][0], adc_arena.samples, adc_arena.avr_data);
+				echo_integ_run(&adc_integ, adc_arena.samples, shape[s][1], adc_integ.iq);
+			}
+			clock_gettime(CLOCK_MONOTONIC, &t_end);
+			t_run = ((t_end.tv_sec - t_start.tv_sec) * 1e3 + (t_end.tv_nsec - t_start.tv_nsec) * 1e-6) / num_of_reps;
+			rate = num_of_words * 2 / t_run * 1e-3; // Msample/s
+
+			max_err = 0;
+			max_phase_err = 0;
+			for (e = 0; e < shape[s][1]; e++) {
+				echo_integ_reference(&adc_integ, adc_arena.samples + (unsigned long) e * shape[s][0], ref);
+				err = fmax(fabs(adc_integ.iq[e * 2] - ref[0]), fabs(adc_integ.iq[e * 2 + 1] - ref[1])) / (1 << ECHO_INTEG_FRAC_BITS);
+				max_err = err > max_err ? err : max_err;
+				if (e < shape[s][1] / 2) { // the echoes well above the noise
+					phase_err = fabs(atan2(adc_integ.iq[e * 2 + 1], adc_integ.iq[e * 2]) - phase) * 180 / M_PI;
+					max_phase_err = phase_err > max_phase_err ? phase_err : max_phase_err;
+				}
+			}
+			printf("%6u x %5u  %6.2f  %-5s %4u  %13.4f  %19.3f  %9.3f  %16.1f  %10.1f  %7u\n", shape[s][0], shape[s][1],
+					adc_echo_centre, window_name[adc_integ_cfg.window], adc_integ.len, max_err, max_phase_err, t_run, rate,
+					rate / adc_freq, shape[s][0]);
+			echo_integ_free(&adc_integ);
+		}
+		free(fifo_words);
+	}
+	capture_arena_print_stat(&adc_arena);
+	return 0;
+}
@@ -0,0 +1,100 @@
+// Unpack + echo average benchmark, runs without the FPGA
+// compares the three passes of the fifo readout (copy, split to 16-bit samples, strided echo sum) with echo_unpack_sum
+
+#define HPS_LINUX_NO_MAIN
+#include "../hps_linux.c"
+
+int main(int argc, char * argv[]) {
+
+	unsigned int shape[][2] = { { 15, 4000 }, { 16, 4000 }, { 50, 2000 }, { 64, 1000 }, { 200, 1000 }, { 1000, 200 }, { 4000, 50 } }; // samples_per_echo x echoes_per_scan
+	unsigned int num_of_reps = 50;
+	unsigned int s, r;
+	unsigned long k, num_of_words;
+	unsigned int samples_per_echo, echoes_per_scan;
+	uint32_t *fifo_words; // the data as it comes out of the fifo
+	unsigned int *ref_16, *ref_avr, *avr_data;
+	unsigned long mismatch, fails = 0;
+	struct timespec t_start, t_end;
+	double t_three_pass, t_scalar, t_fused;
+
+	printf("echo_unpack_sum uses the %s path\n", echo_unpack_impl());
+	printf("samples x echoes : three-pass [ms]   fused scalar [ms]   fused %s [ms]   speed-up   check\n", echo_unpack_impl());
+	for (s = 0; s < sizeof(shape) / sizeof(shape[0]); s++) {
+		samples_per_echo = shape[s][0];
+		echoes_per_scan = shape[s][1];
+		num_of_words = (unsigned long) samples_per_echo * echoes_per_scan / 2;
+
+		fifo_words = malloc(num_of_words * sizeof(uint32_t));
+		ref_16 = malloc(num_of_words * 2 * sizeof(unsigned int));
+		ref_avr = calloc(samples_per_echo, sizeof(unsigned int));
+		avr_data = calloc(samples_per_echo, sizeof(unsigned int));
+		capture_arena_reserve(&adc_arena, num_of_words, samples_per_echo);
+		srand(s);
+		for (k = 0; k < num_of_words; k++) {
+			fifo_words[k] = ((uint32_t) rand() << 1) ^ (uint32_t) rand(); // the 2 unused bits of every sample are not always 0 either
+		}
+
+		// the current readout of CPMG_Sequence
+		clock_gettime(CLOCK_MONOTONIC, &t_start);
+		for (r = 0; r < num_of_reps; r++) {
+			for (i = 0; i < num_of_words; i++) {
+				adc_arena.words[i] = fifo_words[i]; // stands in for the fifo read
+			}
+			j = 0;
+			for (i = 0; i < num_of_words; i++) {
+				ref_16[j++] = (fifo_words[i] & 0x3FFF);
+				ref_16[j++] = ((fifo_words[i] >> 16) & 0x3FFF);
+			}
+			for (i = 0; i < samples_per_echo; i++) {
+				ref_avr[i] = 0;
+			}
+			for (i = 0; i < samples_per_echo; i++) {
+				for (j = i; j < (((long) samples_per_echo * (long) echoes_per_scan)); j += samples_per_echo) {
+					ref_avr[i] += ref_16[j];
+				}
+			}
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t_end);
+		t_three_pass = ((t_end.tv_sec - t_start.tv_sec) * 1e3 + (t_end.tv_nsec - t_start.tv_nsec) * 1e-6) / num_of_reps;
+
+		clock_gettime(CLOCK_MONOTONIC, &t_start);
+		for (r = 0; r < num_of_reps; r++) {
+			for (i = 0; i < num_of_words; i++) {
+				adc_arena.words[i] = fifo_words[i];
+			}
+			memset(avr_data, 0, samples_per_echo * sizeof(unsigned int));
+			echo_unpack_sum_scalar(fifo_words, num_of_words, samples_per_echo, adc_arena.samples, avr_data);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t_end);
+		t_scalar = ((t_end.tv_sec - t_start.tv_sec) * 1e3 + (t_end.tv_nsec - t_start.tv_nsec) * 1e-6) / num_of_reps;
+
+		clock_gettime(CLOCK_MONOTONIC, &t_start);
+		for (r = 0; r < num_of_reps; r++) {
+			for (i = 0; i < num_of_words; i++) {
+				adc_arena.words[i] = fifo_words[i];
+			}
+			memset(avr_data, 0, samples_per_echo * sizeof(unsigned int));
+			echo_unpack_sum(fifo_words, num_of_words, samples_per_echo, adc_arena.samples, avr_data);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t_end);
+		t_fused = ((t_end.tv_sec - t_start.tv_sec) * 1e3 + (t_end.tv_nsec - t_start.tv_nsec) * 1e-6) / num_of_reps;
+
+		mismatch = 0;
+		for (k = 0; k < num_of_words * 2; k++) {
+			mismatch += (adc_arena.samples[k] != ref_16[k]);
+		}
+		for (k = 0; k < samples_per_echo; k++) {
+			mismatch += (avr_data[k] != ref_avr[k]);
+		}
+		printf("%6u x %5u : %16.3f   %17.3f   %14.3f   %7.2fx   %s\n", samples_per_echo, echoes_per_scan,
+				t_three_pass, t_scalar, t_fused, t_three_pass / t_fused, mismatch ? "NOT MATCHED" : "MATCHED");
+		fails += mismatch;
+
+		free(fifo_words);
+		free(ref_16);
+		free(ref_avr);
+		free(avr_data);
+	}
+	capture_arena_print_stat(&adc_arena);
+	return fails != 0;
+}
@@ -0,0 +1,113 @@
+// Event-driven fifo drain against a fake UIO device, runs without the FPGA
+// drains the same stream by polling the csr and by sleeping on the fifo interrupt (an eventfd raised by fifo_emu_irq)
+// and compares the cpu time of the draining thread. The wakeup latency must stay below the headroom left by the
+// almost-full threshold, (depth - almostfull) / fill_rate, or the fifo overflows.
+// By default the polling pass fills the fifo by FIFO_STEP words per access of the reader and must read every word.
+// The interrupt needs the fifo to fill in real time, so a preemption longer than the headroom drops words there: that
+// pass checks the accounting (words read + dropped, the overflow event, the interrupts taken) and warns on drops.
+// With a fill rate given both passes run in real time and are checked like the interrupt pass, as a benchmark
+
+#define HPS_LINUX_NO_MAIN
+#include "../hps_linux.c"
+
+#define FIFO_STEP	0.5		// words per fifo access: the reader keeps up, the level still reaches the almost-full threshold
+
+int main(int argc, char * argv[]) {
+
+	// input parameters
+	double fill_rate = argc > 1 ? atof(argv[1]) : 200000; // fifo fill rate in words per second (one word holds 2 samples)
+	int stepped = argc <= 1; // the polling pass runs stepped unless a fill rate is given
+	unsigned long num_of_words = argc > 2 ? atol(argv[2]) : 200000; // the amount of words produced by the emulated sequence
+
+	const char *backend_name[2] = { "polling", "interrupt" };
+	fifo_emu emu;
+	fifo_emu_irq irq;
+	struct timespec c0, c1, t0, t1;
+	double cpu_ms[2], wall_ms[2];
+	unsigned long k;
+	unsigned long wrong_words;
+	int backend;
+	int fails = 0;
+
+	// plain memory stands in for the lightweight bridge, the fifo and ctrl_in are handled by the emulator
+	h2f_lw_axi_master = calloc(1, h2f_lw_axi_master_span);
+	h2p_ctrl_in_addr = h2f_lw_axi_master + CTRL_IN_BASE;
+	h2p_adc_fifo_addr = h2f_lw_axi_master + ADC_FIFO_MEM_OUT_BASE;
+	h2p_adc_fifo_status_addr = h2f_lw_axi_master + ADC_FIFO_MEM_IN_CSR_BASE;
+	fifo_ring_init(&adc_ring, FIFO_RING_INIT_SIZE);
+	printf("headroom after the almost-full event: %.0f us\n",
+			(ADC_FIFO_MEM_OUT_FIFO_DEPTH - ADC_FIFO_MEM_IN_CSR_FIFO_DEPTH / 2) / fill_rate * 1e6);
+
+	for (backend = 0; backend < 2; backend++) {
+		fifo_emu_init(&emu, ADC_FIFO_MEM_OUT_FIFO_DEPTH, fill_rate);
+		if (backend == 0 && stepped) {
+			fifo_emu_set_step(&emu, FIFO_STEP);
+		}
+		fifo_emu_attach(&emu, h2p_adc_fifo_addr, (void *) h2p_adc_fifo_status_addr, h2p_ctrl_in_addr);
+		sim_bus_en = 1;
+		fifo_event_init_poll(&adc_event, h2p_adc_fifo_status_addr);
+		fifo_ring_clear(&adc_ring);
+
+		fifo_emu_start(&emu, num_of_words);
+		if (backend == 1) {
+			if (!fifo_emu_irq_start(&irq, &emu)) {
+				return 1;
+			}
+			fifo_event_attach_fd(&adc_event, irq.fd, FIFO_EVENT_FD_EVENTFD);
+		}
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &c0);
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		fifo_stream_drain(&adc_ring, h2p_adc_fifo_addr, &adc_event,
+				h2p_ctrl_in_addr, num_of_words, ADC_FIFO_MEM_IN_CSR_FIFO_DEPTH / 2,
+				&adc_stream_stat);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &c1);
+		cpu_ms[backend] = (c1.tv_sec - c0.tv_sec) * 1e3 + (c1.tv_nsec - c0.tv_nsec) * 1e-6;
+		wall_ms[backend] = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) * 1e-6;
+		if (backend == 1) {
+			fifo_emu_irq_stop(&irq);
+		}
+
+		wrong_words = 0;
+		for (k = 0; k < adc_stream_stat.words; k++) {
+			if (fifo_ring_at(&adc_ring, k) != fifo_emu_ramp(NULL, k)) {
+				wrong_words++;
+			}
+		}
+		printf("%s: words: %lu/%lu, bursts: %lu, max fifo level: %u/%u, dropped: %lu, wrong words: %lu\n",
+				backend_name[backend], adc_stream_stat.words, num_of_words, adc_stream_stat.bursts,
+				adc_stream_stat.max_level, emu.depth, (unsigned long) emu.dropped, wrong_words);
+		fifo_event_print_stat(&adc_event);
+		printf("%s: %.1f ms, drain cpu time %.1f ms (%.1f%%)\n", backend_name[backend], wall_ms[backend],
+				cpu_ms[backend], 100 * cpu_ms[backend] / wall_ms[backend]);
+		if (backend == 0 && stepped) {
+			if (adc_stream_stat.words != num_of_words || adc_stream_stat.overflow || wrong_words != 0) {
+				fails++;
+			}
+		}
+		else {
+			// the drops depend on the scheduler, the accounting of them does not
+			if (adc_stream_stat.words + emu.dropped != num_of_words || adc_stream_stat.overflow != (emu.dropped != 0)
+					|| (emu.dropped == 0 && wrong_words != 0) || (backend == 1 && adc_event.irqs > irq.irqs)) {
+				fails++;
+			}
+			if (emu.dropped != 0) {
+				printf("[WARNING] %s: %lu words dropped, the drain was off the cpu for longer than the headroom\n",
+						backend_name[backend], (unsigned long) emu.dropped);
+			}
+		}
+
+		fifo_event_close(&adc_event);
+		sim_bus_en = 0;
+		sim_bus_unmap_all();
+		fifo_emu_free(&emu);
+	}
+	if (!stepped) {
+		printf("the interrupt saves %.1f ms of cpu time\n", cpu_ms[0] - cpu_ms[1]);
+	}
+	printf("event-driven fifo drain : %s\n", fails == 0 ? "PASSED" : "FAILED");
+
+	fifo_ring_free(&adc_ring);
+	free(h2f_lw_axi_master);
+	return fails != 0;
+}
@@ -0,0 +1,59 @@
+// Streaming fifo readout against the emulated fifo, runs without the FPGA
+// by default the fifo fills by FIFO_STEP words per access of the reader, so the result does not depend on the
+// scheduler. With a fill rate given (words per second) the fifo fills in real time instead, as a benchmark
+
+#define HPS_LINUX_NO_MAIN
+#include "../hps_linux.c"
+
+#define FIFO_STEP	0.5		// words per fifo access: the reader keeps up, the level still reaches the almost-full threshold
+
+int main(int argc, char * argv[]) {
+
+	// input parameters
+	double fill_rate = argc > 1 ? atof(argv[1]) : 0; // fifo fill rate in words per second (one word holds 2 samples), 0: stepped
+	unsigned long num_of_words = argc > 2 ? atol(argv[2]) : 100000; // the amount of words produced by the emulated sequence
+
+	fifo_emu emu;
+	unsigned long k;
+	unsigned long wrong_words = 0;
+	int fails;
+
+	// plain memory stands in for the lightweight bridge, the fifo and ctrl_in are handled by the emulator
+	h2f_lw_axi_master = calloc(1, h2f_lw_axi_master_span);
+	h2p_ctrl_in_addr = h2f_lw_axi_master + CTRL_IN_BASE;
+	h2p_adc_fifo_addr = h2f_lw_axi_master + ADC_FIFO_MEM_OUT_BASE;
+	h2p_adc_fifo_status_addr = h2f_lw_axi_master + ADC_FIFO_MEM_IN_CSR_BASE;
+
+	fifo_emu_init(&emu, ADC_FIFO_MEM_OUT_FIFO_DEPTH, fill_rate);
+	if (fill_rate <= 0) {
+		fifo_emu_set_step(&emu, FIFO_STEP);
+	}
+	fifo_emu_attach(&emu, h2p_adc_fifo_addr, (void *) h2p_adc_fifo_status_addr, h2p_ctrl_in_addr);
+	sim_bus_en = 1;
+
+	fifo_ring_init(&adc_ring, FIFO_RING_INIT_SIZE);
+	fifo_event_init_poll(&adc_event, h2p_adc_fifo_status_addr);
+	fifo_emu_start(&emu, num_of_words);
+	fifo_stream_drain(&adc_ring, h2p_adc_fifo_addr, &adc_event,
+			h2p_ctrl_in_addr, num_of_words, ADC_FIFO_MEM_IN_CSR_FIFO_DEPTH / 2,
+			&adc_stream_stat);
+
+	for (k = 0; k < adc_stream_stat.words; k++) {
+		if (fifo_ring_at(&adc_ring, k) != fifo_emu_ramp(NULL, k)) {
+			wrong_words++;
+		}
+	}
+	printf("words: %lu/%lu, bursts: %lu, max fifo level: %u/%u, dropped: %lu, wrong words: %lu, ring size: %lu\n",
+			adc_stream_stat.words, num_of_words, adc_stream_stat.bursts,
+			adc_stream_stat.max_level, emu.depth, (unsigned long) emu.dropped,
+			wrong_words, (unsigned long) adc_ring.size);
+	fails = adc_stream_stat.words != num_of_words || adc_stream_stat.overflow || wrong_words != 0;
+	printf("streaming readout : %s\n", fails == 0 ? "MATCHED" : "NOT MATCHED");
+
+	sim_bus_en = 0;
+	sim_bus_unmap_all();
+	fifo_emu_free(&emu);
+	fifo_ring_free(&adc_ring);
+	free(h2f_lw_axi_master);
+	return fails;
+}
@@ -0,0 +1,75 @@
+// Bounded hardware waits against a wedged simulated sequencer, runs without the FPGA
+// CPMG Manual scans on the simulated backend with the cpu time spent per scan, then a sequence that hangs (the TOKEN
+// issue of ADC_WINGEN) must time out and reset the sequencer, the next scan must work again, and a PLL that does not
+// lock must time out as well. The wait histograms are printed at the end
+
+#define HPS_LINUX_NO_MAIN
+#include "../hps_linux.c"
+
+int main(int argc, char * argv[]) {
+
+	// input parameters
+	double fill_rate = argc > 1 ? atof(argv[1]) : 20000; // fifo fill rate in words per second, a scan takes 50 ms
+	unsigned int number_of_iteration = argc > 2 ? atoi(argv[2]) : 10;
+
+	double cpmg_freq = 4.3;
+	unsigned int samples_per_echo = 20;
+	unsigned int echoes_per_scan = 100;
+	struct timespec t_start, t_end, c_start, c_end;
+	double wall_ms, cpu_ms;
+	unsigned long fails = 0;
+	unsigned long resets;
+	unsigned int n;
+	int captured;
+
+	mmap_sim_peripherals(fill_rate);
+	init_default_system_param();
+	adc_read_mode = READ_FIFO_AFTER_SEQ;
+	write_t1_param(0, 0);
+
+	// the normal scans: the cpu is given back while the sequence runs
+	clock_gettime(CLOCK_MONOTONIC, &t_start);
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &c_start);
+	for (n = 0; n < number_of_iteration; n++) {
+		fails += !CPMG_Manual(cpmg_freq, 5, 10, 0.5, 0.5, 100, 200, 0, samples_per_echo, echoes_per_scan, 0, ENABLE,
+				DISABLE_MESSAGE);
+	}
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &c_end);
+	clock_gettime(CLOCK_MONOTONIC, &t_end);
+	wall_ms = ((t_end.tv_sec - t_start.tv_sec) * 1e3 + (t_end.tv_nsec - t_start.tv_nsec) * 1e-6) / number_of_iteration;
+	cpu_ms = ((c_end.tv_sec - c_start.tv_sec) * 1e3 + (c_end.tv_nsec - c_start.tv_nsec) * 1e-6) / number_of_iteration;
+	printf("scan : %.1f ms, cpu %.2f ms (%.1f %%), %lu scans lost\n", wall_ms, cpu_ms, 100 * cpu_ms / wall_ms, fails);
+
+	// a hanging sequence
+	sim_nmr_fsm.wedge = 1;
+	resets = sim_nmr_fsm.cnt_resets;
+	clock_gettime(CLOCK_MONOTONIC, &t_start);
+	captured = CPMG_Manual(cpmg_freq, 5, 10, 0.5, 0.5, 100, 200, 0, samples_per_echo, echoes_per_scan, 0, ENABLE,
+			DISABLE_MESSAGE);
+	clock_gettime(CLOCK_MONOTONIC, &t_end);
+	printf("hanging sequence : %s after %.1f ms, sequencer reset %s\n", captured ? "CAPTURED" : "timed out",
+			(t_end.tv_sec - t_start.tv_sec) * 1e3 + (t_end.tv_nsec - t_start.tv_nsec) * 1e-6,
+			sim_nmr_fsm.cnt_resets - resets == 1 ? "once" : "NOT ONCE");
+	fails += captured || sim_nmr_fsm.cnt_resets - resets != 1 || wait_nmr_seq_site.timeouts != 1;
+
+	captured = CPMG_Manual(cpmg_freq, 5, 10, 0.5, 0.5, 100, 200, 0, samples_per_echo, echoes_per_scan, 0, ENABLE,
+			DISABLE_MESSAGE);
+	printf("next scan : %s\n", captured ? "captured" : "LOST");
+	fails += !captured;
+
+	// a pll that does not lock
+	sim_nmr_fsm.pll_lock &= ~PLL_NMR_SYS_lock;
+	clock_gettime(CLOCK_MONOTONIC, &t_start);
+	captured = Wait_PLL_To_Lock(h2p_ctrl_in_addr, PLL_NMR_SYS_lock_ofst);
+	clock_gettime(CLOCK_MONOTONIC, &t_end);
+	printf("pll without lock : %s after %.1f ms\n", captured ? "LOCKED" : "timed out",
+			(t_end.tv_sec - t_start.tv_sec) * 1e3 + (t_end.tv_nsec - t_start.tv_nsec) * 1e-6);
+	fails += captured || wait_pll_lock.timeouts != 1;
+	sim_nmr_fsm.pll_lock |= PLL_NMR_SYS_lock;
+
+	hw_wait_print_all();
+	printf("bounded waits : %s\n", fails == 0 ? "PASSED" : "FAILED");
+
+	munmap_sim_peripherals();
+	return fails != 0;
+}
@@ -0,0 +1,83 @@
+// Batched I2C against the simulated cores and expanders, runs without the FPGA
+// a relay and gain sweep written one register update at a time and then one batch per step (both cores at once),
+// a batch longer than the command fifo, and a NACK and a lost arbitration reported by the batch they happened in.
+// The expanders must end with the values written and the batched sweep must take less time
+
+#define HPS_LINUX_NO_MAIN
+#include "../hps_linux.c"
+
+int main(int argc, char * argv[]) {
+
+	// input parameters
+	unsigned int steps = argc > 1 ? atoi(argv[1]) : 40;
+
+	i2c_emu_dev *relay, *cnt;
+	uint8_t data[2] = { 0x12, 0x34 };
+	uint64_t single_ns, batched_ns;
+	unsigned long fails = 0;
+	unsigned int k;
+	int ok;
+
+	setenv(SIM_BACKEND_ENV, "0", 1);
+	open_fpga_backend();
+	relay = i2c_emu_dev_at(&sim_i2c_ext, TCA9555_ADDR);
+	cnt = i2c_emu_dev_at(&sim_i2c_int, TCA9555_ADDR);
+	fails += !init_i2c_expanders();
+	fails += relay->reg[CNT_REG_CONF_PORT0] != 0 || relay->reg[CNT_REG_CONF_PORT1] != 0
+			|| cnt->reg[CNT_REG_CONF_PORT0] != 0 || cnt->reg[CNT_REG_CONF_PORT1] != 0;
+	printf("expanders set up: %s\n", fails == 0 ? "ok" : "FAILED");
+
+	// one register update per call, every call waits for its core
+	i2c_batch_clear_stat(&ctrl_i2c_batch);
+	for (k = 0; k < steps; k++) {
+		write_i2c_relay_cnt(k, 255 - k, DISABLE_MESSAGE);
+		write_i2c_cnt(k & 1, RX_AMP_GAIN_1_msk | RX_AMP_GAIN_3_msk, DISABLE_MESSAGE);
+	}
+	single_ns = ctrl_i2c_batch.stat.total_ns;
+	printf("one update per call : ");
+	i2c_batch_print(&ctrl_i2c_batch);
+
+	// the updates of a step in one batch
+	i2c_batch_clear_stat(&ctrl_i2c_batch);
+	for (k = 0; k < steps; k++) {
+		i2c_batch_begin(&ctrl_i2c_batch);
+		write_i2c_relay_cnt(k + 1, 254 - k, DISABLE_MESSAGE);
+		write_i2c_cnt(k & 1, RX_AMP_GAIN_1_msk | RX_AMP_GAIN_3_msk, DISABLE_MESSAGE);
+		i2c_batch_end(&ctrl_i2c_batch);
+	}
+	batched_ns = ctrl_i2c_batch.stat.total_ns;
+	printf("one batch per step  : ");
+	i2c_batch_print(&ctrl_i2c_batch);
+	fails += ctrl_i2c_batch.stat.batches != steps || batched_ns >= single_ns;
+	fails += relay->reg[CNT_REG_OUT_PORT0] != (uint8_t) steps || relay->reg[CNT_REG_OUT_PORT1] != (uint8_t) (255 - steps)
+			|| cnt->reg[CNT_REG_OUT_PORT0] != (ctrl_i2c & 0xFF) || cnt->reg[CNT_REG_OUT_PORT1] != (ctrl_i2c >> 8);
+	printf("sweep of %u steps: %.3f ms one update per call, %.3f ms batched (%.2fx): %s\n", steps, single_ns * 1e-6,
+			batched_ns * 1e-6, (double) single_ns / batched_ns, fails == 0 ? "ok" : "FAILED");
+
+	// 40 transactions, 160 commands through a fifo of 32
+	i2c_batch_begin(&ctrl_i2c_batch);
+	for (k = 0; k < 40; k++) {
+		write_i2c_relay_cnt(100 + k, 10 + k, DISABLE_MESSAGE);
+	}
+	ok = i2c_batch_end(&ctrl_i2c_batch);
+	ok = ok && relay->reg[CNT_REG_OUT_PORT0] == 139 && relay->reg[CNT_REG_OUT_PORT1] == 49 && sim_i2c_ext.overflow == 0;
+	printf("batch longer than the fifo: %s\n", ok ? "ok" : "FAILED");
+	fails += !ok;
+
+	// a device that does not answer, then a lost arbitration: reported once, by the batch they happened in
+	i2c_batch_clear_stat(&ctrl_i2c_batch);
+	i2c_batch_write(&ctrl_i2c_batch, (void *) h2p_i2c_ext_addr, TCA9555_ADDR + 1, CNT_REG_OUT_PORT0, data, 2);
+	i2c_batch_write(&ctrl_i2c_batch, (void *) h2p_i2c_ext_addr, TCA9555_ADDR, CNT_REG_OUT_PORT0, data, 2);
+	ok = !i2c_batch_commit(&ctrl_i2c_batch) && (ctrl_i2c_batch.isr & NACK_DET_MSK) && relay->reg[CNT_REG_OUT_PORT0] == 0x12;
+	ok = ok && write_i2c_cnt(ENABLE, RX_IN_SEL_1_msk, DISABLE_MESSAGE);
+	i2c_emu_lose_arbitration(&sim_i2c_int);
+	ok = ok && !write_i2c_cnt(ENABLE, RX_IN_SEL_2_msk, DISABLE_MESSAGE) && (ctrl_i2c_batch.isr & ARBLOST_DET_MSK);
+	ok = ok && write_i2c_cnt(ENABLE, RX_IN_SEL_2_msk, DISABLE_MESSAGE) && cnt->reg[CNT_REG_OUT_PORT1] == (ctrl_i2c >> 8);
+	ok = ok && ctrl_i2c_batch.stat.nacks == 1 && ctrl_i2c_batch.stat.arblosts == 1;
+	printf("nack and lost arbitration: %s\n", ok ? "ok" : "FAILED");
+	fails += !ok;
+
+	printf("i2c batch : %s\n", fails == 0 ? "PASSED" : "FAILED");
+	close_fpga_backend();
+	return fails != 0;
+}
@@ -0,0 +1,177 @@
+// Acquisition daemon against the simulated peripherals, runs without the FPGA
+// forks a daemon on the simulated backend and drives it as a client: the request round trip, a CPMG run read back
+// through the socket and compared with the ramp of the emulated fifo, a CPMG Manual scan and the error replies
+
+#define HPS_LINUX_NO_MAIN
+#include "../hps_linux.c"
+
+int main(int argc, char * argv[]) {
+
+	// input parameters
+	double fill_rate = argc > 1 ? atof(argv[1]) : 100000; // fifo fill rate in words per second (one word holds 2 samples)
+	unsigned int samples_per_echo = argc > 2 ? atoi(argv[2]) : 100;
+	unsigned int echoes_per_scan = argc > 3 ? atoi(argv[3]) : 50;
+	unsigned int number_of_iteration = argc > 4 ? atoi(argv[4]) : 3;
+
+	const char *socket_path = "/tmp/nmr_daemon_test.sock";
+	unsigned int num_of_pings = 1000;
+	nmrd_buf reply = { NULL, 0, 0 };
+	nmrd_param par;
+	nmrd_cpmg cpmg;
+	nmrd_cpmg_manual man;
+	nmrd_result res;
+	nmrd_stat daemon_stat;
+	struct stat st;
+	struct timespec t_start, t_end;
+	double ping_us, call_ms;
+	unsigned long fails = 0;
+	unsigned long k, e, expected;
+	unsigned int n;
+	uint16_t *samples;
+	char *line;
+	pid_t pid;
+	int fd = -1;
+	int status;
+
+	pid = fork();
+	if (pid == 0) { // the daemon
+		mmap_sim_peripherals(fill_rate);
+		init_default_system_param();
+		ddc_default_config(&adc_ddc_cfg, 4, 2);
+		nmrd_serve(socket_path, daemon_handler, &daemon_stat);
+		printf("daemon: clients: %lu (%lu refused), requests: %lu, errors: %lu, busy: %.3f s\n",
+				daemon_stat.clients, daemon_stat.refused, daemon_stat.requests, daemon_stat.errors,
+				daemon_stat.busy_ns * 1e-9);
+		munmap_sim_peripherals();
+		exit(0);
+	}
+	for (n = 0; n < 200 && fd < 0; n++) { // wait for the daemon to listen
+		usleep(10000);
+		fd = nmrd_connect(socket_path);
+	}
+	if (fd < 0) {
+		printf("cannot connect to the daemon\n");
+		kill(pid, SIGTERM);
+		waitpid(pid, &status, 0);
+		return 1;
+	}
+
+	// only the user of the daemon can connect
+	if (stat(socket_path, &st) != 0 || (st.st_mode & 0777) != NMRD_SOCKET_MODE) {
+		printf("socket mode : NOT RESTRICTED\n");
+		fails++;
+	}
+
+	// the round trip of an empty request
+	clock_gettime(CLOCK_MONOTONIC, &t_start);
+	for (n = 0; n < num_of_pings; n++) {
+		fails += nmrd_call(fd, NMRD_CMD_PING, NULL, 0, NULL) != NMRD_OK;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t_end);
+	ping_us = ((t_end.tv_sec - t_start.tv_sec) * 1e6 + (t_end.tv_nsec - t_start.tv_nsec) * 1e-3) / num_of_pings;
+	printf("ping round trip : %.1f us\n", ping_us);
+
+	// a CPMG run with the streaming readout and text files
+	memset(&par, 0, sizeof(par));
+	par.id = NMRD_PAR_READ_MODE;
+	par.value[0] = READ_FIFO_STREAM;
+	fails += nmrd_call(fd, NMRD_CMD_SET_PARAM, &par, sizeof(par), NULL) != NMRD_OK;
+	par.id = NMRD_PAR_FILE_FORMAT;
+	par.value[0] = DATA_FILE_TEXT;
+	fails += nmrd_call(fd, NMRD_CMD_SET_PARAM, &par, sizeof(par), NULL) != NMRD_OK;
+
+	memset(&cpmg, 0, sizeof(cpmg));
+	cpmg.cpmg_freq = 4.3;
+	cpmg.pulse1_us = 5;
+	cpmg.pulse2_us = 10;
+	cpmg.pulse1_dtcl = 0.5;
+	cpmg.pulse2_dtcl = 0.5;
+	cpmg.echo_spacing_us = 200;
+	cpmg.scan_spacing_us = 1000;
+	cpmg.samples_per_echo = samples_per_echo;
+	cpmg.echoes_per_scan = echoes_per_scan;
+	cpmg.number_of_iteration = number_of_iteration;
+	cpmg.ph_cycl_en = ENABLE;
+	clock_gettime(CLOCK_MONOTONIC, &t_start);
+	status = nmrd_call(fd, NMRD_CMD_CPMG, &cpmg, sizeof(cpmg), &reply);
+	clock_gettime(CLOCK_MONOTONIC, &t_end);
+	call_ms = (t_end.tv_sec - t_start.tv_sec) * 1e3 + (t_end.tv_nsec - t_start.tv_nsec) * 1e-6;
+	if (status != NMRD_OK || reply.len != sizeof(nmrd_result)) {
+		printf("CPMG request failed (%d)\n", status);
+		fails++;
+	} else {
+		memcpy(&res, reply.data, sizeof(res));
+		printf("CPMG : %s, %.1f ms in the daemon, %.3f ms request overhead\n", res.folder,
+				res.run_ns * 1e-6, call_ms - res.run_ns * 1e-6);
+
+		// the echo sum of the ramp: sample n of a scan has the value n & 0x3FFF
+		status = nmrd_call(fd, NMRD_CMD_READ_FILE, "avg_001", strlen("avg_001"), &reply);
+		if (status != NMRD_OK) {
+			printf("avg_001 cannot be read (%d)\n", status);
+			fails++;
+		} else {
+			line = (char *) nmrd_buf_append(&reply, 1); // terminate the text
+			*line = '\0';
+			line = (char *) reply.data;
+			for (k = 0; k < samples_per_echo; k++) {
+				expected = 0;
+				for (e = 0; e < echoes_per_scan; e++) {
+					expected += (e * samples_per_echo + k) & 0x3FFF;
+				}
+				if (*line == '\0' || strtoul(line, &line, 10) != expected) {
+					break;
+				}
+			}
+			printf("avg_001 vs ramp echo sum : %s\n", k == samples_per_echo ? "MATCHED" : "NOT MATCHED");
+			fails += k != samples_per_echo;
+		}
+		status = nmrd_call(fd, NMRD_CMD_READ_FILE, "acqu.par", strlen("acqu.par"), &reply);
+		printf("acqu.par : %u bytes\n", status == NMRD_OK ? reply.len : 0);
+		fails += status != NMRD_OK;
+	}
+
+	// a single scan returned through the socket
+	memset(&man, 0, sizeof(man));
+	man.cpmg_freq = 4.3;
+	man.pulse1_us = 5;
+	man.pulse2_us = 10;
+	man.pulse1_dtcl = 0.5;
+	man.pulse2_dtcl = 0.5;
+	man.delay1_us = 100;
+	man.delay2_us = 100;
+	man.scan_spacing_us = 1000;
+	man.samples_per_echo = samples_per_echo;
+	man.echoes_per_scan = (ADC_FIFO_MEM_OUT_FIFO_DEPTH * 2) / samples_per_echo; // read after the sequence, so it has to fit the fifo
+	status = nmrd_call(fd, NMRD_CMD_CPMG_MANUAL, &man, sizeof(man), &reply);
+	if (status != NMRD_OK || reply.len != samples_per_echo * man.echoes_per_scan * sizeof(uint16_t)) {
+		printf("CPMG Manual request failed (%d)\n", status);
+		fails++;
+	} else {
+		samples = (uint16_t *) reply.data;
+		for (k = 0; k < reply.len / sizeof(uint16_t) && samples[k] == (k & 0x3FFF); k++)
+			;
+		printf("CPMG Manual : %lu samples, %s\n", k, k == reply.len / sizeof(uint16_t) ? "MATCHED" : "NOT MATCHED");
+		fails += k != reply.len / sizeof(uint16_t);
+	}
+
+	// the error replies
+	status = nmrd_call(fd, NMRD_CMD_READ_FILE, "../acqu.par", strlen("../acqu.par"), &reply);
+	printf("file outside of the folder : %s\n", status == NMRD_ERR_PARAM ? "rejected" : "NOT REJECTED");
+	fails += status != NMRD_ERR_PARAM;
+	status = nmrd_call(fd, NMRD_CMD_READ_FILE, "..acqu.par", strlen("..acqu.par"), &reply);
+	printf("file name with \"..\" : %s\n", status == NMRD_ERR_PARAM ? "rejected" : "NOT REJECTED");
+	fails += status != NMRD_ERR_PARAM;
+	status = nmrd_call(fd, 99, NULL, 0, &reply);
+	printf("unknown command : %s\n", status == NMRD_ERR_CMD ? "rejected" : "NOT REJECTED");
+	fails += status != NMRD_ERR_CMD;
+	status = nmrd_call(fd, NMRD_CMD_CPMG, &cpmg, sizeof(cpmg) - 4, &reply);
+	printf("request of the wrong size : %s\n", status == NMRD_ERR_PROTO ? "rejected" : "NOT REJECTED");
+	fails += status != NMRD_ERR_PROTO;
+
+	nmrd_call(fd, NMRD_CMD_QUIT, NULL, 0, NULL);
+	close(fd);
+	waitpid(pid, &status, 0);
+	nmrd_buf_free(&reply);
+	printf("acquisition daemon : %s\n", fails == 0 ? "PASSED" : "FAILED");
+	return fails != 0;
+}
@@ -0,0 +1,109 @@
+// PLL cache against the simulated reconfig block, runs without the FPGA
+// every setting made through nmr_pll_cache is compared with the one Set_PLL loads into a second simulated reconfig
+// block, then a CPMG_iterate like loop asks for the same clock on every scan, with and without the cache, and a
+// reconfiguration that times out must fail set_nmr_sys_pll and not be remembered as loaded
+
+#define HPS_LINUX_NO_MAIN
+#include "../hps_linux.c"
+
+int main(int argc, char * argv[]) {
+
+	// input parameters
+	double cpmg_freq = argc > 1 ? atof(argv[1]) : 4.3; // MHz, the nmr system pll runs at 16 * cpmg_freq
+	unsigned int number_of_iteration = argc > 2 ? atoi(argv[2]) : 200;
+
+	pll_reconfig_emu ref_pll;
+	void *ref_pll_addr = calloc(1, NMR_SYS_PLL_RECONFIG_SPAN);
+	uint32_t pll_param[TOTAL_PLL_PARAM];
+	struct timespec t_start, t_end;
+	double t_uncached, t_cached, t_calc, t_memo;
+	double freq;
+	unsigned long fails = 0;
+	unsigned long mismatch = 0;
+	unsigned long starts, resets;
+	unsigned int n;
+
+	mmap_sim_peripherals(100000);
+	pll_reconfig_emu_attach(&ref_pll, ref_pll_addr);
+
+	// the loaded registers against the ones of Set_PLL over the cpmg frequencies of 1 to 10 MHz
+	for (freq = 16; freq <= 160; freq += 16 * 0.0173) {
+		set_nmr_sys_pll(freq);
+		Set_PLL(ref_pll_addr, 0, freq, 0.5, DISABLE_MESSAGE);
+		if (sim_nmr_pll.n != ref_pll.n || sim_nmr_pll.m != ref_pll.m || sim_nmr_pll.mfrac != ref_pll.mfrac
+				|| sim_nmr_pll.c[0] != ref_pll.c[0]) {
+			mismatch++;
+		}
+	}
+	printf("settings compared with Set_PLL : %lu mismatches\n", mismatch);
+	fails += mismatch != 0;
+
+	// the same clock on every scan
+	freq = 16 * cpmg_freq;
+	starts = sim_nmr_pll.starts;
+	resets = sim_nmr_fsm.pll_resets;
+	clock_gettime(CLOCK_MONOTONIC, &t_start);
+	for (n = 0; n < number_of_iteration; n++) {
+		Set_PLL(h2p_nmr_sys_pll_addr, 0, freq, 0.5, DISABLE_MESSAGE);
+		Reset_PLL(h2p_ctrl_out_addr, PLL_NMR_SYS_RST_ofst, ctrl_out);
+		reg_shadow_forget(&fpga_shadow, h2p_ctrl_out_addr); // written by Reset_PLL
+		Wait_PLL_To_Lock(h2p_ctrl_in_addr, PLL_NMR_SYS_lock_ofst);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t_end);
+	t_uncached = ((t_end.tv_sec - t_start.tv_sec) * 1e6 + (t_end.tv_nsec - t_start.tv_nsec) * 1e-3) / number_of_iteration;
+	printf("without the cache : %7.2f us per scan, %lu reconfigurations, %lu pll resets\n", t_uncached,
+			sim_nmr_pll.starts - starts, sim_nmr_fsm.pll_resets - resets);
+
+	pll_cache_invalidate(&nmr_pll_cache, h2p_nmr_sys_pll_addr); // Set_PLL was called outside of the cache
+	starts = sim_nmr_pll.starts;
+	resets = sim_nmr_fsm.pll_resets;
+	clock_gettime(CLOCK_MONOTONIC, &t_start);
+	for (n = 0; n < number_of_iteration; n++) {
+		set_nmr_sys_pll(freq);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t_end);
+	t_cached = ((t_end.tv_sec - t_start.tv_sec) * 1e6 + (t_end.tv_nsec - t_start.tv_nsec) * 1e-3) / number_of_iteration;
+	printf("with the cache    : %7.2f us per scan, %lu reconfigurations, %lu pll resets\n", t_cached,
+			sim_nmr_pll.starts - starts, sim_nmr_fsm.pll_resets - resets);
+	fails += sim_nmr_pll.starts - starts != 1 || sim_nmr_fsm.pll_resets - resets != 1;
+	fails += fabs(pll_reconfig_emu_freq(&sim_nmr_pll, 0, INPUT_FREQ) - freq) > 1e-6 * freq;
+
+	// another counter at another frequency changes M and N under counter 0, so counter 0 has to be set again
+	pll_cache_set(&nmr_pll_cache, h2p_nmr_sys_pll_addr, 1, 16 * (cpmg_freq + 0.5), 0.5, DISABLE_MESSAGE);
+	starts = sim_nmr_pll.starts;
+	set_nmr_sys_pll(freq);
+	printf("counter 0 after counter 1 changed M/N : %s\n", sim_nmr_pll.starts - starts == 1 ? "reprogrammed" : "NOT REPROGRAMMED");
+	fails += sim_nmr_pll.starts - starts != 1;
+
+	// a reconfiguration that does not finish
+	sim_nmr_pll.stuck = 1;
+	n = set_nmr_sys_pll(16 * (cpmg_freq + 0.25));
+	sim_nmr_pll.stuck = 0;
+	starts = sim_nmr_pll.starts;
+	n = !n && set_nmr_sys_pll(16 * (cpmg_freq + 0.25)) && sim_nmr_pll.starts - starts == 1;
+	printf("reconfiguration timeout : %s\n", n ? "failed and set again" : "NOT HANDLED");
+	fails += !n;
+	set_nmr_sys_pll(freq);
+
+	// the counter search alone
+	clock_gettime(CLOCK_MONOTONIC, &t_start);
+	for (n = 0; n < number_of_iteration; n++) {
+		pll_calculator(pll_param, freq, INPUT_FREQ);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t_end);
+	t_calc = ((t_end.tv_sec - t_start.tv_sec) * 1e6 + (t_end.tv_nsec - t_start.tv_nsec) * 1e-3) / number_of_iteration;
+	clock_gettime(CLOCK_MONOTONIC, &t_start);
+	for (n = 0; n < number_of_iteration; n++) {
+		pll_cache_calc(&nmr_pll_cache, pll_param, freq);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t_end);
+	t_memo = ((t_end.tv_sec - t_start.tv_sec) * 1e6 + (t_end.tv_nsec - t_start.tv_nsec) * 1e-3) / number_of_iteration;
+	printf("pll_calculator : %.3f us, from the memo : %.3f us\n", t_calc, t_memo);
+
+	pll_cache_print_stat(&nmr_pll_cache);
+	printf("pll cache : %s\n", fails == 0 ? "PASSED" : "FAILED");
+
+	munmap_sim_peripherals();
+	free(ref_pll_addr);
+	return fails != 0;
+}
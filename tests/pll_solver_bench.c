@@ -0,0 +1,60 @@
+// PLL solver equivalence and throughput benchmark, runs without the FPGA
+// pll_calculator against the exhaustive search it replaces, for every frequency of a fine sweep: the cpmg frequencies
+// of 1 to 10 MHz and the nmr system pll clocks of 16 to 160 MHz
+
+#define HPS_LINUX_NO_MAIN
+#include "../hps_linux.c"
+
+int main(int argc, char * argv[]) {
+
+	// input parameters
+	double step = argc > 1 ? atof(argv[1]) : 0.0001; // MHz, the sweep step of the cpmg frequency
+
+	double range[][2] = { { 1, 10 }, { 16, 160 } }; // MHz
+	double scale[] = { 1, 16 }; // the step of the range, in steps of the cpmg frequency
+	uint32_t fast[TOTAL_PLL_PARAM], ref[TOTAL_PLL_PARAM];
+	struct timespec t_start, t_end;
+	double t_fast, t_ref, freq;
+	unsigned long num_of_freq, mismatch, not_found, k;
+	unsigned long fails = 0;
+	unsigned int ok_fast, ok_ref;
+	unsigned int r;
+
+	printf("range [MHz]   frequencies   not found   mismatches   exhaustive [calls/s]   closed form [calls/s]   speed-up\n");
+	for (r = 0; r < 2; r++) {
+		num_of_freq = (unsigned long) ((range[r][1] - range[r][0]) / (step * scale[r])) + 1;
+		mismatch = 0;
+		not_found = 0;
+		for (k = 0; k < num_of_freq; k++) {
+			freq = range[r][0] + k * step * scale[r];
+			ok_fast = pll_calculator(fast, freq, INPUT_FREQ);
+			ok_ref = pll_calculator_exhaustive(ref, freq, INPUT_FREQ);
+			not_found += !ok_ref;
+			if (ok_fast != ok_ref || (ok_ref && memcmp(fast, ref, sizeof(fast)) != 0)) {
+				if (mismatch++ < 10) {
+					printf("%.6f MHz: N %u M %u C %u MFRAC %u instead of N %u M %u C %u MFRAC %u\n", freq,
+							fast[N_COUNTER_ADDR], fast[M_COUNTER_ADDR], fast[C_COUNTER_ADDR], fast[M_FRAC_ADDR],
+							ref[N_COUNTER_ADDR], ref[M_COUNTER_ADDR], ref[C_COUNTER_ADDR], ref[M_FRAC_ADDR]);
+				}
+			}
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &t_start);
+		for (k = 0; k < num_of_freq; k++) {
+			pll_calculator_exhaustive(ref, range[r][0] + k * step * scale[r], INPUT_FREQ);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t_end);
+		t_ref = (t_end.tv_sec - t_start.tv_sec) + (t_end.tv_nsec - t_start.tv_nsec) * 1e-9;
+		clock_gettime(CLOCK_MONOTONIC, &t_start);
+		for (k = 0; k < num_of_freq; k++) {
+			pll_calculator(fast, range[r][0] + k * step * scale[r], INPUT_FREQ);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t_end);
+		t_fast = (t_end.tv_sec - t_start.tv_sec) + (t_end.tv_nsec - t_start.tv_nsec) * 1e-9;
+
+		printf("%5.1f - %5.1f   %11lu   %9lu   %10lu   %20.0f   %21.0f   %7.1fx\n", range[r][0], range[r][1], num_of_freq,
+				not_found, mismatch, num_of_freq / t_ref, num_of_freq / t_fast, t_ref / t_fast);
+		fails += mismatch;
+	}
+	return fails != 0;
+}
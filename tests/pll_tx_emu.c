@@ -0,0 +1,88 @@
+// PLL transaction against the simulated reconfig block, runs without the FPGA
+// the analyzer pll setup of tx_sampling, once with single Set_PLL and Set_DPS calls and once with a pll transaction,
+// each on its own simulated reconfig block. The loaded counters and phases must be the same, the bus traffic is compared
+
+#define HPS_LINUX_NO_MAIN
+#include "../hps_linux.c"
+
+int main(int argc, char * argv[]) {
+
+	// input parameters
+	double freq_start = argc > 1 ? atof(argv[1]) : 1; // MHz
+	double freq_stop = argc > 2 ? atof(argv[2]) : 10;
+	double freq_step = argc > 3 ? atof(argv[3]) : 0.01;
+
+	void *single_addr = calloc(1, NMR_SYS_PLL_RECONFIG_SPAN); // the analyzer pll is not in this FPGA design, its reconfig block is the same IP
+	void *tx_addr = calloc(1, NMR_SYS_PLL_RECONFIG_SPAN);
+	pll_reconfig_emu single_pll, tx_pll;
+	unsigned long single_writes = 0, single_polls = 0, single_starts = 0;
+	unsigned long tx_writes = 0, tx_polls = 0, tx_starts = 0;
+	unsigned long num_of_freq = 0, mismatch = 0, wrong_phase = 0;
+	unsigned int phase[4] = { 0, 90, 180, 270 };
+	double freq;
+	unsigned int k;
+
+	pll_reconfig_emu_attach(&single_pll, single_addr);
+	pll_reconfig_emu_attach(&tx_pll, tx_addr);
+	sim_bus_en = 1;
+	PLL_Tx_Init(&pll_tx_analyzer, tx_addr);
+
+	for (freq = freq_start; freq <= freq_stop; freq += freq_step) {
+		num_of_freq++;
+		pll_reconfig_emu_clear_stat(&single_pll);
+		pll_reconfig_emu_clear_stat(&tx_pll);
+		for (k = 0; k < 4; k++) { // the pll reset between the counters and the phases
+			single_pll.phase_steps[k] = 0;
+			tx_pll.phase_steps[k] = 0;
+		}
+
+		// as tx_sampling did before
+		for (k = 0; k < 4; k++) {
+			Set_PLL(single_addr, k, freq, 0.5, DISABLE_MESSAGE);
+		}
+		for (k = 0; k < 4; k++) {
+			Set_DPS(single_addr, k, phase[k], DISABLE_MESSAGE);
+		}
+
+		// as tx_sampling does now
+		PLL_Tx_Init(&pll_tx_analyzer, tx_addr);
+		for (k = 0; k < 4; k++) {
+			PLL_Tx_Set_PLL(&pll_tx_analyzer, k, freq, 0.5);
+		}
+		PLL_Tx_Commit(&pll_tx_analyzer, DISABLE_MESSAGE);
+		PLL_Tx_Begin(&pll_tx_analyzer);
+		for (k = 0; k < 4; k++) {
+			PLL_Tx_Set_DPS(&pll_tx_analyzer, k, phase[k]);
+		}
+		PLL_Tx_Commit(&pll_tx_analyzer, DISABLE_MESSAGE);
+
+		if (single_pll.n != tx_pll.n || single_pll.m != tx_pll.m || single_pll.mfrac != tx_pll.mfrac) {
+			mismatch++;
+		}
+		for (k = 0; k < 4; k++) {
+			mismatch += single_pll.c[k] != tx_pll.c[k] || single_pll.phase_steps[k] != tx_pll.phase_steps[k];
+			wrong_phase += fabs(pll_reconfig_emu_phase(&tx_pll, k) - phase[k]) > 360.0 / (8 * pll_reconfig_emu_div(tx_pll.c[k]));
+		}
+		single_writes += single_pll.writes;
+		single_polls += single_pll.polls;
+		single_starts += single_pll.starts;
+		tx_writes += tx_pll.writes;
+		tx_polls += tx_pll.polls;
+		tx_starts += tx_pll.starts;
+	}
+
+	printf("%lu frequencies: %lu mismatches against single calls, %lu phases off by more than a step\n",
+			num_of_freq, mismatch, wrong_phase);
+	printf("per setup      : single calls %.1f writes, %.1f reconfigurations, %.1f status polls\n",
+			(double) single_writes / num_of_freq, (double) single_starts / num_of_freq, (double) single_polls / num_of_freq);
+	printf("                 transaction  %.1f writes, %.1f reconfigurations, %.1f status polls\n",
+			(double) tx_writes / num_of_freq, (double) tx_starts / num_of_freq, (double) tx_polls / num_of_freq);
+	PLL_Tx_Print_Stat(&pll_tx_analyzer); // the last setup
+	printf("pll transaction : %s\n", mismatch == 0 && wrong_phase == 0 ? "PASSED" : "FAILED");
+
+	sim_bus_en = 0;
+	sim_bus_unmap_all();
+	free(single_addr);
+	free(tx_addr);
+	return mismatch != 0 || wrong_phase != 0;
+}
@@ -0,0 +1,99 @@
+// Register shadow against a simulated register file, runs without the FPGA
+// a random mix of writes, ctrl_out bit flips, reads and writes behind the shadow runs twice on a register file that
+// counts the bus transactions, without and with the shadow: the registers must always hold what was written, and the
+// shadow must save exactly the transactions it reports. Then the same CPMG_iterate runs without and with the shadow
+// on the simulated sequencer
+
+#define HPS_LINUX_NO_MAIN
+#include "../hps_linux.c"
+
+int main(int argc, char * argv[]) {
+
+	// input parameters
+	unsigned long number_of_ops = argc > 1 ? atol(argv[1]) : 100000;
+	unsigned int number_of_iteration = argc > 2 ? atoi(argv[2]) : 20;
+	double fill_rate = argc > 3 ? atof(argv[3]) : 200000; // fifo fill rate in words per second
+
+	reg_file_emu rf[REG_SHADOW_MAX];
+	uint32_t ref[REG_SHADOW_MAX];
+	unsigned long bus[2], per_scan[2];
+	unsigned long wrong_regs = 0, wrong_reads = 0, saved = 0, fails = 0;
+	unsigned long n;
+	unsigned int k, reg, run;
+	uint32_t val;
+	int op;
+
+	// the random accesses
+	h2f_lw_axi_master = calloc(1, h2f_lw_axi_master_span);
+	set_fpga_peripheral_addr();
+	for (run = 0; run < 2; run++) { // 0: write through, 1: shadowed
+		sim_bus_unmap_all();
+		memset((void *) h2f_lw_axi_master, 0, h2f_lw_axi_master_span);
+		for (k = 0; k < fpga_shadow.num; k++) {
+			reg_file_emu_attach(&rf[k], fpga_shadow.reg[k].addr, 1);
+			ref[k] = 0;
+		}
+		sim_bus_en = 1;
+		reg_shadow_forget_all(&fpga_shadow);
+		reg_shadow_clear_stat(&fpga_shadow);
+		fpga_shadow.en = run;
+		srand(1);
+		for (n = 0; n < number_of_ops; n++) {
+			op = rand() % 10;
+			reg = rand() % fpga_shadow.num;
+			val = rand() % 4; // few values, so that many writes repeat the one the register holds
+			if (op < 4) {
+				reg_shadow_write(&fpga_shadow, fpga_shadow.reg[reg].addr, val);
+				ref[reg] = val;
+			} else if (op < 7) { // the read-modify-write of a ctrl_out bit
+				val = reg_shadow_read(&fpga_shadow, h2p_ctrl_out_addr) ^ (0x01 << (rand() % 11));
+				reg_shadow_write(&fpga_shadow, h2p_ctrl_out_addr, val);
+				ref[0] = val;
+			} else if (op < 8) { // someone else writes the register, as Reset_PLL does
+				bus_write_word(fpga_shadow.reg[reg].addr, val);
+				reg_shadow_forget(&fpga_shadow, fpga_shadow.reg[reg].addr);
+				ref[reg] = val;
+			} else {
+				wrong_reads += reg_shadow_read(&fpga_shadow, fpga_shadow.reg[reg].addr) != ref[reg];
+			}
+			for (k = 0; k < fpga_shadow.num; k++) {
+				wrong_regs += rf[k].mem[0] != ref[k];
+			}
+		}
+		bus[run] = 0;
+		for (k = 0; k < fpga_shadow.num; k++) {
+			bus[run] += rf[k].reads + rf[k].writes;
+		}
+		saved = fpga_shadow.writes_elided + fpga_shadow.reads_elided;
+		reg_shadow_print_stat(&fpga_shadow, 0);
+	}
+	sim_bus_en = 0;
+	sim_bus_unmap_all();
+	free(h2f_lw_axi_master);
+	printf("%lu random accesses: %lu bus transactions written through, %lu shadowed (%lu saved as reported: %s)\n",
+			number_of_ops, bus[0], bus[1], saved, bus[0] - bus[1] == saved ? "yes" : "NO");
+	printf("wrong register values: %lu, wrong reads: %lu\n", wrong_regs, wrong_reads);
+	fails += wrong_regs != 0 || wrong_reads != 0 || bus[0] - bus[1] != saved;
+
+	// the scans on the simulated sequencer
+	mmap_sim_peripherals(fill_rate);
+	init_default_system_param();
+	adc_read_mode = READ_FIFO_AFTER_SEQ;
+	for (run = 0; run < 2; run++) {
+		fpga_shadow.en = run;
+		reg_shadow_forget_all(&fpga_shadow);
+		sim_nmr_fsm.starts = 0;
+		hw_wait_clear(&wait_nmr_seq_site);
+		sleep(run); // the measurement folders are named by the second
+		CPMG_iterate(4.3, 5, 10, 0.5, 0.5, 200, 0, 20, 100, 0, number_of_iteration, ENABLE);
+		per_scan[run] = (fpga_shadow.bus_writes + fpga_shadow.bus_reads) / number_of_iteration;
+		fails += sim_nmr_fsm.starts != number_of_iteration || wait_nmr_seq_site.timeouts != 0
+				|| reg_shadow_check(&fpga_shadow) != 0;
+	}
+	printf("register bus transactions per scan: %lu written through, %lu shadowed\n", per_scan[0], per_scan[1]);
+	fails += per_scan[1] >= per_scan[0];
+	printf("register shadow : %s\n", fails == 0 ? "PASSED" : "FAILED");
+
+	munmap_sim_peripherals();
+	return fails != 0;
+}
@@ -0,0 +1,70 @@
+// Real-time profile against the simulated sequencer, runs without the FPGA
+// the same scheduled CPMG_iterate run without and with the real-time profile, with the worst-case wakeup latency of the
+// sequence waits of both. Without CAP_SYS_NICE or CAP_IPC_LOCK the profile only does what it is allowed to. Afterwards
+// the thread must be back to its scheduling and may run on every core again, and a capture arena that was locked must
+// still be locked (munlockall drops its mlock)
+
+#define HPS_LINUX_NO_MAIN
+#include "../hps_linux.c"
+
+// VmLck of /proc/self/status in KiB, -1 if it cannot be read
+static long locked_kib () {
+	char line[128];
+	long kib = -1;
+	FILE *f = fopen("/proc/self/status", "r");
+
+	if (f == NULL) {
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (sscanf(line, "VmLck: %ld", &kib) == 1) {
+			break;
+		}
+	}
+	fclose(f);
+	return kib;
+}
+
+int main(int argc, char * argv[]) {
+
+	// input parameters
+	int priority = argc > 1 ? atoi(argv[1]) : 80;
+	unsigned int number_of_iteration = argc > 2 ? atoi(argv[2]) : 20;
+	double fill_rate = argc > 3 ? atof(argv[3]) : 50000; // fifo fill rate in words per second, a scan takes 20 ms
+
+	struct sched_param param;
+	double late_us[2];
+	unsigned long fails = 0;
+	int policy;
+	int run;
+	long kib;
+
+	mmap_sim_peripherals(fill_rate);
+	init_default_system_param();
+	adc_read_mode = READ_FIFO_AFTER_SEQ;
+	scan_period_us = 40000;
+
+	for (run = 0; run < 2; run++) { // 0: ordinary process, 1: real-time profile
+		adc_rt.priority = run == 0 ? 0 : priority;
+		hw_wait_clear(&wait_nmr_seq_site);
+		sleep(run); // the measurement folders are named by the second
+		CPMG_iterate(4.3, 5, 10, 0.5, 0.5, 200, 0, 20, 100, 0, number_of_iteration, ENABLE);
+		late_us[run] = wait_nmr_seq_site.max_late_ns * 1e-3;
+		fails += wait_nmr_seq_site.waits != number_of_iteration || wait_nmr_seq_site.timeouts != 0;
+	}
+	printf("worst-case wakeup latency of the sequence waits: %.1f us as an ordinary process, %.1f us with the profile\n",
+			late_us[0], late_us[1]);
+
+	pthread_getschedparam(pthread_self(), &policy, &param);
+	printf("after the run : %s, %d cores\n", policy == SCHED_OTHER ? "SCHED_OTHER" : "STILL REAL-TIME", rt_profile_cores());
+	fails += policy != SCHED_OTHER || rt_profile_cores() != sysconf(_SC_NPROCESSORS_ONLN);
+	kib = locked_kib();
+	if (adc_arena.locked) {
+		printf("capture arena : %lu KiB, %ld KiB locked\n", (unsigned long) (adc_arena.size >> 10), kib);
+		fails += kib >= 0 && (unsigned long) kib < (adc_arena.size >> 10);
+	}
+	printf("real-time profile : %s\n", fails == 0 ? "PASSED" : "FAILED");
+
+	munmap_sim_peripherals();
+	return fails != 0;
+}
@@ -0,0 +1,124 @@
+// Matching network autotuner against a model network, runs without the FPGA
+// a model of the network with its optimum away from the tables is tuned from the tables, then again from the cache
+// (one measurement), then after the optimum drifted (a narrow search from the cache). The tuned points must be within
+// a relay step and 0.05 V of the optimum, with far fewer measurements than a sweep. The board tuning is run against the
+// simulated backend: the analyzer pll must be programmed once, the receiver switched to the directional coupler during
+// the tuning and back after it, and no data file written. Without the analyzer pll the tuning must fail
+
+#include <dirent.h>
+
+#define HPS_LINUX_NO_MAIN
+#include "../hps_linux.c"
+
+typedef struct {
+	double opt[S11_TUNER_DIM];
+	unsigned int sets;
+	unsigned int bad_sets;
+} match_model;
+
+static double model_x[S11_TUNER_DIM];
+
+static void model_set(void *ctx, const double *x) {
+	match_model *m = (match_model *) ctx;
+
+	m->sets++;
+	m->bad_sets += x[0] != floor(x[0]) || x[1] != floor(x[1]) || x[0] < 0 || x[0] > 255 || x[1] < 0 || x[1] > 255
+			|| fabs(x[2]) > 5;
+	memcpy(model_x, x, sizeof(model_x));
+}
+
+// |reflection| of the model: a tilted bowl (the capacitors interact) on a floor of 0.01
+static double model_measure(void *ctx, double freq) {
+	match_model *m = (match_model *) ctx;
+	double a = (model_x[0] - m->opt[0]) / 20, b = (model_x[1] - m->opt[1]) / 25, v = (model_x[2] - m->opt[2]) / 0.8;
+
+	return sqrt(a * a + b * b + v * v + 0.8 * a * b + 0.4 * b * v + 1e-4);
+}
+
+static int model_check(const char *name, match_model *m, double freq, unsigned int max_evals) {
+	s11_tuner_io io = { model_set, model_measure, m };
+	double refl = tune_board(freq, &io, "s11_cache.txt");
+	int bad = fabs(s11_tune.best[0] - m->opt[0]) > 1 || fabs(s11_tune.best[1] - m->opt[1]) > 1
+			|| fabs(s11_tune.best[2] - m->opt[2]) > 0.05 || s11_tune.evals > max_evals || m->bad_sets > 0
+			|| memcmp(model_x, s11_tune.best, sizeof(model_x)) != 0 || !isfinite(refl);
+
+	printf("\t%s: %u measurements (at most %u), %s\n", name, s11_tune.evals, max_evals, bad ? "FAILED" : "ok");
+	return bad;
+}
+
+int main(int argc, char * argv[]) {
+	s11_tuner_table tbl = { mtch_ntwrk_freq_sta, mtch_ntwrk_freq_spa, cpar_tbl, cser_tbl,
+		sizeof(cpar_tbl) / sizeof(cpar_tbl[0]), vvarac_freq_sta, vvarac_freq_spa, vvarac_tbl,
+				sizeof(vvarac_tbl) / sizeof(vvarac_tbl[0]) };
+	match_model m;
+	s11_tuner_cache cache;
+	s11_tuner_io board_io = { s11_set_network, s11_measure, NULL };
+	double start[S11_TUNER_DIM], refl;
+	unsigned long fails = 0;
+	unsigned long starts;
+	uint32_t rx_sel;
+	void *analyzer_pll_addr;
+	DIR *dir;
+	struct dirent *ent;
+	unsigned int files = 0;
+
+	remove("s11_cache.txt");
+	memset(&m, 0, sizeof(m));
+	s11_tuner_table_start(&tbl, 4.3, start);
+	m.opt[0] = round(start[0]) + 13;
+	m.opt[1] = round(start[1]) - 9;
+	m.opt[2] = start[2] + 0.6;
+	printf("tables at 4.3 MHz: cshunt %.1f, cseries %.1f, vvarac %.3f V (a sweep of the relays: 65536 measurements)\n",
+			start[0], start[1], start[2]);
+	fails += model_check("from the tables", &m, 4.3, 100);
+	fails += model_check("from the cache", &m, 4.3, 1);
+	m.opt[0] += 3;
+	m.opt[1] -= 2;
+	m.opt[2] += 0.1;
+	fails += model_check("from the cache, drifted", &m, 4.3, 40);
+	s11_tuner_table_start(&tbl, 4.1, start);
+	m.opt[0] = round(start[0]) - 20;
+	m.opt[1] = round(start[1]) + 12;
+	m.opt[2] = start[2] - 0.4;
+	fails += model_check("another frequency", &m, 4.1, 100);
+
+	s11_tuner_cache_load(&cache, "s11_cache.txt");
+	fails += cache.num != 2 || cache.e[0].freq > cache.e[1].freq || s11_tuner_cache_find(&cache, 4.3) == NULL;
+	s11_tuner_cache_free(&cache);
+
+	setenv(SIM_BACKEND_ENV, "0", 1);
+	open_fpga_backend();
+	init_default_system_param();
+	fails += !init_i2c_expanders() || !init_dac_ad5722r();
+	create_measurement_folder("s11");
+	remove("s11_board.txt");
+	s11_num_of_samples = 256;
+	rx_sel = ctrl_i2c & (RX_IN_SEL_1_msk | RX_IN_SEL_2_msk);
+	starts = sim_analyzer_pll.starts;
+	refl = tune_board(4.3, &board_io, "s11_board.txt");
+	dir = opendir(foldername);
+	while (dir != NULL && (ent = readdir(dir)) != NULL) {
+		files += strncmp(ent->d_name, "s11", 3) == 0;
+	}
+	if (dir != NULL) {
+		closedir(dir);
+	}
+	printf("\ts11 path on the simulated backend: %.3g ADC counts after %u measurements, %lu analyzer pll "
+			"reconfigurations, %u data files, receiver input %s\n", refl, s11_tune.evals,
+			sim_analyzer_pll.starts - starts, files,
+			(ctrl_i2c & (RX_IN_SEL_1_msk | RX_IN_SEL_2_msk)) == rx_sel ? "restored" : "NOT RESTORED");
+	fails += !isfinite(refl) || sim_analyzer_pll.starts - starts != 2 || files != 0
+			|| (ctrl_i2c & (RX_IN_SEL_1_msk | RX_IN_SEL_2_msk)) != rx_sel;
+
+	analyzer_pll_addr = h2p_analyzer_pll_addr; // as on the FPGA
+	h2p_analyzer_pll_addr = NULL;
+	refl = tune_board(4.3, &board_io, "s11_board.txt");
+	h2p_analyzer_pll_addr = analyzer_pll_addr;
+	printf("\twithout the analyzer pll: %s\n", refl == HUGE_VAL ? "not tuned" : "TUNED");
+	fails += refl != HUGE_VAL || (ctrl_i2c & (RX_IN_SEL_1_msk | RX_IN_SEL_2_msk)) != rx_sel;
+	close_system();
+	close_fpga_backend();
+
+	printf("s11 tuner : %s\n", fails == 0 ? "PASSED" : "FAILED");
+	return fails != 0;
+}
@@ -0,0 +1,86 @@
+// On-line accumulation against the emulated fifo, runs without the FPGA
+// the emulated fifo produces a known triangle echo around the ADC mid scale whose sign alternates with the phase cycling,
+// the sums must be exactly number_of_iteration * echo, the offset cancels between the two phases
+
+#define HPS_LINUX_NO_MAIN
+#include "../hps_linux.c"
+
+int main(int argc, char * argv[]) {
+
+	// input parameters
+	double fill_rate = argc > 1 ? atof(argv[1]) : 200000; // fifo fill rate in words per second (one word holds 2 samples)
+	unsigned int samples_per_echo = argc > 2 ? atoi(argv[2]) : 100;
+	unsigned int echoes_per_scan = argc > 3 ? atoi(argv[3]) : 500;
+	unsigned int number_of_iteration = argc > 4 ? atoi(argv[4]) : 10; // even, so that both phases are added equally often
+	if (argc > 5) {
+		data_file_format = atoi(argv[5]); // 0 writes text files, 1 writes binary scan files
+	}
+
+	unsigned long num_of_words = ((unsigned long) samples_per_echo * echoes_per_scan) >> 1;
+	fifo_emu_echo_sig sig = { samples_per_echo, 8192, 1000, 0 };
+	scan_file_header hdr;
+	char path[200];
+	void *data;
+	int64_t expected;
+	unsigned long wrong_sums = 0;
+	unsigned long k;
+	unsigned int iterate;
+	int fails;
+	fifo_emu emu;
+
+	// plain memory stands in for the lightweight bridge, the fifo and ctrl_in are handled by the emulator
+	h2f_lw_axi_master = calloc(1, h2f_lw_axi_master_span);
+	h2p_ctrl_in_addr = h2f_lw_axi_master + CTRL_IN_BASE;
+	h2p_adc_fifo_addr = h2f_lw_axi_master + ADC_FIFO_MEM_OUT_BASE;
+	h2p_adc_fifo_status_addr = h2f_lw_axi_master + ADC_FIFO_MEM_IN_CSR_BASE;
+	fifo_event_init_poll(&adc_event, h2p_adc_fifo_status_addr);
+
+	fifo_emu_init(&emu, ADC_FIFO_MEM_OUT_FIFO_DEPTH, fill_rate);
+	fifo_emu_attach(&emu, h2p_adc_fifo_addr, (void *) h2p_adc_fifo_status_addr, h2p_ctrl_in_addr);
+	fifo_emu_set_gen(&emu, fifo_emu_echo, &sig);
+	sim_bus_en = 1;
+
+	create_measurement_folder("accum");
+	scan_file_init_header(&scan_hdr, 4, 16, 64);
+	scan_accum_init(&adc_accum, samples_per_echo, echoes_per_scan);
+	for (iterate = 1; iterate <= number_of_iteration; iterate++) {
+		sig.negate = iterate & 0x01; // the phase cycling inverts every other scan, as PHASE_CYCLING in CPMG_Sequence
+		scan_hdr.ph_cycl = SCAN_PH_CYCL_EN | (sig.negate ? SCAN_PH_CYCL_STATE : 0);
+		fifo_emu_start(&emu, num_of_words);
+		CPMG_stream_readout(samples_per_echo, echoes_per_scan, "dat", "avg"); // the scan goes to the accumulator
+		if (iterate == number_of_iteration / 2) {
+			scan_accum_fold(&adc_accum); // as after SCAN_ACCUM_FOLD_SCANS scans
+		}
+	}
+	scan_accum_write(&adc_accum, &scan_hdr, data_file_format, foldername, "dat_sum", "avg_sum");
+
+	for (k = 0; k < num_of_words * 2; k++) {
+		expected = (int64_t) number_of_iteration * fifo_emu_echo_shape(&sig, k % samples_per_echo)
+				+ ((int64_t) adc_accum.scans - 2 * (int64_t) adc_accum.scans_negated) * sig.offset;
+		wrong_sums += (adc_accum.sum[k] != expected);
+	}
+	if (data_file_format == DATA_FILE_BIN) { // the file holds the same sums
+		snprintf(path, sizeof(path), "%s/dat_sum%s", foldername, SCAN_FILE_EXT);
+		if (scan_file_read(path, &hdr, &data)) {
+			for (k = 0; k < adc_accum.num_of_samples; k++) {
+				wrong_sums += (scan_file_sample(&hdr, data, k) != adc_accum.sum[k]);
+			}
+			wrong_sums += (hdr.num_of_scans != number_of_iteration);
+			free(data);
+		} else {
+			wrong_sums++;
+		}
+	}
+	printf("scans: %lu (%lu subtracted), dropped words: %lu, wrong sums: %lu\n", adc_accum.scans,
+			adc_accum.scans_negated, (unsigned long) emu.dropped, wrong_sums);
+	fails = adc_accum.scans != number_of_iteration || wrong_sums != 0;
+	printf("on-line accumulation : %s\n", fails == 0 ? "MATCHED" : "NOT MATCHED");
+
+	scan_accum_free(&adc_accum);
+	sim_bus_en = 0;
+	sim_bus_unmap_all();
+	fifo_emu_free(&emu);
+	fifo_ring_free(&adc_ring);
+	free(h2f_lw_axi_master);
+	return fails;
+}
@@ -0,0 +1,77 @@
+// Scan scheduler against a fake clock and the simulated sequencer, runs without the FPGA
+// the scheduling alone on a fake clock, with the work between the starts drawn at random and every 7th scan overrunning
+// its period: every start must be on the grid or, after an overrun, right away. Then CPMG_iterate on the simulated
+// backend, once with scan_spacing_us in front of every scan and once scheduled at the same period
+
+#define HPS_LINUX_NO_MAIN
+#include "../hps_linux.c"
+
+int main(int argc, char * argv[]) {
+
+	// input parameters
+	unsigned int period_us = argc > 1 ? atoi(argv[1]) : 50000;
+	unsigned int number_of_iteration = argc > 2 ? atoi(argv[2]) : 20;
+	double fill_rate = argc > 3 ? atof(argv[3]) : 200000; // fifo fill rate in words per second, a scan takes 12.5 ms
+
+	unsigned int samples_per_echo = 100;
+	unsigned int echoes_per_scan = 50;
+	uint64_t fake_t = 1000000000;
+	uint64_t period_ns = (uint64_t) period_us * 1000;
+	uint64_t work_ns, t_prev = 0, work_prev = 0, expected;
+	scan_clock fake;
+	scan_sched sched;
+	struct timespec t_start, t_end;
+	double run_ms[2], jitter_us, jitter_max_us = 0;
+	unsigned long fails = 0, overruns = 0, wrong_starts = 0, scans = 0;
+	unsigned int n, run;
+	char path[200];
+	FILE *f;
+
+	// the scheduling on the fake clock
+	scan_clock_fake(&fake, &fake_t);
+	scan_sched_init(&sched, &fake, period_ns, 1000);
+	srand(1);
+	for (n = 0; n < 1000; n++) {
+		scan_sched_wait(&sched);
+		scan_sched_started(&sched);
+		expected = n == 0 ? fake_t : t_prev + (work_prev > period_ns ? work_prev : period_ns);
+		wrong_starts += fake_t != expected;
+		work_ns = n % 7 == 6 ? period_ns * 3 / 2 : period_ns / 5 + (uint64_t) rand() % (period_ns * 7 / 10);
+		overruns += work_ns > period_ns;
+		t_prev = fake_t;
+		work_prev = work_ns;
+		fake_t += work_ns; // the readout and the file writing
+	}
+	scan_sched_print_stat(&sched);
+	printf("fake clock : %lu starts off the schedule, %lu overruns (%lu expected)\n", wrong_starts, sched.overruns, overruns);
+	fails += wrong_starts != 0 || sched.overruns != overruns;
+	scan_sched_free(&sched);
+
+	// CPMG_iterate on the simulated backend
+	mmap_sim_peripherals(fill_rate);
+	init_default_system_param();
+	adc_read_mode = READ_FIFO_STREAM;
+	for (run = 0; run < 2; run++) { // 0: scan_spacing_us, 1: scheduled
+		scan_period_us = run == 0 ? 0 : period_us;
+		clock_gettime(CLOCK_MONOTONIC, &t_start);
+		CPMG_iterate(4.3, 5, 10, 0.5, 0.5, 200, period_us, samples_per_echo, echoes_per_scan, 0, number_of_iteration, ENABLE);
+		clock_gettime(CLOCK_MONOTONIC, &t_end);
+		run_ms[run] = ((t_end.tv_sec - t_start.tv_sec) * 1e3 + (t_end.tv_nsec - t_start.tv_nsec) * 1e-6) / number_of_iteration;
+	}
+	snprintf(path, sizeof(path), "%s/scan_jitter.txt", foldername);
+	f = fopen(path, "r");
+	while (f != NULL && fscanf(f, "%lf", &jitter_us) == 1) {
+		jitter_max_us = jitter_us > jitter_max_us ? jitter_us : jitter_max_us;
+		scans++;
+	}
+	if (f != NULL) {
+		fclose(f);
+	}
+	printf("period %.1f ms : with scan_spacing_us %.2f ms per scan, scheduled %.2f ms per scan (max start jitter %.1f us in %lu scans)\n",
+			period_us * 1e-3, run_ms[0], run_ms[1], jitter_max_us, scans);
+	fails += scans != number_of_iteration || run_ms[1] >= run_ms[0];
+	printf("scan scheduler : %s\n", fails == 0 ? "PASSED" : "FAILED");
+
+	munmap_sim_peripherals();
+	return fails != 0;
+}
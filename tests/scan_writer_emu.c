@@ -0,0 +1,117 @@
+// Pipelined scan writing against the emulated fifo, runs without the FPGA
+// the same scans are acquired twice with the streaming readout: once written in line as in CPMG_iterate, once handed to the
+// background writer. Every file of the pipelined run must match the one of the serial run
+
+#define HPS_LINUX_NO_MAIN
+#include "../hps_linux.c"
+
+int main(int argc, char * argv[]) {
+
+	// input parameters
+	double fill_rate = argc > 1 ? atof(argv[1]) : 50000; // fifo fill rate in words per second (one word holds 2 samples), low enough for a single core
+	unsigned int samples_per_echo = argc > 2 ? atoi(argv[2]) : 100;
+	unsigned int echoes_per_scan = argc > 3 ? atoi(argv[3]) : 500;
+	unsigned int number_of_iteration = argc > 4 ? atoi(argv[4]) : 10;
+	long unsigned scan_spacing_us = argc > 5 ? atoi(argv[5]) : 1000;
+	if (argc > 6) {
+		data_file_format = atoi(argv[6]); // 0 writes text files, 1 writes binary scan files
+	}
+
+	unsigned long num_of_words = ((unsigned long) samples_per_echo * echoes_per_scan) >> 1;
+	char serial_folder[50];
+	char name[100], nameavg[100];
+	char path_a[200], path_b[200];
+	struct timespec t_start, t_end;
+	struct timespec t_scan_start, t_scan_end;
+	double run_ms[2];
+	unsigned long wrong_files = 0;
+	unsigned int iterate;
+	int run;
+	int ca, cb;
+	FILE *fa, *fb;
+	fifo_emu emu;
+
+	// plain memory stands in for the lightweight bridge, the fifo and ctrl_in are handled by the emulator
+	h2f_lw_axi_master = calloc(1, h2f_lw_axi_master_span);
+	h2p_ctrl_in_addr = h2f_lw_axi_master + CTRL_IN_BASE;
+	h2p_adc_fifo_addr = h2f_lw_axi_master + ADC_FIFO_MEM_OUT_BASE;
+	h2p_adc_fifo_status_addr = h2f_lw_axi_master + ADC_FIFO_MEM_IN_CSR_BASE;
+	fifo_event_init_poll(&adc_event, h2p_adc_fifo_status_addr);
+
+	fifo_emu_init(&emu, ADC_FIFO_MEM_OUT_FIFO_DEPTH, fill_rate);
+	fifo_emu_attach(&emu, h2p_adc_fifo_addr, (void *) h2p_adc_fifo_status_addr, h2p_ctrl_in_addr);
+	sim_bus_en = 1;
+
+	scan_file_init_header(&scan_hdr, 4, 16, 64);
+	scan_hdr.samples_per_echo = samples_per_echo;
+	scan_hdr.echoes_per_scan = echoes_per_scan;
+
+	for (run = 0; run < 2; run++) { // 0: serial, 1: pipelined
+		create_measurement_folder(run == 0 ? "serial" : "pipelined");
+		if (run == 0) {
+			strcpy(serial_folder, foldername);
+		} else {
+			scan_writer_start(&adc_writer, foldername, data_file_format);
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &t_start);
+		for (iterate = 1; iterate <= number_of_iteration; iterate++) {
+			snprintf(name, sizeof(name), "dat_%03d", iterate);
+			snprintf(nameavg, sizeof(nameavg), "avg_%03d", iterate);
+			usleep(scan_spacing_us); // the repetition delay
+			clock_gettime(CLOCK_MONOTONIC, &t_scan_start);
+			fifo_emu_start(&emu, num_of_words);
+			CPMG_stream_readout(samples_per_echo, echoes_per_scan, name, nameavg);
+			clock_gettime(CLOCK_MONOTONIC, &t_scan_end);
+			if (adc_writer.running) {
+				stage_time_add(&adc_writer.t_acq, &t_scan_start, &t_scan_end);
+			}
+		}
+		if (adc_writer.running) {
+			scan_writer_stop(&adc_writer);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t_end);
+		run_ms[run] = (t_end.tv_sec - t_start.tv_sec) * 1e3 + (t_end.tv_nsec - t_start.tv_nsec) * 1e-6;
+	}
+	scan_writer_print_stat(&adc_writer);
+	capture_arena_print_stat(&adc_arena);
+
+	for (iterate = 1; iterate <= number_of_iteration; iterate++) {
+		for (run = 0; run < 2; run++) { // the raw data, then the echo sum
+			if (run == 0) {
+				snprintf(name, sizeof(name), "dat_%03d%s", iterate, data_file_format == DATA_FILE_BIN ? SCAN_FILE_EXT : "");
+			} else {
+				snprintf(name, sizeof(name), "avg_%03d", iterate);
+			}
+			snprintf(path_a, sizeof(path_a), "%s/%s", serial_folder, name);
+			snprintf(path_b, sizeof(path_b), "%s/%s", foldername, name);
+			fa = fopen(path_a, "rb");
+			fb = fopen(path_b, "rb");
+			if (fa == NULL || fb == NULL) {
+				wrong_files++;
+			} else {
+				do {
+					ca = fgetc(fa);
+					cb = fgetc(fb);
+				} while (ca == cb && ca != EOF);
+				if (ca != cb) {
+					wrong_files++;
+				}
+			}
+			if (fa != NULL)
+				fclose(fa);
+			if (fb != NULL)
+				fclose(fb);
+		}
+	}
+
+	printf("serial: %.3f ms/scan, pipelined: %.3f ms/scan\n", run_ms[0] / number_of_iteration, run_ms[1] / number_of_iteration);
+	printf("pipelined scan writing : %s (%lu wrong files)\n", wrong_files == 0 ? "MATCHED" : "NOT MATCHED", wrong_files);
+
+	sim_bus_en = 0;
+	sim_bus_unmap_all();
+	fifo_emu_free(&emu);
+	fifo_ring_free(&adc_ring);
+	free(h2f_lw_axi_master);
+	return wrong_files != 0;
+}
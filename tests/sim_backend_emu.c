@@ -0,0 +1,78 @@
+// Simulated FPGA backend with timed sequences, runs without the FPGA
+// CPMG_iterate, FID_iterate, noise_iterate and tx_sampling on the simulated backend, the sequences timed from the
+// programmed counts and the PLL models. Every measurement must read all the words of its last sequence, with no
+// overflow, underflow or wait timeout, a CPMG scan must hold the echo train of its phase and must take about as long
+// as its sequence. The same runs on the board with the FPGA backend, so the times are comparable
+
+#define HPS_LINUX_NO_MAIN
+#include "../hps_linux.c"
+
+int main(int argc, char * argv[]) {
+
+	// input parameters
+	unsigned int number_of_iteration = argc > 1 ? atoi(argv[1]) : 10;
+	double echo_spacing_us = argc > 2 ? atof(argv[2]) : 200;
+	unsigned int echoes_per_scan = argc > 3 ? atoi(argv[3]) : 100;
+
+	const char *meas_name[4] = { "CPMG_iterate", "FID_iterate", "noise_iterate", "tx_sampling" };
+	unsigned int samples_per_echo = 20; // the whole scan fits into the fifo, it is read after the sequence
+	struct timespec t0, t1;
+	double run_ms, seq_ms;
+	unsigned long wrong_words = 0, fails = 0, bad;
+	unsigned long k;
+	int meas;
+
+	setenv(SIM_BACKEND_ENV, "0", 1); // timed sequences
+	open_fpga_backend();
+	init_default_system_param();
+	adc_read_mode = READ_FIFO_AFTER_SEQ;
+
+	for (meas = 0; meas < 4; meas++) {
+		hw_wait_clear(&wait_nmr_seq_site);
+		sim_nmr_fsm.starts = 0;
+		sleep(meas > 0); // the measurement folders are named by the second
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		switch (meas) {
+		case 0:
+			CPMG_iterate(4.3, 5, 10, 0.5, 0.5, echo_spacing_us, 0, samples_per_echo, echoes_per_scan, 0,
+					number_of_iteration, ENABLE);
+			// the last scan is still in the arena
+			for (k = 0; k < sim_adc_fifo.total_words; k++) {
+				wrong_words += adc_arena.words[k] != fifo_emu_echo(&sim_nmr_fsm.sig, k);
+			}
+			break;
+		case 1:
+			FID_iterate(4.3, 10, 0.5, 0, 1000, number_of_iteration, DISABLE_MESSAGE);
+			break;
+		case 2:
+			noise_iterate(4.3, 0, 1000, number_of_iteration, DISABLE_MESSAGE);
+			break;
+		case 3:
+			create_measurement_folder("tx_sampling");
+			tx_sampling(4.3, 17.2, 1000, "dat");
+			break;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		run_ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) * 1e-6;
+		seq_ms = sim_nmr_fsm.seq_s * 1e3;
+		bad = sim_adc_fifo.consumed != sim_adc_fifo.total_words || sim_adc_fifo.dropped != 0
+				|| sim_adc_fifo.underflow != 0 || wait_nmr_seq_site.timeouts != 0
+				|| sim_nmr_fsm.starts != (meas == 3 ? 1 : number_of_iteration);
+		printf("%s: %lu sequences of %.3f ms (nmr fsm clock %.3f MHz), %.3f ms per sequence, %lu/%lu words of the last one read: %s\n",
+				meas_name[meas], sim_nmr_fsm.starts, seq_ms, pll_reconfig_emu_freq(&sim_nmr_pll, 0, INPUT_FREQ),
+				run_ms / sim_nmr_fsm.starts, (unsigned long) sim_adc_fifo.consumed,
+				(unsigned long) sim_adc_fifo.total_words, bad ? "FAILED" : "ok");
+		fails += bad;
+		if (meas == 0 && run_ms / number_of_iteration < seq_ms) {
+			printf("the scans are faster than their sequence\n");
+			fails++;
+		}
+	}
+	printf("CPMG echo train: %lu wrong words, parameter registers: %lu writes, %lu reads\n", wrong_words,
+			sim_nmr_param.writes + sim_nmr_samples.writes, sim_nmr_param.reads + sim_nmr_samples.reads);
+	fails += wrong_words != 0;
+	printf("simulated backend : %s\n", fails == 0 ? "PASSED" : "FAILED");
+
+	close_fpga_backend();
+	return fails != 0;
+}
@@ -0,0 +1,95 @@
+// Trace recorder against the simulated backend, runs without the FPGA
+// The cost of an event with the recorder on and off, two threads recording at once without losing an event, then a
+// streamed CPMG_iterate with the writer thread on the simulated backend traced through NMR_TRACE: every scan must
+// have its start, FSM_START, end of sequence, drain and file write, and the trace is written to argv[2] on exit
+// (open it in ui.perfetto.dev or chrome://tracing)
+
+#define HPS_LINUX_NO_MAIN
+#include "../hps_linux.c"
+
+static trace_ring test_trace;
+static void * trace_thread (void *arg) {
+	unsigned long k;
+	for (k = 0; k < (unsigned long) arg; k++) {
+		trace_event(&test_trace, TRACE_FIFO_LEVEL, k);
+	}
+	return NULL;
+}
+int main(int argc, char * argv[]) {
+
+	// input parameters
+	unsigned int number_of_iteration = argc > 1 ? atoi(argv[1]) : 20;
+	char *trace_name = argc > 2 ? argv[2] : "trace.json";
+
+	unsigned long events = 1000000, per_thread = 100000;
+	struct timespec t0, t1;
+	double on_ns, off_ns;
+	pthread_t thread[2];
+	unsigned long fails = 0;
+	unsigned long k, n;
+	uint16_t type;
+	FILE *f;
+
+	// the cost of an event
+	trace_ring_init(&test_trace, TRACE_RING_DEFAULT_EVENTS);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (k = 0; k < events; k++) {
+		trace_event(&test_trace, TRACE_FIFO_LEVEL, k);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	on_ns = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / events;
+	trace_ring_free(&test_trace);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (k = 0; k < events; k++) {
+		trace_event(&test_trace, TRACE_FIFO_LEVEL, k);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	off_ns = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / events;
+	printf("one event: %.1f ns recording, %.1f ns off\n", on_ns, off_ns);
+	fails += on_ns > 100;
+
+	// two producers
+	trace_ring_init(&test_trace, 4 * per_thread);
+	for (k = 0; k < 2; k++) {
+		pthread_create(&thread[k], NULL, trace_thread, (void *) per_thread);
+	}
+	for (k = 0; k < 2; k++) {
+		pthread_join(thread[k], NULL);
+	}
+	n = trace_ring_count(&test_trace, TRACE_FIFO_LEVEL);
+	printf("two threads: %lu of %lu events recorded\n", n, 2 * per_thread);
+	fails += n != 2 * per_thread || test_trace.head != 2 * per_thread;
+	trace_ring_free(&test_trace);
+
+	// the acquisition
+	setenv(SIM_BACKEND_ENV, "0", 1);
+	setenv(TRACE_ENV, trace_name, 1);
+	open_fpga_backend();
+	init_default_system_param();
+	adc_read_mode = READ_FIFO_STREAM;
+	scan_writer_en = 1;
+	CPMG_iterate(4.3, 5, 10, 0.5, 0.5, 200, 0, 20, 500, 0, number_of_iteration, DISABLE_MESSAGE);
+	for (type = TRACE_SCAN_START; type < TRACE_TYPES; type++) {
+		n = trace_ring_count(&adc_trace, type);
+		printf("\t%-12s %lu\n", type == TRACE_SCAN_START ? "scan start" : type == TRACE_FSM_START ? "FSM_START"
+				: type == TRACE_FSM_DONE ? "FSM done" : type == TRACE_FIFO_LEVEL ? "fifo level"
+				: type == TRACE_DRAIN_DONE ? "drain done" : type == TRACE_WRITE_BEGIN ? "write begin"
+				: type == TRACE_WRITE_END ? "write end" : type == TRACE_PLL_BEGIN ? "pll begin" : "pll end", n);
+		if (type == TRACE_FIFO_LEVEL) {
+			fails += n < number_of_iteration;
+		} else if (type == TRACE_PLL_BEGIN || type == TRACE_PLL_END) {
+			fails += n == 0 || n != trace_ring_count(&adc_trace, TRACE_PLL_BEGIN);
+		} else {
+			fails += n != number_of_iteration;
+		}
+	}
+	close_fpga_backend();
+
+	f = fopen(trace_name, "r");
+	fails += f == NULL || fgetc(f) != '{';
+	if (f != NULL) {
+		fclose(f);
+	}
+	printf("trace recorder : %s\n", fails == 0 ? "PASSED" : "FAILED");
+	return fails != 0;
+}